@@ -0,0 +1,172 @@
+#include <malloc.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "arena.h"
+
+/* Builds and frees the same allocations a DIE tree would make, once
+ * straight from the heap, like DIE trees used to be, and once from a
+ * per compilation unit arena. Prints how many times the heap was
+ * called, how many bytes it handed out, and how long it all took.
+ *
+ *   arena_bench [compilation units] [DIEs per compilation unit]
+ */
+
+/* Each DIE gets a node and a name. Some also get location
+ * descriptions or array dimensions.
+ */
+#define NODE_SZ 64
+#define LOCDESC_SZ 48
+#define ARRDIM_SZ 16
+
+static uint64_t rngstate = 0x9e3779b97f4a7c15ULL;
+
+static uint32_t rng(void){
+    rngstate = rngstate * 6364136223846793005ULL + 1442695040888963407ULL;
+    return (uint32_t)(rngstate >> 33);
+}
+
+static double now_ms(void){
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (ts.tv_sec * 1000.0) + (ts.tv_nsec / 1000000.0);
+}
+
+struct bench_totals {
+    size_t bt_nallocs;
+    size_t bt_bytesasked;
+    size_t bt_bytesheap;
+    size_t bt_nheapcalls;
+};
+
+/* Make one compilation unit's worth of allocations from ar, or from
+ * the heap if ar is NULL. Heap allocations are remembered in ptrs so
+ * they can be freed one by one later.
+ */
+static int build_cu(void *ar, int ndies, void **ptrs,
+        struct bench_totals *bt){
+    char name[32];
+    int nptrs = 0;
+
+    rngstate = 0x9e3779b97f4a7c15ULL;
+
+    for(int i=0; i<ndies; i++){
+        size_t sizes[8];
+        int nsizes = 0;
+
+        sizes[nsizes++] = NODE_SZ;
+
+        int namelen = 4 + (rng() % 20);
+
+        memset(name, 'a' + (i % 26), namelen);
+        name[namelen] = '\0';
+
+        uint32_t r = rng() % 8;
+
+        if(r < 2){
+            int nlocs = 1 + (rng() % 3);
+
+            for(int k=0; k<nlocs; k++)
+                sizes[nsizes++] = LOCDESC_SZ;
+        }
+        else if(r == 2){
+            sizes[nsizes++] = ARRDIM_SZ;
+        }
+
+        for(int k=0; k<nsizes; k++){
+            void *p = arena_calloc(ar, 1, sizes[k]);
+
+            if(!ar)
+                ptrs[nptrs++] = p;
+
+            bt->bt_nallocs++;
+            bt->bt_bytesasked += sizes[k];
+        }
+
+        char *s = arena_strdup(ar, name);
+
+        if(!ar)
+            ptrs[nptrs++] = s;
+
+        bt->bt_nallocs++;
+        bt->bt_bytesasked += namelen + 1;
+    }
+
+    return nptrs;
+}
+
+static double run_heap(int ncus, int ndies, struct bench_totals *bt){
+    /* At most one node, one name, and three location
+     * descriptions per DIE.
+     */
+    void **ptrs = malloc(sizeof(void *) * ndies * 5);
+    double start = now_ms();
+
+    for(int i=0; i<ncus; i++){
+        int nptrs = build_cu(NULL, ndies, ptrs, bt);
+
+        for(int k=0; k<nptrs; k++){
+            bt->bt_bytesheap += malloc_usable_size(ptrs[k]);
+            free(ptrs[k]);
+        }
+
+        bt->bt_nheapcalls += nptrs * 2;
+    }
+
+    double ms = now_ms() - start;
+
+    free(ptrs);
+
+    return ms;
+}
+
+static double run_arena(int ncus, int ndies, struct bench_totals *bt){
+    double start = now_ms();
+
+    for(int i=0; i<ncus; i++){
+        void *ar = arena_new();
+
+        build_cu(ar, ndies, NULL, bt);
+
+        size_t nchunks = 0;
+
+        arena_get_stats(ar, NULL, NULL, &bt->bt_bytesheap, &nchunks);
+        arena_free(ar);
+
+        /* The arena itself, then a malloc and a free per chunk */
+        bt->bt_nheapcalls += 2 + (nchunks * 2);
+    }
+
+    return now_ms() - start;
+}
+
+int main(int argc, char **argv){
+    int ncus = argc > 1 ? atoi(argv[1]) : 200;
+    int ndies = argc > 2 ? atoi(argv[2]) : 20000;
+
+    if(ncus <= 0 || ndies <= 0){
+        printf("usage: %s [compilation units] [DIEs per compilation"
+                " unit]\n", argv[0]);
+        return 1;
+    }
+
+    struct bench_totals heap = {0}, arena = {0};
+
+    double heapms = run_heap(ncus, ndies, &heap);
+    double arenams = run_arena(ncus, ndies, &arena);
+
+    printf("%d compilation units of %d DIEs: %zu allocations,"
+            " %zu bytes asked for\n", ncus, ndies, heap.bt_nallocs,
+            heap.bt_bytesasked);
+    printf("heap:  %10zu calls, %10zu bytes handed out, %8.1f ms\n",
+            heap.bt_nheapcalls, heap.bt_bytesheap, heapms);
+    printf("arena: %10zu calls, %10zu bytes handed out, %8.1f ms\n",
+            arena.bt_nheapcalls, arena.bt_bytesheap, arenams);
+
+    return 0;
+}
@@ -0,0 +1,63 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Something for iosdbg to attach to on the device, which calls one
+ * function over and over. Break on its 50,000th call with
+ *
+ *   (iosdbg) breakpoint set --ignore 49999 <address it prints>
+ *   (iosdbg) c
+ *
+ * and press enter here. When it stops, x0 should be 49999, the
+ * number of the call, counting from zero. Passed over hits never
+ * leave the exception server, so this should take seconds. Once it
+ * has stopped, 'stats' shows what each exception cost.
+ *
+ * With --cond instead, like --cond "$x0 == 49999", every false hit
+ * is also handled by the exception server.
+ *
+ *   hotloop [calls]
+ */
+
+static volatile unsigned long SINK;
+
+__attribute__((noinline)) unsigned long hot(unsigned long call){
+    SINK += call;
+
+    return SINK;
+}
+
+static double now_ms(void){
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (ts.tv_sec * 1000.0) + (ts.tv_nsec / 1000000.0);
+}
+
+int main(int argc, char **argv){
+    unsigned long ncalls = argc > 1 ? strtoul(argv[1], NULL, 0) : 100000;
+
+    if(ncalls == 0){
+        printf("usage: %s [calls]\n", argv[0]);
+        return 1;
+    }
+
+    printf("pid %d, hot is at %p\n", getpid(), (void *)hot);
+    printf("attach, set a breakpoint on hot, then press enter\n");
+
+    getchar();
+
+    double start = now_ms();
+
+    for(unsigned long i=0; i<ncalls; i++)
+        hot(i);
+
+    double ms = now_ms() - start;
+
+    printf("%lu calls in %.1f ms, %.2f us per call\n", ncalls, ms,
+            (ms * 1000.0) / ncalls);
+
+    return 0;
+}
@@ -0,0 +1,420 @@
+#include <fcntl.h>
+#include <malloc.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <dwarf.h>
+#include <libdwarf.h>
+
+#include "common.h"
+#include "dwarfobj.h"
+#include "lineprog.h"
+#include "linetab.h"
+
+/* Decodes the line program of every compilation unit in a dSYM, or in
+ * a linked ELF file built with -g, with lineprog.c, straight from the
+ * mapped .debug_line, and with libdwarf's dwarf_srclines_b, makes sure
+ * both got the same rows, and prints how many rows a second each
+ * decodes and how much memory each holds on to while the rows are
+ * around. Then prints how big the line tables built from lineprog's
+ * rows are.
+ *
+ *   lineprog_bench <dSYM DWARF file or ELF file> [passes]
+ */
+
+struct bench_cu {
+    Dwarf_Die bc_die;
+    uint64_t bc_stmtlist;
+    char *bc_compdir;
+};
+
+struct bench_cus {
+    struct bench_cu *bcs_cus;
+    int bcs_count;
+};
+
+static double now_ms(void){
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (ts.tv_sec * 1000.0) + (ts.tv_nsec / 1000000.0);
+}
+
+static size_t heap_in_use(void){
+    return mallinfo2().uordblks;
+}
+
+/* Where the compilation unit's line program is. Before DWARF 4,
+ * DW_AT_stmt_list is a constant.
+ */
+static int get_stmtlist(Dwarf_Debug dbg, Dwarf_Die cudie, uint64_t *out){
+    Dwarf_Attribute attr = NULL;
+    Dwarf_Error d_error = NULL;
+
+    if(dwarf_attr(cudie, DW_AT_stmt_list, &attr, &d_error) != DW_DLV_OK)
+        return 1;
+
+    Dwarf_Off off = 0;
+    int ret = dwarf_global_formref(attr, &off, &d_error);
+
+    if(ret == DW_DLV_ERROR){
+        dwarf_dealloc(dbg, d_error, DW_DLA_ERROR);
+        d_error = NULL;
+
+        Dwarf_Unsigned udata = 0;
+
+        ret = dwarf_formudata(attr, &udata, &d_error);
+        off = udata;
+    }
+
+    dwarf_dealloc(dbg, attr, DW_DLA_ATTR);
+
+    *out = off;
+
+    return ret != DW_DLV_OK;
+}
+
+static void get_cus(Dwarf_Debug dbg, struct bench_cus *bcs){
+    int is_info = 1;
+
+    for(;;){
+        Dwarf_Unsigned hdrlen = 0, abbrevoff = 0, typeoff = 0, next = 0;
+        Dwarf_Half ver = 0, addrsz = 0, lensz = 0, extsz = 0, hdrtype = 0;
+        Dwarf_Sig8 sig;
+        Dwarf_Error d_error = NULL;
+
+        int ret = dwarf_next_cu_header_d(dbg, is_info, &hdrlen, &ver,
+                &abbrevoff, &addrsz, &lensz, &extsz, &sig, &typeoff, &next,
+                &hdrtype, &d_error);
+
+        if(ret != DW_DLV_OK)
+            return;
+
+        Dwarf_Die cudie = NULL;
+
+        if(dwarf_siblingof_b(dbg, NULL, is_info, &cudie, &d_error) !=
+                DW_DLV_OK){
+            continue;
+        }
+
+        struct bench_cu bc = { cudie, 0, NULL };
+
+        if(get_stmtlist(dbg, cudie, &bc.bc_stmtlist)){
+            dwarf_dealloc(dbg, cudie, DW_DLA_DIE);
+            continue;
+        }
+
+        char *compdir = NULL;
+
+        if(dwarf_die_text(cudie, DW_AT_comp_dir, &compdir, &d_error) ==
+                DW_DLV_OK){
+            bc.bc_compdir = strdup(compdir);
+        }
+
+        struct bench_cu *cus_rea = realloc(bcs->bcs_cus,
+                sizeof(struct bench_cu) * (bcs->bcs_count + 1));
+
+        bcs->bcs_cus = cus_rea;
+        bcs->bcs_cus[bcs->bcs_count++] = bc;
+    }
+}
+
+/* Decode every line program, and if keep is non-zero, don't free
+ * anything until every one is decoded, so what's left on the heap
+ * is everything the rows take up.
+ */
+static long run_lineprog(void *dobj, struct bench_cus *bcs, int keep,
+        size_t *bytesout){
+    struct linetab_row **rows = calloc(bcs->bcs_count,
+            sizeof(struct linetab_row *));
+    char ***files = calloc(bcs->bcs_count, sizeof(char **));
+    int *filecnts = calloc(bcs->bcs_count, sizeof(int));
+
+    size_t before = heap_in_use();
+    long total = 0;
+
+    for(int i=0; i<bcs->bcs_count; i++){
+        int rowcnt = 0;
+
+        if(lineprog_decode(dobj, bcs->bcs_cus[i].bc_stmtlist,
+                    bcs->bcs_cus[i].bc_compdir, &rows[i], &rowcnt, &files[i],
+                    &filecnts[i])){
+            continue;
+        }
+
+        total += rowcnt;
+
+        if(!keep){
+            for(int k=0; k<filecnts[i]; k++)
+                free(files[i][k]);
+
+            free(files[i]);
+            free(rows[i]);
+            rows[i] = NULL;
+            files[i] = NULL;
+        }
+    }
+
+    if(bytesout)
+        *bytesout = heap_in_use() - before;
+
+    for(int i=0; i<bcs->bcs_count; i++){
+        for(int k=0; files[i] && k<filecnts[i]; k++)
+            free(files[i][k]);
+
+        free(files[i]);
+        free(rows[i]);
+    }
+
+    free(rows);
+    free(files);
+    free(filecnts);
+
+    return total;
+}
+
+static long run_libdwarf(Dwarf_Debug dbg, struct bench_cus *bcs, int keep,
+        size_t *bytesout){
+    Dwarf_Line_Context *ctxs = calloc(bcs->bcs_count,
+            sizeof(Dwarf_Line_Context));
+
+    size_t before = heap_in_use();
+    long total = 0;
+
+    for(int i=0; i<bcs->bcs_count; i++){
+        Dwarf_Unsigned version = 0;
+        Dwarf_Small tablecnt = 0;
+        Dwarf_Line *lines = NULL;
+        Dwarf_Signed linecnt = 0;
+        Dwarf_Error d_error = NULL;
+
+        if(dwarf_srclines_b(bcs->bcs_cus[i].bc_die, &version, &tablecnt,
+                    &ctxs[i], &d_error) != DW_DLV_OK){
+            ctxs[i] = NULL;
+            continue;
+        }
+
+        if(dwarf_srclines_from_linecontext(ctxs[i], &lines, &linecnt,
+                    &d_error) == DW_DLV_OK){
+            total += linecnt;
+        }
+
+        if(!keep){
+            dwarf_srclines_dealloc_b(ctxs[i]);
+            ctxs[i] = NULL;
+        }
+    }
+
+    if(bytesout)
+        *bytesout = heap_in_use() - before;
+
+    for(int i=0; i<bcs->bcs_count; i++){
+        if(ctxs[i])
+            dwarf_srclines_dealloc_b(ctxs[i]);
+    }
+
+    free(ctxs);
+
+    return total;
+}
+
+/* Both have to give the same addresses and lines, in the same order */
+static int compare_rows(void *dobj, struct bench_cus *bcs){
+    for(int i=0; i<bcs->bcs_count; i++){
+        struct bench_cu *bc = &bcs->bcs_cus[i];
+        struct linetab_row *rows = NULL;
+        int rowcnt = 0;
+        char **files = NULL;
+        int filecnt = 0;
+
+        if(lineprog_decode(dobj, bc->bc_stmtlist, bc->bc_compdir, &rows,
+                    &rowcnt, &files, &filecnt)){
+            printf("line program at %#llx: lineprog couldn't decode it\n",
+                    (unsigned long long)bc->bc_stmtlist);
+            continue;
+        }
+
+        Dwarf_Unsigned version = 0;
+        Dwarf_Small tablecnt = 0;
+        Dwarf_Line_Context ctx = NULL;
+        Dwarf_Line *lines = NULL;
+        Dwarf_Signed linecnt = 0;
+        Dwarf_Error d_error = NULL;
+        int ret = 0;
+
+        if(dwarf_srclines_b(bc->bc_die, &version, &tablecnt, &ctx,
+                    &d_error) != DW_DLV_OK ||
+                dwarf_srclines_from_linecontext(ctx, &lines, &linecnt,
+                    &d_error) != DW_DLV_OK){
+            printf("line program at %#llx: libdwarf couldn't decode it\n",
+                    (unsigned long long)bc->bc_stmtlist);
+            ret = 1;
+        }
+
+        if(!ret && linecnt != rowcnt){
+            printf("line program at %#llx: %d rows vs %lld rows\n",
+                    (unsigned long long)bc->bc_stmtlist, rowcnt,
+                    (long long)linecnt);
+            ret = 1;
+        }
+
+        for(int k=0; !ret && k<rowcnt; k++){
+            Dwarf_Addr addr = 0;
+            Dwarf_Unsigned lineno = 0;
+
+            dwarf_lineaddr(lines[k], &addr, &d_error);
+            dwarf_lineno(lines[k], &lineno, &d_error);
+
+            if(addr != rows[k].lr_addr || lineno != rows[k].lr_line){
+                printf("line program at %#llx, row %d: %#llx line %u vs"
+                        " %#llx line %llu\n",
+                        (unsigned long long)bc->bc_stmtlist, k,
+                        (unsigned long long)rows[k].lr_addr,
+                        rows[k].lr_line, (unsigned long long)addr,
+                        (unsigned long long)lineno);
+                ret = 1;
+            }
+        }
+
+        if(ctx)
+            dwarf_srclines_dealloc_b(ctx);
+
+        for(int k=0; k<filecnt; k++)
+            free(files[k]);
+
+        free(files);
+        free(rows);
+
+        if(ret)
+            return 1;
+    }
+
+    return 0;
+}
+
+/* How big the line tables die.c keeps are, built from lineprog's rows */
+static size_t linetab_bytes(void *dobj, struct bench_cus *bcs){
+    size_t total = 0;
+
+    for(int i=0; i<bcs->bcs_count; i++){
+        struct linetab_row *rows = NULL;
+        int rowcnt = 0;
+        char **files = NULL;
+        int filecnt = 0;
+
+        if(lineprog_decode(dobj, bcs->bcs_cus[i].bc_stmtlist,
+                    bcs->bcs_cus[i].bc_compdir, &rows, &rowcnt, &files,
+                    &filecnt)){
+            continue;
+        }
+
+        void *lt = linetab_new_from_rows(rows, rowcnt, files, filecnt, "");
+
+        total += linetab_size(lt);
+        linetab_free(lt);
+
+        for(int k=0; k<filecnt; k++)
+            free(files[k]);
+
+        free(files);
+        free(rows);
+    }
+
+    return total;
+}
+
+static void report(const char *what, long rows, double ms, size_t bytes){
+    printf("%-10s %10.1f ms, %12.0f rows/sec, %10zu bytes held, %.1f bytes"
+            " per row\n", what, ms, ms > 0 ? rows / (ms / 1000.0) : 0,
+            bytes, rows > 0 ? (double)bytes / rows : 0);
+}
+
+int main(int argc, char **argv){
+    if(argc < 2){
+        printf("usage: %s <dSYM DWARF file or ELF file> [passes]\n",
+                argv[0]);
+        return 1;
+    }
+
+    int passes = argc > 2 ? atoi(argv[2]) : 10;
+
+    if(passes <= 0)
+        passes = 1;
+
+    int fd = open(argv[1], O_RDONLY);
+
+    if(fd == -1){
+        printf("couldn't open %s\n", argv[1]);
+        return 1;
+    }
+
+    void *dobj = dwarfobj_new(fd);
+
+    close(fd);
+
+    Dwarf_Debug dbg = NULL;
+
+    if(!dobj || dwarfobj_init_dbg(dobj, &dbg)){
+        printf("%s: not a Mach-O or ELF file with DWARF we can read\n",
+                argv[1]);
+        dwarfobj_free(dobj);
+        return 1;
+    }
+
+    struct bench_cus bcs = {0};
+
+    get_cus(dbg, &bcs);
+
+    int ret = compare_rows(dobj, &bcs);
+
+    if(!ret){
+        size_t nativebytes = 0, dwarfbytes = 0;
+
+        /* Warm up and measure memory once, then time the rest */
+        long rows = run_lineprog(dobj, &bcs, 1, &nativebytes);
+        run_libdwarf(dbg, &bcs, 1, &dwarfbytes);
+
+        double start = now_ms();
+
+        for(int i=0; i<passes; i++)
+            run_lineprog(dobj, &bcs, 0, NULL);
+
+        double nativems = (now_ms() - start) / passes;
+
+        start = now_ms();
+
+        for(int i=0; i<passes; i++)
+            run_libdwarf(dbg, &bcs, 0, NULL);
+
+        double dwarfms = (now_ms() - start) / passes;
+
+        printf("%d compilation units, %ld rows, same rows from both\n",
+                bcs.bcs_count, rows);
+        report("lineprog:", rows, nativems, nativebytes);
+        report("libdwarf:", rows, dwarfms, dwarfbytes);
+
+        size_t ltbytes = linetab_bytes(dobj, &bcs);
+
+        printf("line tables: %zu bytes, %.1f bytes per row\n", ltbytes,
+                rows > 0 ? (double)ltbytes / rows : 0);
+    }
+
+    for(int i=0; i<bcs.bcs_count; i++){
+        dwarf_dealloc(dbg, bcs.bcs_cus[i].bc_die, DW_DLA_DIE);
+        free(bcs.bcs_cus[i].bc_compdir);
+    }
+
+    free(bcs.bcs_cus);
+
+    Dwarf_Error d_error = NULL;
+
+    dwarf_object_finish(dbg, &d_error);
+    dwarfobj_free(dobj);
+
+    return ret;
+}
@@ -0,0 +1,434 @@
+#include <dirent.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "common.h"
+#include "compunit.h"
+#include "die.h"
+#include "sym.h"
+#include "symerr.h"
+
+/* Loads a file built with -g once with the sequential loader and once
+ * with N loader threads, makes sure both produced the same compilation
+ * units, DIE trees, and names, and prints how long each load took.
+ * Then prints how much memory the DIE trees take up per DIE, how
+ * long it takes to visit every DIE, how long a load takes with and
+ * without the symbol cache, and how long symbolicating an address
+ * takes when the symbol cache answers it.
+ *
+ *   loader_bench <file> [threads]
+ *
+ * With no thread count, one thread per CPU is used.
+ */
+
+static double now_ms(void){
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (ts.tv_sec * 1000.0) + (ts.tv_nsec / 1000000.0);
+}
+
+/* Print the whole DIE tree under root_die to a temporary file, which
+ * is rewound and returned. die_display_die_tree_starting_from only
+ * prints to stdout, so stdout is pointed at the file for a bit.
+ */
+static FILE *dump_die_tree(void *root_die){
+    FILE *fp = tmpfile();
+
+    if(!fp)
+        return NULL;
+
+    fflush(stdout);
+
+    int savedout = dup(STDOUT_FILENO);
+
+    dup2(fileno(fp), STDOUT_FILENO);
+    die_display_die_tree_starting_from(root_die);
+    fflush(stdout);
+    dup2(savedout, STDOUT_FILENO);
+    close(savedout);
+
+    rewind(fp);
+
+    return fp;
+}
+
+static int same_contents(FILE *a, FILE *b){
+    char bufa[4096], bufb[4096];
+
+    for(;;){
+        size_t na = fread(bufa, 1, sizeof(bufa), a);
+        size_t nb = fread(bufb, 1, sizeof(bufb), b);
+
+        if(na != nb || memcmp(bufa, bufb, na))
+            return 0;
+
+        if(na == 0)
+            return 1;
+    }
+}
+
+static int compare_die_trees(dwarfinfo_t *a, dwarfinfo_t *b){
+    for(int i=0; i<a->di_numcompunits; i++){
+        void *roota = NULL, *rootb = NULL;
+        sym_error_t e = {0};
+
+        if(cu_get_root_die(a->di_cus[i], &roota, &e) ||
+                cu_get_root_die(b->di_cus[i], &rootb, &e)){
+            printf("compilation unit %d: no root DIE: %s\n", i,
+                    sym_strerror(e));
+            return 1;
+        }
+
+        uint64_t offa = 0, offb = 0;
+
+        die_get_offset(roota, &offa, NULL);
+        die_get_offset(rootb, &offb, NULL);
+
+        if(offa != offb){
+            printf("compilation unit %d: root DIE at %#llx vs %#llx\n", i,
+                    (unsigned long long)offa, (unsigned long long)offb);
+            return 1;
+        }
+
+        FILE *dumpa = dump_die_tree(roota);
+        FILE *dumpb = dump_die_tree(rootb);
+        int same = dumpa && dumpb && same_contents(dumpa, dumpb);
+
+        if(dumpa)
+            fclose(dumpa);
+        if(dumpb)
+            fclose(dumpb);
+
+        if(!same){
+            printf("compilation unit %d (root DIE at %#llx): DIE trees"
+                    " differ\n", i, (unsigned long long)offa);
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+static int compare_names(dwarfinfo_t *a, dwarfinfo_t *b, int *numnamesout){
+    char **namesa = NULL, **namesb = NULL;
+    int numnamesa = 0, numnamesb = 0;
+    int ret = 0;
+
+    sym_find_names_with_prefix(a, "", &namesa, &numnamesa, NULL);
+    sym_find_names_with_prefix(b, "", &namesb, &numnamesb, NULL);
+
+    if(numnamesa != numnamesb){
+        printf("%d names vs %d names\n", numnamesa, numnamesb);
+        ret = 1;
+    }
+
+    for(int i=0; !ret && i<numnamesa; i++){
+        if(strcmp(namesa[i], namesb[i])){
+            printf("name %d: '%s' vs '%s'\n", i, namesa[i], namesb[i]);
+            ret = 1;
+        }
+    }
+
+    free(namesa);
+    free(namesb);
+
+    *numnamesout = numnamesa;
+
+    return ret;
+}
+
+/* Symbolicate the start of every function with both, the warm load
+ * answering from the symbol cache, and make sure they agree and that
+ * the warm load didn't have to build any DIE trees to do it.
+ */
+static int compare_functions(dwarfinfo_t *cold, dwarfinfo_t *warm,
+        int *numfxnsout, double *msout){
+    int ret = 0, numfxns = 0;
+    double ms = 0;
+
+    for(int i=0; !ret && i<cold->di_numcompunits; i++){
+        void *root_die = NULL;
+
+        if(cu_get_root_die(cold->di_cus[i], &root_die, NULL))
+            continue;
+
+        struct fxnrange *frs = NULL;
+        int nfrs = 0;
+
+        if(die_get_function_ranges(root_die, &frs, &nfrs, NULL))
+            continue;
+
+        for(int k=0; !ret && k<nfrs; k++){
+            char *filea = NULL, *fxna = NULL, *fileb = NULL, *fxnb = NULL;
+            uint64_t linea = 0, lineb = 0;
+            void *cudie = NULL;
+
+            sym_get_line_info_from_pc(cold, frs[k].fr_lowpc, &filea, &fxna,
+                    &linea, &cudie, NULL);
+
+            double start = now_ms();
+
+            sym_get_line_info_from_pc(warm, frs[k].fr_lowpc, &fileb, &fxnb,
+                    &lineb, NULL, NULL);
+
+            ms += now_ms() - start;
+
+            if(fxna && (!fxnb || strcmp(fxna, fxnb) ||
+                        strcmp(filea, fileb) || linea != lineb)){
+                printf("%#llx: %s at %s:%llu vs %s at %s:%llu\n",
+                        (unsigned long long)frs[k].fr_lowpc, fxna, filea,
+                        (unsigned long long)linea, fxnb ? fxnb : "nothing",
+                        fileb ? fileb : "", (unsigned long long)lineb);
+                ret = 1;
+            }
+
+            numfxns += fxna != NULL;
+
+            free(filea);
+            free(fxna);
+            free(fileb);
+            free(fxnb);
+        }
+
+        free(frs);
+    }
+
+    size_t nallocs = 0, bytesinuse = 0, bytesreserved = 0, nchunks = 0;
+
+    cu_get_allocation_stats(warm, &nallocs, &bytesinuse, &bytesreserved,
+            &nchunks, NULL);
+
+    if(!ret && bytesinuse > 0){
+        printf("symbolicating from the symbol cache built DIE trees\n");
+        ret = 1;
+    }
+
+    *numfxnsout = numfxns;
+    *msout = ms;
+
+    return ret;
+}
+
+/* Walk every DIE tree WALK_PASSES times. Nothing has this
+ * offset, so die_search visits every DIE.
+ */
+#define WALK_PASSES 10
+
+static void report_die_trees(dwarfinfo_t *dwarfinfo){
+    size_t numdies = 0, treebytes = 0;
+
+    for(int i=0; i<dwarfinfo->di_numcompunits; i++){
+        void *root_die = NULL;
+
+        if(cu_get_root_die(dwarfinfo->di_cus[i], &root_die, NULL))
+            continue;
+
+        numdies += die_tree_count(root_die);
+        treebytes += die_tree_size(root_die);
+    }
+
+    if(numdies == 0)
+        return;
+
+    double start = now_ms();
+
+    for(int pass=0; pass<WALK_PASSES; pass++){
+        for(int i=0; i<dwarfinfo->di_numcompunits; i++){
+            void *root_die = NULL, *found = NULL;
+
+            if(cu_get_root_die(dwarfinfo->di_cus[i], &root_die, NULL))
+                continue;
+
+            die_search(root_die, (void *)UINT64_MAX,
+                    DIE_SEARCH_IF_DIE_OFFSET_MATCHES, &found, NULL);
+        }
+    }
+
+    double walkms = (now_ms() - start) / WALK_PASSES;
+
+    printf("%zu DIEs, %zu bytes of DIE trees, %.1f bytes per DIE\n",
+            numdies, treebytes, (double)treebytes / numdies);
+    printf("visiting every DIE: %.2f ms, %.1f ns per DIE\n", walkms,
+            (walkms * 1000000.0) / numdies);
+}
+
+static void remove_scratch_home(const char *home){
+    char dir[1024], path[1024 + 256];
+
+    snprintf(dir, sizeof(dir), "%s/.iosdbg/symcache", home);
+
+    DIR *d = opendir(dir);
+
+    if(d){
+        struct dirent *ent;
+
+        while((ent = readdir(d))){
+            if(strcmp(ent->d_name, ".") && strcmp(ent->d_name, "..")){
+                snprintf(path, sizeof(path), "%s/%s", dir, ent->d_name);
+                unlink(path);
+            }
+        }
+
+        closedir(d);
+    }
+
+    rmdir(dir);
+
+    snprintf(dir, sizeof(dir), "%s/.iosdbg", home);
+    rmdir(dir);
+    rmdir(home);
+}
+
+/* Load the file twice with $HOME pointed at a scratch directory. The
+ * first load parses the file and writes the symbol cache, and the
+ * second maps it. Only Mach-O files with a UUID are cached.
+ */
+static int report_symcache(const char *file){
+    char home[] = "/tmp/loader_bench.XXXXXX";
+
+    if(!mkdtemp(home))
+        return 0;
+
+    setenv("HOME", home, 1);
+
+    dwarfinfo_t *cold = NULL, *warm = NULL;
+    sym_error_t e = {0};
+    int ret = 0;
+
+    double start = now_ms();
+
+    if(sym_init_with_dwarf_file(file, (void **)&cold, &e)){
+        printf("%s: %s\n", file, sym_strerror(e));
+        ret = 1;
+        goto out;
+    }
+
+    double coldms = now_ms() - start;
+
+    start = now_ms();
+
+    if(sym_init_with_dwarf_file(file, (void **)&warm, &e)){
+        printf("%s: %s\n", file, sym_strerror(e));
+        ret = 1;
+        goto out;
+    }
+
+    double warmms = now_ms() - start;
+
+    if(!warm->di_symcache){
+        printf("no symbol cache for this file\n");
+        goto out;
+    }
+
+    printf("cold load:  %10.1f ms\n", coldms);
+    printf("warm load:  %10.1f ms (%.2fx)\n", warmms,
+            warmms > 0 ? coldms / warmms : 0);
+
+    int numnames = 0;
+
+    ret = compare_names(cold, warm, &numnames);
+
+    if(!ret)
+        printf("same %d names from the symbol cache\n", numnames);
+
+    int numfxns = 0;
+    double fxnms = 0;
+
+    if(!ret)
+        ret = compare_functions(cold, warm, &numfxns, &fxnms);
+
+    if(!ret){
+        printf("same %d functions from the symbol cache, %.2f us each\n",
+                numfxns, numfxns > 0 ? (fxnms * 1000.0) / numfxns : 0);
+    }
+
+out:
+    sym_end((void **)&cold);
+    sym_end((void **)&warm);
+
+    unsetenv("HOME");
+    remove_scratch_home(home);
+
+    return ret;
+}
+
+int main(int argc, char **argv){
+    if(argc < 2){
+        printf("usage: %s <file built with -g> [threads]\n", argv[0]);
+        return 1;
+    }
+
+    const char *file = argv[1];
+    int nworkers = argc > 2 ? atoi(argv[2]) : 0;
+
+    if(nworkers <= 0){
+        long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+        nworkers = ncpu > 0 ? (int)ncpu : 1;
+    }
+
+    /* The symbol cache goes under $HOME. Without it, both loads
+     * have to parse the file.
+     */
+    unsetenv("HOME");
+
+    dwarfinfo_t *seq = NULL, *par = NULL;
+    sym_error_t e = {0};
+
+    double start = now_ms();
+
+    if(sym_init_with_dwarf_file(file, (void **)&seq, &e)){
+        printf("%s: %s\n", file, sym_strerror(e));
+        return 1;
+    }
+
+    double seqms = now_ms() - start;
+
+    start = now_ms();
+
+    if(sym_init_with_dwarf_file_parallel(file, nworkers, (void **)&par,
+                &e)){
+        printf("%s: %s\n", file, sym_strerror(e));
+        sym_end((void **)&seq);
+        return 1;
+    }
+
+    double parms = now_ms() - start;
+
+    printf("1 thread:   %10.1f ms\n", seqms);
+    printf("%d threads: %10.1f ms (%.2fx)\n", nworkers, parms,
+            parms > 0 ? seqms / parms : 0);
+
+    int ret = 0, numnames = 0;
+
+    if(seq->di_numcompunits != par->di_numcompunits){
+        printf("%d compilation units vs %d compilation units\n",
+                seq->di_numcompunits, par->di_numcompunits);
+        ret = 1;
+    }
+
+    if(!ret)
+        ret = compare_die_trees(seq, par);
+
+    if(!ret)
+        ret = compare_names(seq, par, &numnames);
+
+    if(!ret){
+        printf("same %d compilation units, DIE trees, and %d names\n",
+                seq->di_numcompunits, numnames);
+        report_die_trees(seq);
+    }
+
+    sym_end((void **)&seq);
+    sym_end((void **)&par);
+
+    if(!ret)
+        ret = report_symcache(file);
+
+    return ret;
+}
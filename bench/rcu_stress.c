@@ -0,0 +1,189 @@
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "rcu.h"
+
+/* Readers keep looking at whatever object is published while one
+ * writer keeps publishing new ones and retiring the old ones. Every
+ * object is filled with its own number, and is poisoned before it's
+ * freed, so a reader which sees an object after it was freed sees
+ * numbers which don't match. Build with -fsanitize=address to catch
+ * it for sure.
+ *
+ *   rcu_stress [readers] [objects]
+ */
+
+#define OBJ_NUMVALS 64
+#define OBJ_POISON 0xdeadbeef
+
+struct stress_obj {
+    uint32_t so_num;
+    uint32_t so_vals[OBJ_NUMVALS];
+};
+
+static struct stress_obj *CUR_OBJ;
+static int STOP;
+
+/* Objects allocated but not freed yet, and the most there ever were */
+static long NUM_LIVE;
+static long MAX_LIVE;
+
+struct reader_stats {
+    long rs_reads;
+    long rs_nested;
+    long rs_bad;
+};
+
+static double now_ms(void){
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (ts.tv_sec * 1000.0) + (ts.tv_nsec / 1000000.0);
+}
+
+static struct stress_obj *obj_new(uint32_t num){
+    struct stress_obj *so = malloc(sizeof(struct stress_obj));
+
+    so->so_num = num;
+
+    for(int i=0; i<OBJ_NUMVALS; i++)
+        so->so_vals[i] = num;
+
+    long live = __atomic_add_fetch(&NUM_LIVE, 1, __ATOMIC_RELAXED);
+
+    if(live > MAX_LIVE)
+        MAX_LIVE = live;
+
+    return so;
+}
+
+static void obj_free(void *arg){
+    struct stress_obj *so = arg;
+
+    so->so_num = OBJ_POISON;
+
+    for(int i=0; i<OBJ_NUMVALS; i++)
+        so->so_vals[i] = OBJ_POISON;
+
+    __atomic_sub_fetch(&NUM_LIVE, 1, __ATOMIC_RELAXED);
+
+    free(so);
+}
+
+static int obj_ok(struct stress_obj *so){
+    if(so->so_num == OBJ_POISON)
+        return 0;
+
+    for(int i=0; i<OBJ_NUMVALS; i++){
+        if(so->so_vals[i] != so->so_num)
+            return 0;
+    }
+
+    return 1;
+}
+
+static void *reader(void *arg){
+    struct reader_stats *rs = arg;
+
+    while(!__atomic_load_n(&STOP, __ATOMIC_ACQUIRE)){
+        rcu_read_lock();
+
+        struct stress_obj *so = __atomic_load_n(&CUR_OBJ, __ATOMIC_ACQUIRE);
+
+        if(!obj_ok(so))
+            rs->rs_bad++;
+
+        /* Every so often, look again from a nested read section.
+         * What was seen in the outer one has to stay good.
+         */
+        if((rs->rs_reads & 7) == 0){
+            rcu_read_lock();
+
+            struct stress_obj *inner = __atomic_load_n(&CUR_OBJ,
+                    __ATOMIC_ACQUIRE);
+
+            if(!obj_ok(inner))
+                rs->rs_bad++;
+
+            rcu_read_unlock();
+
+            if(!obj_ok(so))
+                rs->rs_bad++;
+
+            rs->rs_nested++;
+        }
+
+        rcu_read_unlock();
+
+        rs->rs_reads++;
+    }
+
+    return NULL;
+}
+
+int main(int argc, char **argv){
+    int nreaders = argc > 1 ? atoi(argv[1]) : 8;
+    long nobjs = argc > 2 ? atol(argv[2]) : 200000;
+
+    if(nreaders <= 0 || nobjs <= 0){
+        printf("usage: %s [readers] [objects]\n", argv[0]);
+        return 1;
+    }
+
+    pthread_t *threads = malloc(sizeof(pthread_t) * nreaders);
+    struct reader_stats *stats = calloc(nreaders,
+            sizeof(struct reader_stats));
+
+    CUR_OBJ = obj_new(0);
+
+    for(int i=0; i<nreaders; i++)
+        pthread_create(&threads[i], NULL, reader, &stats[i]);
+
+    double start = now_ms();
+
+    for(long i=1; i<=nobjs; i++){
+        struct stress_obj *so = obj_new((uint32_t)i);
+        struct stress_obj *old = __atomic_exchange_n(&CUR_OBJ, so,
+                __ATOMIC_ACQ_REL);
+
+        rcu_retire(old, obj_free);
+    }
+
+    double writems = now_ms() - start;
+
+    __atomic_store_n(&STOP, 1, __ATOMIC_RELEASE);
+
+    for(int i=0; i<nreaders; i++)
+        pthread_join(threads[i], NULL);
+
+    /* Every reader is gone, so everything retired can go */
+    rcu_reclaim();
+
+    long reads = 0, nested = 0, bad = 0;
+
+    for(int i=0; i<nreaders; i++){
+        reads += stats[i].rs_reads;
+        nested += stats[i].rs_nested;
+        bad += stats[i].rs_bad;
+    }
+
+    long leftover = __atomic_load_n(&NUM_LIVE, __ATOMIC_RELAXED) - 1;
+
+    printf("%d readers, %ld objects retired in %.1f ms (%.0f per sec)\n",
+            nreaders, nobjs, writems,
+            writems > 0 ? nobjs / (writems / 1000.0) : 0);
+    printf("%ld reads, %ld of them nested, %ld bad\n", reads, nested, bad);
+    printf("at most %ld objects waiting to be freed, %ld never freed\n",
+            MAX_LIVE - 1, leftover);
+
+    obj_free(CUR_OBJ);
+
+    free(threads);
+    free(stats);
+
+    return bad || leftover ? 1 : 0;
+}
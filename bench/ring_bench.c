@@ -0,0 +1,224 @@
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "queue.h"
+#include "ring.h"
+
+/* Hands messages from one thread to another the way exceptions used
+ * to go from the event loop to whoever replies, and the way they go
+ * now, and prints how many messages a second each gets through.
+ *
+ * Before: every message is malloc'd, goes through a queue behind a
+ * mutex, and is freed once it's taken off. No more than a pool's worth
+ * are let in at once, or dequeue's memmove makes the queue look much
+ * worse than it was with a few exceptions at a time.
+ *
+ * Now: messages come from a fixed pool. The producer takes a free slot
+ * off one ring and pushes it onto another, and the consumer gives it
+ * back through the first one.
+ *
+ *   ring_bench [messages]
+ */
+
+/* Same as the event loop's pool */
+#define POOL_SIZE 256
+
+/* About the size of a received exception message */
+#define MSG_SZ 512
+
+struct bench_msg {
+    uint64_t bm_seq;
+    char bm_body[MSG_SZ - sizeof(uint64_t)];
+};
+
+struct bench_state {
+    long bs_nmsgs;
+    long bs_outoforder;
+    long bs_waits;
+
+    /* Before */
+    struct queue_t *bs_queue;
+    pthread_mutex_t bs_lock;
+    long bs_inflight;
+
+    /* Now */
+    struct ring *bs_ready;
+    struct ring *bs_free;
+};
+
+static double now_ms(void){
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (ts.tv_sec * 1000.0) + (ts.tv_nsec / 1000000.0);
+}
+
+static void *queue_consumer(void *arg){
+    struct bench_state *bs = arg;
+
+    for(long i=0; i<bs->bs_nmsgs; i++){
+        struct bench_msg *bm;
+
+        for(;;){
+            pthread_mutex_lock(&bs->bs_lock);
+            bm = dequeue(bs->bs_queue);
+            pthread_mutex_unlock(&bs->bs_lock);
+
+            if(bm)
+                break;
+
+            sched_yield();
+        }
+
+        if(bm->bm_seq != (uint64_t)i)
+            bs->bs_outoforder++;
+
+        free(bm);
+
+        __atomic_sub_fetch(&bs->bs_inflight, 1, __ATOMIC_RELEASE);
+    }
+
+    return NULL;
+}
+
+static double run_queue(struct bench_state *bs){
+    bs->bs_queue = queue_new();
+    pthread_mutex_init(&bs->bs_lock, NULL);
+
+    pthread_t consumer;
+    double start = now_ms();
+
+    pthread_create(&consumer, NULL, queue_consumer, bs);
+
+    for(long i=0; i<bs->bs_nmsgs; i++){
+        while(__atomic_load_n(&bs->bs_inflight, __ATOMIC_ACQUIRE) >=
+                POOL_SIZE){
+            bs->bs_waits++;
+            sched_yield();
+        }
+
+        __atomic_add_fetch(&bs->bs_inflight, 1, __ATOMIC_RELAXED);
+
+        struct bench_msg *bm = malloc(sizeof(struct bench_msg));
+
+        bm->bm_seq = i;
+
+        pthread_mutex_lock(&bs->bs_lock);
+        enqueue(bs->bs_queue, bm);
+        pthread_mutex_unlock(&bs->bs_lock);
+    }
+
+    pthread_join(consumer, NULL);
+
+    double ms = now_ms() - start;
+
+    /* queue_free writes to the queue after freeing it, and
+     * this exits soon anyway.
+     */
+    pthread_mutex_destroy(&bs->bs_lock);
+
+    return ms;
+}
+
+static void *ring_consumer(void *arg){
+    struct bench_state *bs = arg;
+
+    for(long i=0; i<bs->bs_nmsgs; i++){
+        struct bench_msg *bm;
+
+        while(!(bm = ring_pop(bs->bs_ready)))
+            sched_yield();
+
+        if(bm->bm_seq != (uint64_t)i)
+            bs->bs_outoforder++;
+
+        /* The pool is as big as the free ring, so this can't fail */
+        ring_push(bs->bs_free, bm);
+    }
+
+    return NULL;
+}
+
+static double run_ring(struct bench_state *bs){
+    struct bench_msg *pool = calloc(POOL_SIZE, sizeof(struct bench_msg));
+
+    bs->bs_ready = ring_new(POOL_SIZE);
+    bs->bs_free = ring_new(POOL_SIZE);
+
+    for(int i=0; i<POOL_SIZE; i++)
+        ring_push(bs->bs_free, &pool[i]);
+
+    pthread_t consumer;
+    double start = now_ms();
+
+    pthread_create(&consumer, NULL, ring_consumer, bs);
+
+    for(long i=0; i<bs->bs_nmsgs; i++){
+        struct bench_msg *bm;
+
+        /* Every slot is waiting to be consumed */
+        while(!(bm = ring_pop(bs->bs_free))){
+            bs->bs_waits++;
+            sched_yield();
+        }
+
+        bm->bm_seq = i;
+
+        ring_push(bs->bs_ready, bm);
+    }
+
+    pthread_join(consumer, NULL);
+
+    double ms = now_ms() - start;
+
+    ring_free(bs->bs_ready);
+    ring_free(bs->bs_free);
+    free(pool);
+
+    return ms;
+}
+
+static void report(const char *what, struct bench_state *bs, double ms){
+    printf("%-6s %10.1f ms, %12.0f msgs/sec", what, ms,
+            ms > 0 ? bs->bs_nmsgs / (ms / 1000.0) : 0);
+
+    if(bs->bs_waits)
+        printf(", producer waited %ld times", bs->bs_waits);
+
+    printf("\n");
+}
+
+int main(int argc, char **argv){
+    long nmsgs = argc > 1 ? atol(argv[1]) : 2000000;
+
+    if(nmsgs <= 0){
+        printf("usage: %s [messages]\n", argv[0]);
+        return 1;
+    }
+
+    struct bench_state queue = {0}, ring = {0};
+
+    queue.bs_nmsgs = nmsgs;
+    ring.bs_nmsgs = nmsgs;
+
+    double queuems = run_queue(&queue);
+    double ringms = run_ring(&ring);
+
+    printf("%ld messages of %d bytes, pool of %d\n", nmsgs, MSG_SZ,
+            POOL_SIZE);
+    report("queue:", &queue, queuems);
+    report("ring:", &ring, ringms);
+
+    if(queue.bs_outoforder || ring.bs_outoforder){
+        printf("%ld messages out of order through the queue, %ld through"
+                " the ring\n", queue.bs_outoforder, ring.bs_outoforder);
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,514 @@
+#include <ctype.h>
+#include <mach/mach.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "convvar.h"
+#include "memutils.h"
+#include "strext.h"
+
+/* Breakpoint conditions are compiled once, when the breakpoint is set,
+ * into code for a small stack machine. Evaluating one when the
+ * breakpoint is hit never allocates or looks anything up by name, so
+ * it can be done while the rest of the debuggee keeps running.
+ *
+ * The syntax is expr.c's, plus comparisons, '!', '&&', '||', and
+ * [addr] to read the eight bytes at addr. Convenience variables are
+ * read when the condition is compiled, and what they held then is
+ * baked into the code. The command thread changes them without any
+ * locking, so the exception server can't look them up. Registers are
+ * read when it's evaluated.
+ */
+
+enum {
+    OP_PUSH,
+    OP_REG,
+    OP_REGW,
+    OP_LOAD,
+    OP_NEG,
+    OP_NOT,
+    OP_BOOL,
+    OP_ADD,
+    OP_SUB,
+    OP_MUL,
+    OP_DIV,
+    OP_EQ,
+    OP_NE,
+    OP_LT,
+    OP_LE,
+    OP_GT,
+    OP_GE,
+    /* If the top is zero, leave zero there and jump, otherwise pop it */
+    OP_JZ_OR_POP,
+    /* If the top isn't zero, leave one there and jump, otherwise pop it */
+    OP_JNZ_OR_POP
+};
+
+/* Where OP_REG and OP_REGW read from, past x0-x28 */
+enum {
+    REG_FP = 29,
+    REG_LR,
+    REG_SP,
+    REG_PC,
+    REG_CPSR,
+    REG_ZR
+};
+
+#define BPCOND_MAX_DEPTH 32
+
+struct bpinsn {
+    int op;
+    long arg;
+};
+
+struct bpcond {
+    struct bpinsn *insns;
+    int len;
+    int capacity;
+};
+
+struct parser {
+    const char *str;
+    int pos;
+
+    struct bpcond *cond;
+
+    /* How deep the stack gets, checked as code is emitted */
+    int depth;
+
+    char **error;
+};
+
+static void emit(struct parser *p, int op, long arg){
+    struct bpcond *c = p->cond;
+
+    if(c->len == c->capacity){
+        c->capacity = c->capacity == 0 ? 16 : c->capacity * 2;
+        c->insns = realloc(c->insns, sizeof(struct bpinsn) * c->capacity);
+    }
+
+    c->insns[c->len].op = op;
+    c->insns[c->len].arg = arg;
+    c->len++;
+
+    if(op == OP_PUSH || op == OP_REG || op == OP_REGW)
+        p->depth++;
+    else if(op >= OP_ADD && op <= OP_GE)
+        p->depth--;
+
+    if(p->depth > BPCOND_MAX_DEPTH && !*p->error)
+        concat(p->error, "condition is too complicated");
+}
+
+static void skip_blanks(struct parser *p){
+    while(isspace(p->str[p->pos]))
+        p->pos++;
+}
+
+/* If the next thing in the condition is tok, step over it. */
+static int accept(struct parser *p, const char *tok){
+    skip_blanks(p);
+
+    size_t len = strlen(tok);
+
+    if(strncmp(p->str + p->pos, tok, len) != 0)
+        return 0;
+
+    p->pos += len;
+
+    return 1;
+}
+
+static void parse_or(struct parser *);
+
+static int reg_from_name(const char *name){
+    if(strcmp(name, "fp") == 0)
+        return REG_FP;
+    else if(strcmp(name, "lr") == 0)
+        return REG_LR;
+    else if(strcmp(name, "sp") == 0)
+        return REG_SP;
+    else if(strcmp(name, "pc") == 0)
+        return REG_PC;
+    else if(strcmp(name, "cpsr") == 0)
+        return REG_CPSR;
+    else if(strcmp(name, "xzr") == 0 || strcmp(name, "wzr") == 0)
+        return REG_ZR;
+    else if(strcmp(name, "wsp") == 0)
+        return REG_SP;
+
+    if((name[0] != 'x' && name[0] != 'w') || !isdigit(name[1]))
+        return -1;
+
+    char *end = NULL;
+    long which = strtol(name + 1, &end, 10);
+
+    if(*end || which < 0 || which > 31)
+        return -1;
+
+    /* x31 is sp, like everywhere else in iosdbg */
+    return (int)which;
+}
+
+/* $name is a register if it's named like one, otherwise it has to be
+ * a convenience variable holding an integer.
+ */
+static void parse_dollar(struct parser *p){
+    int start = p->pos++;
+
+    while(isalnum(p->str[p->pos]) || p->str[p->pos] == '_')
+        p->pos++;
+
+    char *name = substr((char *)p->str, start, p->pos - start);
+
+    for(char *c = name + 1; *c; c++)
+        *c = tolower(*c);
+
+    int reg = reg_from_name(name + 1);
+
+    if(reg == REG_ZR)
+        emit(p, OP_PUSH, 0);
+    else if(reg != -1)
+        emit(p, name[1] == 'w' ? OP_REGW : OP_REG, reg);
+    else{
+        free(name);
+        name = substr((char *)p->str, start, p->pos - start);
+
+        struct convvar *var = lookup_convvar(name);
+
+        if(!var || var->state == CONVVAR_VOID)
+            concat(p->error, "no such register or convenience variable"
+                    " '%s'", name);
+        else if(var->kind != CONVVAR_INTEGER)
+            concat(p->error, "'%s' isn't an integer", name);
+        else
+            emit(p, OP_PUSH, (long)var->data.integer);
+    }
+
+    free(name);
+}
+
+/* Numbers are read the same way expr.c reads them: anything with a
+ * hex digit in it is hex.
+ */
+static void parse_number(struct parser *p){
+    const char *start = p->str + p->pos;
+    int base = 10;
+
+    if(strncmp(start, "0x", 2) == 0 || strncmp(start, "0X", 2) == 0){
+        base = 16;
+        p->pos += 2;
+    }
+
+    int digits = p->pos;
+
+    while(isxdigit(p->str[p->pos])){
+        if(!isdigit(p->str[p->pos]))
+            base = 16;
+
+        p->pos++;
+    }
+
+    if(p->pos == digits){
+        concat(p->error, "malformed number at index %d", digits);
+        return;
+    }
+
+    emit(p, OP_PUSH, (long)strtoul(p->str + digits, NULL, base));
+}
+
+static void parse_primary(struct parser *p){
+    skip_blanks(p);
+
+    char c = p->str[p->pos];
+
+    if(accept(p, "(")){
+        parse_or(p);
+
+        if(!*p->error && !accept(p, ")"))
+            concat(p->error, "expected ')' at index %d", p->pos);
+    }
+    else if(accept(p, "[")){
+        parse_or(p);
+
+        if(!*p->error && !accept(p, "]"))
+            concat(p->error, "expected ']' at index %d", p->pos);
+
+        emit(p, OP_LOAD, 0);
+    }
+    else if(c == '$')
+        parse_dollar(p);
+    else if(isxdigit(c))
+        parse_number(p);
+    else if(c == '\0')
+        concat(p->error, "unexpected end of condition");
+    else
+        concat(p->error, "bad character %c at index %d", c, p->pos);
+}
+
+static void parse_unary(struct parser *p){
+    skip_blanks(p);
+
+    if(accept(p, "-")){
+        parse_unary(p);
+        emit(p, OP_NEG, 0);
+    }
+    else if(p->str[p->pos] == '!' && p->str[p->pos + 1] != '='
+            && accept(p, "!")){
+        parse_unary(p);
+        emit(p, OP_NOT, 0);
+    }
+    else{
+        parse_primary(p);
+    }
+}
+
+static void parse_term(struct parser *p){
+    parse_unary(p);
+
+    while(!*p->error){
+        skip_blanks(p);
+
+        /* 6(2) means 6*(2), like in expr.c */
+        if(p->str[p->pos] == '('){
+            parse_unary(p);
+            emit(p, OP_MUL, 0);
+        }
+        else if(accept(p, "*")){
+            parse_unary(p);
+            emit(p, OP_MUL, 0);
+        }
+        else if(accept(p, "/")){
+            parse_unary(p);
+            emit(p, OP_DIV, 0);
+        }
+        else{
+            break;
+        }
+    }
+}
+
+static void parse_sum(struct parser *p){
+    parse_term(p);
+
+    while(!*p->error){
+        if(accept(p, "+")){
+            parse_term(p);
+            emit(p, OP_ADD, 0);
+        }
+        else if(accept(p, "-")){
+            parse_term(p);
+            emit(p, OP_SUB, 0);
+        }
+        else{
+            break;
+        }
+    }
+}
+
+static void parse_compare(struct parser *p){
+    static const struct {
+        const char *tok;
+        int op;
+    } compares[] = {
+        { "==", OP_EQ }, { "!=", OP_NE }, { "<=", OP_LE },
+        { ">=", OP_GE }, { "<", OP_LT }, { ">", OP_GT }
+    };
+
+    parse_sum(p);
+
+    if(*p->error)
+        return;
+
+    for(int i=0; i<sizeof(compares) / sizeof(*compares); i++){
+        if(accept(p, compares[i].tok)){
+            parse_sum(p);
+            emit(p, compares[i].op, 0);
+            return;
+        }
+    }
+}
+
+/* The jump is patched once we know where the right side ends. */
+static void parse_logical(struct parser *p, const char *tok, int jumpop,
+        void (*parse_side)(struct parser *)){
+    parse_side(p);
+
+    while(!*p->error && accept(p, tok)){
+        int jump = p->cond->len;
+
+        emit(p, jumpop, 0);
+
+        /* The right side is only evaluated once the left is popped. */
+        p->depth--;
+
+        parse_side(p);
+        emit(p, OP_BOOL, 0);
+
+        p->cond->insns[jump].arg = p->cond->len;
+    }
+}
+
+static void parse_and(struct parser *p){
+    parse_logical(p, "&&", OP_JZ_OR_POP, parse_compare);
+}
+
+static void parse_or(struct parser *p){
+    parse_logical(p, "||", OP_JNZ_OR_POP, parse_and);
+}
+
+void bpcond_free(struct bpcond *c){
+    if(!c)
+        return;
+
+    free(c->insns);
+    free(c);
+}
+
+/* Returns NULL and sets error if the condition is malformed. */
+struct bpcond *bpcond_compile(const char *str, char **error){
+    if(!str || is_whitespace((char *)str)){
+        concat(error, "empty condition");
+        return NULL;
+    }
+
+    struct parser p = {0};
+
+    p.str = str;
+    p.cond = calloc(1, sizeof(struct bpcond));
+    p.error = error;
+
+    parse_or(&p);
+
+    skip_blanks(&p);
+
+    if(!*error && str[p.pos] != '\0')
+        concat(error, "unexpected '%c' at index %d", str[p.pos], p.pos);
+
+    if(*error){
+        bpcond_free(p.cond);
+        return NULL;
+    }
+
+    return p.cond;
+}
+
+static long read_reg(const arm_thread_state64_t *state, int reg){
+    switch(reg){
+        case REG_FP:
+            return state->__fp;
+        case REG_LR:
+            return state->__lr;
+        case REG_SP:
+            return state->__sp;
+        case REG_PC:
+            return state->__pc;
+        case REG_CPSR:
+            return state->__cpsr;
+        default:
+            return state->__x[reg];
+    }
+}
+
+/* Evaluate a condition against a thread's registers. Returns non-zero
+ * and sets error if it couldn't be.
+ */
+int bpcond_eval(struct bpcond *c, const arm_thread_state64_t *state,
+        long *result, char **error){
+    long stack[BPCOND_MAX_DEPTH + 1];
+    int sp = 0;
+
+    for(int pc=0; pc<c->len; pc++){
+        struct bpinsn *i = &c->insns[pc];
+
+        switch(i->op){
+            case OP_PUSH:
+                stack[sp++] = i->arg;
+                break;
+            case OP_REG:
+                stack[sp++] = read_reg(state, (int)i->arg);
+                break;
+            case OP_REGW:
+                stack[sp++] = (unsigned int)read_reg(state, (int)i->arg);
+                break;
+            case OP_LOAD:
+            {
+                long addr = stack[sp - 1];
+                kern_return_t err = read_memory_at_location((void *)addr,
+                        &stack[sp - 1], sizeof(long));
+
+                if(err){
+                    concat(error, "could not read memory at %#lx: %s",
+                            addr, mach_error_string(err));
+                    return 1;
+                }
+
+                break;
+            }
+            case OP_NEG:
+                stack[sp - 1] = -stack[sp - 1];
+                break;
+            case OP_NOT:
+                stack[sp - 1] = !stack[sp - 1];
+                break;
+            case OP_BOOL:
+                stack[sp - 1] = !!stack[sp - 1];
+                break;
+            case OP_JZ_OR_POP:
+                if(stack[sp - 1] == 0)
+                    pc = (int)i->arg - 1;
+                else
+                    sp--;
+                break;
+            case OP_JNZ_OR_POP:
+                if(stack[sp - 1] != 0){
+                    stack[sp - 1] = 1;
+                    pc = (int)i->arg - 1;
+                }
+                else{
+                    sp--;
+                }
+                break;
+            default:
+            {
+                long right = stack[--sp];
+                long left = stack[sp - 1];
+                long val = 0;
+
+                if(i->op == OP_ADD)
+                    val = left + right;
+                else if(i->op == OP_SUB)
+                    val = left - right;
+                else if(i->op == OP_MUL)
+                    val = left * right;
+                else if(i->op == OP_DIV){
+                    if(right == 0){
+                        concat(error, "attempt to divide by zero");
+                        return 1;
+                    }
+
+                    val = left / right;
+                }
+                else if(i->op == OP_EQ)
+                    val = left == right;
+                else if(i->op == OP_NE)
+                    val = left != right;
+                else if(i->op == OP_LT)
+                    val = left < right;
+                else if(i->op == OP_LE)
+                    val = left <= right;
+                else if(i->op == OP_GT)
+                    val = left > right;
+                else if(i->op == OP_GE)
+                    val = left >= right;
+
+                stack[sp - 1] = val;
+            }
+        }
+    }
+
+    *result = stack[0];
+
+    return 0;
+}
@@ -0,0 +1,11 @@
+#ifndef _BPCOND_H_
+#define _BPCOND_H_
+
+#include <mach/mach.h>
+
+struct bpcond *bpcond_compile(const char *, char **);
+int bpcond_eval(struct bpcond *, const arm_thread_state64_t *, long *,
+        char **);
+void bpcond_free(struct bpcond *);
+
+#endif
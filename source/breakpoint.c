@@ -1,7 +1,9 @@
 #include <mach/mach.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
+#include "bpcond.h"
 #include "breakpoint.h"
 #include "debuggee.h"
 #include "linkedlist.h"
@@ -11,6 +13,37 @@
 
 pthread_mutex_t BREAKPOINT_LOCK = PTHREAD_MUTEX_INITIALIZER;
 
+#define BP_MAX_SKIPS 64
+
+/* Threads stepping past a breakpoint they weren't meant to stop at.
+ * They were never suspended, and nothing but the exception server knows
+ * they hit anything. Guarded by BREAKPOINT_LOCK.
+ */
+static struct {
+    mach_port_t thread;
+    int bp_id;
+} SKIPS[BP_MAX_SKIPS];
+
+static int NUM_SKIPS = 0;
+
+static int find_skip(mach_port_t thread){
+    for(int i=0; i<NUM_SKIPS; i++){
+        if(SKIPS[i].thread == thread)
+            return i;
+    }
+
+    return -1;
+}
+
+static int skipping_bp(int bp_id){
+    for(int i=0; i<NUM_SKIPS; i++){
+        if(SKIPS[i].bp_id == bp_id)
+            return 1;
+    }
+
+    return 0;
+}
+
 /* Find an available hardware breakpoint register.*/
 static int find_ready_bp_reg(void){
     /* Keep track of what hardware breakpoint registers are used
@@ -79,6 +112,15 @@ struct breakpoint *breakpoint_new(unsigned long location, int temporary,
     bp->bcr = 0;
     bp->bvr = 0;
 
+    bp->cond_expr = NULL;
+    bp->cond = NULL;
+
+    bp->ignore_count = 0;
+    bp->every = 0;
+    bp->max_hits = 0;
+    bp->stops = 0;
+    bp->spent = 0;
+
     int available_bp_reg = find_ready_bp_reg();
 
     if(available_bp_reg != -1){
@@ -255,6 +297,10 @@ static void disable_hw_bp(struct breakpoint *bp){
 }
 
 static void bp_set_state_internal(struct breakpoint *bp, int disabled){
+    /* Nothing turns a breakpoint which used up its stops back on. */
+    if(bp->spent)
+        disabled = BP_DISABLED;
+
     if(bp->hw){
         if(disabled)
             disable_hw_bp(bp);
@@ -271,10 +317,51 @@ static void bp_set_state_internal(struct breakpoint *bp, int disabled){
     bp->disabled = disabled;
 }
 
+/* While a thread steps past bp, bp stays out of its way, and
+ * breakpoint_finish_skip puts it back once it's done. Otherwise, that
+ * thread would hit it again right where it is.
+ */
+static void bp_enable_internal(struct breakpoint *bp){
+    if(!skipping_bp(bp->id)){
+        bp_set_state_internal(bp, BP_ENABLED);
+        return;
+    }
+
+    if(bp->spent || !bp->disabled)
+        return;
+
+    if(bp->hw){
+        enable_hw_bp(bp);
+
+        for(int i=0; i<NUM_SKIPS; i++){
+            if(SKIPS[i].bp_id != bp->id)
+                continue;
+
+            arm_debug_state64_t debug_state;
+            mach_msg_type_number_t count = ARM_DEBUG_STATE64_COUNT;
+
+            kern_return_t err = thread_get_state(SKIPS[i].thread,
+                    ARM_DEBUG_STATE64, (thread_state_t)&debug_state, &count);
+
+            if(err)
+                continue;
+
+            debug_state.__bcr[bp->hw_bp_reg] = 0;
+
+            thread_set_state(SKIPS[i].thread, ARM_DEBUG_STATE64,
+                    (thread_state_t)&debug_state, ARM_DEBUG_STATE64_COUNT);
+        }
+    }
+
+    bp->disabled = BP_ENABLED;
+}
+
 static void bp_delete_internal(struct breakpoint *bp){
     bp_set_state_internal(bp, BP_DISABLED);
     
     free(bp->threadinfo.tname);
+    free(bp->cond_expr);
+    bpcond_free(bp->cond);
 
     linkedlist_delete(debuggee->breakpoints, bp);    
     debuggee->num_breakpoints--;
@@ -283,16 +370,38 @@ static void bp_delete_internal(struct breakpoint *bp){
     bp = NULL;
 }
 
+/* cond_expr can be NULL. ignore_count, every, and max_hits can be zero. */
 void breakpoint_at_address(unsigned long address, int temporary,
-        int thread, char **outbuffer, char **error){
+        int thread, char *cond_expr, int ignore_count, int every,
+        int max_hits, char **outbuffer, char **error){
+    struct bpcond *cond = NULL;
+
+    if(cond_expr){
+        cond = bpcond_compile(cond_expr, error);
+
+        if(!cond)
+            return;
+    }
+
     struct breakpoint *bp = breakpoint_new(address, temporary,
             thread, outbuffer, error);
 
-    if(!bp)
+    if(!bp){
+        bpcond_free(cond);
         return;
+    }
 
     bp->for_stepping = 0;
 
+    if(cond){
+        bp->cond_expr = strdup(cond_expr);
+        bp->cond = cond;
+    }
+
+    bp->ignore_count = ignore_count;
+    bp->every = every;
+    bp->max_hits = max_hits;
+
     BP_LOCK;
     linkedlist_add(debuggee->breakpoints, bp);
     BP_UNLOCK;
@@ -300,6 +409,18 @@ void breakpoint_at_address(unsigned long address, int temporary,
     if(!temporary){
         concat(outbuffer, "Breakpoint %d at %#lx", bp->id, bp->location);
 
+        if(bp->cond)
+            concat(outbuffer, ", when '%s'", bp->cond_expr);
+
+        if(bp->ignore_count)
+            concat(outbuffer, ", ignoring %d hit(s)", bp->ignore_count);
+
+        if(bp->every > 1)
+            concat(outbuffer, ", stopping every %d hit(s)", bp->every);
+
+        if(bp->max_hits)
+            concat(outbuffer, ", disabled after %d stop(s)", bp->max_hits);
+
         if(!bp->threadinfo.all){
             concat(outbuffer, ", for thread #%d (tid: %#llx), '%s'",
                     bp->threadinfo.iosdbg_tid, bp->threadinfo.pthread_tid,
@@ -347,10 +468,18 @@ void breakpoint_hit(struct breakpoint *bp){
     if(!bp)
         return;
 
-    if(bp->temporary)
+    if(bp->temporary){
         breakpoint_delete_specific(bp);
-    else
-        bp->hit_count++;
+        return;
+    }
+
+    bp->hit_count++;
+    bp->stops++;
+
+    if(bp->max_hits && bp->stops >= bp->max_hits){
+        bp->spent = 1;
+        bp_set_state_internal(bp, BP_DISABLED);
+    }
 }
 
 void breakpoint_delete(int breakpoint_id, char **error){
@@ -397,7 +526,7 @@ void breakpoint_enable(int breakpoint_id, char **error){
         struct breakpoint *bp = current->data;
 
         if(bp->id == breakpoint_id){
-            bp_set_state_internal(bp, BP_ENABLED);
+            bp_enable_internal(bp);
             BP_END_LOCKED_FOREACH;
             return;
         }
@@ -419,7 +548,7 @@ void breakpoint_disable_all(void){
 void breakpoint_enable_all(void){
     BP_LOCKED_FOREACH(current){
         struct breakpoint *bp = current->data;
-        bp_set_state_internal(bp, BP_ENABLED);
+        bp_enable_internal(bp);
     }
     BP_END_LOCKED_FOREACH;
 }
@@ -430,12 +559,12 @@ void breakpoint_enable_all_specific(int way){
 
         if(way == BP_COND_NORMAL){
             if(!bp->temporary && !bp->for_stepping)
-                bp_set_state_internal(bp, BP_ENABLED);
+                bp_enable_internal(bp);
         }
 
         if(way == BP_COND_STEPPING){
             if(bp->for_stepping)
-                bp_set_state_internal(bp, BP_ENABLED);
+                bp_enable_internal(bp);
         }
     }
     BP_END_LOCKED_FOREACH;
@@ -539,3 +668,244 @@ void breakpoint_disable_all_except(int except){
     }
     BP_END_LOCKED_FOREACH;
 }
+
+/* Whether the next hit where bp's condition is true should stop. */
+static int next_hit_stops(struct breakpoint *bp){
+    int hit = bp->hit_count + 1;
+
+    if(hit <= bp->ignore_count)
+        return 0;
+
+    if(bp->every > 1 && (hit - bp->ignore_count) % bp->every != 0)
+        return 0;
+
+    return 1;
+}
+
+/* Whether a thread in this state should stop at bp. Hits which are
+ * passed over because of bp's ignore count or how often it stops are
+ * counted here, the ones which stop are counted by breakpoint_hit. If
+ * its condition can't be evaluated, it stops, and why is described
+ * in desc.
+ */
+int breakpoint_should_stop(struct breakpoint *bp, arm_thread_state64_t *state,
+        char **desc){
+    if(bp->cond){
+        long result = 0;
+        char *e = NULL;
+
+        if(bpcond_eval(bp->cond, state, &result, &e)){
+            concat(desc, " could not evaluate condition '%s': %s.",
+                    bp->cond_expr, e);
+            free(e);
+
+            return 1;
+        }
+
+        if(!result)
+            return 0;
+    }
+
+    if(!next_hit_stops(bp)){
+        bp->hit_count++;
+        return 0;
+    }
+
+    return 1;
+}
+
+static struct breakpoint *find_bp_with_id_locked(int id){
+    for(struct node_t *current = debuggee->breakpoints->front;
+            current;
+            current = current->next){
+        struct breakpoint *bp = current->data;
+
+        if(bp->id == id && !bp->temporary && !bp->for_stepping)
+            return bp;
+    }
+
+    return NULL;
+}
+
+/* The breakpoint at location, unless something else, like stepping,
+ * also wants threads to stop there.
+ */
+static struct breakpoint *find_only_bp_locked(unsigned long location){
+    struct breakpoint *found = NULL;
+
+    for(struct node_t *current = debuggee->breakpoints->front;
+            current;
+            current = current->next){
+        struct breakpoint *bp = current->data;
+
+        if(bp->location != location)
+            continue;
+
+        if(bp->temporary || bp->for_stepping || found)
+            return NULL;
+
+        found = bp;
+    }
+
+    return found;
+}
+
+/* Called from the exception server the moment a thread hits a
+ * breakpoint at location. If the breakpoint's condition is false, or
+ * this hit is one its ignore count or how often it stops passes over,
+ * only that thread is set up to step past it, and non-zero is returned
+ * so the server can reply right away without suspending anything.
+ * Anything which isn't that simple is left for handle_exception.
+ *
+ * While a software breakpoint is being stepped past, other threads can
+ * run through it without stopping.
+ */
+int breakpoint_skip_quietly(mach_port_t thread, unsigned long location){
+    BP_LOCK;
+
+    struct breakpoint *bp = find_only_bp_locked(location);
+
+    if(!bp || bp->disabled || NUM_SKIPS == BP_MAX_SKIPS ||
+            find_skip(thread) != -1){
+        BP_UNLOCK;
+        return 0;
+    }
+
+    /* Thread specific software breakpoints are emulated elsewhere,
+     * and breakpoints without any of this stop every time.
+     */
+    if((!bp->threadinfo.all && !bp->hw) ||
+            (!bp->cond && bp->ignore_count == 0 && bp->every <= 1)){
+        BP_UNLOCK;
+        return 0;
+    }
+
+    long result = 1;
+    kern_return_t err;
+
+    if(bp->cond){
+        arm_thread_state64_t state;
+        mach_msg_type_number_t count = ARM_THREAD_STATE64_COUNT;
+
+        err = thread_get_state(thread, ARM_THREAD_STATE64,
+                (thread_state_t)&state, &count);
+
+        char *e = NULL;
+
+        /* Errors are reported when handle_exception evaluates it again. */
+        if(err || bpcond_eval(bp->cond, &state, &result, &e)){
+            free(e);
+            BP_UNLOCK;
+            return 0;
+        }
+    }
+
+    /* handle_exception counts the hits which stop. */
+    if(result && next_hit_stops(bp)){
+        BP_UNLOCK;
+        return 0;
+    }
+
+    arm_debug_state64_t debug_state;
+    mach_msg_type_number_t count = ARM_DEBUG_STATE64_COUNT;
+
+    err = thread_get_state(thread, ARM_DEBUG_STATE64,
+            (thread_state_t)&debug_state, &count);
+
+    if(err){
+        BP_UNLOCK;
+        return 0;
+    }
+
+    if(result)
+        bp->hit_count++;
+
+    /* Single step this thread with the breakpoint out of its way. */
+    debug_state.__mdscr_el1 |= 1;
+
+    if(bp->hw)
+        debug_state.__bcr[bp->hw_bp_reg] = 0;
+    else if(!skipping_bp(bp->id))
+        write_memory_to_location(bp->location, bp->old_instruction, 4);
+
+    thread_set_state(thread, ARM_DEBUG_STATE64,
+            (thread_state_t)&debug_state, ARM_DEBUG_STATE64_COUNT);
+
+    SKIPS[NUM_SKIPS].thread = thread;
+    SKIPS[NUM_SKIPS].bp_id = bp->id;
+    NUM_SKIPS++;
+
+    BP_UNLOCK;
+
+    return 1;
+}
+
+/* Take thread's entry out of SKIPS and put back the breakpoint it was
+ * stepping past.
+ */
+static void end_skip_locked(mach_port_t thread, int idx){
+    int bp_id = SKIPS[idx].bp_id;
+
+    SKIPS[idx] = SKIPS[--NUM_SKIPS];
+
+    /* It could have been deleted or disabled in the meantime. */
+    struct breakpoint *bp = find_bp_with_id_locked(bp_id);
+
+    arm_debug_state64_t debug_state;
+    mach_msg_type_number_t count = ARM_DEBUG_STATE64_COUNT;
+
+    kern_return_t err = thread_get_state(thread, ARM_DEBUG_STATE64,
+            (thread_state_t)&debug_state, &count);
+
+    if(!err){
+        debug_state.__mdscr_el1 &= ~1ULL;
+
+        if(bp && bp->hw && !bp->disabled){
+            debug_state.__bcr[bp->hw_bp_reg] = bp->bcr;
+            debug_state.__bvr[bp->hw_bp_reg] = bp->bvr;
+        }
+
+        thread_set_state(thread, ARM_DEBUG_STATE64,
+                (thread_state_t)&debug_state, ARM_DEBUG_STATE64_COUNT);
+    }
+
+    if(bp && !bp->hw && !bp->disabled && !skipping_bp(bp_id))
+        write_memory_to_location(bp->location, BRK, 4);
+}
+
+/* Called from the exception server when a thread single steps. If it
+ * was stepping past a breakpoint from breakpoint_skip_quietly, put the
+ * breakpoint back and return non-zero.
+ */
+int breakpoint_finish_skip(mach_port_t thread){
+    BP_LOCK;
+
+    int idx = find_skip(thread);
+
+    if(idx == -1){
+        BP_UNLOCK;
+        return 0;
+    }
+
+    end_skip_locked(thread, idx);
+
+    BP_UNLOCK;
+
+    return 1;
+}
+
+/* Called from the exception server when a thread reports anything but
+ * a single step. If it was stepping past a breakpoint, it never got
+ * past it, so put the breakpoint back. Otherwise, it would be left out
+ * for good, and this thread could never skip another one.
+ */
+void breakpoint_cancel_skip(mach_port_t thread){
+    BP_LOCK;
+
+    int idx = find_skip(thread);
+
+    if(idx != -1)
+        end_skip_locked(thread, idx);
+
+    BP_UNLOCK;
+}
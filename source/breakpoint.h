@@ -1,6 +1,7 @@
 #ifndef _BREAKPOINT_H_
 #define _BREAKPOINT_H_
 
+#include <mach/mach.h>
 #include <pthread/pthread.h>
 
 extern pthread_mutex_t BREAKPOINT_LOCK;
@@ -37,6 +38,23 @@ struct breakpoint {
 
     __uint64_t bcr;
     __uint64_t bvr;
+
+    /* Only stop here when this is true. NULL if there is no condition. */
+    char *cond_expr;
+    struct bpcond *cond;
+
+    /* Hits where the condition was true but which don't stop: the first
+     * ignore_count of them, and after that, all but one in every 'every'.
+     */
+    int ignore_count;
+    int every;
+
+    /* After stopping max_hits times it disables itself for good.
+     * Zero means there's no limit.
+     */
+    int max_hits;
+    int stops;
+    int spent;
 };
 
 #define BP_ALL_THREADS (-1)
@@ -64,7 +82,8 @@ static int current_breakpoint_id = 1;
 /* BRK #0 */
 static const unsigned long long BRK = 0xd4200000;
 
-void breakpoint_at_address(unsigned long, int, int, char **, char **);
+void breakpoint_at_address(unsigned long, int, int, char *, int, int, int,
+        char **, char **);
 void set_stepping_breakpoint(unsigned long, int);
 
 void breakpoint_hit(struct breakpoint *);
@@ -81,5 +100,10 @@ void breakpoint_delete_all_specific(int);
 struct breakpoint *find_bp_with_address(unsigned long);
 struct breakpoint *find_bp_with_cond(unsigned long, int);
 void breakpoint_disable_all_except(int);
+int breakpoint_should_stop(struct breakpoint *, arm_thread_state64_t *,
+        char **);
+int breakpoint_skip_quietly(mach_port_t, unsigned long);
+int breakpoint_finish_skip(mach_port_t);
+void breakpoint_cancel_skip(mach_port_t);
 
 #endif
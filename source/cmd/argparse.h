@@ -4,7 +4,7 @@
 #include "../linkedlist.h"
 #include "../queue.h"
 
-#define MAX_GROUPS (4)
+#define MAX_GROUPS (6)
 
 enum cmd_error_t {
     CMD_SUCCESS,
@@ -79,15 +79,24 @@ void audit_breakpoint_set(struct cmd_args_t *args, const char **groupnames,
         concat(error, "no debuggee");
 
     char *tidstr = argcopy(args, groupnames[0]);
-    char *locations = argcopy(args, groupnames[1]);
+    char *cond = argcopy(args, groupnames[1]);
+    char *ignore = argcopy(args, groupnames[2]);
+    char *every = argcopy(args, groupnames[3]);
+    char *maxhits = argcopy(args, groupnames[4]);
+    char *locations = argcopy(args, groupnames[5]);
 
     if(!locations){
         concat(error, "need location");
-        nfree(1, locations);
+        nfree(6, tidstr, cond, ignore, every, maxhits, locations);
         return;
     }
 
-    nfree(2, tidstr, locations);
+    if(every && strtol(every, NULL, 10) == 0)
+        concat(error, "'every' must be at least 1");
+    else if(maxhits && strtol(maxhits, NULL, 10) == 0)
+        concat(error, "'maxhits' must be at least 1");
+
+    nfree(6, tidstr, cond, ignore, every, maxhits, locations);
 }
 
 void audit_continue(struct cmd_args_t *args, const char **groupnames,
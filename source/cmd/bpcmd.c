@@ -79,6 +79,22 @@ enum cmd_error_t cmdfunc_breakpoint_list(struct cmd_args_t *args,
         concat(outbuffer, "%4s%d: address = %-16.16lx, hit count = %d, hardware = %d\n",
                 "", b->id, b->location, b->hit_count, b->hw);
 
+        if(b->cond)
+            concat(outbuffer, "%8swhen '%s'\n", "", b->cond_expr);
+
+        if(b->ignore_count || b->every > 1 || b->max_hits){
+            concat(outbuffer, "%8signore = %d, every = %d, stops = %d",
+                    "", b->ignore_count, b->every > 1 ? b->every : 1, b->stops);
+
+            if(b->max_hits)
+                concat(outbuffer, " of %d", b->max_hits);
+
+            if(b->spent)
+                concat(outbuffer, " (disabled)");
+
+            concat(outbuffer, "\n");
+        }
+
         if(!(b->threadinfo.all)){
             concat(outbuffer, "%8sfor thread %d (tid: %#llx), '%s'",
                     "", b->threadinfo.iosdbg_tid, b->threadinfo.pthread_tid,
@@ -95,6 +111,20 @@ enum cmd_error_t cmdfunc_breakpoint_list(struct cmd_args_t *args,
     return CMD_SUCCESS;
 }
 
+/* Zero if the argument wasn't given. */
+static int int_arg(struct cmd_args_t *args, const char *group){
+    char *arg = argcopy(args, group);
+
+    if(!arg)
+        return 0;
+
+    int val = (int)strtol(arg, NULL, 10);
+
+    free(arg);
+
+    return val;
+}
+
 enum cmd_error_t cmdfunc_breakpoint_set(struct cmd_args_t *args, 
         int arg1, char **outbuffer, char **error){
     char *thread_str = argcopy(args, BREAKPOINT_SET_COMMAND_REGEX_GROUPS[0]);
@@ -123,7 +153,12 @@ enum cmd_error_t cmdfunc_breakpoint_set(struct cmd_args_t *args,
 
     free(thread_str);
 
-    char *location_str = argcopy(args, BREAKPOINT_SET_COMMAND_REGEX_GROUPS[1]);
+    char *cond = argcopy(args, BREAKPOINT_SET_COMMAND_REGEX_GROUPS[1]);
+    int ignore_count = int_arg(args, BREAKPOINT_SET_COMMAND_REGEX_GROUPS[2]);
+    int every = int_arg(args, BREAKPOINT_SET_COMMAND_REGEX_GROUPS[3]);
+    int max_hits = int_arg(args, BREAKPOINT_SET_COMMAND_REGEX_GROUPS[4]);
+
+    char *location_str = argcopy(args, BREAKPOINT_SET_COMMAND_REGEX_GROUPS[5]);
 
     while(location_str){
         char *e = NULL;
@@ -132,7 +167,8 @@ enum cmd_error_t cmdfunc_breakpoint_set(struct cmd_args_t *args,
         if(e)
             concat(outbuffer, "warning: could not set breakpoint: %s\n", e);
         else{
-            breakpoint_at_address(location, BP_NO_TEMP, thread, outbuffer, &e);
+            breakpoint_at_address(location, BP_NO_TEMP, thread, cond,
+                    ignore_count, every, max_hits, outbuffer, &e);
 
             if(e)
                 concat(outbuffer, "warning: could not set breakpoint: %s\n", e);
@@ -141,8 +177,10 @@ enum cmd_error_t cmdfunc_breakpoint_set(struct cmd_args_t *args,
         free(e);
         free(location_str);
 
-        location_str = argcopy(args, BREAKPOINT_SET_COMMAND_REGEX_GROUPS[1]);
+        location_str = argcopy(args, BREAKPOINT_SET_COMMAND_REGEX_GROUPS[5]);
     }
 
+    free(cond);
+
     return CMD_SUCCESS;
 }
@@ -31,7 +31,7 @@ static const char *BREAKPOINT_LIST_COMMAND_DOCUMENTATION =
 
 static const char *BREAKPOINT_SET_COMMAND_DOCUMENTATION =
     "Set a breakpoint.\n"
-    "This command has one mandatory argument and one optional argument.\n"
+    "This command has one mandatory argument and five optional arguments.\n"
     "\nMandatory arguments:\n"
     "\tlocation\n"
     "\t\tThis expression will used as the location for the breakpoint.\n"
@@ -42,8 +42,27 @@ static const char *BREAKPOINT_SET_COMMAND_DOCUMENTATION =
     "\t\t'tid' ensures a breakpoint is only active for a specific thread.\n"
     "\t\tiosdbg will notify you if this thread goes away.\n"
     "\t\tIf this argument is omitted, this breakpoint applies to all threads.\n"
+    "\tcond\n"
+    "\t\tOnly stop when this expression isn't zero. It's written like any\n"
+    "\t\tother expression, and can also use ==, !=, <, <=, >, >=, !, &&,\n"
+    "\t\tand ||. [addr] is the eight bytes at addr. Registers are read\n"
+    "\t\twhen the breakpoint is hit. Convenience variables are read once,\n"
+    "\t\twhen the breakpoint is set, so setting one afterwards doesn't\n"
+    "\t\tchange the condition.\n"
+    "\t\tWhen it's zero, only the thread which hit the breakpoint is\n"
+    "\t\tstopped, just long enough to step past it.\n"
+    "\tignore\n"
+    "\t\tDon't stop the first 'ignore' times this breakpoint is hit.\n"
+    "\t\tHits are only counted when the condition is true. Like a false\n"
+    "\t\tcondition, hits which don't stop only stop the thread which\n"
+    "\t\thit the breakpoint, just long enough to step past it.\n"
+    "\tevery\n"
+    "\t\tAfter any ignored hits, only stop every 'every' hits.\n"
+    "\tmaxhits\n"
+    "\t\tDisable this breakpoint after it stops 'maxhits' times.\n"
     "\nSyntax:\n"
-    "\tbreakpoint set (--t tid)? location\n"
+    "\tbreakpoint set (--t tid)? (--cond \"cond\")? (--ignore ignore)?\n"
+    "\t\t(--every every)? (--max-hits maxhits)? location\n"
     "\n";
 
 /*
@@ -53,7 +72,12 @@ static const char *BREAKPOINT_DELETE_COMMAND_REGEX =
     "(?<ids>[\\d\\s]+)?";
 
 static const char *BREAKPOINT_SET_COMMAND_REGEX =
-    "(--t\\s+(?<tid>(0[xX])?[[:xdigit:]]+)\\s+)?(?<locations>[\\w+\\-*\\/\\$()]+)";
+    "(--t\\s+(?<tid>(0[xX])?[[:xdigit:]]+)\\s+)?"
+    "(--cond\\s+\"(?<cond>[^\"]+)\"\\s+)?"
+    "(--ignore\\s+(?<ignore>\\d+)\\s+)?"
+    "(--every\\s+(?<every>\\d+)\\s+)?"
+    "(--max-hits\\s+(?<maxhits>\\d+)\\s+)?"
+    "(?<locations>[\\w+\\-*\\/\\$()]+)";
 
 /*
  * Regex groups
@@ -62,6 +86,6 @@ static const char *BREAKPOINT_DELETE_COMMAND_REGEX_GROUPS[MAX_GROUPS] =
     { "ids" };
 
 static const char *BREAKPOINT_SET_COMMAND_REGEX_GROUPS[MAX_GROUPS] =
-    { "tid", "locations" };
+    { "tid", "cond", "ignore", "every", "maxhits", "locations" };
 
 #endif
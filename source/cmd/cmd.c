@@ -221,7 +221,7 @@ void initialize_commands(void){
                 NULL);
         struct dbg_cmd_t *set = create_child_cmd("set",
                 NULL, BREAKPOINT_SET_COMMAND_DOCUMENTATION, _AT_LEVEL(1),
-                BREAKPOINT_SET_COMMAND_REGEX, _NUM_GROUPS(2), _UNK_ARGS(1),
+                BREAKPOINT_SET_COMMAND_REGEX, _NUM_GROUPS(6), _UNK_ARGS(1),
                 BREAKPOINT_SET_COMMAND_REGEX_GROUPS, cmdfunc_breakpoint_set,
                 audit_breakpoint_set);
 
@@ -370,6 +370,14 @@ void initialize_commands(void){
 
     ADD_CMD(signal);
 
+    struct dbg_cmd_t *stats = create_parent_cmd("stats",
+            NULL, STATS_COMMAND_DOCUMENTATION, _AT_LEVEL(0),
+            STATS_COMMAND_REGEX, _NUM_GROUPS(2), _UNK_ARGS(0),
+            STATS_COMMAND_REGEX_GROUPS, _NUM_SUBCMDS(0), cmdfunc_stats,
+            NULL);
+
+    ADD_CMD(stats);
+
     struct dbg_cmd_t *step = create_parent_cmd("step",
             NULL, STEP_COMMAND_DOCUMENTATION, _AT_LEVEL(0),
             NO_ARGUMENT_REGEX, _NUM_GROUPS(0), _UNK_ARGS(0),
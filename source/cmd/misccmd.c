@@ -16,6 +16,7 @@
 #include "../dbgops.h"
 #include "../debuggee.h"
 #include "../exception.h"
+#include "../excstats.h"
 #include "../expr.h"
 #include "../interaction.h"
 #include "../linkedlist.h"
@@ -142,6 +143,9 @@ enum cmd_error_t cmdfunc_attach(struct cmd_args_t *args,
     if(debuggee->aslr_slide == -1)
         concat(outbuffer, "warning: couldn't find debuggee's ASLR slide\n");
 
+    if(debuggee->find_images())
+        concat(outbuffer, "warning: couldn't read debuggee's image list\n");
+
     debuggee->pid = target_pid;
 
     if(is_number_fast(target)){
@@ -224,8 +228,16 @@ enum cmd_error_t cmdfunc_backtrace(struct cmd_args_t *args,
 
     get_thread_state(focused);
 
-    concat(outbuffer, "  * frame #0: 0x%16.16llx\n", focused->thread_state.__pc);
-    concat(outbuffer, "    frame #1: 0x%16.16llx\n", focused->thread_state.__lr);
+    /* Pick up anything which was loaded since we attached. */
+    debuggee->find_images();
+
+    concat(outbuffer, "  * frame #0: 0x%16.16llx", focused->thread_state.__pc);
+    describe_location(focused->thread_state.__pc, outbuffer);
+    concat(outbuffer, "\n");
+
+    concat(outbuffer, "    frame #1: 0x%16.16llx", focused->thread_state.__lr);
+    describe_location(focused->thread_state.__lr, outbuffer);
+    concat(outbuffer, "\n");
 
     /* There's a linked list of frame pointers. */
     struct frame_t {
@@ -246,8 +258,10 @@ enum cmd_error_t cmdfunc_backtrace(struct cmd_args_t *args,
     int frame_counter = 2;
 
     while(current_frame->next){
-        concat(outbuffer, "%4sframe #%d: 0x%16.16lx\n", "", frame_counter,
+        concat(outbuffer, "%4sframe #%d: 0x%16.16lx", "", frame_counter,
                 current_frame->frame);
+        describe_location(current_frame->frame, outbuffer);
+        concat(outbuffer, "\n");
 
         read_memory_at_location((void *)current_frame->next, 
                 (void *)current_frame, sizeof(struct frame_t)); 
@@ -433,6 +447,31 @@ enum cmd_error_t cmdfunc_quit(struct cmd_args_t *args,
     return CMD_QUIT;
 }
 
+enum cmd_error_t cmdfunc_stats(struct cmd_args_t *args, 
+        int arg1, char **outbuffer, char **error){
+    char *reset = argcopy(args, STATS_COMMAND_REGEX_GROUPS[0]);
+    char *file = argcopy(args, STATS_COMMAND_REGEX_GROUPS[1]);
+
+    enum cmd_error_t result = CMD_SUCCESS;
+
+    if(reset)
+        excstats_reset();
+    else if(file){
+        if(excstats_dump(file, error))
+            result = CMD_FAILURE;
+        else
+            concat(outbuffer, "Exception timings written to '%s'\n", file);
+    }
+    else{
+        excstats_report(outbuffer);
+    }
+
+    free(reset);
+    free(file);
+
+    return result;
+}
+
 enum cmd_error_t cmdfunc_trace(struct cmd_args_t *args, 
         int arg1, char **outbuffer, char **error){
     if(debuggee->tracing_disabled){
@@ -16,6 +16,7 @@ enum cmd_error_t cmdfunc_help(struct cmd_args_t *, int, char **, char **);
 enum cmd_error_t cmdfunc_interrupt(struct cmd_args_t *, int, char **, char **);
 enum cmd_error_t cmdfunc_kill(struct cmd_args_t *, int, char **, char **);
 enum cmd_error_t cmdfunc_quit(struct cmd_args_t *, int, char **, char **);
+enum cmd_error_t cmdfunc_stats(struct cmd_args_t *, int, char **, char **);
 enum cmd_error_t cmdfunc_trace(struct cmd_args_t *, int, char **, char **);
 
 static const char *ASLR_COMMAND_DOCUMENTATION = 
@@ -104,6 +105,26 @@ static const char *QUIT_COMMAND_DOCUMENTATION =
     "\tquit\n"
     "\n";
 
+static const char *STATS_COMMAND_DOCUMENTATION =
+    "Show how long exceptions take to get through iosdbg, from when they're\n"
+    "received to when the debuggee is resumed.\n"
+    "Counts and latency percentiles are shown for each kind of exception,\n"
+    "broken down by where the time went, followed by a histogram of\n"
+    "round trip times. A watchpoint hit is counted as a watchpoint and\n"
+    "then a single step.\n"
+    "This command has no mandatory arguments and two optional arguments.\n"
+    "\nOptional arguments:\n"
+    "\t--dump\n"
+    "\t\tWrite every recorded exception to this file instead, one per\n"
+    "\t\tline, with each timestamp in nanoseconds.\n"
+    "\t--reset\n"
+    "\t\tForget everything recorded so far.\n"
+    "\nSyntax:\n"
+    "\tstats\n"
+    "\tstats --dump file\n"
+    "\tstats --reset\n"
+    "\n";
+
 static const char *TRACE_COMMAND_DOCUMENTATION =
     "This command provides similar functionality as strace through"
     " the kdebug interface.\n"
@@ -127,6 +148,9 @@ static const char *EVALUATE_COMMAND_REGEX =
 static const char *HELP_COMMAND_REGEX =
     "(?<cmd>[\\w\\s]+)?";
 
+static const char *STATS_COMMAND_REGEX =
+    "^\\s*((?<reset>--reset)|--dump\\s+(?<file>[^\\s]+))?\\s*$";
+
 /*
  * Regex groups
  */
@@ -139,4 +163,7 @@ static const char *EVALUATE_COMMAND_REGEX_GROUPS[MAX_GROUPS] =
 static const char *HELP_COMMAND_REGEX_GROUPS[MAX_GROUPS] =
     { "cmd" };
 
+static const char *STATS_COMMAND_REGEX_GROUPS[MAX_GROUPS] =
+    { "reset", "file" };
+
 #endif
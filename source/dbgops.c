@@ -1,5 +1,6 @@
 #include <ctype.h>
 #include <signal.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -9,10 +10,10 @@
 #include "dbgops.h"
 #include "debuggee.h"
 #include "exception.h"
+#include "excstats.h"
 #include "linkedlist.h"
 #include "memutils.h"
 #include "ptrace.h"
-#include "queue.h"
 #include "servers.h"
 #include "sigsupport.h"
 #include "strext.h"
@@ -20,6 +21,8 @@
 #include "trace.h"
 #include "watchpoint.h"
 
+#include "symbol/sym.h"
+
 void ops_printsiginfo(char **outbuffer){
     concat(outbuffer, "%-11s %-5s %-5s %-6s\n", "NAME", "PASS", "STOP", "NOTIFY");
     concat(outbuffer, "=========== ===== ===== ======\n");
@@ -58,16 +61,12 @@ void ops_printsiginfo(char **outbuffer){
 static void reply_to_all_exceptions(void){
     EXC_QUEUE_LOCK;
 
-    if(NEED_REPLY){
-        Request *r = dequeue(EXCEPTION_QUEUE);
-
-        while(r){
-            reply_to_exception(r, KERN_SUCCESS);
-            free(r);
-            r = dequeue(EXCEPTION_QUEUE);
-        }
+    Request *r = exception_dequeue();
 
-        NEED_REPLY = 0;
+    while(r){
+        reply_to_exception(r, KERN_SUCCESS);
+        exception_release(r);
+        r = exception_dequeue();
     }
 
     pthread_mutex_unlock(&EXCEPTION_QUEUE_MUTEX);
@@ -94,6 +93,9 @@ void ops_detach(int from_death, char **outbuffer){
 
     debuggee->deallocate_ports(outbuffer);
 
+    /* The event loop has nothing left to wait on. */
+    stop_servers();
+
     /* Send SIGSTOP to set debuggee's process status to
      * SSTOP so we can detach. Calling ptrace with PT_THUPDATE
      * to handle Unix signals sets this status to SRUN, and ptrace 
@@ -114,10 +116,8 @@ void ops_detach(int from_death, char **outbuffer){
         kill(debuggee->pid, SIGCONT);
     }
 
-    EXC_QUEUE_LOCK;
-    queue_free(EXCEPTION_QUEUE);
-    EXCEPTION_QUEUE = NULL;
-    EXC_QUEUE_UNLOCK;
+    /* Whatever was replied to above is done with. */
+    excstats_resumed();
 
     BP_LOCK;
     linkedlist_free(debuggee->breakpoints);
@@ -134,6 +134,8 @@ void ops_detach(int from_death, char **outbuffer){
     debuggee->threads = NULL;
     TH_UNLOCK;
 
+    sym_images_free(&debuggee->images);
+
     concat(outbuffer, "Detached from %s (%d)\n",
             debuggee->debuggee_name, debuggee->pid);
 
@@ -154,7 +156,11 @@ void ops_detach(int from_death, char **outbuffer){
 kern_return_t ops_resume(void){
     reply_to_all_exceptions();
 
-    return debuggee->resume();
+    kern_return_t kret = debuggee->resume();
+
+    excstats_resumed();
+
+    return kret;
 }
 
 kern_return_t ops_suspend(void){
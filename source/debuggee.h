@@ -59,9 +59,19 @@ struct debuggee {
     /* The debuggee's ASLR slide. */
     unsigned long aslr_slide;
 
+    /* Every image loaded into the debuggee, each with its own slide,
+     * used to symbolicate addresses.
+     */
+    void *images;
+
     /* The function pointer to find the debuggee's ASLR slide. */
     unsigned long (*find_slide)(void);
 
+    /* The function pointer to read the debuggee's image list from dyld.
+     * Cheap to call again if the list hasn't changed.
+     */
+    kern_return_t (*find_images)(void);
+
     /* The function pointer to restore original exception ports. */
     kern_return_t (*restore_exception_ports)(void);
 
@@ -174,11 +174,37 @@ static void handle_hit_breakpoint(struct machthread *t,
         }
     }
 
+    /* The exception server steps past breakpoints whose condition is
+     * false, or which are ignoring this hit, without us, but it leaves
+     * the ones it can't to us.
+     */
+    if(hit && !breakpoint_should_stop(hit, &t->thread_state, desc)){
+        if(!hit->hw){
+            t->just_hit_sw_breakpoint = 1;
+            breakpoint_disable(hit->id, NULL);
+        }
+
+        t->last_hit_bkpt_ID = hit->id;
+
+        if(!step){
+            /* should not print, should auto resume */
+            *should_print = 0;
+            return;
+        }
+
+        hit = NULL;
+    }
+
     breakpoint_hit(hit);
 
     if(hit){
-        concat(desc, " breakpoint %d at %#lx hit %d time(s).\n",
+        concat(desc, " breakpoint %d at %#lx hit %d time(s)",
                 hit->id, hit->location, hit->hit_count);
+
+        if(hit->spent)
+            concat(desc, ", now disabled");
+
+        concat(desc, ".\n");
     }
     else if(step){
         concat(desc, " instruction step over.\n");
@@ -348,12 +374,24 @@ void handle_exception(Request *request, int *should_auto_resume,
             if(focused->stepconfig.is_stepping){
                 struct breakpoint *hit = find_bp_with_cond(
                         focused->thread_state.__pc, BP_COND_NORMAL);
-                
-                if(hit){
+
+                concat(desc, ": '%s':", focused->tname);
+
+                /* Landing on a breakpoint only counts as hitting it if
+                 * it would have stopped here on its own. Otherwise,
+                 * this is just the end of the step.
+                 */
+                if(hit && !hit->threadinfo.all && !hit->hw &&
+                        focused->tid != hit->threadinfo.pthread_tid){
+                    hit = NULL;
+                }
+
+                if(hit && breakpoint_should_stop(hit,
+                            &focused->thread_state, desc)){
                     breakpoint_hit(hit);
 
-                    concat(desc, ": '%s': breakpoint %d at %#lx hit %d time(s).",
-                            focused->tname, hit->id, hit->location, hit->hit_count);
+                    concat(desc, " breakpoint %d at %#lx hit %d time(s).",
+                            hit->id, hit->location, hit->hit_count);
                 }
                 else{
                     const char *step_kind = "instruction step in";
@@ -361,7 +399,7 @@ void handle_exception(Request *request, int *should_auto_resume,
                     if(focused->stepconfig.step_kind == INST_STEP_OVER)
                         step_kind = "instruction step over";
 
-                    concat(desc, ": '%s': %s.", focused->tname, step_kind);
+                    concat(desc, " %s.", step_kind);
                 }
             }
     
@@ -393,22 +431,31 @@ void handle_exception(Request *request, int *should_auto_resume,
     }
 }
 
-void reply_to_exception(Request *req, kern_return_t retcode){
-    Reply reply;
-    
-    mach_msg_header_t *rpl_head = &reply.Head;
+/* Fill in a reply to req. It's safe for reply to be where req is. */
+void build_exception_reply(Request *req, kern_return_t retcode,
+        Reply *reply){
+    mach_msg_header_t head = req->Head;
+    NDR_record_t ndr = req->NDR;
+
+    mach_msg_header_t *rpl_head = &reply->Head;
 
     /* This is from mach_excServer.c. */
     rpl_head->msgh_bits = MACH_MSGH_BITS(MACH_MSGH_BITS_REMOTE(
-                req->Head.msgh_bits), 0);
-    rpl_head->msgh_remote_port = req->Head.msgh_remote_port;
+                head.msgh_bits), 0);
+    rpl_head->msgh_remote_port = head.msgh_remote_port;
     rpl_head->msgh_size = (mach_msg_size_t)sizeof(mig_reply_error_t);
     rpl_head->msgh_local_port = MACH_PORT_NULL;
-    rpl_head->msgh_id = req->Head.msgh_id + 100;
+    rpl_head->msgh_id = head.msgh_id + 100;
     rpl_head->msgh_reserved = 0;
 
-    reply.NDR = req->NDR;
-    reply.RetCode = retcode;
+    reply->NDR = ndr;
+    reply->RetCode = retcode;
+}
+
+void reply_to_exception(Request *req, kern_return_t retcode){
+    Reply reply;
+
+    build_exception_reply(req, retcode, &reply);
 
     mach_msg(&reply.Head,
             MACH_SEND_MSG,
@@ -24,6 +24,7 @@ typedef struct {
 } Reply;
 
 void handle_exception(Request *, int *, int *, char **);
+void build_exception_reply(Request *, kern_return_t, Reply *);
 void reply_to_exception(Request *, kern_return_t);
 
 #endif
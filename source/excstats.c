@@ -0,0 +1,394 @@
+#include <errno.h>
+#include <mach/mach.h>
+#include <mach/mach_time.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "excstats.h"
+#include "strext.h"
+
+/* How many of the most recent exceptions are kept around for
+ * percentiles. Must be a power of two.
+ */
+#define EXCSTATS_NSAMPLES 4096
+
+/* How many exceptions can be replied to before the debuggee is resumed */
+#define EXCSTATS_MAX_REPLIED 256
+
+#define EXCSTATS_NBUCKETS 32
+
+static const char *KIND_NAMES[EXCKIND_COUNT] = {
+    "breakpoint", "watchpoint", "single-step", "signal", "other"
+};
+
+/* Each phase is the time between two stamps */
+static const struct {
+    const char *name;
+    int from, to;
+} PHASES[] = {
+    { "suspend",     EXCSTAMP_RECEIVE,       EXCSTAMP_SUSPEND },
+    { "dispatch",    EXCSTAMP_SUSPEND,       EXCSTAMP_HANDLER_START },
+    { "handler",     EXCSTAMP_HANDLER_START, EXCSTAMP_HANDLER_END },
+    { "until reply", EXCSTAMP_HANDLER_END,   EXCSTAMP_REPLY },
+    { "resume",      EXCSTAMP_REPLY,         EXCSTAMP_RESUME },
+    { "total",       EXCSTAMP_RECEIVE,       EXCSTAMP_RESUME },
+};
+
+#define EXCSTATS_NPHASES (sizeof(PHASES) / sizeof(*PHASES))
+
+/* A sample is being written while its sequence number is odd. Writers
+ * never wait on each other or on readers, and readers throw away
+ * whatever was overwritten while they were copying it.
+ */
+struct excslot {
+    uint64_t sl_seq;
+    struct excsample sl_sample;
+};
+
+static struct excslot SLOTS[EXCSTATS_NSAMPLES];
+
+/* The ticket of the next sample to be written, and of the first
+ * one after the last reset.
+ */
+static uint64_t NEXT_TICKET = 0;
+static uint64_t FIRST_TICKET = 0;
+
+/* Every exception since the last reset, not just the ones kept */
+static uint64_t KIND_COUNTS[EXCKIND_COUNT];
+
+/* Exceptions which were replied to but the debuggee hasn't been
+ * resumed yet.
+ */
+static struct excsample REPLIED[EXCSTATS_MAX_REPLIED];
+static int NREPLIED = 0;
+static pthread_mutex_t REPLIED_LOCK = PTHREAD_MUTEX_INITIALIZER;
+
+static uint64_t now(void){
+    return mach_absolute_time();
+}
+
+static uint64_t to_ns(uint64_t t){
+    static mach_timebase_info_data_t tb;
+
+    if(tb.denom == 0)
+        mach_timebase_info(&tb);
+
+    return t * tb.numer / tb.denom;
+}
+
+static void record(struct excsample *s){
+    uint64_t ticket = __atomic_fetch_add(&NEXT_TICKET, 1, __ATOMIC_RELAXED);
+    struct excslot *slot = &SLOTS[ticket & (EXCSTATS_NSAMPLES - 1)];
+
+    __atomic_store_n(&slot->sl_seq, (ticket << 1) | 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    memcpy(&slot->sl_sample, s, sizeof(struct excsample));
+
+    __atomic_store_n(&slot->sl_seq, (ticket + 1) << 1, __ATOMIC_RELEASE);
+
+    __atomic_fetch_add(&KIND_COUNTS[s->es_kind], 1, __ATOMIC_RELAXED);
+}
+
+/* Start a sample when its exception has just been received. */
+void excstats_begin(struct excsample *s){
+    memset(s, 0, sizeof(struct excsample));
+
+    s->es_kind = EXCKIND_OTHER;
+    s->es_stamps[EXCSTAMP_RECEIVE] = now();
+}
+
+void excstats_stamp(struct excsample *s, int which){
+    s->es_stamps[which] = now();
+}
+
+/* Figure out what kind of exception this is the same way
+ * handle_exception does.
+ */
+void excstats_classify(struct excsample *s, int exception, long code,
+        long subcode){
+    if(exception == EXC_SOFTWARE && code == EXC_SOFT_SIGNAL)
+        s->es_kind = EXCKIND_SIGNAL;
+    else if(code == EXC_ARM_DA_DEBUG)
+        s->es_kind = EXCKIND_WATCHPOINT;
+    else if(exception == EXC_BREAKPOINT && code == EXC_ARM_BREAKPOINT)
+        s->es_kind = subcode == 0 ? EXCKIND_SINGLE_STEP : EXCKIND_BREAKPOINT;
+    else
+        s->es_kind = EXCKIND_OTHER;
+}
+
+/* The exception this sample is for was just replied to. The sample is
+ * copied, since the message it came with can be reused right after.
+ */
+void excstats_replied(struct excsample *s){
+    excstats_stamp(s, EXCSTAMP_REPLY);
+
+    pthread_mutex_lock(&REPLIED_LOCK);
+
+    if(NREPLIED < EXCSTATS_MAX_REPLIED)
+        REPLIED[NREPLIED++] = *s;
+    else
+        record(s);
+
+    pthread_mutex_unlock(&REPLIED_LOCK);
+}
+
+/* The exception this sample is for was replied to without the debuggee
+ * ever being suspended.
+ */
+void excstats_finish(struct excsample *s){
+    s->es_stamps[EXCSTAMP_REPLY] = now();
+    s->es_stamps[EXCSTAMP_RESUME] = s->es_stamps[EXCSTAMP_REPLY];
+
+    record(s);
+}
+
+/* The debuggee was just resumed. Everything replied to since it was
+ * last resumed is done.
+ */
+void excstats_resumed(void){
+    uint64_t resumed = now();
+
+    pthread_mutex_lock(&REPLIED_LOCK);
+
+    for(int i=0; i<NREPLIED; i++){
+        REPLIED[i].es_stamps[EXCSTAMP_RESUME] = resumed;
+        record(&REPLIED[i]);
+    }
+
+    NREPLIED = 0;
+
+    pthread_mutex_unlock(&REPLIED_LOCK);
+}
+
+/* Copy out whatever samples are still around. Returns how many there
+ * are. The caller frees *samplesout.
+ */
+static int snapshot(struct excsample **samplesout){
+    uint64_t next = __atomic_load_n(&NEXT_TICKET, __ATOMIC_ACQUIRE);
+    uint64_t first = __atomic_load_n(&FIRST_TICKET, __ATOMIC_ACQUIRE);
+
+    if(next - first > EXCSTATS_NSAMPLES)
+        first = next - EXCSTATS_NSAMPLES;
+
+    struct excsample *samples = malloc(sizeof(struct excsample) *
+            (next - first + 1));
+    int count = 0;
+
+    for(uint64_t ticket = first; ticket < next; ticket++){
+        struct excslot *slot = &SLOTS[ticket & (EXCSTATS_NSAMPLES - 1)];
+        uint64_t want = (ticket + 1) << 1;
+
+        if(__atomic_load_n(&slot->sl_seq, __ATOMIC_ACQUIRE) != want)
+            continue;
+
+        memcpy(&samples[count], &slot->sl_sample, sizeof(struct excsample));
+
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+        /* Overwritten while it was being copied */
+        if(__atomic_load_n(&slot->sl_seq, __ATOMIC_RELAXED) != want)
+            continue;
+
+        count++;
+    }
+
+    *samplesout = samples;
+
+    return count;
+}
+
+static int cmp_u64(const void *a, const void *b){
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+/* How long a phase took, in nanoseconds, or -1 if it never finished */
+static int64_t phase_ns(struct excsample *s, int phase){
+    uint64_t from = s->es_stamps[PHASES[phase].from];
+    uint64_t to = s->es_stamps[PHASES[phase].to];
+
+    if(from == 0 || to == 0 || to < from)
+        return -1;
+
+    return to_ns(to - from);
+}
+
+static void describe_ns(uint64_t ns, char *buf, size_t len){
+    if(ns < 1000)
+        snprintf(buf, len, "%lluns", ns);
+    else if(ns < 1000000)
+        snprintf(buf, len, "%.1fus", ns / 1e3);
+    else if(ns < 1000000000)
+        snprintf(buf, len, "%.1fms", ns / 1e6);
+    else
+        snprintf(buf, len, "%.2fs", ns / 1e9);
+}
+
+static void report_kind(struct excsample *samples, int count, int kind,
+        uint64_t *scratch, char **outbuffer){
+    for(int phase=0; phase<EXCSTATS_NPHASES; phase++){
+        int n = 0;
+
+        for(int i=0; i<count; i++){
+            if(samples[i].es_kind != kind)
+                continue;
+
+            int64_t ns = phase_ns(&samples[i], phase);
+
+            if(ns >= 0)
+                scratch[n++] = ns;
+        }
+
+        if(n == 0)
+            continue;
+
+        qsort(scratch, n, sizeof(uint64_t), cmp_u64);
+
+        char p50[32], p90[32], p99[32], max[32];
+
+        describe_ns(scratch[n / 2], p50, sizeof(p50));
+        describe_ns(scratch[(n * 9) / 10], p90, sizeof(p90));
+        describe_ns(scratch[(n * 99) / 100], p99, sizeof(p99));
+        describe_ns(scratch[n - 1], max, sizeof(max));
+
+        concat(outbuffer, "%4s%-12s %8d %10s %10s %10s %10s\n", "",
+                PHASES[phase].name, n, p50, p90, p99, max);
+    }
+}
+
+/* A power of two histogram of how long the whole round trip took */
+static void report_histogram(struct excsample *samples, int count,
+        char **outbuffer){
+    int total = EXCSTATS_NPHASES - 1;
+    uint64_t buckets[EXCSTATS_NBUCKETS] = {0}, most = 0;
+    int lo = EXCSTATS_NBUCKETS, hi = -1;
+
+    for(int i=0; i<count; i++){
+        int64_t ns = phase_ns(&samples[i], total);
+
+        if(ns < 0)
+            continue;
+
+        uint64_t us = ns / 1000;
+        int b = 0;
+
+        while(us > 1 && b < EXCSTATS_NBUCKETS - 1){
+            us >>= 1;
+            b++;
+        }
+
+        if(++buckets[b] > most)
+            most = buckets[b];
+
+        if(b < lo)
+            lo = b;
+
+        if(b > hi)
+            hi = b;
+    }
+
+    if(hi == -1)
+        return;
+
+    concat(outbuffer, "\nRound trip histogram:\n");
+
+    for(int b=lo; b<=hi; b++){
+        char from[32];
+        describe_ns(b == 0 ? 0 : (1ULL << b) * 1000, from, sizeof(from));
+
+        int width = (int)((buckets[b] * 40 + most - 1) / most);
+
+        concat(outbuffer, "%4s>= %-8s %8llu ", "", from, buckets[b]);
+
+        for(int i=0; i<width; i++)
+            concat(outbuffer, "#");
+
+        concat(outbuffer, "\n");
+    }
+}
+
+void excstats_report(char **outbuffer){
+    uint64_t seen = 0;
+
+    for(int kind=0; kind<EXCKIND_COUNT; kind++)
+        seen += __atomic_load_n(&KIND_COUNTS[kind], __ATOMIC_RELAXED);
+
+    if(seen == 0){
+        concat(outbuffer, "No exceptions have been recorded.\n");
+        return;
+    }
+
+    struct excsample *samples = NULL;
+    int count = snapshot(&samples);
+
+    uint64_t *scratch = malloc(sizeof(uint64_t) * (count + 1));
+
+    concat(outbuffer, "%-16s %8s %10s %10s %10s %10s\n",
+            "", "count", "p50", "p90", "p99", "max");
+
+    for(int kind=0; kind<EXCKIND_COUNT; kind++){
+        uint64_t seen = __atomic_load_n(&KIND_COUNTS[kind], __ATOMIC_RELAXED);
+
+        if(seen == 0)
+            continue;
+
+        concat(outbuffer, "%-16s %8llu\n", KIND_NAMES[kind], seen);
+
+        report_kind(samples, count, kind, scratch, outbuffer);
+    }
+
+    report_histogram(samples, count, outbuffer);
+
+    concat(outbuffer, "\nPercentiles are over the last %d exception(s).\n",
+            count);
+
+    free(scratch);
+    free(samples);
+}
+
+/* Write every sample still around to path, one per line, with each
+ * stamp in nanoseconds.
+ */
+int excstats_dump(const char *path, char **error){
+    FILE *fp = fopen(path, "w");
+
+    if(!fp){
+        concat(error, "could not open '%s': %s", path, strerror(errno));
+        return 1;
+    }
+
+    struct excsample *samples = NULL;
+    int count = snapshot(&samples);
+
+    fprintf(fp, "kind,receive,suspend,handler_start,handler_end,"
+            "reply,resume\n");
+
+    for(int i=0; i<count; i++){
+        fprintf(fp, "%s", KIND_NAMES[samples[i].es_kind]);
+
+        for(int j=0; j<EXCSTAMP_COUNT; j++){
+            uint64_t stamp = samples[i].es_stamps[j];
+            fprintf(fp, ",%llu", stamp ? to_ns(stamp) : 0);
+        }
+
+        fprintf(fp, "\n");
+    }
+
+    free(samples);
+    fclose(fp);
+
+    return 0;
+}
+
+void excstats_reset(void){
+    uint64_t next = __atomic_load_n(&NEXT_TICKET, __ATOMIC_ACQUIRE);
+
+    __atomic_store_n(&FIRST_TICKET, next, __ATOMIC_RELEASE);
+
+    for(int kind=0; kind<EXCKIND_COUNT; kind++)
+        __atomic_store_n(&KIND_COUNTS[kind], 0, __ATOMIC_RELAXED);
+}
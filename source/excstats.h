@@ -0,0 +1,45 @@
+#ifndef _EXCSTATS_H_
+#define _EXCSTATS_H_
+
+#include <stdint.h>
+
+enum {
+    EXCKIND_BREAKPOINT,
+    EXCKIND_WATCHPOINT,
+    EXCKIND_SINGLE_STEP,
+    EXCKIND_SIGNAL,
+    EXCKIND_OTHER,
+    EXCKIND_COUNT
+};
+
+/* Points in an exception's round trip, in the order they happen */
+enum {
+    EXCSTAMP_RECEIVE,
+    EXCSTAMP_SUSPEND,
+    EXCSTAMP_HANDLER_START,
+    EXCSTAMP_HANDLER_END,
+    EXCSTAMP_REPLY,
+    EXCSTAMP_RESUME,
+    EXCSTAMP_COUNT
+};
+
+/* Stamps are in mach absolute time units, zero if that point
+ * was never reached.
+ */
+struct excsample {
+    uint64_t es_stamps[EXCSTAMP_COUNT];
+    int es_kind;
+};
+
+void excstats_begin(struct excsample *);
+void excstats_stamp(struct excsample *, int);
+void excstats_classify(struct excsample *, int, long, long);
+void excstats_replied(struct excsample *);
+void excstats_resumed(void);
+void excstats_finish(struct excsample *);
+
+void excstats_report(char **);
+int excstats_dump(const char *, char **);
+void excstats_reset(void);
+
+#endif
@@ -1,6 +1,10 @@
+#include <mach-o/dyld_images.h>
 #include <mach-o/loader.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/param.h>
 
 #include "debuggee.h"
 #include "linkedlist.h"
@@ -8,6 +12,8 @@
 #include "strext.h"
 #include "thread.h"
 
+#include "symbol/sym.h"
+
 unsigned long find_slide(void){
     kern_return_t err = KERN_SUCCESS;
     vm_address_t addr = 0;
@@ -70,6 +76,220 @@ unsigned long find_slide(void){
     return -1;
 }
 
+/* When dyld last changed its image list, so we know when it needs
+ * to be read again.
+ */
+static uint64_t images_timestamp;
+static uint32_t images_count;
+
+/* Both the exception thread and the main thread look for images */
+static pthread_mutex_t images_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Paths are somewhere in dyld's memory. Read a bit at a time so we
+ * don't run off the end of a mapping.
+ */
+static char *read_image_path(unsigned long location){
+    char path[MAXPATHLEN] = {0};
+
+    for(int i=0; i<MAXPATHLEN - 1; i += 64){
+        int len = (MAXPATHLEN - 1) - i;
+
+        if(len > 64)
+            len = 64;
+
+        if(read_memory_at_location((void *)(location + i), path + i, len))
+            return NULL;
+
+        if(memchr(path + i, '\0', len))
+            break;
+    }
+
+    return strdup(path);
+}
+
+/* For images in the shared cache, which have nothing on disk to
+ * read symbols from.
+ */
+static int read_image_memory(void *arg, uint64_t location, void *buf,
+        size_t size){
+    return read_memory_at_location((void *)location, buf, size) !=
+        KERN_SUCCESS;
+}
+
+/* Only __TEXT goes into the symbol manager, since that's where the code
+ * is. An image's other segments aren't always next to it. Returns
+ * non-zero if the image couldn't be read.
+ */
+static int add_image(unsigned long loadaddr, const char *path){
+    struct mach_header_64 mh = {0};
+
+    kern_return_t err = read_memory_at_location((void *)loadaddr, &mh,
+            sizeof(mh));
+
+    if(err)
+        return 1;
+
+    if(mh.magic != MH_MAGIC_64)
+        return 0;
+
+    uint8_t *cmds = malloc(mh.sizeofcmds);
+
+    err = read_memory_at_location((void *)(loadaddr + sizeof(mh)), cmds,
+            mh.sizeofcmds);
+
+    if(err){
+        free(cmds);
+        return 1;
+    }
+
+    uint8_t uuid[16] = {0};
+    int hasuuid = 0;
+
+    unsigned long slide = 0, textsize = 0;
+
+    uint32_t off = 0;
+
+    for(int i=0; i<mh.ncmds; i++){
+        if(off + sizeof(struct load_command) > mh.sizeofcmds)
+            break;
+
+        struct load_command *lc = (struct load_command *)(cmds + off);
+
+        if(lc->cmdsize == 0 || off + lc->cmdsize > mh.sizeofcmds)
+            break;
+
+        if(lc->cmd == LC_UUID){
+            memcpy(uuid, ((struct uuid_command *)lc)->uuid, sizeof(uuid));
+            hasuuid = 1;
+        }
+        else if(lc->cmd == LC_SEGMENT_64){
+            struct segment_command_64 *segcmd =
+                (struct segment_command_64 *)lc;
+
+            if(strcmp(segcmd->segname, "__TEXT") == 0){
+                slide = loadaddr - segcmd->vmaddr;
+                textsize = segcmd->vmsize;
+            }
+        }
+
+        off += lc->cmdsize;
+    }
+
+    free(cmds);
+
+    sym_images_add(debuggee->images, path, hasuuid ? uuid : NULL, loadaddr,
+            slide, textsize, NULL);
+
+    return 0;
+}
+
+static kern_return_t find_images_locked(void){
+    struct task_dyld_info dyld_info = {0};
+    mach_msg_type_number_t count = TASK_DYLD_INFO_COUNT;
+
+    kern_return_t err = task_info(debuggee->task, TASK_DYLD_INFO,
+            (task_info_t)&dyld_info, &count);
+
+    if(err)
+        return err;
+
+    struct dyld_all_image_infos all_image_infos = {0};
+
+    err = read_memory_at_location((void *)dyld_info.all_image_info_addr,
+            &all_image_infos, sizeof(all_image_infos));
+
+    if(err)
+        return err;
+
+    if(!debuggee->images){
+        sym_images_new(&debuggee->images, NULL);
+        sym_images_set_memory_reader(debuggee->images, read_image_memory,
+                NULL, NULL);
+
+        images_timestamp = 0;
+        images_count = 0;
+    }
+
+    /* dyld is in the middle of changing the list */
+    if(!all_image_infos.infoArray)
+        return KERN_FAILURE;
+
+    /* Nothing was loaded or unloaded since last time. Images added
+     * before are found again by their load address, so when something
+     * was, everything can be read again, and whatever isn't in the list
+     * anymore was unloaded.
+     */
+    if(all_image_infos.infoArrayChangeTimestamp == images_timestamp &&
+            all_image_infos.infoArrayCount == images_count){
+        return KERN_SUCCESS;
+    }
+
+    size_t infossz = sizeof(struct dyld_image_info) *
+        all_image_infos.infoArrayCount;
+    struct dyld_image_info *infos = malloc(infossz);
+
+    err = read_memory_at_location((void *)all_image_infos.infoArray, infos,
+            infossz);
+
+    if(err){
+        free(infos);
+        return err;
+    }
+
+    /* dyld isn't in its own list */
+    char *dyldpath = NULL;
+
+    if(all_image_infos.dyldPath)
+        dyldpath = read_image_path((unsigned long)all_image_infos.dyldPath);
+
+    sym_images_begin_update(debuggee->images, NULL);
+
+    int complete = 1;
+
+    if(add_image((unsigned long)all_image_infos.dyldImageLoadAddress,
+                dyldpath ? dyldpath : "/usr/lib/dyld")){
+        complete = 0;
+    }
+
+    free(dyldpath);
+
+    for(uint32_t i=0; i<all_image_infos.infoArrayCount; i++){
+        char *path = read_image_path((unsigned long)infos[i].imageFilePath);
+
+        if(!path){
+            complete = 0;
+            continue;
+        }
+
+        if(add_image((unsigned long)infos[i].imageLoadAddress, path))
+            complete = 0;
+
+        free(path);
+    }
+
+    free(infos);
+
+    /* If we missed an image, it isn't dropped, and the whole
+     * list is read again next time.
+     */
+    sym_images_end_update(debuggee->images, complete, NULL);
+
+    if(complete){
+        images_timestamp = all_image_infos.infoArrayChangeTimestamp;
+        images_count = all_image_infos.infoArrayCount;
+    }
+
+    return KERN_SUCCESS;
+}
+
+kern_return_t find_images(void){
+    pthread_mutex_lock(&images_lock);
+    kern_return_t err = find_images_locked();
+    pthread_mutex_unlock(&images_lock);
+
+    return err;
+}
+
 kern_return_t restore_exception_ports(void){
     for(mach_msg_type_number_t i=0;
             i<debuggee->original_exception_ports.count;
@@ -4,6 +4,7 @@
 #include <mach/mach.h>
 
 unsigned long find_slide(void);
+kern_return_t find_images(void);
 
 kern_return_t restore_exception_ports(void);
 kern_return_t resume(void);
@@ -44,6 +44,7 @@ static void interrupt(int x1){
 
 static void install_handlers(void){
     debuggee->find_slide = &find_slide;
+    debuggee->find_images = &find_images;
     debuggee->restore_exception_ports = &restore_exception_ports;
     debuggee->resume = &resume;
     debuggee->setup_exception_handling = &setup_exception_handling;
@@ -280,6 +281,8 @@ static void setup_initial_debuggee(void){
     debuggee->watchpoints = NULL;
     debuggee->threads = NULL;
 
+    debuggee->images = NULL;
+
     /* Figure out how many hardware breakpoints/watchpoints are supported. */
     size_t len = sizeof(int);
 
@@ -12,6 +12,8 @@
 #include "strext.h"
 #include "thread.h"
 
+#include "symbol/sym.h"
+
 /* Thanks https://opensource.apple.com/source/CF/CF-299/Base.subproj/CFByteOrder.h */
 unsigned int CFSwapInt32(unsigned int arg){
     unsigned int result;
@@ -31,6 +33,44 @@ unsigned long long CFSwapInt64(unsigned long long arg){
     return result.sv;
 }
 
+/* Appends where location is in the debuggee, like
+ * " App`main at main.c:12", or " libfoo.dylib + 0x1234" when there are no
+ * symbols for that image. Returns non-zero and appends nothing if
+ * location isn't inside any image.
+ */
+int describe_location(unsigned long location, char **outbuffer){
+    const char *imagename = NULL;
+    uint64_t offset = 0, lineno = 0;
+    char *function = NULL, *file = NULL;
+
+    /* The image name belongs to the image, which could be dropped
+     * by another thread.
+     */
+    sym_read_lock();
+
+    if(sym_symbolicate_address(debuggee->images, location, &imagename,
+                &offset, &function, &file, &lineno, NULL)){
+        sym_read_unlock();
+        return 1;
+    }
+
+    if(!function)
+        concat(outbuffer, " %s + %#llx", imagename, offset);
+    else if(!file)
+        concat(outbuffer, " %s`%s", imagename, function);
+    else{
+        concat(outbuffer, " %s`%s at %s:%llu", imagename, function,
+                file, lineno);
+    }
+
+    sym_read_unlock();
+
+    free(function);
+    free(file);
+
+    return 0;
+}
+
 kern_return_t disassemble_at_location(unsigned long location, int num_instrs,
         char **outbuffer){
     unsigned long current_location = location;
@@ -48,6 +88,14 @@ kern_return_t disassemble_at_location(unsigned long location, int num_instrs,
 
     enum { data_size = 4 };
 
+    /* Images are only looked for when something has to be symbolicated,
+     * not every time the debuggee stops. Anything loaded since the last
+     * time has to be known about to say which function we're in.
+     */
+    debuggee->find_images();
+
+    char *lastwhere = NULL;
+
     while(current_location < (location + (num_instrs * data_size))){
         uint8_t data[data_size];
 
@@ -60,6 +108,8 @@ kern_return_t disassemble_at_location(unsigned long location, int num_instrs,
                         location, mach_error_string(err));
             }
 
+            free(lastwhere);
+
             return err;
         }
 
@@ -86,6 +136,26 @@ kern_return_t disassemble_at_location(unsigned long location, int num_instrs,
         free(val);
         free(error);
 
+        /* Say which function we're in whenever it changes. */
+        char *where = NULL;
+
+        if(describe_location(current_location, &where) == 0){
+            char *function = strchr(where, '`');
+            char *at = function ? strstr(function, " at ") : NULL;
+
+            if(at)
+                *at = '\0';
+
+            if(!lastwhere || strcmp(where, lastwhere) != 0){
+                concat(outbuffer, "%s:\n", where + 1);
+
+                free(lastwhere);
+                lastwhere = strdup(where);
+            }
+
+            free(where);
+        }
+
         char *disassembled = ArmadilloDisassembleB(instr, current_location);
 
         struct machthread *focused = get_focused_thread();
@@ -94,6 +164,7 @@ kern_return_t disassemble_at_location(unsigned long location, int num_instrs,
 
         if(err){
             free(disassembled);
+            free(lastwhere);
             return KERN_FAILURE;
         }
 
@@ -106,6 +177,8 @@ kern_return_t disassemble_at_location(unsigned long location, int num_instrs,
         current_location += data_size;
     }
 
+    free(lastwhere);
+
     return KERN_SUCCESS;
 }
 
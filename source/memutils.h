@@ -6,6 +6,7 @@
 unsigned int CFSwapInt32(unsigned int);
 unsigned long long CFSwapInt64(unsigned long long);
 
+int describe_location(unsigned long, char **);
 kern_return_t disassemble_at_location(unsigned long, int, char **);
 kern_return_t dump_memory(unsigned long, vm_size_t, char **);
 kern_return_t read_memory_at_location(void *, void *, vm_size_t);
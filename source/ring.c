@@ -0,0 +1,85 @@
+#include <stdint.h>
+#include <stdlib.h>
+
+/* A bounded queue of pointers with one producer and one consumer,
+ * neither of which ever takes a lock or allocates. More than one
+ * thread can consume as long as they take turns.
+ */
+struct ring {
+    void **r_slots;
+    unsigned int r_mask;
+
+    /* Only the consumer writes r_head and only the producer writes
+     * r_tail. They're kept on different cache lines so the two
+     * threads don't fight over one.
+     */
+    _Alignas(64) uint64_t r_head;
+    _Alignas(64) uint64_t r_tail;
+};
+
+/* capacity is rounded up to a power of two */
+struct ring *ring_new(unsigned int capacity){
+    unsigned int size = 1;
+
+    while(size < capacity)
+        size <<= 1;
+
+    struct ring *r = aligned_alloc(64, sizeof(struct ring));
+
+    r->r_slots = calloc(size, sizeof(void *));
+    r->r_mask = size - 1;
+    r->r_head = 0;
+    r->r_tail = 0;
+
+    return r;
+}
+
+/* Producer only. Returns 1 if the ring is full. */
+int ring_push(struct ring *r, void *data){
+    uint64_t tail = __atomic_load_n(&r->r_tail, __ATOMIC_RELAXED);
+    uint64_t head = __atomic_load_n(&r->r_head, __ATOMIC_ACQUIRE);
+
+    if(tail - head > r->r_mask)
+        return 1;
+
+    r->r_slots[tail & r->r_mask] = data;
+
+    /* Whatever data points to is visible before the slot is. */
+    __atomic_store_n(&r->r_tail, tail + 1, __ATOMIC_SEQ_CST);
+
+    return 0;
+}
+
+/* Consumer only. Returns NULL if the ring is empty. */
+void *ring_pop(struct ring *r){
+    uint64_t head = __atomic_load_n(&r->r_head, __ATOMIC_RELAXED);
+    uint64_t tail = __atomic_load_n(&r->r_tail, __ATOMIC_ACQUIRE);
+
+    if(head == tail)
+        return NULL;
+
+    void *data = r->r_slots[head & r->r_mask];
+
+    __atomic_store_n(&r->r_head, head + 1, __ATOMIC_RELEASE);
+
+    return data;
+}
+
+/* Either side can ask, but the answer can go stale for the side
+ * which isn't changing it: the consumer can't trust "empty" and the
+ * producer can't trust "not empty".
+ */
+int ring_empty(struct ring *r){
+    uint64_t head = __atomic_load_n(&r->r_head, __ATOMIC_SEQ_CST);
+    uint64_t tail = __atomic_load_n(&r->r_tail, __ATOMIC_SEQ_CST);
+
+    return head == tail;
+}
+
+void ring_free(struct ring *r){
+    if(!r)
+        return;
+
+    free(r->r_slots);
+    free(r);
+}
@@ -0,0 +1,10 @@
+#ifndef _RING_H_
+#define _RING_H_
+
+struct ring *ring_new(unsigned int);
+int ring_push(struct ring *, void *);
+void *ring_pop(struct ring *);
+int ring_empty(struct ring *);
+void ring_free(struct ring *);
+
+#endif
@@ -1,157 +1,97 @@
 #include <errno.h>
 #include <mach/mach.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/event.h>
 #include <unistd.h>
 
+#include "breakpoint.h"
 #include "convvar.h"
 #include "dbgio.h"
 #include "dbgops.h"
 #include "debuggee.h"
 #include "exception.h"
+#include "excstats.h"
 #include "linkedlist.h"
-#include "queue.h"
+#include "ring.h"
 #include "servers.h"
 #include "strext.h"
 #include "thread.h"
 #include "trace.h"
 
 pthread_mutex_t EXCEPTION_QUEUE_MUTEX = PTHREAD_MUTEX_INITIALIZER;
-struct queue_t *EXCEPTION_QUEUE = NULL;
-int NEED_REPLY = 0;
-
 struct req {
     mach_msg_header_t hdr;
     char data[256];
-};
-
-static void *exception_server(void *arg){
-    pthread_setname_np("exception handling thread");
-
-    int will_auto_resume = 1;
-
-    EXCEPTION_QUEUE = queue_new();
-    struct queue_t *exc_queue_internal = queue_new();
-
-    while(MACH_PORT_VALID(debuggee->exception_port)){ 
-        struct req *req = malloc(sizeof(struct req));
-
-        /* Set a one second timeout so we can check if we need to
-         * shutdown this thread.
-         * For whatever reason, after deallocating this exception port,
-         * mach_msg doesn't return.
-         */
-        kern_return_t err = mach_msg(&(req->hdr),
-                MACH_RCV_MSG | MACH_RCV_TIMEOUT,
-                0,
-                sizeof(struct req),
-                debuggee->exception_port,
-                1000,
-                MACH_PORT_NULL);
-
-        if(err == MACH_RCV_TIMED_OUT){
-            free(req);
-            continue;
-        }
-
-        /* We got something, suspend debuggee execution. */
-        ops_suspend();
-
-        enqueue(exc_queue_internal, (Request *)req);
-
-        EXC_QUEUE_LOCK;
-        NEED_REPLY = 1;
-        enqueue(EXCEPTION_QUEUE, (Request *)req);
-        EXC_QUEUE_UNLOCK;
-
-        err = KERN_SUCCESS;
-
-        /* Gather up any more exceptions. */
-        while(err != MACH_RCV_TIMED_OUT){
-            req = malloc(sizeof(struct req));
-
-            err = mach_msg(&(req->hdr),
-                    MACH_RCV_MSG | MACH_RCV_TIMEOUT,
-                    0,
-                    sizeof(struct req),
-                    debuggee->exception_port,
-                    0,
-                    MACH_PORT_NULL);
-
-            if(err == KERN_SUCCESS){
-                enqueue(exc_queue_internal, (Request *)req);
-                
-                EXC_QUEUE_LOCK;
-                enqueue(EXCEPTION_QUEUE, (Request *)req);
-                EXC_QUEUE_UNLOCK;
-            }
-        }
-
-        /* Assume we need to automatically resume after this exception.
-         * If this flag is set to 0, it will never be set to 1 again.
-         */
-        will_auto_resume = 1;
-        char *exception_buffer = NULL;
-
-        Request *r = dequeue(exc_queue_internal);
 
-        while(r){
-            int should_auto_resume = 1, should_print = 1;
-            char *what = NULL;
-
-            handle_exception(r,
-                    &should_auto_resume,
-                    &should_print,
-                    &what);
-
-            if(will_auto_resume && !should_auto_resume)
-                will_auto_resume = 0;
-
-            if(should_print)
-                concat(&exception_buffer, "%s", what);
-
-            free(what);
-
-            r = dequeue(exc_queue_internal);
-        }
-
-        if(will_auto_resume)
-            ops_resume();
-
-        if(exception_buffer){
-            io_append("%s", exception_buffer);
-            free(exception_buffer);
-        }
-    }
-
-    queue_free(EXCEPTION_QUEUE);
-    queue_free(exc_queue_internal);
-
-    return NULL;
-}
-
-static void *death_server(void *arg){
-    pthread_setname_np("death event thread");
-
-    int kqid = *(int *)arg;
+    /* When this exception got to each point of its round trip */
+    struct excsample sample;
+};
 
-    struct kevent death_event;
+/* How many exception messages can be waiting on a reply at once. A
+ * thread can't raise another exception until its last one is replied
+ * to, so this is plenty. If it does run out, the rest wait in the
+ * kernel until some are replied to.
+ */
+#define EXC_POOL_SIZE 256
+
+/* Wakes the event loop up so it can shut itself down */
+static mach_port_t SERVERS_WAKEUP_PORT = MACH_PORT_NULL;
+
+/* Everything the event loop waits on. Exceptions, thread deaths, and
+ * wakeups all arrive on one port set, and the kqueue waits on that port
+ * set and on the debuggee exiting, so nothing is polled.
+ */
+struct servers {
+    mach_port_t portset;
+
+    /* Copies of the ports in the port set, since detaching
+     * forgets about them before the loop is done with them.
+     */
+    mach_port_t exception_port;
+    mach_port_t death_port;
+    mach_port_t wakeup_port;
+
+    int kqid;
+    pid_t pid;
+
+    /* Every exception message is received into a slot from here, so
+     * nothing is allocated while the debuggee is hitting breakpoints.
+     */
+    struct req *pool;
+
+    /* Slots the event loop can receive into, and exceptions which still
+     * need a reply, in the order they came in. The event loop is the
+     * only consumer of free_slots and the only producer of pending.
+     * Whoever replies is the other side of both, under EXC_QUEUE_LOCK.
+     */
+    struct ring *free_slots;
+    struct ring *pending;
+
+    /* A slot which was taken for a message which wasn't an exception */
+    struct req *spare;
+
+    /* Set while the port set isn't being watched because there
+     * were no free slots.
+     */
+    int starved;
+};
 
-    /* Provide a struct for the kernel to write to if any changes occur. */
-    int changes = kevent(kqid, NULL, 0, &death_event, 1, NULL);
+/* The event loop replies are given back to. Guarded by EXC_QUEUE_LOCK. */
+static struct servers *CUR_SERVERS = NULL;
 
+static void handle_death(struct servers *srv){
     /* Don't report if we detached earlier. */
-    if(debuggee->pid == -1){
-        free(arg);
-        pthread_exit(NULL);
-    }
+    if(debuggee->pid == -1)
+        return;
 
     wait_for_trace();
 
     /* Figure out how the debuggee exited. */
     int status;
-    waitpid(debuggee->pid, &status, 0);
+    waitpid(srv->pid, &status, 0);
 
     char *exitbuf = NULL, *error = NULL;
 
@@ -192,71 +132,519 @@ static void *death_server(void *arg){
 
     free(exitbuf);
     free(error);
+}
 
-    close(kqid);
+static void update_threads(void){
+    char *thbuffer = NULL;
 
-    free(arg);
+    ops_threadupdate(&thbuffer);
 
-    return NULL;
+    if(thbuffer){
+        io_append("%s", thbuffer);
+        free(thbuffer);
+    }
 }
 
-static void *thread_monitor_server(void *arg){
-    pthread_setname_np("thread monitor");
+static void handle_exceptions(struct req **batch, int nexc){
+    /* Assume we need to automatically resume after this exception.
+     * If this flag is set to 0, it will never be set to 1 again.
+     */
+    int will_auto_resume = 1;
+    char *exception_buffer = NULL;
 
-    while(MACH_PORT_VALID(THREAD_DEATH_NOTIFY_PORT)){
-        struct req *req = malloc(sizeof(struct req));
+    for(int i=0; i<nexc; i++){
+        Request *r = (Request *)batch[i];
+        int should_auto_resume = 1, should_print = 1;
+        char *what = NULL;
 
-        /* Update the list of threads every second or right
-         * after one goes away.
+        /* It's already pending, so it could be replied to while it's
+         * handled, and exception_release copies its sample. Both sides
+         * only touch the sample under EXC_QUEUE_LOCK.
          */
-        mach_msg(&(req->hdr),
-                MACH_RCV_MSG | MACH_RCV_TIMEOUT,
+        EXC_QUEUE_LOCK;
+        excstats_classify(&batch[i]->sample, r->exception,
+                ((long *)r->code)[0], ((long *)r->code)[1]);
+        excstats_stamp(&batch[i]->sample, EXCSTAMP_HANDLER_START);
+        EXC_QUEUE_UNLOCK;
+
+        handle_exception(r,
+                &should_auto_resume,
+                &should_print,
+                &what);
+
+        EXC_QUEUE_LOCK;
+        excstats_stamp(&batch[i]->sample, EXCSTAMP_HANDLER_END);
+        EXC_QUEUE_UNLOCK;
+
+        if(will_auto_resume && !should_auto_resume)
+            will_auto_resume = 0;
+
+        if(should_print)
+            concat(&exception_buffer, "%s", what);
+
+        free(what);
+    }
+
+    if(will_auto_resume)
+        ops_resume();
+
+    if(exception_buffer){
+        io_append("%s", exception_buffer);
+        free(exception_buffer);
+    }
+}
+
+static void watch_portset(struct servers *srv, int watch){
+    struct kevent kev;
+    EV_SET(&kev, srv->portset, EVFILT_MACHPORT, watch ? EV_ENABLE : EV_DISABLE,
+            0, 0, NULL);
+
+    kevent(srv->kqid, &kev, 1, NULL, 0, NULL);
+}
+
+static void unstarve(struct servers *srv){
+    int starved = 1;
+
+    /* Only whoever clears the flag starts watching again. */
+    if(__atomic_compare_exchange_n(&srv->starved, &starved, 0, 0,
+                __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)){
+        watch_portset(srv, 1);
+    }
+}
+
+/* Stop watching the port set until a slot is given back, otherwise
+ * the messages left in it would wake the event loop up over and over.
+ */
+static void starve(struct servers *srv){
+    watch_portset(srv, 0);
+
+    __atomic_store_n(&srv->starved, 1, __ATOMIC_SEQ_CST);
+
+    /* A slot could have been given back before the flag was set. */
+    if(!ring_empty(srv->free_slots))
+        unstarve(srv);
+}
+
+static struct req *get_slot(struct servers *srv){
+    struct req *req = srv->spare;
+
+    if(req){
+        srv->spare = NULL;
+        return req;
+    }
+
+    return ring_pop(srv->free_slots);
+}
+
+/* Breakpoint hits which shouldn't stop, because the condition is false
+ * or the hit is being ignored, and the single steps past them, are dealt
+ * with right here. Only the thread which hit one ever stopped, so nobody
+ * else hears about it. Returns non-zero if that's what this exception
+ * was, in which case req now holds the reply, for drain_ports to send.
+ */
+static int handle_without_stopping(struct req *req){
+    Request *r = (Request *)req;
+
+    long code = ((long *)r->code)[0];
+    long subcode = ((long *)r->code)[1];
+
+    mach_port_t thread = r->thread.name;
+    int brk = r->exception == EXC_BREAKPOINT && code == EXC_ARM_BREAKPOINT;
+
+    /* A thread which was stepping past a breakpoint and reports
+     * anything else didn't get past it.
+     */
+    if(!brk || subcode != 0)
+        breakpoint_cancel_skip(thread);
+
+    if(!brk)
+        return 0;
+
+    excstats_stamp(&req->sample, EXCSTAMP_HANDLER_START);
+
+    int handled = subcode == 0 ? breakpoint_finish_skip(thread) :
+        breakpoint_skip_quietly(thread, subcode);
+
+    if(!handled)
+        return 0;
+
+    excstats_stamp(&req->sample, EXCSTAMP_HANDLER_END);
+    excstats_classify(&req->sample, r->exception, code, subcode);
+
+    /* Nothing else is going to look at this message. */
+    mach_port_deallocate(mach_task_self(), r->thread.name);
+    mach_port_deallocate(mach_task_self(), r->task.name);
+
+    build_exception_reply(r, KERN_SUCCESS, (Reply *)req);
+
+    return 1;
+}
+
+/* Receive everything waiting on the port set. Returns non-zero if
+ * the loop was asked to stop.
+ */
+static int drain_ports(struct servers *srv){
+    struct req *batch[EXC_POOL_SIZE];
+    int nexc = 0, thread_died = 0, stop = 0;
+
+    /* A reply to an exception from handle_without_stopping is sent by
+     * the same mach_msg which receives the next message into its slot,
+     * so when threads keep hitting breakpoints they shouldn't stop at,
+     * each one costs a single trip into the kernel.
+     */
+    struct req *req = NULL;
+    int replying = 0;
+
+    while(1){
+        if(!req)
+            req = get_slot(srv);
+
+        if(!req){
+            starve(srv);
+            break;
+        }
+
+        mach_msg_option_t options = MACH_RCV_MSG | MACH_RCV_TIMEOUT;
+        mach_msg_size_t send_size = 0;
+
+        if(replying){
+            options |= MACH_SEND_MSG;
+            send_size = req->hdr.msgh_size;
+        }
+
+        kern_return_t err = mach_msg(&(req->hdr),
+                options,
+                send_size,
+                offsetof(struct req, sample),
+                srv->portset,
                 0,
-                sizeof(struct req),
-                THREAD_DEATH_NOTIFY_PORT,
-                1000,
                 MACH_PORT_NULL);
 
-        free(req);
+        if(replying){
+            replying = 0;
+
+            /* The receive only touches what comes before the sample. */
+            excstats_finish(&req->sample);
+
+            /* If the reply didn't go out, nothing was received either. */
+            if(err != MACH_MSG_SUCCESS && err < MACH_RCV_IN_PROGRESS){
+                mach_msg_destroy(&(req->hdr));
+                continue;
+            }
+        }
+
+        if(err)
+            break;
+
+        mach_port_t from = req->hdr.msgh_local_port;
+
+        if(from == srv->exception_port){
+            Request *r = (Request *)req;
+
+            excstats_begin(&req->sample);
+
+            if(handle_without_stopping(req)){
+                replying = 1;
+                continue;
+            }
+
+            /* We got something, suspend debuggee execution. */
+            if(nexc == 0)
+                ops_suspend();
+
+            excstats_stamp(&req->sample, EXCSTAMP_SUSPEND);
+
+            /* This can be replied to before it's handled. That's fine,
+             * since this thread is the only one which reuses slots.
+             *
+             * pending has room for every slot, so this can't fail. If
+             * it ever did, nobody would reply to this exception and its
+             * thread would be stuck for good, so let it go right away.
+             */
+            if(ring_push(srv->pending, req)){
+                io_append("warning: no room to queue an exception, letting"
+                        " it go\n");
+
+                mach_port_deallocate(mach_task_self(), r->thread.name);
+                mach_port_deallocate(mach_task_self(), r->task.name);
+
+                reply_to_exception(r, KERN_SUCCESS);
 
-        char *thbuffer = NULL;
-        
-        ops_threadupdate(&thbuffer);
+                if(nexc == 0)
+                    debuggee->resume();
 
-        if(thbuffer){
-            io_append("%s", thbuffer);
-            free(thbuffer);
+                continue;
+            }
+
+            batch[nexc++] = req;
+
+            req = NULL;
+
+            continue;
         }
+
+        if(from == srv->death_port)
+            thread_died = 1;
+        else if(from == srv->wakeup_port)
+            stop = 1;
+
+        mach_msg_destroy(&(req->hdr));
     }
-    
+
+    /* Whatever slot is left over holds nothing anyone needs. */
+    if(req)
+        srv->spare = req;
+
+    if(stop)
+        return 1;
+
+    /* Whichever thread caused an exception has to be known about
+     * to be given focus, so the list is brought up to date whenever
+     * the debuggee stops, not just when a thread goes away.
+     */
+    if(nexc > 0 || thread_died)
+        update_threads();
+
+    if(nexc > 0)
+        handle_exceptions(batch, nexc);
+
+    return 0;
+}
+
+static void servers_free(struct servers *srv){
+    if(srv->kqid != -1)
+        close(srv->kqid);
+
+    mach_port_t self = mach_task_self();
+
+    if(MACH_PORT_VALID(srv->portset))
+        mach_port_mod_refs(self, srv->portset, MACH_PORT_RIGHT_PORT_SET, -1);
+
+    if(MACH_PORT_VALID(srv->exception_port)){
+        mach_port_mod_refs(self, srv->exception_port,
+                MACH_PORT_RIGHT_RECEIVE, -1);
+    }
+
+    if(MACH_PORT_VALID(srv->death_port))
+        mach_port_mod_refs(self, srv->death_port, MACH_PORT_RIGHT_RECEIVE, -1);
+
+    if(MACH_PORT_VALID(srv->wakeup_port)){
+        mach_port_destroy(self, srv->wakeup_port);
+
+        if(SERVERS_WAKEUP_PORT == srv->wakeup_port)
+            SERVERS_WAKEUP_PORT = MACH_PORT_NULL;
+    }
+
+    EXC_QUEUE_LOCK;
+
+    if(CUR_SERVERS == srv)
+        CUR_SERVERS = NULL;
+
+    /* Anything still here came in after everything was replied to. */
+    struct req *req;
+
+    while(srv->pending && (req = ring_pop(srv->pending)))
+        mach_msg_destroy(&(req->hdr));
+
+    EXC_QUEUE_UNLOCK;
+
+    ring_free(srv->free_slots);
+    ring_free(srv->pending);
+    free(srv->pool);
+    free(srv);
+}
+
+static void *event_loop(void *arg){
+    pthread_setname_np("event loop");
+
+    struct servers *srv = arg;
+    int stop = 0;
+
+    while(!stop){
+        struct kevent events[2];
+
+        /* No timeout, this thread only wakes up when there's
+         * something for it to do.
+         */
+        int nevents = kevent(srv->kqid, NULL, 0, events, 2, NULL);
+
+        if(nevents == -1){
+            if(errno == EINTR)
+                continue;
+
+            break;
+        }
+
+        int died = 0;
+
+        for(int i=0; i<nevents; i++){
+            if(events[i].filter == EVFILT_PROC)
+                died = 1;
+        }
+
+        /* Anything the debuggee sent before it exited still
+         * has to be handled.
+         */
+        stop = drain_ports(srv);
+
+        if(died && !stop){
+            handle_death(srv);
+            stop = 1;
+        }
+    }
+
+    servers_free(srv);
+
     return NULL;
 }
 
+static int add_to_portset(struct servers *srv, mach_port_t port,
+        char **outbuffer){
+    if(!MACH_PORT_VALID(port))
+        return 0;
+
+    kern_return_t err = mach_port_move_member(mach_task_self(), port,
+            srv->portset);
+
+    if(err){
+        concat(outbuffer, "warning: could not watch port %#x: %s\n",
+                port, mach_error_string(err));
+    }
+
+    return err;
+}
+
 void setup_servers(char **outbuffer){
     debuggee->setup_exception_handling(outbuffer);
 
-    pthread_t exception_server_thread;
-    pthread_create(&exception_server_thread, NULL, exception_server, NULL);
+    struct servers *srv = calloc(1, sizeof(struct servers));
+
+    srv->kqid = -1;
+    srv->pid = debuggee->pid;
+
+    srv->pool = calloc(EXC_POOL_SIZE, sizeof(struct req));
+    srv->free_slots = ring_new(EXC_POOL_SIZE);
+    srv->pending = ring_new(EXC_POOL_SIZE);
+
+    for(int i=0; i<EXC_POOL_SIZE; i++){
+        if(ring_push(srv->free_slots, &srv->pool[i])){
+            concat(outbuffer, "warning: could not fill the exception"
+                    " pool\n");
+            servers_free(srv);
+            return;
+        }
+    }
+
+    mach_port_t self = mach_task_self();
+
+    kern_return_t err = mach_port_allocate(self, MACH_PORT_RIGHT_PORT_SET,
+            &srv->portset);
+
+    if(err){
+        concat(outbuffer, "warning: could not create port set: %s\n",
+                mach_error_string(err));
+        servers_free(srv);
+        return;
+    }
+
+    err = mach_port_allocate(self, MACH_PORT_RIGHT_RECEIVE,
+            &srv->wakeup_port);
 
-    int kqid = kqueue();
+    if(!err){
+        err = mach_port_insert_right(self, srv->wakeup_port, srv->wakeup_port,
+                MACH_MSG_TYPE_MAKE_SEND);
+    }
+
+    if(err){
+        concat(outbuffer, "warning: could not create wakeup port: %s\n",
+                mach_error_string(err));
+    }
+
+    srv->exception_port = debuggee->exception_port;
+    srv->death_port = THREAD_DEATH_NOTIFY_PORT;
 
-    if(kqid == -1)
+    add_to_portset(srv, srv->exception_port, outbuffer);
+    add_to_portset(srv, srv->death_port, outbuffer);
+    add_to_portset(srv, srv->wakeup_port, outbuffer);
+
+    srv->kqid = kqueue();
+
+    if(srv->kqid == -1){
         concat(outbuffer, "warning: could not create kernel event queue\n");
-    else{
-        struct kevent kev;
+        servers_free(srv);
+        return;
+    }
+
+    struct kevent kevs[2];
+
+    EV_SET(&kevs[0], srv->portset, EVFILT_MACHPORT, EV_ADD, 0, 0, NULL);
+    EV_SET(&kevs[1], srv->pid, EVFILT_PROC, EV_ADD, NOTE_EXIT, 0, NULL);
+
+    /* Tell the kernel to add these events to the monitored list. */
+    if(kevent(srv->kqid, kevs, 2, NULL, 0, NULL) == -1){
+        concat(outbuffer, "warning: could not watch for events: %s\n",
+                strerror(errno));
+    }
+
+    SERVERS_WAKEUP_PORT = srv->wakeup_port;
+
+    EXC_QUEUE_LOCK;
+    CUR_SERVERS = srv;
+    EXC_QUEUE_UNLOCK;
+
+    pthread_t event_loop_thread;
+    pthread_create(&event_loop_thread, NULL, event_loop, srv);
+}
+
+/* Tell the event loop to stop, without waiting for it to. Safe to call
+ * from the event loop itself.
+ */
+void stop_servers(void){
+    mach_port_t port = SERVERS_WAKEUP_PORT;
+
+    if(!MACH_PORT_VALID(port))
+        return;
+
+    SERVERS_WAKEUP_PORT = MACH_PORT_NULL;
+
+    mach_msg_header_t msg = {0};
+
+    msg.msgh_bits = MACH_MSGH_BITS(MACH_MSG_TYPE_COPY_SEND, 0);
+    msg.msgh_size = sizeof(msg);
+    msg.msgh_remote_port = port;
+
+    mach_msg(&msg, MACH_SEND_MSG | MACH_SEND_TIMEOUT, sizeof(msg), 0,
+            MACH_PORT_NULL, 0, MACH_PORT_NULL);
+}
+
+/* The oldest exception which hasn't been replied to yet, or NULL.
+ * Call with EXC_QUEUE_LOCK held.
+ */
+void *exception_dequeue(void){
+    if(!CUR_SERVERS)
+        return NULL;
+
+    return ring_pop(CUR_SERVERS->pending);
+}
 
-        EV_SET(&kev, debuggee->pid, EVFILT_PROC, EV_ADD, NOTE_EXIT, 0, NULL);
+/* Give back an exception from exception_dequeue after replying to it.
+ * Call with EXC_QUEUE_LOCK held.
+ */
+void exception_release(void *request){
+    struct servers *srv = CUR_SERVERS;
 
-        /* Tell the kernel to add this event to the monitored list. */
-        kevent(kqid, &kev, 1, NULL, 0, NULL);
+    if(!srv || !request)
+        return;
 
-        int *intptr = malloc(sizeof(int));
-        *intptr = kqid;
+    excstats_replied(&((struct req *)request)->sample);
 
-        pthread_t death_server_thread;
-        pthread_create(&death_server_thread, NULL, death_server, intptr);
+    /* There's room for every slot, so this only fails if request was
+     * given back twice. It's already in there then, so nothing is lost.
+     */
+    if(ring_push(srv->free_slots, request)){
+        io_append("warning: exception %p was given back twice\n", request);
+        return;
     }
 
-    pthread_t tmon_thread;
-    pthread_create(&tmon_thread, NULL, thread_monitor_server, NULL);
+    unstarve(srv);
 }
@@ -0,0 +1,161 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ARENA_CHUNK_SZ (64 * 1024)
+#define ARENA_ALIGN (sizeof(void *) * 2)
+
+struct arena_chunk {
+    struct arena_chunk *ac_next;
+    size_t ac_size;
+    size_t ac_used;
+    /* Keep ac_data aligned the same way malloc would */
+    uint64_t ac_data[];
+};
+
+/* A bump allocator. Memory is handed out from the front of the newest
+ * chunk, and nothing is freed until the whole arena is, so freeing
+ * everything allocated from it only walks the chunk list.
+ *
+ * Passing a NULL arena to arena_alloc, arena_calloc, or arena_strdup
+ * falls back to the heap, and that memory must be freed as usual.
+ */
+struct arena {
+    struct arena_chunk *ar_chunks;
+
+    /* How many allocations were made, how many bytes they asked
+     * for, and how many bytes were reserved for them.
+     */
+    size_t ar_nallocs;
+    size_t ar_bytesinuse;
+    size_t ar_bytesreserved;
+    size_t ar_nchunks;
+};
+
+struct arena *arena_new(void){
+    return calloc(1, sizeof(struct arena));
+}
+
+static struct arena_chunk *arena_new_chunk(struct arena *ar, size_t atleast){
+    size_t sz = ARENA_CHUNK_SZ;
+
+    /* Something too big for a normal chunk gets a chunk to itself */
+    if(atleast > sz)
+        sz = atleast;
+
+    struct arena_chunk *ac = malloc(sizeof(struct arena_chunk) + sz);
+
+    if(!ac)
+        return NULL;
+
+    ac->ac_size = sz;
+    ac->ac_used = 0;
+
+    /* Oversized chunks go behind the current one so what's left
+     * of the current one can still be used.
+     */
+    if(sz > ARENA_CHUNK_SZ && ar->ar_chunks){
+        ac->ac_next = ar->ar_chunks->ac_next;
+        ar->ar_chunks->ac_next = ac;
+    }
+    else{
+        ac->ac_next = ar->ar_chunks;
+        ar->ar_chunks = ac;
+    }
+
+    ar->ar_bytesreserved += sz;
+    ar->ar_nchunks++;
+
+    return ac;
+}
+
+void *arena_alloc(struct arena *ar, size_t sz){
+    if(!ar)
+        return malloc(sz);
+
+    size_t alignedsz = (sz + (ARENA_ALIGN - 1)) & ~(ARENA_ALIGN - 1);
+
+    if(alignedsz == 0)
+        alignedsz = ARENA_ALIGN;
+
+    struct arena_chunk *ac = ar->ar_chunks;
+
+    if(!ac || ac->ac_size - ac->ac_used < alignedsz){
+        ac = arena_new_chunk(ar, alignedsz);
+
+        if(!ac)
+            return NULL;
+    }
+
+    void *p = (uint8_t *)ac->ac_data + ac->ac_used;
+    ac->ac_used += alignedsz;
+
+    ar->ar_nallocs++;
+    ar->ar_bytesinuse += sz;
+
+    return p;
+}
+
+void *arena_calloc(struct arena *ar, size_t cnt, size_t sz){
+    if(!ar)
+        return calloc(cnt, sz);
+
+    void *p = arena_alloc(ar, cnt * sz);
+
+    if(p)
+        memset(p, 0, cnt * sz);
+
+    return p;
+}
+
+char *arena_strdup(struct arena *ar, const char *str){
+    if(!str)
+        return NULL;
+
+    if(!ar)
+        return strdup(str);
+
+    size_t len = strlen(str) + 1;
+    char *s = arena_alloc(ar, len);
+
+    if(s)
+        memcpy(s, str, len);
+
+    return s;
+}
+
+/* Adds to what the out parameters already hold, so the totals for
+ * many arenas can be collected.
+ */
+void arena_get_stats(struct arena *ar, size_t *nallocs, size_t *bytesinuse,
+        size_t *bytesreserved, size_t *nchunks){
+    if(!ar)
+        return;
+
+    if(nallocs)
+        *nallocs += ar->ar_nallocs;
+
+    if(bytesinuse)
+        *bytesinuse += ar->ar_bytesinuse;
+
+    if(bytesreserved)
+        *bytesreserved += ar->ar_bytesreserved;
+
+    if(nchunks)
+        *nchunks += ar->ar_nchunks;
+}
+
+void arena_free(struct arena *ar){
+    if(!ar)
+        return;
+
+    struct arena_chunk *ac = ar->ar_chunks;
+
+    while(ac){
+        struct arena_chunk *next = ac->ac_next;
+        free(ac);
+        ac = next;
+    }
+
+    free(ar);
+}
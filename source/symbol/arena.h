@@ -0,0 +1,11 @@
+#ifndef _ARENA_H_
+#define _ARENA_H_
+
+void *arena_new(void);
+void *arena_alloc(void *, size_t);
+void *arena_calloc(void *, size_t, size_t);
+char *arena_strdup(void *, const char *);
+void arena_get_stats(void *, size_t *, size_t *, size_t *, size_t *);
+void arena_free(void *);
+
+#endif
@@ -1,18 +1,104 @@
 #ifndef _COMMON_H_
 #define _COMMON_H_
 
+#include <pthread.h>
+
 #include <libdwarf.h>
 
 typedef struct {
     /* Our DWARF file */
     int di_fd;
 
+    /* The DWARF file mapped by dwarfobj_new, which di_dbg and the
+     * loader threads' handles read from. NULL if it couldn't be mapped,
+     * in which case libdwarf reads di_fd itself.
+     */
+    void *di_dwarfobj;
+
     Dwarf_Debug di_dbg;
 
     struct linkedlist *di_compunits;
     int di_numcompunits;
+
+    /* Compilation units in .debug_info order, and the offsets
+     * of their root DIEs.
+     */
+    void **di_cus;
+    uint64_t *di_curootoffs;
+
+    /* Sorted, non-overlapping address ranges, each mapped to
+     * the compilation unit which covers it.
+     */
+    void *di_curanges;
+
+    /* Maps names to the DIEs with those names */
+    void *di_nameidx;
+
+    /* Types which are identical across compilation units, stored once */
+    void *di_typereg;
+
+    /* The mapped symbol cache this was loaded from, if any. Line tables
+     * and the name index can point into it.
+     */
+    void *di_symcache;
+
+    /* If non-zero, a compilation unit's DIE tree is not built
+     * until something asks for its root DIE.
+     */
+    int di_lazy;
+
+    /* When lazily loading, once the DIE trees which have been built take
+     * up more than di_membudget bytes, the trees of the least recently
+     * used compilation units are freed. Zero means no limit.
+     */
+    size_t di_membudget;
+    size_t di_memused;
+    uint64_t di_usetick;
+
+    /* libdwarf isn't thread safe, so only one thread at a time can
+     * build or evict a DIE tree. Everything else is only read once it's
+     * loaded, and DIE trees are published and retired with RCU, so
+     * queries never take this.
+     */
+    pthread_mutex_t di_buildlock;
+
+    /* Handles opened by loader threads, which DIE trees they
+     * built still reference. When di_dwarfobj is set, the handles
+     * share its mapping and the descriptors are -1.
+     */
+    int *di_workerfds;
+    Dwarf_Debug *di_workerdbgs;
+    int di_numworkers;
 } dwarfinfo_t;
 
+/* [pr_lowpc, pr_highpc) */
+struct pcrange {
+    uint64_t pr_lowpc;
+    uint64_t pr_highpc;
+};
+
+/* Which function [fr_lowpc, fr_highpc) belongs to. If that's inlined
+ * code, this is the function it was inlined into.
+ */
+struct fxnrange {
+    uint64_t fr_lowpc;
+    uint64_t fr_highpc;
+    uint64_t fr_dieoffset;
+    const char *fr_name;
+};
+
+/* Everything resolving a type figures out, except array dimensions */
+struct typesummary {
+    uint64_t ts_dieoffset;
+    uint64_t ts_basedieoffset;
+    uint64_t ts_bytesize;
+    uint64_t ts_arrmembsz;
+    const char *ts_name;
+    unsigned short ts_tag;
+    unsigned short ts_encoding;
+    unsigned int ts_class;
+};
+
 #define dprintf(fmt, ...) do { \
     printf("%s:%s:%d: " fmt, __FILE__, __func__, __LINE__, ##__VA_ARGS__); \
     } while(0)
@@ -68,4 +154,36 @@ enum {
     LOCATION_LIST_ENTRY_SPLIT
 };
 
+/* High level data type classification */
+enum {
+    DTC_POINTER =           (1 << 0),
+    DTC_STRUCT =            (1 << 1),
+    DTC_UNION =             (1 << 2),
+    DTC_ARRAY =             (1 << 3),
+    DTC_OTHER =             (1 << 4)
+};
+
+/* What each piece of an evaluated location description is */
+enum {
+    LOCPROG_MEMORY = 0,
+    LOCPROG_REGISTER,
+    LOCPROG_VALUE,
+    LOCPROG_UNDEFINED
+};
+
+/* Line table row flags */
+enum {
+    LINETAB_IS_STMT = (1 << 0),
+    LINETAB_END_SEQUENCE = (1 << 1),
+    LINETAB_PROLOGUE_END = (1 << 2)
+};
+
+/* One row of a decoded line program, before it's put in a line table */
+struct linetab_row {
+    uint64_t lr_addr;
+    uint32_t lr_line;
+    uint16_t lr_fileidx;
+    uint16_t lr_flags;
+};
+
 #endif
@@ -1,6 +1,9 @@
+#include <fcntl.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #include <libdwarf.h>
 
@@ -8,7 +11,12 @@
 
 #include "common.h"
 #include "die.h"
+#include "dwarfobj.h"
+#include "linetab.h"
+#include "rangetab.h"
+#include "symcache.h"
 #include "symerr.h"
+#include "typereg.h"
 
 typedef struct {
     Dwarf_Unsigned cu_header_len;
@@ -17,6 +25,32 @@ typedef struct {
     Dwarf_Unsigned cu_next_header_offset;
 
     void *cu_root_die;
+
+    /* The dwarfinfo this compilation unit belongs to */
+    dwarfinfo_t *cu_dwarfinfo;
+
+    /* The Dwarf_Debug the DIE tree was built with. This is only
+     * different from di_dbg if the tree was built by a loader thread.
+     */
+    Dwarf_Debug cu_dbg;
+
+    /* Whether or not the DIE tree under cu_root_die has been built,
+     * how big it is, and when it was last asked for.
+     */
+    int cu_built;
+    size_t cu_treesize;
+    uint64_t cu_lastuse;
+
+    /* This compilation unit's flattened line table inside the
+     * symbol cache, if it was loaded from one.
+     */
+    const void *cu_cachedlinetab;
+    size_t cu_cachedlinetablen;
+
+    /* The line table above, opened the first time something is
+     * symbolicated without building the DIE tree.
+     */
+    void *cu_cachedlinetabview;
 } compunit_t;
 
 int cu_display_compilation_units(dwarfinfo_t *dwarfinfo, sym_error_t *e){
@@ -48,6 +82,66 @@ int cu_display_compilation_units(dwarfinfo_t *dwarfinfo, sym_error_t *e){
     return 0;
 }
 
+/* Totals for the arenas of every compilation unit whose DIE tree
+ * is currently built.
+ */
+int cu_get_allocation_stats(dwarfinfo_t *dwarfinfo, size_t *nallocs,
+        size_t *bytesinuse, size_t *bytesreserved, size_t *nchunks,
+        sym_error_t *e){
+    if(!dwarfinfo){
+        errset(e, GENERIC_ERROR_KIND, GE_INVALID_DWARFINFO);
+        return 1;
+    }
+
+    *nallocs = *bytesinuse = *bytesreserved = *nchunks = 0;
+
+    LL_FOREACH(dwarfinfo->di_compunits, current){
+        compunit_t *cu = current->data;
+
+        if(!cu->cu_built)
+            continue;
+
+        die_get_allocation_stats(cu->cu_root_die, nallocs, bytesinuse,
+                bytesreserved, nchunks, NULL);
+    }
+
+    return 0;
+}
+
+int cu_display_allocation_stats(dwarfinfo_t *dwarfinfo, sym_error_t *e){
+    size_t nallocs = 0, bytesinuse = 0, bytesreserved = 0, nchunks = 0;
+
+    if(cu_get_allocation_stats(dwarfinfo, &nallocs, &bytesinuse,
+                &bytesreserved, &nchunks, e)){
+        return 1;
+    }
+
+    int built = 0;
+
+    LL_FOREACH(dwarfinfo->di_compunits, current){
+        compunit_t *cu = current->data;
+        built += cu->cu_built;
+    }
+
+    printf("DIE tree allocations for %d/%d compilation units:\n"
+            "\tallocations: %zu\n"
+            "\tbytes in use: %zu\n"
+            "\tbytes reserved: %zu\n"
+            "\tchunks: %zu\n",
+            built, dwarfinfo->di_numcompunits, nallocs, bytesinuse,
+            bytesreserved, nchunks);
+
+    int ntypes = 0, nmerged = 0;
+    typereg_get_stats(dwarfinfo->di_typereg, &ntypes, &nmerged);
+
+    printf("Types shared across compilation units:\n"
+            "\tdistinct types: %d\n"
+            "\tduplicates merged: %d\n",
+            ntypes, nmerged);
+
+    return 0;
+}
+
 int cu_find_compilation_unit_by_name(dwarfinfo_t *dwarfinfo,
         compunit_t **cuout, char *name, sym_error_t *e){
     if(!dwarfinfo){
@@ -88,21 +182,15 @@ int cu_find_compilation_unit_by_pc(dwarfinfo_t *dwarfinfo,
         return 1;
     }
 
-    LL_FOREACH(dwarfinfo->di_compunits, current){
-        compunit_t *cu = current->data;
+    compunit_t *cu = rangetab_lookup(dwarfinfo->di_curanges, pc);
 
-        Dwarf_Unsigned lpc = 0, hpc = 0;
-        die_get_low_pc(cu->cu_root_die, &lpc, NULL);
-        die_get_high_pc(cu->cu_root_die, &hpc, NULL);
-        
-        if(pc >= lpc && pc < hpc){
-            *cuout = cu;
-            return 0;
-        }
+    if(!cu){
+        errset(e, CU_ERROR_KIND, CU_CU_NOT_FOUND);
+        return 1;
     }
 
-    errset(e, CU_ERROR_KIND, CU_CU_NOT_FOUND);
-    return 1;
+    *cuout = cu;
+    return 0;
 }
 
 int cu_free(compunit_t *cu, sym_error_t *e){
@@ -111,12 +199,134 @@ int cu_free(compunit_t *cu, sym_error_t *e){
         return 1;
     }
 
+    die_tree_free(cu->cu_dbg, cu->cu_root_die, 0);
     free(cu->cu_root_die);
+    linetab_free(cu->cu_cachedlinetabview);
     free(cu);
 
     return 0;
 }
 
+int cu_get_cached_linetab(compunit_t *cu, const void **linetabout,
+        size_t *lenout, sym_error_t *e){
+    if(!cu){
+        errset(e, GENERIC_ERROR_KIND, GE_INVALID_CU_POINTER);
+        return 1;
+    }
+
+    *linetabout = cu->cu_cachedlinetab;
+    *lenout = cu->cu_cachedlinetablen;
+    return 0;
+}
+
+/* Say where pc is using only the symbol cache, so symbolicating an
+ * address doesn't build the DIE tree it's in. Fails if there's no cache
+ * or it doesn't know about pc.
+ */
+int cu_get_line_info_from_cache(compunit_t *cu, uint64_t pc,
+        char **srcfilename, char **srcfunction, uint64_t *srclineno,
+        sym_error_t *e){
+    if(!cu){
+        errset(e, GENERIC_ERROR_KIND, GE_INVALID_CU_POINTER);
+        return 1;
+    }
+
+    struct fxnrange fr = {0};
+
+    if(!cu->cu_cachedlinetab ||
+            symcache_find_function(cu->cu_dwarfinfo->di_symcache, pc, &fr)){
+        errset(e, DIE_ERROR_KIND, DIE_COULD_NOT_GET_LINE_INFO);
+        return 1;
+    }
+
+    void *linetab = __atomic_load_n(&cu->cu_cachedlinetabview,
+            __ATOMIC_ACQUIRE);
+
+    if(!linetab){
+        void *expected = NULL;
+
+        linetab = linetab_new_from_flat(cu->cu_cachedlinetab,
+                cu->cu_cachedlinetablen);
+
+        /* Someone else could be doing the same thing */
+        if(linetab && !__atomic_compare_exchange_n(&cu->cu_cachedlinetabview,
+                    &expected, linetab, 0, __ATOMIC_ACQ_REL,
+                    __ATOMIC_ACQUIRE)){
+            linetab_free(linetab);
+            linetab = expected;
+        }
+    }
+
+    /* pc does not have to be the start of a line */
+    int row = linetab ? linetab_find_row(linetab, pc, 0) : -1;
+
+    if(row == -1){
+        errset(e, DIE_ERROR_KIND, DIE_COULD_NOT_GET_LINE_INFO);
+        return 1;
+    }
+
+    char *fname = NULL;
+    linetab_get_row(linetab, row, NULL, srclineno, &fname, NULL);
+
+    /* We are only interested in the file name */
+    char *slash = strrchr(fname, '/');
+
+    *srcfilename = strdup(slash ? slash + 1 : fname);
+    *srcfunction = strdup(fr.fr_name);
+
+    return 0;
+}
+
+int cu_get_dbg(compunit_t *cu, Dwarf_Debug *dbgout, sym_error_t *e){
+    if(!cu){
+        errset(e, GENERIC_ERROR_KIND, GE_INVALID_CU_POINTER);
+        return 1;
+    }
+
+    *dbgout = cu->cu_dbg;
+    return 0;
+}
+
+int cu_get_dwarfinfo(compunit_t *cu, dwarfinfo_t **dwarfinfoout,
+        sym_error_t *e){
+    if(!cu){
+        errset(e, GENERIC_ERROR_KIND, GE_INVALID_CU_POINTER);
+        return 1;
+    }
+
+    *dwarfinfoout = cu->cu_dwarfinfo;
+    return 0;
+}
+
+/* Get the line table without building the DIE tree. See
+ * die_get_cu_linetab.
+ */
+int cu_get_linetab(compunit_t *cu, void **linetabout, int *ownedout,
+        sym_error_t *e){
+    if(!cu){
+        errset(e, GENERIC_ERROR_KIND, GE_INVALID_CU_POINTER);
+        return 1;
+    }
+
+    return die_get_cu_linetab(cu->cu_dwarfinfo, cu->cu_root_die, linetabout,
+            ownedout, e);
+}
+
+int cu_get_header_info(compunit_t *cu, Dwarf_Unsigned *headerlen,
+        Dwarf_Unsigned *abbrevoffset, Dwarf_Half *addrsize,
+        Dwarf_Unsigned *nextheaderoffset, sym_error_t *e){
+    if(!cu){
+        errset(e, GENERIC_ERROR_KIND, GE_INVALID_CU_POINTER);
+        return 1;
+    }
+
+    *headerlen = cu->cu_header_len;
+    *abbrevoffset = cu->cu_abbrev_offset;
+    *addrsize = cu->cu_address_size;
+    *nextheaderoffset = cu->cu_next_header_offset;
+    return 0;
+}
+
 int cu_get_address_size(compunit_t *cu, Dwarf_Half *addrsize,
         sym_error_t *e){
     if(!cu){
@@ -128,16 +338,248 @@ int cu_get_address_size(compunit_t *cu, Dwarf_Half *addrsize,
     return 0;
 }
 
+/* Free the DIE trees of the least recently used compilation units until
+ * we're back under the memory budget. keep is never evicted. The caller
+ * must hold di_buildlock.
+ */
+void cu_evict_cold_compilation_units(dwarfinfo_t *dwarfinfo,
+        compunit_t *keep){
+    if(!dwarfinfo || !dwarfinfo->di_lazy || dwarfinfo->di_membudget == 0)
+        return;
+
+    while(dwarfinfo->di_memused > dwarfinfo->di_membudget){
+        compunit_t *coldest = NULL;
+
+        LL_FOREACH(dwarfinfo->di_compunits, current){
+            compunit_t *cu = current->data;
+
+            if(cu == keep || !cu->cu_built)
+                continue;
+
+            if(!coldest || cu->cu_lastuse < coldest->cu_lastuse)
+                coldest = cu;
+        }
+
+        if(!coldest)
+            return;
+
+        /* Readers still inside this tree keep it until they're done */
+        __atomic_store_n(&coldest->cu_built, 0, __ATOMIC_RELEASE);
+        die_tree_free_children(dwarfinfo->di_dbg, coldest->cu_root_die);
+
+        dwarfinfo->di_memused -= coldest->cu_treesize;
+
+        coldest->cu_treesize = 0;
+    }
+}
+
+static int cu_build_die_tree(compunit_t *cu, sym_error_t *e){
+    dwarfinfo_t *dwarfinfo = cu->cu_dwarfinfo;
+
+    if(die_build_cu_tree(dwarfinfo, cu, cu->cu_root_die, e))
+        return 1;
+
+    cu->cu_treesize = die_tree_size(cu->cu_root_die);
+    __atomic_store_n(&cu->cu_built, 1, __ATOMIC_RELEASE);
+
+    dwarfinfo->di_memused += cu->cu_treesize;
+
+    return 0;
+}
+
+/* When lazily loading, the DIE tree is built here the first
+ * time it's needed. DIEs from compilation units evicted to make room
+ * for this one are no longer valid once the caller's read section ends.
+ * If the tree is already built, no lock is taken.
+ */
 int cu_get_root_die(compunit_t *cu, void **dieout, sym_error_t *e){
     if(!cu){
         errset(e, GENERIC_ERROR_KIND, GE_INVALID_CU_POINTER);
         return 1;
     }
 
+    dwarfinfo_t *dwarfinfo = cu->cu_dwarfinfo;
+
+    if(!__atomic_load_n(&cu->cu_built, __ATOMIC_ACQUIRE)){
+        pthread_mutex_lock(&dwarfinfo->di_buildlock);
+
+        /* Someone else could have built it while we waited */
+        if(!cu->cu_built){
+            if(cu_build_die_tree(cu, e)){
+                pthread_mutex_unlock(&dwarfinfo->di_buildlock);
+                return 1;
+            }
+
+            cu_evict_cold_compilation_units(dwarfinfo, cu);
+        }
+
+        pthread_mutex_unlock(&dwarfinfo->di_buildlock);
+    }
+
+    /* Only a hint for eviction, so it doesn't matter if two
+     * threads race here.
+     */
+    uint64_t tick = __atomic_add_fetch(&dwarfinfo->di_usetick, 1,
+            __ATOMIC_RELAXED);
+    __atomic_store_n(&cu->cu_lastuse, tick, __ATOMIC_RELAXED);
+
     *dieout = cu->cu_root_die;
     return 0;
 }
 
+/* Compilation units are added in the order they appear in .debug_info,
+ * so they are already sorted by root DIE offset.
+ */
+static void cu_build_offset_index(dwarfinfo_t *dwarfinfo){
+    int cnt = dwarfinfo->di_numcompunits;
+
+    dwarfinfo->di_cus = malloc(sizeof(void *) * (cnt + 1));
+    dwarfinfo->di_curootoffs = malloc(sizeof(uint64_t) * (cnt + 1));
+
+    int idx = 0;
+
+    LL_FOREACH(dwarfinfo->di_compunits, current){
+        compunit_t *cu = current->data;
+
+        dwarfinfo->di_cus[idx] = cu;
+        die_get_offset(cu->cu_root_die, &dwarfinfo->di_curootoffs[idx], NULL);
+
+        idx++;
+    }
+}
+
+/* Index into di_cus of the compilation unit whose root DIE is at
+ * offset dieoff, or -1.
+ */
+static int cu_index_by_root_die_offset(dwarfinfo_t *dwarfinfo,
+        uint64_t dieoff){
+    int lo = 0, hi = dwarfinfo->di_numcompunits - 1;
+
+    while(lo <= hi){
+        int mid = lo + ((hi - lo) / 2);
+        uint64_t off = dwarfinfo->di_curootoffs[mid];
+
+        if(off == dieoff)
+            return mid;
+        else if(off < dieoff)
+            lo = mid + 1;
+        else
+            hi = mid - 1;
+    }
+
+    return -1;
+}
+
+int cu_find_compilation_unit_by_die_offset(dwarfinfo_t *dwarfinfo,
+        compunit_t **cuout, uint64_t dieoff, sym_error_t *e){
+    if(!dwarfinfo){
+        errset(e, GENERIC_ERROR_KIND, GE_INVALID_DWARFINFO);
+        return 1;
+    }
+
+    if(!cuout){
+        errset(e, GENERIC_ERROR_KIND, GE_INVALID_PARAMETER);
+        return 1;
+    }
+
+    int idx = cu_index_by_root_die_offset(dwarfinfo, dieoff);
+
+    if(idx == -1){
+        errset(e, CU_ERROR_KIND, CU_CU_NOT_FOUND);
+        return 1;
+    }
+
+    *cuout = dwarfinfo->di_cus[idx];
+    return 0;
+}
+
+/* Build the sorted table used to look up a compilation unit by PC.
+ * .debug_aranges is preferred. Any compilation unit not described
+ * there falls back to the DW_AT_ranges or DW_AT_low_pc/DW_AT_high_pc
+ * of its root DIE.
+ */
+static void cu_build_range_index(dwarfinfo_t *dwarfinfo){
+    dwarfinfo->di_curanges = rangetab_new();
+
+    int cnt = dwarfinfo->di_numcompunits;
+
+    if(cnt == 0){
+        rangetab_finalize(dwarfinfo->di_curanges);
+        return;
+    }
+
+    compunit_t **cus = (compunit_t **)dwarfinfo->di_cus;
+    int *covered = calloc(cnt, sizeof(int));
+
+    Dwarf_Debug dbg = dwarfinfo->di_dbg;
+    Dwarf_Arange *aranges = NULL;
+    Dwarf_Signed arangecnt = 0;
+    Dwarf_Error d_error = NULL;
+
+    int ret = dwarf_get_aranges(dbg, &aranges, &arangecnt, &d_error);
+
+    if(ret == DW_DLV_ERROR)
+        dwarf_dealloc(dbg, d_error, DW_DLA_ERROR);
+
+    if(ret == DW_DLV_OK){
+        for(Dwarf_Signed i=0; i<arangecnt; i++){
+            Dwarf_Unsigned seg = 0, segentsz = 0, len = 0;
+            Dwarf_Addr start = 0;
+            Dwarf_Off cudieoff = 0;
+
+            ret = dwarf_get_arange_info_b(aranges[i], &seg, &segentsz,
+                    &start, &len, &cudieoff, &d_error);
+
+            if(ret == DW_DLV_ERROR)
+                dwarf_dealloc(dbg, d_error, DW_DLA_ERROR);
+
+            if(ret == DW_DLV_OK && len > 0){
+                int which = cu_index_by_root_die_offset(dwarfinfo, cudieoff);
+
+                if(which != -1){
+                    rangetab_add(dwarfinfo->di_curanges, start, start + len,
+                            cus[which]);
+                    covered[which] = 1;
+                }
+            }
+
+            dwarf_dealloc(dbg, aranges[i], DW_DLA_ARANGE);
+        }
+
+        dwarf_dealloc(dbg, aranges, DW_DLA_LIST);
+    }
+
+    for(int i=0; i<cnt; i++){
+        if(covered[i])
+            continue;
+
+        void *root_die = cus[i]->cu_root_die;
+
+        struct pcrange *ranges = NULL;
+        int rangescnt = 0;
+        die_get_ranges(root_die, (void **)&ranges, &rangescnt, NULL);
+
+        if(rangescnt > 0){
+            for(int j=0; j<rangescnt; j++){
+                rangetab_add(dwarfinfo->di_curanges, ranges[j].pr_lowpc,
+                        ranges[j].pr_highpc, cus[i]);
+            }
+
+            continue;
+        }
+
+        Dwarf_Unsigned lpc = 0, hpc = 0;
+        die_get_low_pc(root_die, &lpc, NULL);
+        die_get_high_pc(root_die, &hpc, NULL);
+
+        rangetab_add(dwarfinfo->di_curanges, lpc, hpc, cus[i]);
+    }
+
+    rangetab_finalize(dwarfinfo->di_curanges);
+
+    free(covered);
+}
+
 int cu_load_compilation_units(dwarfinfo_t *dwarfinfo, sym_error_t *e){
     for(;;){
         compunit_t *cu = calloc(1, sizeof(compunit_t));
@@ -162,21 +604,332 @@ int cu_load_compilation_units(dwarfinfo_t *dwarfinfo, sym_error_t *e){
 
         if(ret == DW_DLV_NO_ENTRY){
             free(cu);
-            return 0;
+            break;
+        }
+
+        cu->cu_dwarfinfo = dwarfinfo;
+        cu->cu_dbg = dwarfinfo->di_dbg;
+
+        /* Lazily loaded compilation units only get their root DIE,
+         * which is enough to find them by name or by PC.
+         */
+        void *root_die = NULL;
+        if(dwarfinfo->di_lazy)
+            ret = die_create_cu_root_die(dwarfinfo, cu, &root_die, e);
+        else{
+            ret = initialize_and_build_die_tree_from_root_die(dwarfinfo, cu,
+                    &root_die, e);
         }
 
+        if(ret){
+            free(cu);
+            return 1;
+        }
+
+        cu->cu_root_die = root_die;
+        cu->cu_built = !dwarfinfo->di_lazy;
+
+        linkedlist_add(dwarfinfo->di_compunits, cu);
+
+        dwarfinfo->di_numcompunits++;
+    }
+
+    cu_build_offset_index(dwarfinfo);
+    cu_build_range_index(dwarfinfo);
+
+    return 0;
+}
+
+/* Load compilation units from the symbol cache instead of walking
+ * .debug_info. Only their root DIEs are created, like a lazy load, and
+ * the range index comes straight from the cache.
+ */
+int cu_load_compilation_units_from_cache(dwarfinfo_t *dwarfinfo,
+        void *symcache, sym_error_t *e){
+    if(!dwarfinfo){
+        errset(e, GENERIC_ERROR_KIND, GE_INVALID_DWARFINFO);
+        return 1;
+    }
+
+    int cnt = symcache_cu_count(symcache);
+
+    for(int i=0; i<cnt; i++){
+        compunit_t *cu = calloc(1, sizeof(compunit_t));
+        uint64_t rootoff = 0;
+
+        symcache_get_cu(symcache, i, &rootoff, &cu->cu_header_len,
+                &cu->cu_abbrev_offset, &cu->cu_address_size,
+                &cu->cu_next_header_offset, &cu->cu_cachedlinetab,
+                &cu->cu_cachedlinetablen);
+
+        cu->cu_dwarfinfo = dwarfinfo;
+        cu->cu_dbg = dwarfinfo->di_dbg;
+
         void *root_die = NULL;
-        if(initialize_and_build_die_tree_from_root_die(dwarfinfo, cu,
-                &root_die, e)){
+
+        if(die_create_cu_root_die_at_offset(dwarfinfo, cu, rootoff,
+                    &root_die, e)){
             free(cu);
             return 1;
         }
 
         cu->cu_root_die = root_die;
+        cu->cu_built = 0;
+
         linkedlist_add(dwarfinfo->di_compunits, cu);
 
         dwarfinfo->di_numcompunits++;
     }
 
+    cu_build_offset_index(dwarfinfo);
+
+    dwarfinfo->di_curanges = rangetab_new();
+
+    int rangecnt = symcache_range_count(symcache);
+
+    for(int i=0; i<rangecnt; i++){
+        uint64_t lowpc = 0, highpc = 0;
+        int cuidx = -1;
+
+        symcache_get_range(symcache, i, &lowpc, &highpc, &cuidx);
+
+        if(cuidx >= 0 && cuidx < cnt){
+            rangetab_add(dwarfinfo->di_curanges, lowpc, highpc,
+                    dwarfinfo->di_cus[cuidx]);
+        }
+    }
+
+    rangetab_finalize(dwarfinfo->di_curanges);
+
     return 0;
 }
+
+struct cu_loader {
+    dwarfinfo_t *cl_dwarfinfo;
+
+    /* Every compilation unit, in .debug_info order */
+    compunit_t **cl_cus;
+    int cl_cucnt;
+
+    /* Root DIEs built by the loader threads and the handles they
+     * were built with, parallel to cl_cus.
+     */
+    void **cl_roots;
+    Dwarf_Debug *cl_dbgs;
+
+    /* Next compilation unit to hand out */
+    int cl_next;
+    pthread_mutex_t cl_lock;
+
+    /* First error seen by any loader thread */
+    int cl_failed;
+    sym_error_t cl_error;
+};
+
+struct cu_loader_worker {
+    struct cu_loader *clw_loader;
+
+    /* Loader threads each have their own libdwarf handle,
+     * since a Dwarf_Debug cannot be shared between threads.
+     */
+    dwarfinfo_t clw_dwarfinfo;
+};
+
+static void *cu_loader_thread(void *arg){
+    struct cu_loader_worker *worker = arg;
+    struct cu_loader *loader = worker->clw_loader;
+
+    for(;;){
+        pthread_mutex_lock(&loader->cl_lock);
+
+        int idx = loader->cl_next++;
+        int stop = loader->cl_failed;
+
+        pthread_mutex_unlock(&loader->cl_lock);
+
+        if(idx >= loader->cl_cucnt || stop)
+            return NULL;
+
+        compunit_t *cu = loader->cl_cus[idx];
+
+        uint64_t rootoff = 0;
+        die_get_offset(cu->cu_root_die, &rootoff, NULL);
+
+        sym_error_t e = {0};
+        void *root_die = NULL;
+
+        int ret = die_create_cu_root_die_at_offset(&worker->clw_dwarfinfo, cu,
+                rootoff, &root_die, &e);
+
+        if(!ret){
+            ret = die_build_cu_tree(&worker->clw_dwarfinfo, cu, root_die, &e);
+
+            if(ret){
+                die_tree_free(worker->clw_dwarfinfo.di_dbg, root_die, 0);
+                free(root_die);
+            }
+        }
+
+        if(ret){
+            pthread_mutex_lock(&loader->cl_lock);
+
+            if(!loader->cl_failed){
+                loader->cl_failed = 1;
+                loader->cl_error = e;
+            }
+
+            pthread_mutex_unlock(&loader->cl_lock);
+
+            return NULL;
+        }
+
+        loader->cl_roots[idx] = root_die;
+        loader->cl_dbgs[idx] = worker->clw_dwarfinfo.di_dbg;
+    }
+
+    return NULL;
+}
+
+/* Build the DIE tree of every compilation unit loaded by
+ * cu_load_compilation_units in lazy mode, using nworkers threads.
+ * Each thread gets its own handle on dwarfinfo's mapping of the file,
+ * or opens file for itself if it isn't mapped. Those handles live in
+ * dwarfinfo until sym_end, since the DIE trees built with them
+ * reference them.
+ */
+int cu_build_compilation_units_parallel(dwarfinfo_t *dwarfinfo,
+        const char *file, int nworkers, sym_error_t *e){
+    if(!dwarfinfo){
+        errset(e, GENERIC_ERROR_KIND, GE_INVALID_DWARFINFO);
+        return 1;
+    }
+
+    if(!file || nworkers <= 0){
+        errset(e, GENERIC_ERROR_KIND, GE_INVALID_PARAMETER);
+        return 1;
+    }
+
+    int cnt = dwarfinfo->di_numcompunits;
+
+    if(cnt == 0)
+        return 0;
+
+    if(nworkers > cnt)
+        nworkers = cnt;
+
+    struct cu_loader loader = {0};
+
+    loader.cl_dwarfinfo = dwarfinfo;
+    loader.cl_cus = malloc(sizeof(compunit_t *) * cnt);
+    loader.cl_cucnt = cnt;
+    loader.cl_roots = calloc(cnt, sizeof(void *));
+    loader.cl_dbgs = calloc(cnt, sizeof(Dwarf_Debug));
+
+    pthread_mutex_init(&loader.cl_lock, NULL);
+
+    int idx = 0;
+
+    LL_FOREACH(dwarfinfo->di_compunits, current)
+        loader.cl_cus[idx++] = current->data;
+
+    struct cu_loader_worker *workers = calloc(nworkers,
+            sizeof(struct cu_loader_worker));
+    pthread_t *threads = calloc(nworkers, sizeof(pthread_t));
+
+    dwarfinfo->di_workerfds = malloc(sizeof(int) * nworkers);
+    dwarfinfo->di_workerdbgs = malloc(sizeof(Dwarf_Debug) * nworkers);
+    dwarfinfo->di_numworkers = 0;
+
+    int started = 0;
+
+    for(int i=0; i<nworkers; i++){
+        int fd = -1;
+        Dwarf_Debug dbg = NULL;
+
+        /* If the file is mapped, every thread reads from that mapping */
+        if(dwarfinfo->di_dwarfobj){
+            if(dwarfobj_init_dbg(dwarfinfo->di_dwarfobj, &dbg)){
+                errset(e, SYM_ERROR_KIND, SYM_DWARF_INIT_FAILED);
+                break;
+            }
+        }
+        else{
+            fd = open(file, O_RDONLY);
+
+            if(fd < 0){
+                errset(e, GENERIC_ERROR_KIND, GE_FILE_NOT_FOUND);
+                break;
+            }
+
+            Dwarf_Error d_error = NULL;
+
+            int ret = dwarf_init(fd, DW_DLC_READ, NULL, NULL, &dbg, &d_error);
+
+            if(ret != DW_DLV_OK){
+                close(fd);
+                errset(e, SYM_ERROR_KIND, SYM_DWARF_INIT_FAILED);
+                break;
+            }
+        }
+
+        dwarfinfo->di_workerfds[dwarfinfo->di_numworkers] = fd;
+        dwarfinfo->di_workerdbgs[dwarfinfo->di_numworkers] = dbg;
+        dwarfinfo->di_numworkers++;
+
+        workers[i].clw_loader = &loader;
+        workers[i].clw_dwarfinfo = *dwarfinfo;
+        workers[i].clw_dwarfinfo.di_dbg = dbg;
+
+        if(pthread_create(&threads[i], NULL, cu_loader_thread, &workers[i])){
+            errset(e, CU_ERROR_KIND, CU_LOADER_THREAD_FAILED);
+            break;
+        }
+
+        started++;
+    }
+
+    /* If we couldn't start every thread, tell the ones
+     * which did start to stop.
+     */
+    if(started < nworkers){
+        pthread_mutex_lock(&loader.cl_lock);
+        loader.cl_failed = 1;
+        pthread_mutex_unlock(&loader.cl_lock);
+    }
+
+    for(int i=0; i<started; i++)
+        pthread_join(threads[i], NULL);
+
+    pthread_mutex_destroy(&loader.cl_lock);
+
+    int failed = loader.cl_failed;
+
+    if(failed && started == nworkers && e)
+        *e = loader.cl_error;
+
+    /* Swap in the trees the loader threads built, keeping the
+     * compilation units in the same order as a sequential load.
+     */
+    for(int i=0; i<cnt; i++){
+        compunit_t *cu = loader.cl_cus[i];
+        void *root_die = loader.cl_roots[i];
+
+        if(!root_die)
+            continue;
+
+        die_tree_free(cu->cu_dbg, cu->cu_root_die, 0);
+        free(cu->cu_root_die);
+
+        cu->cu_root_die = root_die;
+        cu->cu_dbg = loader.cl_dbgs[i];
+        cu->cu_built = 1;
+    }
+
+    free(threads);
+    free(workers);
+    free(loader.cl_dbgs);
+    free(loader.cl_roots);
+    free(loader.cl_cus);
+
+    return failed;
+}
@@ -1,12 +1,27 @@
 #ifndef _COMPUNIT_H_
 #define _COMPUNIT_H_
 
+int cu_build_compilation_units_parallel(void *, const char *, int, void *);
+int cu_display_allocation_stats(void *, void *);
 int cu_display_compilation_units(void *, void *);
+void cu_evict_cold_compilation_units(void *, void *);
+int cu_find_compilation_unit_by_die_offset(void *, void **, uint64_t, void *);
 int cu_find_compilation_unit_by_name(void *, void **, char *, void *);
 int cu_find_compilation_unit_by_pc(void *, void **, uint64_t, void *);
 int cu_free(void *, void *);
+int cu_get_allocation_stats(void *, size_t *, size_t *, size_t *, size_t *,
+        void *);
 int cu_get_address_size(void *, unsigned short *, void *);
+int cu_get_cached_linetab(void *, const void **, size_t *, void *);
+int cu_get_dbg(void *, void **, void *);
+int cu_get_dwarfinfo(void *, void **, void *);
+int cu_get_header_info(void *, uint64_t *, uint64_t *, unsigned short *,
+        uint64_t *, void *);
+int cu_get_line_info_from_cache(void *, uint64_t, char **, char **,
+        uint64_t *, void *);
+int cu_get_linetab(void *, void **, int *, void *);
 int cu_get_root_die(void *, void **, void *);
 int cu_load_compilation_units(void *, void *); 
+int cu_load_compilation_units_from_cache(void *, void *, void *);
 
 #endif
@@ -4,7 +4,9 @@
 
 #include <dwarf.h>
 
+#include "arena.h"
 #include "common.h"
+#include "locprog.h"
 
 struct dwarf_locdesc {
     uint64_t locdesc_lopc;
@@ -391,11 +393,12 @@ void add_additional_location_description(Dwarf_Half whichattr,
     add->locdesc_prev = current;
 }
 
-static struct dwarf_locdesc *create_new_locdesc(int bounded,
+static struct dwarf_locdesc *create_new_locdesc(void *arena, int bounded,
         uint64_t locdesc_lopc, uint64_t locdesc_hipc, Dwarf_Small op,
         Dwarf_Unsigned opd1, Dwarf_Unsigned opd2, Dwarf_Unsigned opd3,
         Dwarf_Unsigned offsetforbranch){
-    struct dwarf_locdesc *locdesc = calloc(1, sizeof(struct dwarf_locdesc));
+    struct dwarf_locdesc *locdesc = arena_calloc(arena, 1,
+            sizeof(struct dwarf_locdesc));
 
     if(bounded){
         locdesc->locdesc_bounded = 1;
@@ -413,11 +416,13 @@ static struct dwarf_locdesc *create_new_locdesc(int bounded,
     return locdesc;
 }
 
-struct dwarf_locdesc *copy_locdesc(struct dwarf_locdesc *based_on){
+struct dwarf_locdesc *copy_locdesc(void *arena,
+        struct dwarf_locdesc *based_on){
     if(!based_on)
         return NULL;
 
-    struct dwarf_locdesc *root = create_new_locdesc(based_on->locdesc_bounded,
+    struct dwarf_locdesc *root = create_new_locdesc(arena,
+            based_on->locdesc_bounded,
             based_on->locdesc_lopc, based_on->locdesc_hipc,
             based_on->locdesc_op, based_on->locdesc_opd1,
             based_on->locdesc_opd2, based_on->locdesc_opd3,
@@ -428,7 +433,7 @@ struct dwarf_locdesc *copy_locdesc(struct dwarf_locdesc *based_on){
 
     while(paramcurrent){
         struct dwarf_locdesc *copied =
-            create_new_locdesc(paramcurrent->locdesc_bounded,
+            create_new_locdesc(arena, paramcurrent->locdesc_bounded,
                 paramcurrent->locdesc_lopc, paramcurrent->locdesc_hipc,
                 paramcurrent->locdesc_op, paramcurrent->locdesc_opd1,
                 paramcurrent->locdesc_opd2, paramcurrent->locdesc_opd3,
@@ -444,7 +449,7 @@ struct dwarf_locdesc *copy_locdesc(struct dwarf_locdesc *based_on){
     return root;
 }
 
-void *create_location_description(Dwarf_Small loclist_source,
+void *create_location_description(void *arena, Dwarf_Small loclist_source,
         uint64_t locdesc_lopc, uint64_t locdesc_hipc,
         Dwarf_Small op, Dwarf_Unsigned opd1,
         Dwarf_Unsigned opd2, Dwarf_Unsigned opd3,
@@ -454,7 +459,7 @@ void *create_location_description(Dwarf_Small loclist_source,
     if(loclist_source == LOCATION_LIST_ENTRY)
         bounded = 1;
     
-    return create_new_locdesc(bounded, locdesc_lopc, locdesc_hipc,
+    return create_new_locdesc(arena, bounded, locdesc_lopc, locdesc_hipc,
             op, opd1, opd2, opd3, offsetforbranch);
 }
 
@@ -1027,6 +1032,48 @@ done:
     return strdup(exprstr);
 }
 
+/* Compile a location description for locprog_eval. Operations come
+ * from libdwarf already decoded, so this only flattens the list and
+ * resolves branches.
+ */
+void *compile_location_description(void *arena,
+        struct dwarf_locdesc *locdesc){
+    if(!locdesc)
+        return NULL;
+
+    int cnt = 0;
+
+    for(struct dwarf_locdesc *ld = locdesc; ld; ld = ld->locdesc_next)
+        cnt++;
+
+    uint8_t *ops = malloc(sizeof(uint8_t) * cnt);
+    uint64_t *opd1s = malloc(sizeof(uint64_t) * cnt);
+    uint64_t *opd2s = malloc(sizeof(uint64_t) * cnt);
+    uint64_t *offs = malloc(sizeof(uint64_t) * cnt);
+
+    int idx = 0;
+
+    for(struct dwarf_locdesc *ld = locdesc; ld; ld = ld->locdesc_next){
+        ops[idx] = ld->locdesc_op;
+        opd1s[idx] = ld->locdesc_opd1;
+        opd2s[idx] = ld->locdesc_opd2;
+        offs[idx] = ld->locdesc_offsetforbranch;
+
+        idx++;
+    }
+
+    void *prog = locprog_compile(arena, locdesc->locdesc_bounded,
+            locdesc->locdesc_lopc, locdesc->locdesc_hipc, ops, opd1s, opd2s,
+            offs, cnt);
+
+    free(ops);
+    free(opd1s);
+    free(opd2s);
+    free(offs);
+
+    return prog;
+}
+
 void describe_location_description(struct dwarf_locdesc *locdesc,
         int is_fb, int idx, int idx2, int level, int *byteswritten){
     write_tabs(level);
@@ -1084,11 +1131,12 @@ void *get_next_location_description(struct dwarf_locdesc *ld){
     return ld->locdesc_next;
 }
 
-void initialize_die_loclists(struct dwarf_locdesc ***locdescs,
+void initialize_die_loclists(void *arena, struct dwarf_locdesc ***locdescs,
         Dwarf_Unsigned lcount){
-    *locdescs = calloc(lcount, sizeof(struct dwarf_locdesc));
+    *locdescs = arena_calloc(arena, lcount, sizeof(struct dwarf_locdesc *));
 }
 
+/* Only for location descriptions which weren't allocated from an arena */
 void loc_free(struct dwarf_locdesc *locdesc){
     struct dwarf_locdesc *current = locdesc;
 
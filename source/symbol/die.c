@@ -7,21 +7,22 @@
 
 #include "../strext.h"
 
+#include "arena.h"
 #include "common.h"
 #include "compunit.h"
 #include "dexpr.h"
+#include "lineprog.h"
+#include "linetab.h"
+#include "locprog.h"
+#include "rangetab.h"
+#include "rcu.h"
+#include "symcache.h"
 #include "symerr.h"
+#include "typereg.h"
+#include "valread.h"
 
 typedef struct die die_t;
 
-enum {
-    DTC_POINTER =           (1 << 0),
-    DTC_STRUCT =            (1 << 1),
-    DTC_UNION =             (1 << 2),
-    DTC_ARRAY =             (1 << 3),
-    DTC_OTHER =             (1 << 4)
-};
-
 #define ARR_DIM_SZ_UNKNOWN ((unsigned)-1)
 
 struct arrdim {
@@ -29,95 +30,330 @@ struct arrdim {
     unsigned int sz;
 };
 
-struct die {
-    Dwarf_Die die_dwarfdie;
-    Dwarf_Unsigned die_dieoffset;
+/* A data type, resolved once per compilation unit no matter how many
+ * DIEs use it. Type IDs index ds_typetab, and type ID 0 is no type.
+ */
+struct die_type {
+    Dwarf_Unsigned dt_dieoffset;
+    Dwarf_Unsigned dt_basedieoffset;
+    Dwarf_Half dt_tag;
+    /* DW_ATE_* */
+    Dwarf_Half dt_encoding;
+    Dwarf_Unsigned dt_bytesize;
+    unsigned int dt_nameid;
+    /* DTC_* */
+    unsigned int dt_class;
+    /* If we have an array, we need to know the size of each element,
+     * not just the overall size of the array.
+     */
+    Dwarf_Unsigned dt_arrmembsz;
+    struct arrdim *dt_arrdims;
+    int dt_arrdimslen;
 
-    /* If this DIE represents a compilation unit, the following
-     * two are non-NULL.
+    /* Node IDs of the members of the struct or union this type
+     * ends up at, found the first time they're asked for.
      */
-    Dwarf_Line *die_srclines;
-    Dwarf_Signed die_srclinescnt;
+    int dt_memberscached;
+    int *dt_members;
+    int dt_nummembers;
 
-    Dwarf_Half die_tag;
-    char *die_tagname;
+    /* The copy of this type every compilation unit shares */
+    void *dt_canon;
+};
 
-    /* If this DIE represents an anonymous type. */
-    int die_anon;
+/* Only DIEs which describe some sort of variable, parameter, or member
+ * have one of these.
+ */
+struct die_typeinfo {
+    int ti_id;
 
-    /* If this DIE represents a lexical block. */
-    int die_lexblock;
+    Dwarf_Unsigned ti_datatypedieoffset;
+    unsigned int ti_typeid;
 
-    char *die_diename;
+    /* Where a member is in a structure, union, etc */
+    Dwarf_Unsigned ti_memb_off;
 
-    Dwarf_Half die_haschildren;
+    /* For bitfield members, how many bits there are, and where the first
+     * one is, counting from the start of the structure.
+     */
+    Dwarf_Unsigned ti_bitsize;
+    Dwarf_Unsigned ti_bitoff;
+};
 
-    /* non-NULL when this die is a parent */
-    /* NULL terminated array of children */
-    die_t **die_children;
-    int die_numchildren;
+/* Where a subroutine, lexical block, etc starts and ends */
+struct die_rangeinfo {
+    int ri_id;
 
-    /* non-NULL when this die is a child */
-    die_t *die_parent;
+    Dwarf_Unsigned ri_low_pc;
+    Dwarf_Unsigned ri_high_pc;
 
-    /* If this DIE describes any sort of variable/parameter in the
-     * debugged program, the following ten are initialized.
+    /* If this DIE has the attribute DW_AT_ranges, the following
+     * two are initialized. These ranges are not necessarily contiguous.
      */
-    Dwarf_Unsigned die_datatypedieoffset;
-    Dwarf_Unsigned die_basedatatypedieoffset;
-    Dwarf_Die die_datatypedie;
-    Dwarf_Half die_datatypedietag;
-    /* DW_ATE_* */
-    Dwarf_Half die_datatypeencoding;
-    Dwarf_Unsigned die_databytessize;
-    char *die_datatypename;
-    /* If we have an array, we need to know the size of each element,
-     * not just the overall size of the array.
+    struct pcrange *ri_ranges;
+    int ri_rangescnt;
+
+    /* If this DIE represents an inlined subroutine */
+    Dwarf_Unsigned ri_aboriginoff;
+};
+
+/* [lr_lopc, lr_hipc) of one location list entry */
+struct die_locrange {
+    uint64_t lr_lopc;
+    uint64_t lr_hipc;
+    void *lr_prog;
+};
+
+struct die_locinfo {
+    int li_id;
+
+    /* If this DIE has the attribute DW_AT_location, the following
+     * two are initialized.
      */
-    Dwarf_Unsigned die_arrmembsz;
-    /* Array of array dimensions */
-    struct arrdim **die_arrdims;
-    int die_arrdimslen;
-    /* High level data type classification. Really, we are only interested
-     * in if this data type DIE represents a pointer, struct, union,
-     * array, or base type.
+    Dwarf_Unsigned li_loclistcnt;
+    /* Will have li_loclistcnt elements */
+    void **li_loclists;
+
+    /* If this DIE's tag is DW_TAG_subprogram, or it's inside of one,
+     * this will be initialized.
+     */
+    void *li_framebaselocdesc;
+
+    /* The above, compiled for locprog_eval the first time this DIE's
+     * location is evaluated. Location list entries are in li_ranges,
+     * sorted by low PC, so the one for a PC is found with a binary
+     * search. A location which isn't a list applies to every PC and
+     * is li_anyprog instead. Like everything else these records point
+     * to, these are on the heap for the root DIE and in ds_arena for
+     * the rest.
      */
-    unsigned int die_datatypeclass : 5;
+    int li_compiled;
+    struct die_locrange *li_ranges;
+    int li_numranges;
+    void *li_anyprog;
 
-    /* If this DIE represents an inlined subroutine, the following
-     * two are initialized.
+    /* Variables share the compiled frame base of their subprogram */
+    void *li_frameprog;
+};
+
+/* Every DIE of a compilation unit. DIEs are numbered in the order
+ * they appear in .debug_info, and the root DIE is node 0.
+ *
+ * Most DIEs don't have a type, location, or PC range, so those live in
+ * side tables sorted by node ID instead of in every DIE.
+ */
+struct die_store {
+    die_t *ds_root;
+
+    /* The root DIE is allocated by itself so its address never
+     * changes, so ds_nodes[0] is unused.
      */
-    int die_inlinedsub;
-    Dwarf_Unsigned die_aboriginoff;
+    die_t *ds_nodes;
+    int ds_numnodes;
+    int ds_nodescap;
 
-    /* Where a subroutine, lexical block, etc starts and ends */
-    Dwarf_Unsigned die_low_pc;
-    Dwarf_Unsigned die_high_pc;
+    /* The root DIE's first child. It's kept here rather than in the root
+     * DIE so a reader gets it from the same store it looks it up in.
+     */
+    int ds_rootfirstchild;
 
-    /* Where a member is in a structure, union, etc */
-    Dwarf_Unsigned die_memb_off;
+    /* Name IDs index this, and name ID 0 is no name. Names which belong
+     * to the root DIE are on the heap, and the rest are in ds_arena.
+     */
+    char **ds_names;
+    int ds_numnames;
+    int ds_namescap;
+    int ds_numrootnames;
 
-    /* If this DIE has the attribute DW_AT_location, the following
-     * two are initialized.
+    struct die_typeinfo *ds_types;
+    int ds_numtypes;
+    int ds_typescap;
+
+    /* Type IDs index this. Everything types point to is in ds_arena. */
+    struct die_type *ds_typetab;
+    int ds_numtypetab;
+    int ds_typetabcap;
+
+    struct die_rangeinfo *ds_ranges;
+    int ds_numranges;
+    int ds_rangescap;
+
+    struct die_locinfo *ds_locs;
+    int ds_numlocs;
+    int ds_locscap;
+
+    /* Node IDs, sorted by DIE offset */
+    int *ds_offidx;
+
+    /* Line table, sorted by address */
+    void *ds_linetab;
+
+    /* Maps every PC covered by a subprogram, inlined subroutine, or
+     * lexical block to the innermost one.
+     */
+    void *ds_scopetab;
+
+    /* Everything for DIEs other than the root DIE is allocated
+     * from here.
      */
-    Dwarf_Unsigned die_loclistcnt;
+    void *ds_arena;
+};
+
+#define DIE_NONE (-1)
+
+struct die {
+    Dwarf_Unsigned die_dieoffset;
+    struct die_store *die_store;
+
+    int die_id;
+    int die_parent;
+    int die_firstchild;
+    int die_sibling;
+
+    unsigned int die_nameid;
+    Dwarf_Half die_tag;
+
+    Dwarf_Half die_haschildren : 1;
+
+    /* If this DIE represents an anonymous type. */
+    Dwarf_Half die_anon : 1;
 
-    /* Will have die_loclistcnt elements */
-    void **die_loclists;
+    /* If this DIE represents a lexical block. */
+    Dwarf_Half die_lexblock : 1;
+
+    /* If this DIE represents an inlined subroutine. */
+    Dwarf_Half die_inlinedsub : 1;
 
-    /* If this DIE's tag is DW_TAG_subprogram, this will be initialized */
-    void *die_framebaselocdesc;
+    /* High level data type classification. Really, we are only interested
+     * in if this data type DIE represents a pointer, struct, union,
+     * array, or base type.
+     */
+    Dwarf_Half die_datatypeclass : 5;
 };
 
+static const struct die_type NO_TYPE = {0};
+static const struct die_typeinfo NO_TYPEINFO = {0};
+static const struct die_rangeinfo NO_RANGEINFO = {0};
+static const struct die_locinfo NO_LOCINFO = {0};
+
+static die_t *die_node(struct die_store *ds, int id){
+    if(id == DIE_NONE)
+        return NULL;
+
+    if(id == 0)
+        return ds->ds_root;
+
+    return &ds->ds_nodes[id];
+}
+
+static die_t *die_parent(die_t *die){
+    return die_node(die->die_store, die->die_parent);
+}
+
+/* A root DIE's tree is swapped out from under readers when it's built
+ * or evicted, so its first child comes from whichever store a reader
+ * loads, and a reader never goes looking for a child in a store which
+ * doesn't have it.
+ */
+static die_t *die_first_child(die_t *die){
+    struct die_store *ds = __atomic_load_n(&die->die_store, __ATOMIC_ACQUIRE);
+
+    if(die->die_id == 0)
+        return die_node(ds, ds->ds_rootfirstchild);
+
+    return die_node(ds, die->die_firstchild);
+}
+
+static die_t *die_next_sibling(die_t *die){
+    return die_node(die->die_store, die->die_sibling);
+}
+
+static char *die_name(die_t *die){
+    return die->die_store->ds_names[die->die_nameid];
+}
+
+/* Every side table starts its records with the node ID they're for */
+static const void *die_side_lookup(const void *recs, int cnt, size_t recsz,
+        int id, const void *none){
+    int lo = 0, hi = cnt - 1;
+
+    while(lo <= hi){
+        int mid = lo + ((hi - lo) / 2);
+        const void *rec = (const char *)recs + (recsz * mid);
+        int recid = *(const int *)rec;
+
+        if(recid == id)
+            return rec;
+        else if(recid < id)
+            lo = mid + 1;
+        else
+            hi = mid - 1;
+    }
+
+    return none;
+}
+
+static const struct die_typeinfo *die_typeinfo(die_t *die){
+    struct die_store *ds = die->die_store;
+
+    return die_side_lookup(ds->ds_types, ds->ds_numtypes,
+            sizeof(struct die_typeinfo), die->die_id, &NO_TYPEINFO);
+}
+
+/* The data type of this DIE */
+static const struct die_type *die_type(die_t *die){
+    struct die_store *ds = die->die_store;
+    unsigned int id = die_typeinfo(die)->ti_typeid;
+
+    if(id == 0 || id >= ds->ds_numtypetab)
+        return &NO_TYPE;
+
+    return &ds->ds_typetab[id];
+}
+
+static const struct die_rangeinfo *die_rangeinfo(die_t *die){
+    struct die_store *ds = die->die_store;
+
+    return die_side_lookup(ds->ds_ranges, ds->ds_numranges,
+            sizeof(struct die_rangeinfo), die->die_id, &NO_RANGEINFO);
+}
+
+static const struct die_locinfo *die_locinfo(die_t *die){
+    struct die_store *ds = die->die_store;
+
+    return die_side_lookup(ds->ds_locs, ds->ds_numlocs,
+            sizeof(struct die_locinfo), die->die_id, &NO_LOCINFO);
+}
+
+/* Make room for one more element in a growable array */
+static void *die_grow(void *arr, int cnt, int *cap, size_t elemsz){
+    if(cnt < *cap)
+        return arr;
+
+    int newcap = *cap == 0 ? 16 : *cap * 2;
+    void *arr_rea = realloc(arr, elemsz * newcap);
+
+    *cap = newcap;
+
+    return arr_rea;
+}
+
 int die_get_members(die_t *, die_t *, die_t ***, int *, sym_error_t *);
 int die_pc_to_lineno(Dwarf_Debug, die_t *, uint64_t, uint64_t *, sym_error_t *);
+int die_find_function_by_pc(die_t *, uint64_t, die_t **, sym_error_t *);
 int die_search(die_t *, void *, int, die_t **, sym_error_t *);
+int die_find_by_offset(die_t *, uint64_t, die_t **, sym_error_t *);
+void die_tree_free_children(Dwarf_Debug, die_t *);
+
+static struct die_locinfo *die_locinfo_for_compile(die_t *);
+static void die_compile_locations(die_t *, struct die_locinfo *);
+static void die_store_free(void *);
 
 static int is_anonymous_type(die_t *die){
     return (die->die_tag == DW_TAG_structure_type ||
             die->die_tag == DW_TAG_union_type ||
             die->die_tag == DW_TAG_enumeration_type) &&
-        !die->die_diename;
+        die->die_nameid == 0;
 }
 
 static int is_inlined_subroutine(die_t *die){
@@ -323,8 +559,203 @@ struct arrdim *create_arrdim(unsigned dim, unsigned sz){
 
 #define NON_COMPILE_TIME_CONSTANT_SIZE ((Dwarf_Unsigned)-1)
 
-static int lex_block_count = 0, anon_struct_count = 0, anon_union_count = 0,
-           anon_enum_count = 0, IS_POINTER = 0;
+/* Build state is per thread so compilation units
+ * can be built in parallel.
+ */
+static __thread int lex_block_count = 0, anon_struct_count = 0,
+           anon_union_count = 0, anon_enum_count = 0, IS_POINTER = 0;
+
+/* Store and arena of the compilation unit being built. The root DIE
+ * is created with no arena, so everything for it is on the heap.
+ */
+static __thread struct die_store *CUR_STORE = NULL;
+static __thread void *CUR_ARENA = NULL;
+
+/* Low PC of the root DIE of the compilation unit being built */
+static __thread uint64_t CUR_CU_LOWPC = 0;
+
+/* Name IDs hashed by name, so every name is stored once per
+ * compilation unit. Only exists while a tree is being built.
+ */
+static __thread unsigned int *CUR_NAMEHASH = NULL;
+static __thread unsigned int CUR_NAMEHASHCAP = 0;
+
+/* Type IDs hashed by the offset of their type DIE, so a type is only
+ * resolved once per compilation unit. Only exists while a tree is
+ * being built.
+ */
+static __thread unsigned int *CUR_TYPEHASH = NULL;
+static __thread unsigned int CUR_TYPEHASHCAP = 0;
+
+static uint32_t die_name_hash(const char *name){
+    /* FNV-1a */
+    uint32_t h = 2166136261u;
+
+    while(*name){
+        h ^= (uint8_t)*name++;
+        h *= 16777619u;
+    }
+
+    return h;
+}
+
+static void die_name_hash_insert(unsigned int id){
+    unsigned int mask = CUR_NAMEHASHCAP - 1;
+    unsigned int slot = die_name_hash(CUR_STORE->ds_names[id]) & mask;
+
+    while(CUR_NAMEHASH[slot] != 0)
+        slot = (slot + 1) & mask;
+
+    CUR_NAMEHASH[slot] = id;
+}
+
+/* Keep the hash table at most half full */
+static void die_name_hash_resize(void){
+    free(CUR_NAMEHASH);
+
+    CUR_NAMEHASHCAP = 1024;
+
+    while(CUR_NAMEHASHCAP < CUR_STORE->ds_numnames * 2)
+        CUR_NAMEHASHCAP *= 2;
+
+    CUR_NAMEHASH = calloc(CUR_NAMEHASHCAP, sizeof(unsigned int));
+
+    for(int i=1; i<CUR_STORE->ds_numnames; i++)
+        die_name_hash_insert(i);
+}
+
+static void die_name_hash_free(void){
+    free(CUR_NAMEHASH);
+    CUR_NAMEHASH = NULL;
+    CUR_NAMEHASHCAP = 0;
+}
+
+static uint32_t die_type_hash(Dwarf_Unsigned offset){
+    /* Fibonacci hashing */
+    return (uint32_t)((offset * 11400714819323198485ull) >> 32);
+}
+
+static void die_type_hash_insert(unsigned int id){
+    unsigned int mask = CUR_TYPEHASHCAP - 1;
+    unsigned int slot =
+        die_type_hash(CUR_STORE->ds_typetab[id].dt_dieoffset) & mask;
+
+    while(CUR_TYPEHASH[slot] != 0)
+        slot = (slot + 1) & mask;
+
+    CUR_TYPEHASH[slot] = id;
+}
+
+/* Keep the hash table at most half full */
+static void die_type_hash_resize(void){
+    free(CUR_TYPEHASH);
+
+    CUR_TYPEHASHCAP = 256;
+
+    while(CUR_TYPEHASHCAP < CUR_STORE->ds_numtypetab * 2)
+        CUR_TYPEHASHCAP *= 2;
+
+    CUR_TYPEHASH = calloc(CUR_TYPEHASHCAP, sizeof(unsigned int));
+
+    for(int i=1; i<CUR_STORE->ds_numtypetab; i++)
+        die_type_hash_insert(i);
+}
+
+static void die_type_hash_free(void){
+    free(CUR_TYPEHASH);
+    CUR_TYPEHASH = NULL;
+    CUR_TYPEHASHCAP = 0;
+}
+
+/* Type ID of the type whose DIE is at offset, or 0 if it hasn't
+ * been resolved yet.
+ */
+static unsigned int die_find_type(Dwarf_Unsigned offset){
+    if(!CUR_TYPEHASH)
+        return 0;
+
+    unsigned int mask = CUR_TYPEHASHCAP - 1;
+    unsigned int slot = die_type_hash(offset) & mask;
+
+    while(CUR_TYPEHASH[slot] != 0){
+        unsigned int id = CUR_TYPEHASH[slot];
+
+        if(CUR_STORE->ds_typetab[id].dt_dieoffset == offset)
+            return id;
+
+        slot = (slot + 1) & mask;
+    }
+
+    return 0;
+}
+
+/* Give a string we were handed a name ID, copying it into the current
+ * arena if it hasn't been seen yet.
+ */
+static unsigned int die_intern_name(Dwarf_Debug dbg, char *str,
+        int fromdwarf){
+    if(!str)
+        return 0;
+
+    struct die_store *ds = CUR_STORE;
+    unsigned int id = 0;
+
+    if(CUR_NAMEHASH){
+        unsigned int mask = CUR_NAMEHASHCAP - 1;
+        unsigned int slot = die_name_hash(str) & mask;
+
+        while(CUR_NAMEHASH[slot] != 0){
+            if(strcmp(ds->ds_names[CUR_NAMEHASH[slot]], str) == 0){
+                id = CUR_NAMEHASH[slot];
+                break;
+            }
+
+            slot = (slot + 1) & mask;
+        }
+    }
+
+    if(id == 0){
+        ds->ds_names = die_grow(ds->ds_names, ds->ds_numnames,
+                &ds->ds_namescap, sizeof(char *));
+
+        id = ds->ds_numnames++;
+        ds->ds_names[id] = arena_strdup(CUR_ARENA, str);
+
+        if(CUR_NAMEHASH){
+            if(ds->ds_numnames * 2 > CUR_NAMEHASHCAP)
+                die_name_hash_resize();
+            else
+                die_name_hash_insert(id);
+        }
+    }
+
+    if(fromdwarf)
+        dwarf_dealloc(dbg, str, DW_DLA_STRING);
+    else
+        free(str);
+
+    return id;
+}
+
+/* Move array dimensions built by generate_data_type_info into the
+ * current arena, as one block.
+ */
+static struct arrdim *die_take_arrdims(struct arrdim **dims, int dimslen){
+    if(!dims)
+        return NULL;
+
+    struct arrdim *out = arena_alloc(CUR_ARENA,
+            sizeof(struct arrdim) * dimslen);
+
+    for(int i=0; i<dimslen; i++){
+        out[i] = *dims[i];
+        free(dims[i]);
+    }
+
+    free(dims);
+
+    return out;
+}
 
 static void generate_data_type_info(Dwarf_Debug dbg, void *compile_unit,
         Dwarf_Die die, char **outtype, Dwarf_Unsigned *outsize,
@@ -660,30 +1091,46 @@ static void generate_data_type_info(Dwarf_Debug dbg, void *compile_unit,
     concat(outtype, type_tag_string);
 }
 
-static void get_die_data_type_info(dwarfinfo_t *dwarfinfo, void *compile_unit,
-        die_t **die, int level){
-    Dwarf_Debug dbg = dwarfinfo->di_dbg;
-    Dwarf_Error d_error = NULL;
-    Dwarf_Attribute attr = NULL;
+/* Give a newly resolved type a type ID */
+static unsigned int die_add_type(struct die_type *dt){
+    struct die_store *ds = CUR_STORE;
 
-    int ret = dwarf_attr((*die)->die_dwarfdie, DW_AT_type, &attr, &d_error);
+    /* Type ID 0 is no type */
+    if(ds->ds_numtypetab == 0){
+        ds->ds_typetab = die_grow(ds->ds_typetab, 0, &ds->ds_typetabcap,
+                sizeof(struct die_type));
+        memset(&ds->ds_typetab[0], 0, sizeof(struct die_type));
+        ds->ds_numtypetab = 1;
+    }
 
-    if(ret == DW_DLV_ERROR)
-        dwarf_dealloc(dbg, d_error, DW_DLA_ERROR);
+    ds->ds_typetab = die_grow(ds->ds_typetab, ds->ds_numtypetab,
+            &ds->ds_typetabcap, sizeof(struct die_type));
 
-    if(ret != DW_DLV_OK)
-        return;
+    unsigned int id = ds->ds_numtypetab++;
+    ds->ds_typetab[id] = *dt;
 
-    ret = dwarf_global_formref(attr, &((*die)->die_datatypedieoffset),
-            &d_error);
+    if(CUR_TYPEHASH){
+        if(ds->ds_numtypetab * 2 > CUR_TYPEHASHCAP)
+            die_type_hash_resize();
+        else
+            die_type_hash_insert(id);
+    }
 
-    if(ret == DW_DLV_ERROR)
-        dwarf_dealloc(dbg, d_error, DW_DLA_ERROR);
+    return id;
+}
 
-    dwarf_dealloc(dbg, attr, DW_DLA_ATTR);
+/* Follow the chain of DIEs which make up the type whose DIE is at
+ * offset, and figure out everything about it we care about.
+ */
+static void resolve_data_type(dwarfinfo_t *dwarfinfo, void *compile_unit,
+        Dwarf_Unsigned offset, struct die_type *dt){
+    Dwarf_Debug dbg = dwarfinfo->di_dbg;
+    Dwarf_Error d_error = NULL;
+    Dwarf_Die datatypedie = NULL;
 
-    ret = dwarf_offdie(dwarfinfo->di_dbg, (*die)->die_datatypedieoffset,
-            &((*die)->die_datatypedie), &d_error);
+    dt->dt_dieoffset = offset;
+
+    int ret = dwarf_offdie(dbg, offset, &datatypedie, &d_error);
 
     if(ret == DW_DLV_ERROR)
         dwarf_dealloc(dbg, d_error, DW_DLA_ERROR);
@@ -691,10 +1138,9 @@ static void get_die_data_type_info(dwarfinfo_t *dwarfinfo, void *compile_unit,
     if(ret != DW_DLV_OK)
         return;
 
-    dwarf_tag((*die)->die_datatypedie,
-            &((*die)->die_datatypedietag), &d_error);
+    dwarf_tag(datatypedie, &dt->dt_tag, &d_error);
 
-    Dwarf_Half tag = (*die)->die_datatypedietag;
+    Dwarf_Half tag = dt->dt_tag;
     Dwarf_Half base_tag = 0, base_die_encoding = 0;
     Dwarf_Die base_die = NULL;
 
@@ -704,34 +1150,35 @@ static void get_die_data_type_info(dwarfinfo_t *dwarfinfo, void *compile_unit,
      * or an enum, we're done.
      */
     if(tag == DW_TAG_base_type || tag == DW_TAG_enumeration_type){
-        ret = dwarf_diename((*die)->die_datatypedie, &((*die)->die_datatypename),
-                &d_error);
+        char *name = NULL;
+        ret = dwarf_diename(datatypedie, &name, &d_error);
 
         if(ret == DW_DLV_ERROR)
             dwarf_dealloc(dbg, d_error, DW_DLA_ERROR);
 
-        ret = dwarf_bytesize((*die)->die_datatypedie, &((*die)->die_databytessize),
-                &d_error);
+        dt->dt_nameid = die_intern_name(dbg, name, 1);
+
+        ret = dwarf_bytesize(datatypedie, &dt->dt_bytesize, &d_error);
 
         if(ret == DW_DLV_ERROR)
             dwarf_dealloc(dbg, d_error, DW_DLA_ERROR);
 
         /* For some reason calling dwarf_formsdata with this attribute
-         * wipes die->die_databytessize...
+         * wipes dt->dt_bytesize...
          */
-        Dwarf_Unsigned sz = (*die)->die_databytessize;
+        Dwarf_Unsigned sz = dt->dt_bytesize;
 
         Dwarf_Attribute dw_at_encoding_attr = NULL;
 
         /* this will fail for DW_TAG_enumeration_type, who cares */
-        get_die_attribute(dbg, (*die)->die_datatypedie, DW_AT_encoding,
+        get_die_attribute(dbg, datatypedie, DW_AT_encoding,
                 &dw_at_encoding_attr);
 
         if(dw_at_encoding_attr){
             get_form_data_from_attr(dbg, dw_at_encoding_attr,
-                    &((*die)->die_datatypeencoding), FORMSDATA);
+                    &dt->dt_encoding, FORMSDATA);
             dwarf_dealloc(dbg, dw_at_encoding_attr, DW_DLA_ATTR);
-            (*die)->die_databytessize = sz;
+            dt->dt_bytesize = sz;
         }
     }
     else{
@@ -752,8 +1199,8 @@ static void get_die_data_type_info(dwarfinfo_t *dwarfinfo, void *compile_unit,
         struct arrdim **dims = NULL;
         int dimslen = 0;
 
-        generate_data_type_info(dwarfinfo->di_dbg, compile_unit,
-                (*die)->die_datatypedie, &name, &size, &base_tag,
+        generate_data_type_info(dbg, compile_unit,
+                datatypedie, &name, &size, &base_tag,
                 &base_die, &base_die_encoding, &base_data_type_die_offset,
                 &arrmembsz, &arrmembencoding, &classification,
                 &dims, &dimslen, 0);
@@ -763,13 +1210,13 @@ static void get_die_data_type_info(dwarfinfo_t *dwarfinfo, void *compile_unit,
 
         IS_POINTER = 0;
 
-        (*die)->die_databytessize = size;
-        (*die)->die_datatypename = name;
-        (*die)->die_datatypeencoding = base_die_encoding;
-        (*die)->die_basedatatypedieoffset = base_data_type_die_offset;
-        (*die)->die_arrmembsz = arrmembsz;
-        (*die)->die_arrdims = dims;
-        (*die)->die_arrdimslen = dimslen;
+        dt->dt_bytesize = size;
+        dt->dt_nameid = die_intern_name(dbg, name, 0);
+        dt->dt_encoding = base_die_encoding;
+        dt->dt_basedieoffset = base_data_type_die_offset;
+        dt->dt_arrmembsz = arrmembsz;
+        dt->dt_arrdims = die_take_arrdims(dims, dimslen);
+        dt->dt_arrdimslen = dimslen;
     }
 
     unsigned int c = classification;
@@ -779,15 +1226,86 @@ static void get_die_data_type_info(dwarfinfo_t *dwarfinfo, void *compile_unit,
         classification |= DTC_OTHER;
     }
 
-    (*die)->die_datatypeclass = classification;
+    dt->dt_class = classification;
+
+    /* generate_data_type_info leaves the last base type DIE it saw
+     * for us to free.
+     */
+    if(base_die && base_die != datatypedie)
+        dwarf_dealloc(dbg, base_die, DW_DLA_DIE);
+
+    dwarf_dealloc(dbg, datatypedie, DW_DLA_DIE);
+}
+
+/* Point this DIE at its type, resolving the type if this is the first
+ * DIE in the compilation unit to use it.
+ */
+static void get_die_data_type_info(dwarfinfo_t *dwarfinfo, void *compile_unit,
+        Dwarf_Die dwdie, die_t *die, struct die_typeinfo *ti, int level){
+    Dwarf_Debug dbg = dwarfinfo->di_dbg;
+    Dwarf_Error d_error = NULL;
+    Dwarf_Attribute attr = NULL;
+
+    int ret = dwarf_attr(dwdie, DW_AT_type, &attr, &d_error);
+
+    if(ret == DW_DLV_ERROR)
+        dwarf_dealloc(dbg, d_error, DW_DLA_ERROR);
+
+    if(ret != DW_DLV_OK)
+        return;
+
+    ret = dwarf_global_formref(attr, &ti->ti_datatypedieoffset, &d_error);
+
+    if(ret == DW_DLV_ERROR)
+        dwarf_dealloc(dbg, d_error, DW_DLA_ERROR);
+
+    dwarf_dealloc(dbg, attr, DW_DLA_ATTR);
+
+    unsigned int id = die_find_type(ti->ti_datatypedieoffset);
+
+    if(id == 0){
+        struct die_type dt = {0};
+        struct typesummary ts = {0};
+
+        /* The symbol cache already knows about most types */
+        if(symcache_find_type(dwarfinfo->di_symcache,
+                    ti->ti_datatypedieoffset, &ts) == 0){
+            dt.dt_dieoffset = ts.ts_dieoffset;
+            dt.dt_basedieoffset = ts.ts_basedieoffset;
+            dt.dt_tag = ts.ts_tag;
+            dt.dt_encoding = ts.ts_encoding;
+            dt.dt_bytesize = ts.ts_bytesize;
+            dt.dt_class = ts.ts_class;
+            dt.dt_arrmembsz = ts.ts_arrmembsz;
+
+            if(ts.ts_name)
+                dt.dt_nameid = die_intern_name(dbg, strdup(ts.ts_name), 0);
+        }
+        else{
+            resolve_data_type(dwarfinfo, compile_unit,
+                    ti->ti_datatypedieoffset, &dt);
+        }
+
+        id = die_add_type(&dt);
+    }
+
+    ti->ti_typeid = id;
+    die->die_datatypeclass = CUR_STORE->ds_typetab[id].dt_class;
 }
 
-static die_t *CUR_PARENTS[100] = {0};
+/* Node IDs of the closest parent at each level of the tree being built */
+static __thread int CUR_PARENTS[100];
+
+static void reset_cur_parents(void){
+    for(int i=0; i<sizeof(CUR_PARENTS) / sizeof(*CUR_PARENTS); i++)
+        CUR_PARENTS[i] = DIE_NONE;
+}
 
-static void copy_location_lists(Dwarf_Debug dbg, die_t **die,
-        Dwarf_Half whichattr, int level){
+static void copy_location_lists(Dwarf_Debug dbg, Dwarf_Die dwdie,
+        die_t *die, struct die_locinfo *li, Dwarf_Half whichattr,
+        int level){
     Dwarf_Attribute attr = NULL;
-    get_die_attribute(dbg, (*die)->die_dwarfdie, whichattr, &attr);
+    get_die_attribute(dbg, dwdie, whichattr, &attr);
 
     if(!attr)
         return;
@@ -795,15 +1313,17 @@ static void copy_location_lists(Dwarf_Debug dbg, die_t **die,
     Dwarf_Error d_error = NULL;
     Dwarf_Loc_Head_c loclisthead = NULL;
 
-    int lret = dwarf_get_loclist_c(attr, &loclisthead,
-            &((*die)->die_loclistcnt), &d_error);
+    Dwarf_Unsigned lcount = 0;
+    int lret = dwarf_get_loclist_c(attr, &loclisthead, &lcount, &d_error);
 
     dwarf_dealloc(dbg, attr, DW_DLA_ATTR);
 
     if(lret == DW_DLV_OK){
-        Dwarf_Unsigned lcount = (*die)->die_loclistcnt;
-
-        initialize_die_loclists(&((*die)->die_loclists), lcount);
+        /* DW_AT_frame_base goes in li_framebaselocdesc instead */
+        if(whichattr == DW_AT_location){
+            li->li_loclistcnt = lcount;
+            initialize_die_loclists(CUR_ARENA, &li->li_loclists, lcount);
+        }
 
         for(Dwarf_Unsigned i=0; i<lcount; i++){
             Dwarf_Small loclist_source = 0, lle_value = 0;
@@ -831,37 +1351,40 @@ static void copy_location_lists(Dwarf_Debug dbg, die_t **die,
                             &d_error);
 
                     if(opret == DW_DLV_OK){
-                        uint64_t cudie_lopc = 0, cudie_hipc = 0;
+                        uint64_t cudie_lopc = 0;
 
                         /* Low and high PC values here are based off the
                          * compilation unit's (or root DIE) low PC value when
                          * loclist_source == LOCATION_LIST_ENTRY. Otherwise,
                          * lle_value, lopc, and hipc aren't of any use to us.
                          */
-                        if(loclist_source == LOCATION_LIST_ENTRY){
-                            die_t *cudie = CUR_PARENTS[0];
-
-                            cudie_lopc = cudie->die_low_pc;
-                            cudie_hipc = cudie->die_high_pc;
-                        }
+                        if(loclist_source == LOCATION_LIST_ENTRY)
+                            cudie_lopc = CUR_CU_LOWPC;
 
                         uint64_t locdesc_lopc = lopc + cudie_lopc;
                         uint64_t locdesc_hipc = hipc + cudie_lopc;
 
                         void *locdesc =
-                            create_location_description(loclist_source,
+                            create_location_description(CUR_ARENA,
+                                    loclist_source,
                                     locdesc_lopc, locdesc_hipc, op, opd1,
                                     opd2, opd3, offsetforbranch);
 
-                        if(j > 0){
+                        if(whichattr == DW_AT_frame_base){
+                            if(j > 0){
+                                add_additional_location_description(whichattr,
+                                        &li->li_framebaselocdesc, locdesc, 0);
+                            }
+                            else{
+                                li->li_framebaselocdesc = locdesc;
+                            }
+                        }
+                        else if(j > 0){
                             add_additional_location_description(whichattr,
-                                    (*die)->die_loclists, locdesc, i);
+                                    li->li_loclists, locdesc, i);
                         }
                         else{
-                            if(whichattr == DW_AT_location)
-                                (*die)->die_loclists[i] = locdesc;
-                            else if(whichattr == DW_AT_frame_base)
-                                (*die)->die_framebaselocdesc = locdesc;
+                            li->li_loclists[i] = locdesc;
                         }
                     }
                     else{
@@ -880,70 +1403,240 @@ static void copy_location_lists(Dwarf_Debug dbg, die_t **die,
     /* If this DIE is the child of a subroutine DIE, initialize its
      * frame base location description.
      */
-    if((*die)->die_tag != DW_TAG_subprogram && level > 0){
-        int pos = level;
-        die_t *curparent = CUR_PARENTS[pos];
+    if(whichattr == DW_AT_location && die->die_tag != DW_TAG_subprogram &&
+            level > 0){
+        for(int pos=level; pos>=0; pos--){
+            die_t *curparent = die_node(CUR_STORE, CUR_PARENTS[pos]);
 
-        while(pos >= 0 &&
-                (!curparent || curparent->die_tag != DW_TAG_subprogram)){
-            curparent = CUR_PARENTS[pos--];
-        }
+            if(!curparent || curparent->die_tag != DW_TAG_subprogram)
+                continue;
 
-        if(curparent->die_tag == DW_TAG_subprogram){
-            (*die)->die_framebaselocdesc =
-                copy_locdesc(curparent->die_framebaselocdesc);
+            li->li_framebaselocdesc = copy_locdesc(CUR_ARENA,
+                    die_locinfo(curparent)->li_framebaselocdesc);
+            break;
         }
     }
 }
 
-static int copy_die_info(dwarfinfo_t *dwarfinfo, void *compile_unit,
-        die_t **die, int level){
-    Dwarf_Debug dbg = dwarfinfo->di_dbg;
-    Dwarf_Error d_error = NULL;
 
-    int ret = dwarf_diename((*die)->die_dwarfdie, &((*die)->die_diename),
-            &d_error);
+static void copy_die_ranges(Dwarf_Debug dbg, Dwarf_Die dwdie, die_t *die,
+        struct die_rangeinfo *ri){
+    Dwarf_Attribute ranges_attr = NULL;
+    get_die_attribute(dbg, dwdie, DW_AT_ranges, &ranges_attr);
 
-    if(ret == DW_DLV_ERROR)
-        dwarf_dealloc(dbg, d_error, DW_DLA_ERROR);
+    if(!ranges_attr)
+        return;
 
-    ret = dwarf_dieoffset((*die)->die_dwarfdie, &((*die)->die_dieoffset),
-            &d_error);
+    Dwarf_Error d_error = NULL;
+    Dwarf_Off rangesoff = 0;
+
+    int ret = dwarf_global_formref(ranges_attr, &rangesoff, &d_error);
+
+    /* Older producers use a constant form for DW_AT_ranges */
+    if(ret == DW_DLV_ERROR){
+        dwarf_dealloc(dbg, d_error, DW_DLA_ERROR);
+        d_error = NULL;
+
+        Dwarf_Unsigned udata = 0;
+        ret = get_form_data_from_attr(dbg, ranges_attr, &udata, FORMUDATA);
+
+        rangesoff = udata;
+        ret = ret ? DW_DLV_ERROR : DW_DLV_OK;
+    }
+
+    dwarf_dealloc(dbg, ranges_attr, DW_DLA_ATTR);
+
+    if(ret != DW_DLV_OK)
+        return;
+
+    Dwarf_Ranges *ranges = NULL;
+    Dwarf_Signed rangescnt = 0;
+    Dwarf_Unsigned bytecnt = 0;
+
+    ret = dwarf_get_ranges_a(dbg, rangesoff, dwdie, &ranges,
+            &rangescnt, &bytecnt, &d_error);
+
+    if(ret == DW_DLV_ERROR)
+        dwarf_dealloc(dbg, d_error, DW_DLA_ERROR);
+
+    if(ret != DW_DLV_OK)
+        return;
+
+    /* Range list entries are relative to the base address of the
+     * compilation unit, unless a base address selection entry says
+     * otherwise.
+     */
+    uint64_t base = ri->ri_low_pc;
+
+    if(die->die_tag != DW_TAG_compile_unit)
+        base = CUR_CU_LOWPC;
+
+    struct pcrange *pcranges = arena_alloc(CUR_ARENA,
+            sizeof(struct pcrange) * rangescnt);
+    int cnt = 0;
+
+    for(Dwarf_Signed i=0; i<rangescnt; i++){
+        Dwarf_Ranges *r = &ranges[i];
+
+        if(r->dwr_type == DW_RANGES_END)
+            break;
+
+        if(r->dwr_type == DW_RANGES_ADDRESS_SELECTION){
+            base = r->dwr_addr2;
+            continue;
+        }
+
+        if(r->dwr_addr1 == r->dwr_addr2)
+            continue;
+
+        pcranges[cnt].pr_lowpc = base + r->dwr_addr1;
+        pcranges[cnt].pr_highpc = base + r->dwr_addr2;
+        cnt++;
+    }
+
+    dwarf_ranges_dealloc(dbg, ranges, rangescnt);
+
+    if(cnt == 0){
+        if(!CUR_ARENA)
+            free(pcranges);
+
+        return;
+    }
+
+    ri->ri_ranges = pcranges;
+    ri->ri_rangescnt = cnt;
+}
+
+static Dwarf_Unsigned get_udata_attr(Dwarf_Debug dbg, Dwarf_Die dwdie,
+        Dwarf_Half whichattr, int *found){
+    Dwarf_Attribute attr = NULL;
+    Dwarf_Unsigned val = 0;
+
+    get_die_attribute(dbg, dwdie, whichattr, &attr);
+
+    *found = attr != NULL;
+
+    if(attr){
+        get_form_data_from_attr(dbg, attr, &val, FORMUDATA);
+        dwarf_dealloc(dbg, attr, DW_DLA_ATTR);
+    }
+
+    return val;
+}
+
+/* DWARF 4 gives a bitfield's offset from the start of the structure.
+ * Before that, it was given from the most significant bit of a storage
+ * unit of DW_AT_byte_size bytes at DW_AT_data_member_location.
+ */
+static void copy_bitfield_info(Dwarf_Debug dbg, Dwarf_Die dwdie,
+        struct die_typeinfo *ti){
+    int found = 0;
+
+    ti->ti_bitsize = get_udata_attr(dbg, dwdie, DW_AT_bit_size, &found);
+
+    if(!found){
+        ti->ti_bitsize = 0;
+        return;
+    }
+
+    ti->ti_bitoff = get_udata_attr(dbg, dwdie, DW_AT_data_bit_offset, &found);
+
+    if(found)
+        return;
+
+    Dwarf_Unsigned msboff = get_udata_attr(dbg, dwdie, DW_AT_bit_offset,
+            &found);
+    Dwarf_Unsigned unitsz = get_udata_attr(dbg, dwdie, DW_AT_byte_size,
+            &found);
+
+    /* Little endian, so the least significant bit comes first */
+    ti->ti_bitoff = (ti->ti_memb_off * 8) + (unitsz * 8) - msboff -
+        ti->ti_bitsize;
+}
+
+static void add_side_records(struct die_typeinfo *ti,
+        struct die_rangeinfo *ri, struct die_locinfo *li){
+    struct die_store *ds = CUR_STORE;
+
+    if(ti->ti_datatypedieoffset || ti->ti_memb_off || ti->ti_bitsize){
+        ds->ds_types = die_grow(ds->ds_types, ds->ds_numtypes,
+                &ds->ds_typescap, sizeof(struct die_typeinfo));
+        ds->ds_types[ds->ds_numtypes++] = *ti;
+    }
+
+    if(ri->ri_low_pc || ri->ri_high_pc || ri->ri_rangescnt ||
+            ri->ri_aboriginoff){
+        ds->ds_ranges = die_grow(ds->ds_ranges, ds->ds_numranges,
+                &ds->ds_rangescap, sizeof(struct die_rangeinfo));
+        ds->ds_ranges[ds->ds_numranges++] = *ri;
+    }
+
+    if(li->li_loclistcnt || li->li_framebaselocdesc){
+        ds->ds_locs = die_grow(ds->ds_locs, ds->ds_numlocs,
+                &ds->ds_locscap, sizeof(struct die_locinfo));
+        ds->ds_locs[ds->ds_numlocs++] = *li;
+    }
+}
+
+/* DIEs are created in node ID order, so appending to the side tables
+ * here keeps them sorted.
+ */
+static int copy_die_info(dwarfinfo_t *dwarfinfo, void *compile_unit,
+        Dwarf_Die dwdie, die_t *die, int level){
+    Dwarf_Debug dbg = dwarfinfo->di_dbg;
+    Dwarf_Error d_error = NULL;
+
+    char *name = NULL;
+    int ret = dwarf_diename(dwdie, &name, &d_error);
+
+    if(ret == DW_DLV_ERROR)
+        dwarf_dealloc(dbg, d_error, DW_DLA_ERROR);
+
+    die->die_nameid = die_intern_name(dbg, name, 1);
+
+    ret = dwarf_dieoffset(dwdie, &die->die_dieoffset, &d_error);
 
     if(ret == DW_DLV_ERROR)
         dwarf_dealloc(dbg, d_error, DW_DLA_ERROR);
 
-    dwarf_tag((*die)->die_dwarfdie, &((*die)->die_tag), &d_error);
+    dwarf_tag(dwdie, &die->die_tag, &d_error);
 
     if(ret == DW_DLV_ERROR)
         dwarf_dealloc(dbg, d_error, DW_DLA_ERROR);
 
-    if(is_anonymous_type(*die)){
-        (*die)->die_anon = 1;
+    struct die_typeinfo ti = { .ti_id = die->die_id };
+    struct die_rangeinfo ri = { .ri_id = die->die_id };
+    struct die_locinfo li = { .li_id = die->die_id };
+
+    if(is_anonymous_type(die)){
+        die->die_anon = 1;
 
         const char *type = "STRUCT";
         int *cnter = &anon_struct_count;
 
-        if((*die)->die_tag == DW_TAG_union_type){
+        if(die->die_tag == DW_TAG_union_type){
             type = "UNION";
             cnter = &anon_union_count;
         }
-        else if((*die)->die_tag == DW_TAG_enumeration_type){
+        else if(die->die_tag == DW_TAG_enumeration_type){
             type = "ENUM";
             cnter = &anon_enum_count;
         }
 
-        concat(&((*die)->die_diename), "ANON_%s_%d", type, (*cnter)++);
+        char *anonname = NULL;
+        concat(&anonname, "ANON_%s_%d", type, (*cnter)++);
+
+        die->die_nameid = die_intern_name(dbg, anonname, 0);
     }
-    else if(is_inlined_subroutine(*die)){
-        (*die)->die_inlinedsub = 1;
+    else if(is_inlined_subroutine(die)){
+        die->die_inlinedsub = 1;
 
         Dwarf_Attribute typeattr = NULL;
-        int ret = dwarf_attr((*die)->die_dwarfdie, DW_AT_abstract_origin,
+        int ret = dwarf_attr(dwdie, DW_AT_abstract_origin,
                 &typeattr, &d_error);
 
         if(ret == DW_DLV_OK){
-            ret = dwarf_global_formref(typeattr, &((*die)->die_aboriginoff),
+            ret = dwarf_global_formref(typeattr, &ri.ri_aboriginoff,
                     &d_error);
 
             if(ret == DW_DLV_ERROR)
@@ -953,50 +1646,65 @@ static int copy_die_info(dwarfinfo_t *dwarfinfo, void *compile_unit,
         }
     }
 
-    dwarf_get_TAG_name((*die)->die_tag, (const char **)&((*die)->die_tagname));
-
     /* Label these ourselves */
-    if(!(*die)->die_diename){
-        if((*die)->die_tag == DW_TAG_lexical_block){
-            concat(&((*die)->die_diename), "LEXICAL_BLOCK_%d",
-                    lex_block_count++);
-            (*die)->die_lexblock = 1;
+    if(die->die_nameid == 0){
+        if(die->die_tag == DW_TAG_lexical_block){
+            char *lexname = NULL;
+            concat(&lexname, "LEXICAL_BLOCK_%d", lex_block_count++);
+
+            die->die_nameid = die_intern_name(dbg, lexname, 0);
+            die->die_lexblock = 1;
         }
     }
 
-    dwarf_die_abbrev_children_flag((*die)->die_dwarfdie,
-            &((*die)->die_haschildren));
+    Dwarf_Half haschildren = 0;
+    dwarf_die_abbrev_children_flag(dwdie, &haschildren);
+    die->die_haschildren = haschildren != 0;
 
-    get_die_data_type_info(dwarfinfo, compile_unit, die, level);
+    get_die_data_type_info(dwarfinfo, compile_unit, dwdie, die, &ti, level);
 
-    ret = dwarf_lowpc((*die)->die_dwarfdie, &((*die)->die_low_pc), &d_error);
+    ret = dwarf_lowpc(dwdie, &ri.ri_low_pc, &d_error);
 
     if(ret == DW_DLV_ERROR)
         dwarf_dealloc(dbg, d_error, DW_DLA_ERROR);
 
     Dwarf_Half retform = 0;
     enum Dwarf_Form_Class retformclass = 0;
-    ret = dwarf_highpc_b((*die)->die_dwarfdie, &((*die)->die_high_pc), &retform,
+    ret = dwarf_highpc_b(dwdie, &ri.ri_high_pc, &retform,
             &retformclass, &d_error);
 
     if(ret == DW_DLV_ERROR)
         dwarf_dealloc(dbg, d_error, DW_DLA_ERROR);
 
-    (*die)->die_high_pc += (*die)->die_low_pc;
+    /* DW_AT_high_pc is only an offset from DW_AT_low_pc when it
+     * isn't an address.
+     */
+    if(ret != DW_DLV_OK || retformclass != DW_FORM_CLASS_ADDRESS)
+        ri.ri_high_pc += ri.ri_low_pc;
+
+    if(die->die_tag == DW_TAG_compile_unit)
+        CUR_CU_LOWPC = ri.ri_low_pc;
+
+    copy_die_ranges(dbg, dwdie, die, &ri);
 
     Dwarf_Attribute memb_attr = NULL;
-    get_die_attribute(dbg, (*die)->die_dwarfdie, DW_AT_data_member_location,
+    get_die_attribute(dbg, dwdie, DW_AT_data_member_location,
             &memb_attr);
 
     // XXX check for location list once expression evaluator is done
     // will have to encounter this
     if(memb_attr)
-        get_form_data_from_attr(dbg, memb_attr, &((*die)->die_memb_off), FORMUDATA);
+        get_form_data_from_attr(dbg, memb_attr, &ti.ti_memb_off, FORMUDATA);
 
     dwarf_dealloc(dbg, memb_attr, DW_DLA_ATTR);
 
-    copy_location_lists(dbg, die, DW_AT_location, level);
-    copy_location_lists(dbg, die, DW_AT_frame_base, level);
+    if(die->die_tag == DW_TAG_member)
+        copy_bitfield_info(dbg, dwdie, &ti);
+
+    copy_location_lists(dbg, dwdie, die, &li, DW_AT_location, level);
+    copy_location_lists(dbg, dwdie, die, &li, DW_AT_frame_base, level);
+
+    add_side_records(&ti, &ri, &li);
 
     return 0;
 }
@@ -1056,26 +1764,35 @@ static void describe_die_internal(die_t *die, int level){
     if(!die)
         return;
 
+    const struct die_typeinfo *ti = die_typeinfo(die);
+    const struct die_type *dt = die_type(die);
+    const struct die_rangeinfo *ri = die_rangeinfo(die);
+    const struct die_locinfo *li = die_locinfo(die);
+    struct die_store *ds = die->die_store;
+    die_t *parent = die_parent(die);
+    char *diename = die_name(die);
+
     const char *varnamecolorstr = LIGHT_MAGENTA;
 
     if(die->die_haschildren)
         varnamecolorstr = GREEN;
 
     printf("%#llx: <%d> <%s>: '%s%s%s', is parent: %d",
-            die->die_dieoffset, level, die->die_tagname,
-            varnamecolorstr, die->die_diename, RESET,
+            die->die_dieoffset, level, get_tag_name(die->die_tag),
+            varnamecolorstr, diename, RESET,
             die->die_haschildren);
 
     printf(", type DIE at %s%#llx%s",
-            die->die_datatypedieoffset!=0?CYAN:"",
-            die->die_datatypedieoffset, die->die_datatypedieoffset!=0?RESET:"");
+            ti->ti_datatypedieoffset!=0?CYAN:"",
+            ti->ti_datatypedieoffset, ti->ti_datatypedieoffset!=0?RESET:"");
 
-    if(die->die_datatypedieoffset!=0){
-        printf(", type = '"LIGHT_BLUE"%s"RESET"'", die->die_datatypename);
+    if(ti->ti_datatypedieoffset!=0){
+        printf(", type = '"LIGHT_BLUE"%s"RESET"'",
+                ds->ds_names[dt->dt_nameid]);
 
         if(die->die_tag != DW_TAG_subprogram){
             printf(", sizeof(%s%s%s) = "LIGHT_YELLOW"%#llx"RESET"",
-                    varnamecolorstr, die->die_diename, RESET, die->die_databytessize);
+                    varnamecolorstr, diename, RESET, dt->dt_bytesize);
         }
     }
 
@@ -1083,7 +1800,7 @@ static void describe_die_internal(die_t *die, int level){
             die->die_tag == DW_TAG_variable ||
             die->die_tag == DW_TAG_member){
         const char *e = NULL;
-        dwarf_get_ATE_name(die->die_datatypeencoding, &e);
+        dwarf_get_ATE_name(dt->dt_encoding, &e);
 
         if(e)
             printf(", data type encoding = "WHITE_BG""BLACK"%s"RESET""RESET_BG, e);
@@ -1101,9 +1818,9 @@ static void describe_die_internal(die_t *die, int level){
                 none?GREEN_BG:RED_BG, none?BLACK:"", RESET, RESET_BG);
     }
    
-    if(die->die_datatypedietag == DW_TAG_array_type){
+    if(dt->dt_tag == DW_TAG_array_type){
         printf(", membsz = %s%s%#llx%s%s",
-                MAGENTA_BG, LIGHT_YELLOW, die->die_arrmembsz,
+                MAGENTA_BG, LIGHT_YELLOW, dt->dt_arrmembsz,
                 RESET, RESET_BG);
     }
 
@@ -1111,35 +1828,41 @@ static void describe_die_internal(die_t *die, int level){
             die->die_tag == DW_TAG_subprogram ||
             die->die_tag == DW_TAG_lexical_block){
         printf(", low PC = "YELLOW"%#llx"RESET", high PC = "YELLOW"%#llx"RESET"",
-                die->die_low_pc, die->die_high_pc);
+                ri->ri_low_pc, ri->ri_high_pc);
+    }
+
+    for(int i=0; i<ri->ri_rangescnt; i++){
+        printf(", range %d = ["YELLOW"%#llx"RESET", "YELLOW"%#llx"RESET")",
+                i, ri->ri_ranges[i].pr_lowpc, ri->ri_ranges[i].pr_highpc);
     }
 
     if(die->die_tag == DW_TAG_member){
-        char *parentname = die->die_parent->die_diename;
+        char *parentname = die_name(parent);
         printf(", offset = "GREEN"%s"RESET"+"LIGHT_GREEN"%#llx"RESET"",
-                parentname, die->die_memb_off);
+                parentname, ti->ti_memb_off);
     }
 
     if(level == 0){
-        printf(", srclinescnt = "MAGENTA"%lld"RESET"", die->die_srclinescnt);
+        printf(", srclinescnt = "MAGENTA"%d"RESET"",
+                linetab_count(ds->ds_linetab));
     }
 
-    if(die->die_loclistcnt > 0){ 
+    if(li->li_loclistcnt > 0){ 
         printf(", loclistcnt = %s%#llx%s",
-                BLUE_BG, die->die_loclistcnt, RESET_BG);
+                BLUE_BG, li->li_loclistcnt, RESET_BG);
     }
 
     if(die->die_inlinedsub)
-        printf(", abstract origin %s%#llx%s", MAGENTA, die->die_aboriginoff, RESET);
+        printf(", abstract origin %s%#llx%s", MAGENTA, ri->ri_aboriginoff, RESET);
 
-    if(!die->die_haschildren && die->die_parent){
-        printf(", parent DIE name '"GREEN"%s"RESET"'\n", die->die_parent->die_diename);
+    if(!die->die_haschildren && parent){
+        printf(", parent DIE name '"GREEN"%s"RESET"'\n", die_name(parent));
     }
-    else if(!die->die_haschildren && !die->die_parent){
+    else if(!die->die_haschildren && !parent){
         printf(", "RED"no parent???"RESET"\n");
     }
-    else if(die->die_haschildren && die->die_parent){
-        printf(", parent DIE name '"GREEN"%s"RESET"'\n", die->die_parent->die_diename);
+    else if(die->die_haschildren && parent){
+        printf(", parent DIE name '"GREEN"%s"RESET"'\n", die_name(parent));
     }
     else{
         putchar('\n');
@@ -1151,11 +1874,11 @@ static void describe_die_internal(die_t *die, int level){
     // XXX for testing read_buffer location lists
     uint64_t pc = 0x1000191d4;
 
-    if(die->die_loclistcnt > 0){
+    if(li->li_loclistcnt > 0){
         putseparator = 1;
 
-        for(Dwarf_Unsigned i=0; i<die->die_loclistcnt; i++){
-            void *current = die->die_loclists[i];
+        for(Dwarf_Unsigned i=0; i<li->li_loclistcnt; i++){
+            void *current = li->li_loclists[i];
 
             int idx2 = 0;
             while(current){
@@ -1170,7 +1893,7 @@ static void describe_die_internal(die_t *die, int level){
                 current = get_next_location_description(current);
             }
 
-            current = die->die_loclists[i];
+            current = li->li_loclists[i];
 
             if(current){
                 write_tabs(level);
@@ -1190,7 +1913,7 @@ static void describe_die_internal(die_t *die, int level){
                 uint64_t result = 0;
 
                 char *loc_desc_decoded =
-                    decode_location_description(die->die_framebaselocdesc,
+                    decode_location_description(li->li_framebaselocdesc,
                             current, pc, &result);
                 printf(" Decoded: '%s'\n", loc_desc_decoded);
                 free(loc_desc_decoded);
@@ -1198,9 +1921,9 @@ static void describe_die_internal(die_t *die, int level){
         }
     }
 
-    if(die->die_framebaselocdesc){
+    if(li->li_framebaselocdesc){
         int byteswritten = 0;
-        describe_location_description(die->die_framebaselocdesc, 1, 0, 0, level, &byteswritten);
+        describe_location_description(li->li_framebaselocdesc, 1, 0, 0, level, &byteswritten);
         if(byteswritten > maxbyteswritten)
             maxbyteswritten = byteswritten;
 
@@ -1222,8 +1945,8 @@ static void describe_die_internal(die_t *die, int level){
 
         uint64_t result = 0;
         char *loc_desc_decoded =
-            decode_location_description(die->die_framebaselocdesc,
-                    die->die_framebaselocdesc, pc, &result);
+            decode_location_description(li->li_framebaselocdesc,
+                    li->li_framebaselocdesc, pc, &result);
         printf(" Decoded: '%s'\n", loc_desc_decoded);
         free(loc_desc_decoded);
 
@@ -1245,27 +1968,7 @@ static void describe_die_internal(die_t *die, int level){
     }
 }
 
-static die_t *create_new_die(dwarfinfo_t *dwarfinfo, void *compile_unit,
-        Dwarf_Die based_on, int level){
-    if(!based_on)
-        return NULL;
-
-    die_t *d = calloc(1, sizeof(die_t));
-    d->die_dwarfdie = based_on;
-
-    copy_die_info(dwarfinfo, compile_unit, &d, level);
-
-    if(d->die_haschildren){
-        d->die_children = malloc(sizeof(die_t));
-        d->die_children[0] = NULL;
-
-        d->die_numchildren = 0;
-    }
-
-    return d;
-}
-
-static int should_add_die_to_tree(die_t *die){
+static int should_add_die_to_tree(Dwarf_Half tag){
     const static Dwarf_Half accepted_tags[] = {
         DW_TAG_compile_unit, DW_TAG_subprogram, DW_TAG_inlined_subroutine,
         DW_TAG_formal_parameter, DW_TAG_enumeration_type, DW_TAG_enumerator,
@@ -1276,23 +1979,107 @@ static int should_add_die_to_tree(die_t *die){
     size_t count = sizeof(accepted_tags) / sizeof(Dwarf_Half);
 
     for(size_t i=0; i<count; i++){
-        if(die->die_tag == accepted_tags[i])
+        if(tag == accepted_tags[i])
             return 1;
     }
 
     return 0;
 }
 
-static void add_die_to_tree(die_t *current, int level){
+static void init_die(die_t *die, struct die_store *ds, int id){
+    memset(die, 0, sizeof(die_t));
+
+    die->die_store = ds;
+    die->die_id = id;
+    die->die_parent = DIE_NONE;
+    die->die_firstchild = DIE_NONE;
+    die->die_sibling = DIE_NONE;
+}
+
+/* Add a DIE to the store being built and return its node ID. Returns
+ * DIE_NONE if based_on has a tag we don't keep in the tree, so none of
+ * its attributes are read.
+ */
+static int create_new_die(dwarfinfo_t *dwarfinfo, void *compile_unit,
+        Dwarf_Die based_on, int level){
+    if(!based_on)
+        return DIE_NONE;
+
+    Dwarf_Half tag = 0;
+
+    if(dwarf_tag(based_on, &tag, NULL) != DW_DLV_OK ||
+            !should_add_die_to_tree(tag)){
+        return DIE_NONE;
+    }
+
+    struct die_store *ds = CUR_STORE;
+
+    ds->ds_nodes = die_grow(ds->ds_nodes, ds->ds_numnodes, &ds->ds_nodescap,
+            sizeof(die_t));
+
+    int id = ds->ds_numnodes++;
+    die_t *d = &ds->ds_nodes[id];
+
+    init_die(d, ds, id);
+    copy_die_info(dwarfinfo, compile_unit, based_on, d, level);
+
+    return id;
+}
+
+/* Create a root DIE and the store for the rest of its tree. Nothing
+ * here comes from an arena.
+ */
+static die_t *create_root_die(dwarfinfo_t *dwarfinfo, void *compile_unit,
+        Dwarf_Die based_on){
+    if(!based_on)
+        return NULL;
+
+    struct die_store *ds = calloc(1, sizeof(struct die_store));
+    die_t *root = calloc(1, sizeof(die_t));
+
+    init_die(root, ds, 0);
+
+    ds->ds_root = root;
+    ds->ds_numnodes = 1;
+    ds->ds_rootfirstchild = DIE_NONE;
+
+    /* Name ID 0 is no name */
+    ds->ds_names = die_grow(ds->ds_names, 0, &ds->ds_namescap,
+            sizeof(char *));
+    ds->ds_names[0] = NULL;
+    ds->ds_numnames = 1;
+
+    reset_cur_parents();
+
+    CUR_STORE = ds;
+    CUR_ARENA = NULL;
+
+    copy_die_info(dwarfinfo, compile_unit, based_on, root, 0);
+
+    CUR_STORE = NULL;
+
+    ds->ds_numrootnames = ds->ds_numnames;
+
+    /* Every store this root DIE ever has shares these records, so
+     * they can't be filled in later.
+     */
+    die_compile_locations(root, die_locinfo_for_compile(root));
+
+    return root;
+}
+
+static void add_die_to_tree(int id, int level){
+    die_t *current = die_node(CUR_STORE, id);
+
     if(level == 0){
-        CUR_PARENTS[level] = current;
+        CUR_PARENTS[level] = id;
         return;
     }
 
-    die_t *parent = NULL;
+    int parent = DIE_NONE;
 
     if(current->die_haschildren){
-        CUR_PARENTS[level] = current;
+        CUR_PARENTS[level] = id;
         parent = CUR_PARENTS[level - 1];
     }
     else{
@@ -1302,84 +2089,72 @@ static void add_die_to_tree(die_t *current, int level){
         /* Find the closest valid parent. We could be multiple levels
          * deep without seeing `level` amount of parent DIEs.
          */
-        while(!parent)
+        while(parent == DIE_NONE)
             parent = CUR_PARENTS[level - (++sub)];
     }
 
-    if(parent){
-        die_t **children = realloc(parent->die_children,
-                (++parent->die_numchildren) * sizeof(die_t));
-        parent->die_children = children;
-        parent->die_children[parent->die_numchildren - 1] = current;
-        parent->die_children[parent->die_numchildren] = NULL;
+    if(parent != DIE_NONE){
+        die_t *p = die_node(CUR_STORE, parent);
+
+        /* Children are linked newest first here, and put back in
+         * order by link_die_children once the tree is built.
+         */
+        current->die_sibling = p->die_firstchild;
+        p->die_firstchild = id;
 
         current->die_parent = parent;
     }
 }
 
-static void die_free(Dwarf_Debug dbg, die_t *die, int critical){
-    if(!die)
-        return;
+static void link_die_children(struct die_store *ds){
+    for(int i=0; i<ds->ds_numnodes; i++){
+        die_t *die = die_node(ds, i);
+        int prev = DIE_NONE, cur = die->die_firstchild;
 
-    if(critical){
-        if(die->die_dwarfdie){
-            dwarf_dealloc(dbg, die->die_dwarfdie, DW_DLA_DIE);
-            die->die_dwarfdie = NULL;
-        }
-    }
-    else{
-        free(die->die_children);
-        die->die_children = NULL;
-    }
+        while(cur != DIE_NONE){
+            die_t *child = die_node(ds, cur);
+            int next = child->die_sibling;
 
-    if(die->die_srclines){
-        dwarf_srclines_dealloc(dbg, die->die_srclines, die->die_srclinescnt);
-        die->die_srclines = NULL;
-    }
+            child->die_sibling = prev;
+            prev = cur;
+            cur = next;
+        }
 
-    if(!die->die_anon && !die->die_lexblock){
-        if(die->die_diename)
-            dwarf_dealloc(dbg, die->die_diename, DW_DLA_STRING);
-    }
-    else{
-        free(die->die_diename);
+        die->die_firstchild = prev;
     }
 
-    die->die_diename = NULL;
+    ds->ds_rootfirstchild = ds->ds_root->die_firstchild;
+}
 
-    if(die->die_datatypedie){
-        dwarf_dealloc(dbg, die->die_datatypedie, DW_DLA_DIE);
-        die->die_datatypedie = NULL;
-    }
+/* Free what the root DIE's side table records point to, which
+ * are on the heap.
+ */
+static void free_root_side_records(struct die_store *ds){
+    for(int i=0; i<ds->ds_numranges && ds->ds_ranges[i].ri_id == 0; i++)
+        free(ds->ds_ranges[i].ri_ranges);
 
-    /* see get_die_data_type_info */
-    if(die->die_datatypedietag == DW_TAG_base_type ||
-            die->die_datatypedietag == DW_TAG_enumeration_type){
-        dwarf_dealloc(dbg, die->die_datatypename, DW_DLA_STRING);
-    }
-    else{
-        free(die->die_datatypename);
-    }
+    for(int i=0; i<ds->ds_numlocs && ds->ds_locs[i].li_id == 0; i++){
+        struct die_locinfo *li = &ds->ds_locs[i];
 
-    for(int i=0; i<die->die_arrdimslen; i++)
-        free(die->die_arrdims[i]);
-    free(die->die_arrdims);
+        for(Dwarf_Unsigned k=0; k<li->li_loclistcnt; k++)
+            loc_free(li->li_loclists[k]);
 
-    die->die_arrdims = NULL;
+        free(li->li_loclists);
+        loc_free(li->li_framebaselocdesc);
 
-    for(Dwarf_Unsigned i=0; i<die->die_loclistcnt; i++)
-        loc_free(die->die_loclists[i]);
+        if(li->li_compiled){
+            for(int k=0; k<li->li_numranges; k++)
+                free(li->li_ranges[k].lr_prog);
 
-    if(die->die_loclists){
-        free(die->die_loclists);
-        die->die_loclists = NULL;
-        die->die_loclistcnt = 0;
+            /* The root DIE has no subprogram to share a frame base with */
+            free(li->li_ranges);
+            free(li->li_anyprog);
+            free(li->li_frameprog);
+        }
     }
 
-    if(die->die_framebaselocdesc){
-        loc_free(die->die_framebaselocdesc);
-        die->die_framebaselocdesc = NULL;
-    }
+    for(int i=1; i<ds->ds_numrootnames; i++)
+        free(ds->ds_names[i]);
 }
 
 /* This tree only contains DIEs with these tags:
@@ -1397,60 +2172,55 @@ static void die_free(Dwarf_Debug dbg, die_t *die, int critical){
  * It becomes too much to keep track off every possible
  * aspect of a DIE, and we're able to retrieve the info we need if
  * we already have a target DIE.
+ *
+ * current is the node ID for first_die, or DIE_NONE if it isn't
+ * something we keep. We still need to look at its children. No
+ * libdwarf DIE is held onto once it has been looked at, except for
+ * first_die, which belongs to the caller.
  */
 static void construct_die_tree(dwarfinfo_t *dwarfinfo, void *compile_unit,
-        die_t *current, int level){
+        Dwarf_Die first_die, int current, int level){
     int is_info = 1;
-    Dwarf_Die child_die = NULL, cur_die = current->die_dwarfdie;
-    Dwarf_Die cur_die_backup = NULL;
+    Dwarf_Die child_die = NULL, cur_die = first_die;
     Dwarf_Error d_error = NULL;
 
     int ret = DW_DLV_OK;
 
-    /* We don't want to deallocate the DWARF DIE associated with the
-     * parameter because it is used in dwarf_siblingof_b.
-     */
-    int critical = 0;
-
-    if(should_add_die_to_tree(current))
+    if(current != DIE_NONE)
         add_die_to_tree(current, level);
-    else{
-        die_free(dwarfinfo->di_dbg, current, critical);
-        free(current);
-        current = NULL;
-    }
 
     for(;;){
         ret = dwarf_child(cur_die, &child_die, NULL);
 
         if(ret == DW_DLV_OK){
-            die_t *cd = create_new_die(dwarfinfo, compile_unit, child_die, level);
-            construct_die_tree(dwarfinfo, compile_unit, cd, level+1);
+            int cd = create_new_die(dwarfinfo, compile_unit, child_die, level);
+            construct_die_tree(dwarfinfo, compile_unit, child_die, cd, level+1);
+
+            dwarf_dealloc(dwarfinfo->di_dbg, child_die, DW_DLA_DIE);
         }
 
         Dwarf_Die sibling_die = NULL;
         ret = dwarf_siblingof_b(dwarfinfo->di_dbg, cur_die, is_info,
                 &sibling_die, &d_error);
 
+        if(cur_die != first_die)
+            dwarf_dealloc(dwarfinfo->di_dbg, cur_die, DW_DLA_DIE);
+
         if(ret == DW_DLV_ERROR)
             dwarf_dealloc(dwarfinfo->di_dbg, d_error, DW_DLA_ERROR);
-        else if(ret == DW_DLV_NO_ENTRY){
+
+        if(ret != DW_DLV_OK){
             /* Discard the parent we were on */
-            CUR_PARENTS[level] = NULL;
+            CUR_PARENTS[level] = DIE_NONE;
             return;
         }
 
         cur_die = sibling_die;
 
-        die_t *newdie = create_new_die(dwarfinfo, compile_unit, cur_die, level);
+        int newdie = create_new_die(dwarfinfo, compile_unit, cur_die, level);
 
-        if(should_add_die_to_tree(newdie))
+        if(newdie != DIE_NONE)
             add_die_to_tree(newdie, level);
-        else{
-            die_free(dwarfinfo->di_dbg, newdie, critical);
-            free(newdie);
-            newdie = NULL;
-        }
     }
 }
 
@@ -1461,16 +2231,9 @@ static void display_die_tree_internal(die_t *die, int level){
     write_tabs(level);
     describe_die_internal(die, level);
 
-    if(!die->die_haschildren)
-        return;
-    else{
-        int idx = 0;
-        die_t *child = die->die_children[idx];
-
-        while(child){
-            display_die_tree_internal(child, level+1);
-            child = die->die_children[++idx];
-        }
+    for(die_t *child = die_first_child(die); child;
+            child = die_next_sibling(child)){
+        display_die_tree_internal(child, level+1);
     }
 }
 
@@ -1482,38 +2245,31 @@ void die_display_die_tree_starting_from(die_t *die){
     display_die_tree_internal(die, 0);
 }
 
+/* Free everything a compilation unit's root DIE owns, including the
+ * tree under it. The root DIE itself is not freed.
+ */
 void die_tree_free(Dwarf_Debug dbg, die_t *die, int level){
-    if(!die)
+    if(!die || !die->die_store)
         return;
 
-    int critical = 1;
-    die_free(dbg, die, critical);
+    struct die_store *ds = die->die_store;
 
-    if(!die->die_haschildren)
-        return;
-    else{
-        int idx = 0;
-        die_t *child = die->die_children[idx];
-
-        while(child){
-            die_tree_free(dbg, child, level+1);
-            free(die->die_children[idx]);
-            die->die_children[idx] = NULL;
-            child = die->die_children[++idx];
-        }
+    /* Nobody can be reading this anymore */
+    free_root_side_records(ds);
+    die_store_free(ds);
 
-        free(die->die_children);
-        die->die_children = NULL;
-    }
+    die->die_store = NULL;
+    die->die_firstchild = DIE_NONE;
 }
 
 #define INDENT_INCRE (2)
 
 static int create_array_desc(die_t *die, char **desc, int curdimnum,
         int indent){
-    struct arrdim *curdim = die->die_arrdims[curdimnum];
+    const struct die_type *dt = die_type(die);
+    const struct arrdim *curdim = &dt->dt_arrdims[curdimnum];
 
-    if(curdimnum == die->die_arrdimslen-1){
+    if(curdimnum == dt->dt_arrdimslen-1){
         for(int i=0; i<curdim->sz; i++)
             concat(desc, "%*s[%d] = [value here]\n", indent, "", i);
 
@@ -1534,6 +2290,9 @@ int die_create_variable_or_parameter_desc(die_t *die, void *cu_root_die,
     if(!die)
         return 0;
 
+    char *typename = die->die_store->ds_names[die_type(die)->dt_nameid];
+    char *diename = die_name(die);
+
     if(!(die->die_datatypeclass & DTC_POINTER)){
         if(die->die_datatypeclass & DTC_STRUCT ||
                 die->die_datatypeclass & DTC_UNION){
@@ -1542,8 +2301,6 @@ int die_create_variable_or_parameter_desc(die_t *die, void *cu_root_die,
 
             die_get_members(die, cu_root_die, &members, &len, e);
 
-            char *typename = die->die_datatypename;
-            
             if(!typename){
                 if(die->die_datatypeclass & DTC_STRUCT)
                     typename = "(anonymous struct)";
@@ -1552,7 +2309,7 @@ int die_create_variable_or_parameter_desc(die_t *die, void *cu_root_die,
             }
 
             concat(desc, "%*s(%s) %s = {\n",
-                    indent, "", typename, die->die_diename);
+                    indent, "", typename, diename);
 
             for(int i=0; i<len; i++){
                 die_create_variable_or_parameter_desc(members[i], cu_root_die,
@@ -1570,7 +2327,7 @@ int die_create_variable_or_parameter_desc(die_t *die, void *cu_root_die,
 
     if(die->die_datatypeclass & DTC_ARRAY){
         concat(desc, "%*s(%s) %s = {\n",
-                indent, "", die->die_datatypename, die->die_diename);
+                indent, "", typename, diename);
         create_array_desc(die, desc, 0, indent+INDENT_INCRE);
         concat(desc, "%*s}", indent, "");
 
@@ -1580,171 +2337,393 @@ int die_create_variable_or_parameter_desc(die_t *die, void *cu_root_die,
     if(die->die_datatypeclass & DTC_POINTER ||
             die->die_datatypeclass & DTC_OTHER){
         concat(desc, "%*s(%s) %s = [value here]",
-                indent, "", die->die_datatypename, die->die_diename);
+                indent, "", typename, diename);
     }
 
     return 0;
 }
 
-int die_evaluate_location_description(die_t *die, uint64_t pc,
-        uint64_t *resultout, sym_error_t *e){
+static int locrange_cmp(const void *a, const void *b){
+    const struct die_locrange *ra = a;
+    const struct die_locrange *rb = b;
+
+    if(ra->lr_lopc < rb->lr_lopc)
+        return -1;
+    else if(ra->lr_lopc > rb->lr_lopc)
+        return 1;
+
+    return 0;
+}
+
+/* Compiling caches programs in the location record, which is only
+ * read-only for DIEs sharing NO_LOCINFO.
+ */
+static struct die_locinfo *die_locinfo_for_compile(die_t *die){
+    return (struct die_locinfo *)die_locinfo(die);
+}
+
+/* Like die_create_variable_or_parameter_desc, but with the values of
+ * everything, read from the target. This DIE's value lives at addr.
+ */
+int die_create_value_desc(die_t *die, uint64_t addr,
+        int (*readmem)(void *, uint64_t, void *, size_t), void *arg,
+        int maxdepth, char **descout, sym_error_t *e){
     if(!die){
         errset(e, GENERIC_ERROR_KIND, GE_INVALID_DIE);
         return 1;
     }
 
-    if(!resultout){
+    if(!readmem || !descout){
         errset(e, GENERIC_ERROR_KIND, GE_INVALID_PARAMETER);
         return 1;
     }
 
-    /* Iterate over all the location lists until we find the right one. */
-    for(Dwarf_Signed i=0; i<die->die_loclistcnt; i++){
-        void *current = die->die_loclists[i];
+    void *canon = die_type(die)->dt_canon;
+
+    if(!canon){
+        errset(e, DIE_ERROR_KIND, DIE_NO_DATA_TYPE);
+        return 1;
+    }
+
+    return valread_describe_value(canon, die_name(die), addr, readmem, arg,
+            maxdepth, descout);
+}
+
+/* Compile this DIE's location descriptions if that hasn't been done yet.
+ * DIEs without any location share NO_LOCINFO, which has nothing to
+ * compile, so it's never written to.
+ */
+static void die_compile_locations(die_t *die, struct die_locinfo *li){
+    if(li->li_compiled || li == &NO_LOCINFO)
+        return;
+
+    /* The root DIE's records are on the heap */
+    void *arena = die->die_id == 0 ? NULL : die->die_store->ds_arena;
+
+    if(li->li_loclistcnt > 0){
+        li->li_ranges = arena_alloc(arena,
+                sizeof(struct die_locrange) * li->li_loclistcnt);
+    }
+
+    for(Dwarf_Unsigned i=0; i<li->li_loclistcnt; i++){
+        void *prog = compile_location_description(arena,
+                li->li_loclists[i]);
 
-        if(current && !is_locdesc_in_bounds(current, pc))
+        if(!prog)
             continue;
 
-        char *s = decode_location_description(die->die_framebaselocdesc,
-                current, pc, resultout);
-        free(s);
-        break;
+        uint64_t lopc, hipc;
+
+        if(!locprog_get_bounds(prog, &lopc, &hipc)){
+            li->li_anyprog = prog;
+            continue;
+        }
+
+        struct die_locrange *lr = &li->li_ranges[li->li_numranges++];
+
+        lr->lr_lopc = lopc;
+        lr->lr_hipc = hipc;
+        lr->lr_prog = prog;
     }
 
-    return 0;
-}
+    qsort(li->li_ranges, li->li_numranges, sizeof(struct die_locrange),
+            locrange_cmp);
 
-int die_get_array_elem_size(die_t *die, uint64_t *elemszout, sym_error_t *e){
-    if(!die){
-        errset(e, GENERIC_ERROR_KIND, GE_INVALID_DIE);
-        return 1;
+    /* A variable's copy of the frame base is the same as its
+     * subprogram's, so compile that one once and point to it.
+     */
+    if(li->li_framebaselocdesc && die->die_tag != DW_TAG_subprogram){
+        for(die_t *p = die_parent(die); p; p = die_parent(p)){
+            if(p->die_tag != DW_TAG_subprogram)
+                continue;
+
+            struct die_locinfo *pli = die_locinfo_for_compile(p);
+
+            die_compile_locations(p, pli);
+            li->li_frameprog = pli->li_frameprog;
+            break;
+        }
     }
 
-    if(!elemszout){
-        errset(e, GENERIC_ERROR_KIND, GE_INVALID_PARAMETER);
-        return 1;
+    if(!li->li_frameprog){
+        li->li_frameprog = compile_location_description(arena,
+                li->li_framebaselocdesc);
     }
 
-    *elemszout = die->die_arrmembsz;
-    return 0;
+    li->li_compiled = 1;
 }
 
-int die_get_array_size_determined_at_runtime(die_t *die, int *retval,
+/* Which compiled location applies at pc. Location list entries
+ * don't overlap, so the only candidate is the last one starting
+ * at or before pc.
+ */
+static void *die_find_locprog(struct die_locinfo *li, uint64_t pc){
+    int lo = 0, hi = li->li_numranges;
+
+    while(lo < hi){
+        int mid = lo + ((hi - lo) / 2);
+
+        if(li->li_ranges[mid].lr_lopc <= pc)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    if(lo > 0 && pc < li->li_ranges[lo - 1].lr_hipc)
+        return li->li_ranges[lo - 1].lr_prog;
+
+    return li->li_anyprog;
+}
+
+enum { MAX_LOCATION_PIECES = 32 };
+
+static int die_evaluate_location_into(die_t *die, uint64_t pc,
+        int *fbknown, uint64_t *fb, void **fbprog,
+        int (*readreg)(void *, int, uint64_t *),
+        int (*readmem)(void *, uint64_t, void *, size_t), void *arg,
+        int *kinds, uint64_t *values, uint64_t *sizes, int *npieces,
         sym_error_t *e){
-    if(!die){
-        errset(e, GENERIC_ERROR_KIND, GE_INVALID_DIE);
+    struct die_locinfo *li = die_locinfo_for_compile(die);
+
+    die_compile_locations(die, li);
+
+    void *prog = die_find_locprog(li, pc);
+
+    if(!prog){
+        errset(e, DIE_ERROR_KIND, DIE_NO_LOCATION);
         return 1;
     }
 
-    if(!retval){
-        errset(e, GENERIC_ERROR_KIND, GE_INVALID_PARAMETER);
+    /* Only reuse a frame base computed for this same function */
+    if(fbprog && *fbprog != li->li_frameprog){
+        *fbknown = 0;
+        *fbprog = li->li_frameprog;
+    }
+
+    if(locprog_eval(prog, li->li_frameprog, fbknown, fb, readreg, readmem,
+                arg, kinds, values, sizes, MAX_LOCATION_PIECES, npieces)){
+        errset(e, DIE_ERROR_KIND, DIE_LOCATION_EVAL_FAILED);
         return 1;
     }
 
-    *retval = die->die_databytessize == NON_COMPILE_TIME_CONSTANT_SIZE;
     return 0;
 }
 
-int die_get_data_type_str(die_t *die, char **datatypeout, sym_error_t *e){
+/* Evaluate the location of this DIE at pc. Registers and memory of the
+ * target are read through the callbacks given, which can be NULL if the
+ * location doesn't need them. Register numbers given to readreg are
+ * DWARF register numbers. A location made up of DW_OP_piece operations
+ * results in more than one piece. All three arrays must be freed.
+ */
+int die_evaluate_location(die_t *die, uint64_t pc,
+        int (*readreg)(void *, int, uint64_t *),
+        int (*readmem)(void *, uint64_t, void *, size_t), void *arg,
+        int **kindsout, uint64_t **valuesout, uint64_t **sizesout,
+        int *lenout, sym_error_t *e){
     if(!die){
         errset(e, GENERIC_ERROR_KIND, GE_INVALID_DIE);
         return 1;
     }
 
-    if(!datatypeout){
+    if(!kindsout || !valuesout || !sizesout || !lenout){
         errset(e, GENERIC_ERROR_KIND, GE_INVALID_PARAMETER);
         return 1;
     }
 
-    if(!die->die_datatypename){
-        errset(e, DIE_ERROR_KIND, DIE_NO_DATA_TYPE_NAME);
+    int kinds[MAX_LOCATION_PIECES];
+    uint64_t values[MAX_LOCATION_PIECES], sizes[MAX_LOCATION_PIECES];
+    int npieces = 0;
+
+    if(die_evaluate_location_into(die, pc, NULL, NULL, NULL, readreg,
+                readmem, arg, kinds, values, sizes, &npieces, e)){
         return 1;
     }
 
-    strncpy(*datatypeout, die->die_datatypename, strlen(die->die_datatypename));
+    *kindsout = malloc(sizeof(int) * npieces);
+    *valuesout = malloc(sizeof(uint64_t) * npieces);
+    *sizesout = malloc(sizeof(uint64_t) * npieces);
+
+    memcpy(*kindsout, kinds, sizeof(int) * npieces);
+    memcpy(*valuesout, values, sizeof(uint64_t) * npieces);
+    memcpy(*sizesout, sizes, sizeof(uint64_t) * npieces);
+
+    *lenout = npieces;
 
     return 0;
 }
 
-int die_get_encoding(die_t *die, uint64_t *encodingout, sym_error_t *e){
-    if(!die){
-        errset(e, GENERIC_ERROR_KIND, GE_INVALID_DIE);
-        return 1;
+/* The same as die_evaluate_location, but for many DIEs at the same pc,
+ * like every local of a frame. The pieces of every DIE are put one
+ * after the other, and piece counts has one element per DIE. A DIE
+ * with no location at pc, or whose location couldn't be evaluated,
+ * has a piece count of zero. A frame base is only computed once for
+ * DIEs from the same function which are next to each other.
+ * All four arrays must be freed.
+ */
+int die_evaluate_locations(die_t **dies, int numdies, uint64_t pc,
+        int (*readreg)(void *, int, uint64_t *),
+        int (*readmem)(void *, uint64_t, void *, size_t), void *arg,
+        int **kindsout, uint64_t **valuesout, uint64_t **sizesout,
+        int **piececntsout, sym_error_t *e){
+    if(!dies || numdies < 0 || !kindsout || !valuesout || !sizesout ||
+            !piececntsout){
+        errset(e, GENERIC_ERROR_KIND, GE_INVALID_PARAMETER);
+        return 1;
     }
 
-    if(!encodingout){
+    int *kinds = NULL, *piececnts = calloc(numdies + 1, sizeof(int));
+    uint64_t *values = NULL, *sizes = NULL;
+    int len = 0, cap = 0;
+
+    int fbknown = 0;
+    uint64_t fb = 0;
+    void *fbprog = NULL;
+
+    for(int i=0; i<numdies; i++){
+        if(!dies[i])
+            continue;
+
+        if(cap - len < MAX_LOCATION_PIECES){
+            cap = (cap * 2) + MAX_LOCATION_PIECES;
+
+            kinds = realloc(kinds, sizeof(int) * cap);
+            values = realloc(values, sizeof(uint64_t) * cap);
+            sizes = realloc(sizes, sizeof(uint64_t) * cap);
+        }
+
+        int npieces = 0;
+
+        if(die_evaluate_location_into(dies[i], pc, &fbknown, &fb, &fbprog,
+                    readreg, readmem, arg, kinds + len, values + len,
+                    sizes + len, &npieces, NULL)){
+            continue;
+        }
+
+        piececnts[i] = npieces;
+        len += npieces;
+    }
+
+    *kindsout = kinds;
+    *valuesout = values;
+    *sizesout = sizes;
+    *piececntsout = piececnts;
+
+    return 0;
+}
+
+/* Only works for locations which don't depend on the target's registers
+ * or memory, like those of global variables. The value of the first
+ * piece is given back.
+ */
+int die_evaluate_location_description(die_t *die, uint64_t pc,
+        uint64_t *resultout, sym_error_t *e){
+    if(!resultout){
         errset(e, GENERIC_ERROR_KIND, GE_INVALID_PARAMETER);
         return 1;
     }
 
-    *encodingout = die->die_datatypeencoding;
+    int *kinds = NULL, npieces = 0;
+    uint64_t *values = NULL, *sizes = NULL;
+
+    if(die_evaluate_location(die, pc, NULL, NULL, NULL, &kinds, &values,
+                &sizes, &npieces, e)){
+        return 1;
+    }
+
+    if(npieces > 0)
+        *resultout = values[0];
+
+    free(kinds);
+    free(values);
+    free(sizes);
+
     return 0;
 }
 
-int die_get_high_pc(die_t *die, uint64_t *highpcout, sym_error_t *e){
+int die_get_array_elem_size(die_t *die, uint64_t *elemszout, sym_error_t *e){
     if(!die){
         errset(e, GENERIC_ERROR_KIND, GE_INVALID_DIE);
         return 1;
     }
 
-    if(!highpcout){
+    if(!elemszout){
         errset(e, GENERIC_ERROR_KIND, GE_INVALID_PARAMETER);
         return 1;
     }
 
-    *highpcout = die->die_high_pc;
+    *elemszout = die_type(die)->dt_arrmembsz;
     return 0;
 }
 
-static char *get_dwarf_line_filename(Dwarf_Debug dbg, Dwarf_Line line){
-    if(!line)
-        return NULL;
-
-    Dwarf_Error d_error = NULL;
-    char *filename = NULL;
-
-    int ret = dwarf_linesrc(line, &filename, &d_error);
+int die_get_array_size_determined_at_runtime(die_t *die, int *retval,
+        sym_error_t *e){
+    if(!die){
+        errset(e, GENERIC_ERROR_KIND, GE_INVALID_DIE);
+        return 1;
+    }
 
-    if(ret == DW_DLV_ERROR){
-        dwarf_dealloc(dbg, d_error, DW_DLA_ERROR);
-        return NULL;
+    if(!retval){
+        errset(e, GENERIC_ERROR_KIND, GE_INVALID_PARAMETER);
+        return 1;
     }
 
-    return filename;
+    *retval = die_type(die)->dt_bytesize ==
+        NON_COMPILE_TIME_CONSTANT_SIZE;
+    return 0;
 }
 
-static Dwarf_Unsigned get_dwarf_line_lineno(Dwarf_Debug dbg, Dwarf_Line line){
-    if(!line)
-        return 0;
+int die_get_data_type_str(die_t *die, char **datatypeout, sym_error_t *e){
+    if(!die){
+        errset(e, GENERIC_ERROR_KIND, GE_INVALID_DIE);
+        return 1;
+    }
 
-    Dwarf_Error d_error = NULL;
-    Dwarf_Unsigned lineno = 0;
+    if(!datatypeout){
+        errset(e, GENERIC_ERROR_KIND, GE_INVALID_PARAMETER);
+        return 1;
+    }
 
-    int ret = dwarf_lineno(line, &lineno, &d_error);
+    char *typename =
+        die->die_store->ds_names[die_type(die)->dt_nameid];
 
-    if(ret == DW_DLV_ERROR){
-        dwarf_dealloc(dbg, d_error, DW_DLA_ERROR);
-        return 0;
+    if(!typename){
+        errset(e, DIE_ERROR_KIND, DIE_NO_DATA_TYPE_NAME);
+        return 1;
     }
 
-    return lineno;
+    strncpy(*datatypeout, typename, strlen(typename));
+
+    return 0;
 }
 
-static Dwarf_Addr get_dwarf_line_virtual_addr(Dwarf_Debug dbg, Dwarf_Line line){
-    if(!line)
-        return 0;
+int die_get_encoding(die_t *die, uint64_t *encodingout, sym_error_t *e){
+    if(!die){
+        errset(e, GENERIC_ERROR_KIND, GE_INVALID_DIE);
+        return 1;
+    }
 
-    Dwarf_Error d_error = NULL;
-    Dwarf_Addr lineaddr = 0;
+    if(!encodingout){
+        errset(e, GENERIC_ERROR_KIND, GE_INVALID_PARAMETER);
+        return 1;
+    }
 
-    int ret = dwarf_lineaddr(line, &lineaddr, &d_error);
+    *encodingout = die_type(die)->dt_encoding;
+    return 0;
+}
 
-    if(ret == DW_DLV_ERROR){
-        dwarf_dealloc(dbg, d_error, DW_DLA_ERROR);
-        return 0;
+int die_get_high_pc(die_t *die, uint64_t *highpcout, sym_error_t *e){
+    if(!die){
+        errset(e, GENERIC_ERROR_KIND, GE_INVALID_DIE);
+        return 1;
+    }
+
+    if(!highpcout){
+        errset(e, GENERIC_ERROR_KIND, GE_INVALID_PARAMETER);
+        return 1;
     }
 
-    return lineaddr;
+    *highpcout = die_rangeinfo(die)->ri_high_pc;
+    return 0;
 }
 
 int die_get_line_info_from_pc(Dwarf_Debug dbg, die_t *die, uint64_t pc,
@@ -1761,45 +2740,38 @@ int die_get_line_info_from_pc(Dwarf_Debug dbg, die_t *die, uint64_t pc,
         return 1;
     }
 
-    for(Dwarf_Signed i=0; i<die->die_srclinescnt; i++){
-        Dwarf_Line line = die->die_srclines[i];
+    /* pc does not have to be the start of a line */
+    int row = linetab_find_row(die->die_store->ds_linetab, pc, 0);
 
-        if(pc == get_dwarf_line_virtual_addr(dbg, line)){
-            char *fname = get_dwarf_line_filename(dbg, line);
-
-            /* We are only interested in the file name */
-            if(fname){
-                char *slash = strrchr(fname, '/');
-
-                if(slash)
-                    *srcfilename = strdup(slash + 1);
-                else
-                    *srcfilename = strdup(fname);
-
-                dwarf_dealloc(dbg, fname, DW_DLA_STRING);
-            }
+    if(row == -1){
+        errset(e, DIE_ERROR_KIND, DIE_COULD_NOT_GET_LINE_INFO);
+        return 1;
+    }
 
-            *srclineno = get_dwarf_line_lineno(dbg, line);
+    char *fname = NULL;
+    linetab_get_row(die->die_store->ds_linetab, row, NULL, srclineno, &fname, NULL);
 
-            die_t *fxndie = NULL;
-            int ret = die_search(die, (void *)pc, DIE_SEARCH_FUNCTION_BY_PC,
-                    &fxndie, e);
+    /* We are only interested in the file name */
+    char *slash = strrchr(fname, '/');
 
-            if(ret){
-                free(*srcfilename);
-                *srcfilename = NULL;
-                *srclineno = 0;
-                return 1;
-            }
+    if(slash)
+        *srcfilename = strdup(slash + 1);
+    else
+        *srcfilename = strdup(fname);
 
-            *srcfunction = strdup(fxndie->die_diename);
+    die_t *fxndie = NULL;
+    int ret = die_find_function_by_pc(die, pc, &fxndie, e);
 
-            return 0;
-        }
+    if(ret){
+        free(*srcfilename);
+        *srcfilename = NULL;
+        *srclineno = 0;
+        return 1;
     }
 
-    errset(e, DIE_ERROR_KIND, DIE_COULD_NOT_GET_LINE_INFO);
-    return 1;
+    *srcfunction = strdup(die_name(fxndie));
+
+    return 0;
 }
 
 int die_get_low_pc(die_t *die, uint64_t *lowpcout, sym_error_t *e){
@@ -1813,7 +2785,41 @@ int die_get_low_pc(die_t *die, uint64_t *lowpcout, sym_error_t *e){
         return 1;
     }
 
-    *lowpcout = die->die_low_pc;
+    *lowpcout = die_rangeinfo(die)->ri_low_pc;
+    return 0;
+}
+
+/* Remember which DIEs are the members of the struct or union a type
+ * ends up at, so describing every variable of that type doesn't
+ * search the tree for it again.
+ */
+static int die_cache_type_members(struct die_store *ds, struct die_type *dt){
+    if(dt->dt_memberscached)
+        return 0;
+
+    die_t *target = NULL;
+
+    if(die_find_by_offset(ds->ds_root, dt->dt_basedieoffset, &target, NULL))
+        return 1;
+
+    int cnt = 0;
+
+    for(die_t *child = die_first_child(target); child;
+            child = die_next_sibling(child)){
+        if(child->die_tag == DW_TAG_member)
+            cnt++;
+    }
+
+    dt->dt_members = arena_alloc(ds->ds_arena, sizeof(int) * (cnt + 1));
+
+    for(die_t *child = die_first_child(target); child;
+            child = die_next_sibling(child)){
+        if(child->die_tag == DW_TAG_member)
+            dt->dt_members[dt->dt_nummembers++] = child->die_id;
+    }
+
+    dt->dt_memberscached = 1;
+
     return 0;
 }
 
@@ -1829,34 +2835,40 @@ int die_get_members(die_t *die, die_t *cu_root_die,
         return 1;
     }
 
-    die_t *target = die;
     Dwarf_Half tag = die->die_tag;
 
     if(tag != DW_TAG_structure_type && tag != DW_TAG_union_type){
-        die_t *d = NULL;
-        if(die_search(cu_root_die, (void *)die->die_basedatatypedieoffset,
-                    DIE_SEARCH_IF_DIE_OFFSET_MATCHES, &d, e)){
+        struct die_store *ds = die->die_store;
+        struct die_type *dt = (struct die_type *)die_type(die);
+
+        if(dt == &NO_TYPE || die_cache_type_members(ds, dt)){
             errset(e, DIE_ERROR_KIND, DIE_NOT_STRUCT_OR_UNION);
             return 1;
         }
 
-        target = d;
+        die_t **members = malloc(sizeof(die_t *) * (dt->dt_nummembers + 1));
+
+        for(int i=0; i<dt->dt_nummembers; i++)
+            members[i] = die_node(ds, dt->dt_members[i]);
+
+        members[dt->dt_nummembers] = NULL;
+
+        *len = dt->dt_nummembers;
+        *membersout = members;
+
+        return 0;
     }
 
     die_t **members = malloc(sizeof(die_t));
     members[0] = NULL;
 
-    int idx = 0;
-    die_t *child = target->die_children[idx];
-
-    while(child){
+    for(die_t *child = die_first_child(die); child;
+            child = die_next_sibling(child)){
         if(child->die_tag == DW_TAG_member){
             die_t **members_rea = realloc(members, sizeof(die_t) * ++(*len));
             members = members_rea;
             members[(*len) - 1] = child;
         }
-
-        child = target->die_children[++idx];
     }
 
     *membersout = members;
@@ -1875,7 +2887,7 @@ int die_get_name(die_t *die, char **dienameout, sym_error_t *e){
         return 1;
     }
 
-    *dienameout = die->die_diename;
+    *dienameout = die_name(die);
     return 0;
 }
 
@@ -1890,7 +2902,22 @@ int die_get_member_offset(die_t *die, uint64_t *offout, sym_error_t *e){
         return 1;
     }
 
-    *offout = die->die_memb_off;
+    *offout = die_typeinfo(die)->ti_memb_off;
+    return 0;
+}
+
+int die_get_offset(die_t *die, uint64_t *offout, sym_error_t *e){
+    if(!die){
+        errset(e, GENERIC_ERROR_KIND, GE_INVALID_DIE);
+        return 1;
+    }
+
+    if(!offout){
+        errset(e, GENERIC_ERROR_KIND, GE_INVALID_PARAMETER);
+        return 1;
+    }
+
+    *offout = die->die_dieoffset;
     return 0;
 }
 
@@ -1917,17 +2944,13 @@ int die_get_parameters(die_t *die, die_t ***paramsout, int *lenout,
     die_t **params = malloc(sizeof(die_t));
     params[0] = NULL;
 
-    int idx = 0;
-    die_t *child = die->die_children[idx];
-
-    while(child){
+    for(die_t *child = die_first_child(die); child;
+            child = die_next_sibling(child)){
         if(child->die_tag == DW_TAG_formal_parameter){
             die_t **params_rea = realloc(params, sizeof(die_t) * ++(*lenout));
             params = params_rea;
             params[(*lenout) - 1] = child;
         }
-
-        child = die->die_children[++idx];
     }
 
     *paramsout = params;
@@ -1945,7 +2968,7 @@ int die_get_parent(die_t *die, die_t **parentout, sym_error_t *e){
         return 1;
     }
 
-    *parentout = die->die_parent;
+    *parentout = die_parent(die);
     return 0;
 }
 
@@ -1967,31 +2990,36 @@ int die_get_pc_of_next_line(Dwarf_Debug dbg, die_t *die,
         return 1;
     }
 
-    uint64_t next_line = 0, start_pc_lineno = 0;
+    int row = linetab_find_row(die->die_store->ds_linetab, start_pc, 1);
 
-    if(die_pc_to_lineno(dbg, die, start_pc, &start_pc_lineno, e))
+    if(row == -1){
+        errset(e, DIE_ERROR_KIND, DIE_LINE_NOT_FOUND);
         return 1;
+    }
+
+    uint64_t next_line = 0, start_pc_lineno = 0;
+    linetab_get_row(die->die_store->ds_linetab, row, NULL, &start_pc_lineno, NULL, NULL);
+
+    /* Rows are sorted by address, so the first row after start_pc
+     * which begins a different line is the closest one.
+     */
+    int rowcnt = linetab_count(die->die_store->ds_linetab);
 
-    Dwarf_Unsigned prevlineno = start_pc_lineno;
+    for(int i=row + 1; i<rowcnt; i++){
+        uint64_t curlineaddr = 0, curlineno = 0;
+        int flags = 0;
 
-    /* Lines given back aren't guarenteed to be in chronological order. */
-    for(Dwarf_Signed i=0; i<die->die_srclinescnt; i++){
-        Dwarf_Line line = die->die_srclines[i];
-        Dwarf_Unsigned curlineaddr = get_dwarf_line_virtual_addr(dbg, line);
-        Dwarf_Unsigned curlineno = get_dwarf_line_lineno(dbg, line);
+        linetab_get_row(die->die_store->ds_linetab, i, &curlineaddr, &curlineno, NULL,
+                &flags);
 
         if(curlineaddr <= start_pc || curlineno == 0 ||
-                start_pc_lineno == curlineno){
+                start_pc_lineno == curlineno ||
+                (flags & LINETAB_END_SEQUENCE)){
             continue;
         }
-        
-        uint64_t current = llabs((int64_t)(next_line - start_pc));
-        uint64_t diff = llabs((int64_t)(curlineaddr - start_pc));
 
-        if(diff < current && prevlineno != curlineno)
-            next_line = curlineaddr;
-
-        prevlineno = curlineno;
+        next_line = curlineaddr;
+        break;
     }
 
     /* If this is still 0, the next line's PC wasn't found. */
@@ -2006,26 +3034,61 @@ int die_get_pc_of_next_line(Dwarf_Debug dbg, die_t *die,
 
 int die_get_pc_values_from_lineno(Dwarf_Debug dbg, die_t *die,
         uint64_t lineno, uint64_t **pcs, int *len, sym_error_t *e){
+    if(!die){
+        errset(e, GENERIC_ERROR_KIND, GE_INVALID_DIE);
+        return 1;
+    }
+
+    if(die->die_tag != DW_TAG_compile_unit){
+        errset(e, DIE_ERROR_KIND, DIE_NOT_COMPILE_UNIT_DIE);
+        return 1;
+    }
+
     if(!pcs || !len){
         errset(e, GENERIC_ERROR_KIND, GE_INVALID_PARAMETER);
         return 1;
     }
 
-    *pcs = malloc(sizeof(uint64_t));
-    (*pcs)[0] = 0;
+    int fileidx = linetab_primary_file(die->die_store->ds_linetab);
 
-    for(Dwarf_Signed i=0; i<die->die_srclinescnt; i++){
-        Dwarf_Line line = die->die_srclines[i];
-        Dwarf_Unsigned curlineaddr = get_dwarf_line_virtual_addr(dbg, line);
-        Dwarf_Unsigned curlineno = get_dwarf_line_lineno(dbg, line);
+    uint64_t *found = NULL;
+    int foundlen = 0;
 
-        if(curlineno == lineno){
-            uint64_t *pcs_rea = realloc(*pcs, sizeof(uint64_t) * ++(*len));
-            *pcs = pcs_rea;
-            (*pcs)[(*len) - 1] = curlineaddr;
-        }
+    if(linetab_line_to_pcs(die->die_store->ds_linetab, fileidx, lineno, 0, NULL,
+                &found, &foundlen)){
+        *pcs = malloc(sizeof(uint64_t));
+        (*pcs)[0] = 0;
+        *len = 0;
+
+        return 0;
+    }
+
+    *pcs = found;
+    *len = foundlen;
+
+    return 0;
+}
+
+/* Ranges from DW_AT_ranges. The array returned must not be freed.
+ * If this DIE has no such attribute, *lenout is zero.
+ */
+int die_get_ranges(die_t *die, struct pcrange **rangesout, int *lenout,
+        sym_error_t *e){
+    if(!die){
+        errset(e, GENERIC_ERROR_KIND, GE_INVALID_DIE);
+        return 1;
     }
 
+    if(!rangesout || !lenout){
+        errset(e, GENERIC_ERROR_KIND, GE_INVALID_PARAMETER);
+        return 1;
+    }
+
+    const struct die_rangeinfo *ri = die_rangeinfo(die);
+
+    *rangesout = ri->ri_ranges;
+    *lenout = ri->ri_rangescnt;
+
     return 0;
 }
 
@@ -2043,23 +3106,14 @@ int die_get_variables(Dwarf_Debug dbg, die_t *die, die_t ***vardies,
         (*vardies)[(*len) - 1] = die;
     }
 
-    if(!die->die_haschildren)
-        return 0;
-    else{
-        int idx = 0;
-        die_t *child = die->die_children[idx];
-
-        int ret = 0;
-
-        while(child){
-            ret = die_get_variables(dbg, child, vardies, len);
-            child = die->die_children[++idx];
-        }
+    int ret = 0;
 
-        return ret;
+    for(die_t *child = die_first_child(die); child;
+            child = die_next_sibling(child)){
+        ret = die_get_variables(dbg, child, vardies, len);
     }
 
-    return 0;
+    return ret;
 }
 
 int die_get_variable_size(die_t *die, uint64_t *sizeout, sym_error_t *e){
@@ -2073,7 +3127,7 @@ int die_get_variable_size(die_t *die, uint64_t *sizeout, sym_error_t *e){
         return 1;
     }
 
-    *sizeout = die->die_databytessize;
+    *sizeout = die_type(die)->dt_bytesize;
     return 0;
 }
 
@@ -2084,7 +3138,9 @@ int die_is_member_of_struct_or_union(die_t *die, int *retval,
         return 1;
     }
 
-    if(!die->die_parent){
+    die_t *parent = die_parent(die);
+
+    if(!parent){
         errset(e, DIE_ERROR_KIND, DIE_NO_PARENT);
         return 1;
     }
@@ -2094,7 +3150,7 @@ int die_is_member_of_struct_or_union(die_t *die, int *retval,
         return 1;
     }
 
-    Dwarf_Half t = die->die_tag, tp = die->die_parent->die_tag;
+    Dwarf_Half t = die->die_tag, tp = parent->die_tag;
 
     *retval = t == DW_TAG_member && (tp == DW_TAG_structure_type ||
             tp == DW_TAG_union_type);
@@ -2122,36 +3178,30 @@ int die_lineno_to_pc(Dwarf_Debug dbg, die_t *die, uint64_t *lineno,
     /* Find the closest line to lineno. Sometimes the source file does
      * not accurately reflect the compiled program.
      */
-    uint64_t closestlineno = 0;
-    Dwarf_Line closestline = NULL;
-
-    uint64_t linepassedin = *lineno;
+    int fileidx = linetab_primary_file(die->die_store->ds_linetab);
 
-    for(Dwarf_Signed i=0; i<die->die_srclinescnt; i++){
-        Dwarf_Line line = die->die_srclines[i];
-        Dwarf_Unsigned curlineno = get_dwarf_line_lineno(dbg, line);
+    uint64_t linepassedin = *lineno, closestlineno = 0;
+    uint64_t *pcs = NULL;
+    int len = 0;
 
-        uint64_t current = llabs((int64_t)(closestlineno - linepassedin));
-        uint64_t diff = llabs((int64_t)(curlineno - linepassedin));
-
-        /* exact match */
-        if(diff == 0){
-            *pcout = get_dwarf_line_virtual_addr(dbg, line);
-            return 0;
-        }
-        else if(diff < current){
-            closestlineno = curlineno;
-            closestline = line;
-        }
+    if(linetab_line_to_pcs(die->die_store->ds_linetab, fileidx, linepassedin, 1,
+                &closestlineno, &pcs, &len)){
+        errset(e, DIE_ERROR_KIND, DIE_LINE_NOT_FOUND);
+        return 1;
     }
 
-    // XXX concat(outbuffer, ...
-    printf("Line %lld doesn't exist, auto-adjusted to line %lld\n",
-            linepassedin, closestlineno);
+    if(closestlineno != linepassedin){
+        // XXX concat(outbuffer, ...
+        printf("Line %lld doesn't exist, auto-adjusted to line %lld\n",
+                linepassedin, closestlineno);
+    }
 
-    *pcout = get_dwarf_line_virtual_addr(dbg, closestline);
+    /* Lowest address for this line */
+    *pcout = pcs[0];
     *lineno = closestlineno;
 
+    free(pcs);
+
     return 0;
 }
 
@@ -2173,27 +3223,30 @@ int die_pc_to_lineno(Dwarf_Debug dbg, die_t *die, uint64_t target_pc,
     }
 
     /* If we're given a PC to match against, we should match exactly. */
-    for(Dwarf_Signed i=0; i<die->die_srclinescnt; i++){
-        Dwarf_Line line = die->die_srclines[i];
-        Dwarf_Unsigned curlineaddr = get_dwarf_line_virtual_addr(dbg, line);
+    int row = linetab_find_row(die->die_store->ds_linetab, target_pc, 1);
 
-        if(target_pc == curlineaddr){
-            *lineno = get_dwarf_line_lineno(dbg, line);
-            return 0;
-        }
+    if(row == -1){
+        errset(e, DIE_ERROR_KIND, DIE_LINE_NOT_FOUND);
+        return 1;
     }
 
-    errset(e, DIE_ERROR_KIND, DIE_LINE_NOT_FOUND);
-    return 1;
+    linetab_get_row(die->die_store->ds_linetab, row, NULL, lineno, NULL, NULL);
+    return 0;
 }
 
 static int die_is_func_in_range(die_t *die, void *pc){
-    return die->die_tag == DW_TAG_subprogram &&
-        (uint64_t)pc >= die->die_low_pc && (uint64_t)pc < die->die_high_pc;
+    if(die->die_tag != DW_TAG_subprogram)
+        return 0;
+
+    const struct die_rangeinfo *ri = die_rangeinfo(die);
+
+    return (uint64_t)pc >= ri->ri_low_pc && (uint64_t)pc < ri->ri_high_pc;
 }
 
 static int die_name_matches(die_t *die, void *name){
-    return die->die_diename && strcmp(die->die_diename, (const char *)name) == 0;
+    char *diename = die_name(die);
+
+    return diename && strcmp(diename, (const char *)name) == 0;
 }
 
 static int die_offset_matches(die_t *die, void *offset){
@@ -2210,16 +3263,9 @@ static void die_search_internal(die_t *die, void *data,
         return;
     }
 
-    if(!die->die_haschildren)
-        return;
-    else{
-        int idx = 0;
-        die_t *child = die->die_children[idx];
-
-        while(child){
-            die_search_internal(child, data, comparefxn, out);
-            child = die->die_children[++idx];
-        }
+    for(die_t *child = die_first_child(die); child && !(*out);
+            child = die_next_sibling(child)){
+        die_search_internal(child, data, comparefxn, out);
     }
 }
 
@@ -2244,8 +3290,12 @@ int die_search(die_t *start, void *data, int way, die_t **out,
     return 0;
 }
 
-int initialize_and_build_die_tree_from_root_die(dwarfinfo_t *dwarfinfo,
-        void *compile_unit, die_t **_root_die, sym_error_t *e){
+/* Create only the root DIE of the compilation unit whose header was
+ * last read with dwarf_next_cu_header_d. Its children are built with
+ * die_build_cu_tree.
+ */
+int die_create_cu_root_die(dwarfinfo_t *dwarfinfo, void *compile_unit,
+        die_t **_root_die, sym_error_t *e){
     int is_info = 1;
     Dwarf_Error d_error = NULL;
     Dwarf_Die cu_rootdie = NULL;
@@ -2254,27 +3304,1041 @@ int initialize_and_build_die_tree_from_root_die(dwarfinfo_t *dwarfinfo,
             &cu_rootdie, &d_error);
 
     if(ret == DW_DLV_ERROR){
+        dwarf_dealloc(dwarfinfo->di_dbg, d_error, DW_DLA_ERROR);
         errset(e, SYM_ERROR_KIND, SYM_DWARF_SIBLING_OF_B_FAILED);
         return 1;
     }
 
-    die_t *root_die = create_new_die(dwarfinfo, compile_unit, cu_rootdie, 0);
-    memset(CUR_PARENTS, 0, sizeof(CUR_PARENTS));
-    CUR_PARENTS[0] = root_die;
+    *_root_die = create_root_die(dwarfinfo, compile_unit, cu_rootdie);
 
-     //if(strcmp(root_die->die_diename, "source/cmd/memcmd.c") != 0)
-       //return 0;
+    if(cu_rootdie)
+        dwarf_dealloc(dwarfinfo->di_dbg, cu_rootdie, DW_DLA_DIE);
+
+    return 0;
+}
 
-    construct_die_tree(dwarfinfo, compile_unit, root_die, 0);
+static int die_offset_cmp(const void *a, const void *b){
+    const die_t *da = die_node(CUR_STORE, *(const int *)a);
+    const die_t *db = die_node(CUR_STORE, *(const int *)b);
 
-    ret = dwarf_srclines(root_die->die_dwarfdie, &root_die->die_srclines,
-            &root_die->die_srclinescnt, &d_error);
-    
-    if(ret == DW_DLV_ERROR){
-        dwarf_dealloc(dwarfinfo->di_dbg, d_error, DW_DLA_ERROR);
-        errset(e, SYM_ERROR_KIND, SYM_DWARF_SRCLINES_FAILED);
+    if(da->die_dieoffset < db->die_dieoffset)
+        return -1;
+    else if(da->die_dieoffset > db->die_dieoffset)
+        return 1;
+
+    return 0;
+}
+
+static void build_die_offset_index(struct die_store *ds){
+    ds->ds_offidx = malloc(sizeof(int) * ds->ds_numnodes);
+
+    for(int i=0; i<ds->ds_numnodes; i++)
+        ds->ds_offidx[i] = i;
+
+    /* Node IDs are already in DIE offset order, but
+     * don't depend on it.
+     */
+    qsort(ds->ds_offidx, ds->ds_numnodes, sizeof(int), die_offset_cmp);
+}
+
+static int die_is_scope(die_t *die){
+    return die->die_tag == DW_TAG_subprogram ||
+        die->die_tag == DW_TAG_inlined_subroutine ||
+        die->die_tag == DW_TAG_lexical_block;
+}
+
+struct scope_interval {
+    uint64_t si_lowpc;
+    uint64_t si_highpc;
+    int si_depth;
+    die_t *si_die;
+};
+
+static int scope_interval_cmp(const void *a, const void *b){
+    const struct scope_interval *sa = a;
+    const struct scope_interval *sb = b;
+
+    if(sa->si_lowpc != sb->si_lowpc)
+        return sa->si_lowpc < sb->si_lowpc ? -1 : 1;
+
+    /* Outer scopes first */
+    if(sa->si_highpc != sb->si_highpc)
+        return sa->si_highpc > sb->si_highpc ? -1 : 1;
+
+    return sa->si_depth - sb->si_depth;
+}
+
+static void scope_emit(void *scopetab, uint64_t start, uint64_t end,
+        die_t *die){
+    if(start < end)
+        rangetab_add(scopetab, start, end, die);
+}
+
+/* Split the PC ranges of every scope into pieces which each map to
+ * the innermost scope covering them. Since scopes nest, a sweep
+ * with a stack of open scopes does this in one pass.
+ */
+static void build_die_scope_index(struct die_store *ds){
+    ds->ds_scopetab = rangetab_new();
+
+    int cnt = 0, cap = 64;
+    struct scope_interval *ivs = malloc(sizeof(struct scope_interval) * cap);
+
+    for(int i=0; i<ds->ds_numnodes; i++){
+        die_t *die = die_node(ds, i);
+
+        if(!die_is_scope(die))
+            continue;
+
+        int depth = 0;
+
+        for(die_t *p = die_parent(die); p; p = die_parent(p))
+            depth++;
+
+        const struct die_rangeinfo *ri = die_rangeinfo(die);
+        int nranges = ri->ri_rangescnt > 0 ? ri->ri_rangescnt : 1;
+
+        for(int k=0; k<nranges; k++){
+            uint64_t lo = ri->ri_low_pc, hi = ri->ri_high_pc;
+
+            if(ri->ri_rangescnt > 0){
+                lo = ri->ri_ranges[k].pr_lowpc;
+                hi = ri->ri_ranges[k].pr_highpc;
+            }
+
+            if(lo >= hi)
+                continue;
+
+            if(cnt == cap){
+                cap *= 2;
+
+                struct scope_interval *ivs_rea = realloc(ivs,
+                        sizeof(struct scope_interval) * cap);
+                ivs = ivs_rea;
+            }
+
+            ivs[cnt].si_lowpc = lo;
+            ivs[cnt].si_highpc = hi;
+            ivs[cnt].si_depth = depth;
+            ivs[cnt].si_die = die;
+
+            cnt++;
+        }
+    }
+
+    qsort(ivs, cnt, sizeof(struct scope_interval), scope_interval_cmp);
+
+    struct scope_interval **stack = malloc(sizeof(struct scope_interval *) *
+            (cnt + 1));
+    int top = -1;
+    uint64_t pos = 0;
+
+    for(int i=0; i<cnt; i++){
+        struct scope_interval *iv = &ivs[i];
+
+        while(top >= 0 && stack[top]->si_highpc <= iv->si_lowpc){
+            scope_emit(ds->ds_scopetab, pos, stack[top]->si_highpc,
+                    stack[top]->si_die);
+            pos = stack[top]->si_highpc;
+            top--;
+        }
+
+        if(top >= 0){
+            scope_emit(ds->ds_scopetab, pos, iv->si_lowpc,
+                    stack[top]->si_die);
+
+            /* Don't let bad DWARF break the nesting */
+            if(iv->si_highpc > stack[top]->si_highpc)
+                iv->si_highpc = stack[top]->si_highpc;
+        }
+
+        stack[++top] = iv;
+        pos = iv->si_lowpc;
+    }
+
+    while(top >= 0){
+        scope_emit(ds->ds_scopetab, pos, stack[top]->si_highpc,
+                stack[top]->si_die);
+        pos = stack[top]->si_highpc;
+        top--;
+    }
+
+    rangetab_finalize(ds->ds_scopetab);
+
+    free(stack);
+    free(ivs);
+}
+
+/* Get every scope pc is inside of, innermost first. These are
+ * subprograms, inlined subroutines, and lexical blocks. The array
+ * must be freed, but not the DIEs inside it.
+ */
+int die_get_scopes_at_pc(die_t *root_die, uint64_t pc, die_t ***scopesout,
+        int *lenout, sym_error_t *e){
+    if(!root_die){
+        errset(e, GENERIC_ERROR_KIND, GE_INVALID_DIE);
+        return 1;
+    }
+
+    if(root_die->die_tag != DW_TAG_compile_unit){
+        errset(e, DIE_ERROR_KIND, DIE_NOT_COMPILE_UNIT_DIE);
+        return 1;
+    }
+
+    if(!scopesout || !lenout){
+        errset(e, GENERIC_ERROR_KIND, GE_INVALID_PARAMETER);
+        return 1;
+    }
+
+    die_t *innermost = rangetab_lookup(root_die->die_store->ds_scopetab, pc);
+
+    if(!innermost){
+        errset(e, DIE_ERROR_KIND, DIE_DIE_NOT_FOUND);
+        return 1;
+    }
+
+    int cnt = 0;
+
+    for(die_t *d = innermost; d; d = die_parent(d)){
+        if(die_is_scope(d))
+            cnt++;
+    }
+
+    *scopesout = malloc(sizeof(die_t *) * cnt);
+    *lenout = 0;
+
+    for(die_t *d = innermost; d; d = die_parent(d)){
+        if(die_is_scope(d))
+            (*scopesout)[(*lenout)++] = d;
+    }
+
+    return 0;
+}
+
+/* Find the subprogram which pc belongs to. If pc is inside inlined
+ * code, this is the function it was inlined into.
+ */
+int die_find_function_by_pc(die_t *root_die, uint64_t pc, die_t **out,
+        sym_error_t *e){
+    if(!out){
+        errset(e, GENERIC_ERROR_KIND, GE_INVALID_PARAMETER);
+        return 1;
+    }
+
+    die_t **scopes = NULL;
+    int len = 0;
+
+    if(die_get_scopes_at_pc(root_die, pc, &scopes, &len, e))
+        return 1;
+
+    die_t *fxndie = NULL;
+
+    for(int i=len - 1; i>=0; i--){
+        if(scopes[i]->die_tag == DW_TAG_subprogram){
+            fxndie = scopes[i];
+            break;
+        }
+    }
+
+    free(scopes);
+
+    if(!fxndie){
+        errset(e, DIE_ERROR_KIND, DIE_DIE_NOT_FOUND);
+        return 1;
+    }
+
+    *out = fxndie;
+    return 0;
+}
+
+/* Get where every function in a compilation unit is, in address
+ * order, for the symbol cache. Names point into the tree, and the
+ * array must be freed.
+ */
+int die_get_function_ranges(die_t *root_die, struct fxnrange **rangesout,
+        int *lenout, sym_error_t *e){
+    if(!root_die){
+        errset(e, GENERIC_ERROR_KIND, GE_INVALID_DIE);
+        return 1;
+    }
+
+    if(root_die->die_tag != DW_TAG_compile_unit){
+        errset(e, DIE_ERROR_KIND, DIE_NOT_COMPILE_UNIT_DIE);
+        return 1;
+    }
+
+    if(!rangesout || !lenout){
+        errset(e, GENERIC_ERROR_KIND, GE_INVALID_PARAMETER);
+        return 1;
+    }
+
+    void *scopetab = root_die->die_store->ds_scopetab;
+    int cnt = rangetab_count(scopetab);
+
+    *rangesout = malloc(sizeof(struct fxnrange) * (cnt + 1));
+    *lenout = 0;
+
+    for(int i=0; i<cnt; i++){
+        uint64_t lo = 0, hi = 0;
+        die_t *scope = NULL;
+
+        rangetab_get(scopetab, i, &lo, &hi, (void **)&scope);
+
+        die_t *fxndie = NULL;
+
+        for(die_t *d = scope; d; d = die_parent(d)){
+            if(d->die_tag == DW_TAG_subprogram)
+                fxndie = d;
+        }
+
+        if(!fxndie || !die_name(fxndie))
+            continue;
+
+        /* Scopes inside a function split it into pieces */
+        struct fxnrange *last = *lenout > 0 ?
+            &(*rangesout)[*lenout - 1] : NULL;
+
+        if(last && last->fr_dieoffset == fxndie->die_dieoffset &&
+                last->fr_highpc == lo){
+            last->fr_highpc = hi;
+            continue;
+        }
+
+        struct fxnrange *fr = &(*rangesout)[(*lenout)++];
+
+        fr->fr_lowpc = lo;
+        fr->fr_highpc = hi;
+        fr->fr_dieoffset = fxndie->die_dieoffset;
+        fr->fr_name = die_name(fxndie);
+    }
+
+    return 0;
+}
+
+/* Get every type a compilation unit's tree resolved, for the symbol
+ * cache. Arrays are left out since their dimensions aren't part of a
+ * summary. Names point into the tree, and the array must be freed.
+ */
+int die_get_type_summaries(die_t *root_die, struct typesummary **typesout,
+        int *lenout, sym_error_t *e){
+    if(!root_die){
+        errset(e, GENERIC_ERROR_KIND, GE_INVALID_DIE);
+        return 1;
+    }
+
+    if(root_die->die_tag != DW_TAG_compile_unit){
+        errset(e, DIE_ERROR_KIND, DIE_NOT_COMPILE_UNIT_DIE);
+        return 1;
+    }
+
+    if(!typesout || !lenout){
+        errset(e, GENERIC_ERROR_KIND, GE_INVALID_PARAMETER);
+        return 1;
+    }
+
+    struct die_store *ds = root_die->die_store;
+
+    *typesout = malloc(sizeof(struct typesummary) * (ds->ds_numtypetab + 1));
+    *lenout = 0;
+
+    /* Type ID 0 is no type */
+    for(int i=1; i<ds->ds_numtypetab; i++){
+        struct die_type *dt = &ds->ds_typetab[i];
+
+        /* A tag of zero means the type DIE couldn't be read */
+        if(dt->dt_tag == 0 || dt->dt_arrdimslen > 0)
+            continue;
+
+        struct typesummary *ts = &(*typesout)[(*lenout)++];
+
+        ts->ts_dieoffset = dt->dt_dieoffset;
+        ts->ts_basedieoffset = dt->dt_basedieoffset;
+        ts->ts_bytesize = dt->dt_bytesize;
+        ts->ts_arrmembsz = dt->dt_arrmembsz;
+        ts->ts_name = ds->ds_names[dt->dt_nameid];
+        ts->ts_tag = dt->dt_tag;
+        ts->ts_encoding = dt->dt_encoding;
+        ts->ts_class = dt->dt_class;
+    }
+
+    return 0;
+}
+
+/* Find a DIE in a compilation unit's tree by its offset
+ * in .debug_info.
+ */
+int die_find_by_offset(die_t *root_die, uint64_t offset, die_t **out,
+        sym_error_t *e){
+    if(!root_die){
+        errset(e, GENERIC_ERROR_KIND, GE_INVALID_DIE);
+        return 1;
+    }
+
+    if(!out){
+        errset(e, GENERIC_ERROR_KIND, GE_INVALID_PARAMETER);
+        return 1;
+    }
+
+    struct die_store *ds = root_die->die_store;
+
+    if(!ds->ds_offidx){
+        return die_search(root_die, (void *)offset,
+                DIE_SEARCH_IF_DIE_OFFSET_MATCHES, out, e);
+    }
+
+    int lo = 0, hi = ds->ds_numnodes - 1;
+
+    while(lo <= hi){
+        int mid = lo + ((hi - lo) / 2);
+        die_t *d = die_node(ds, ds->ds_offidx[mid]);
+
+        if(d->die_dieoffset == offset){
+            *out = d;
+            return 0;
+        }
+        else if(d->die_dieoffset < offset)
+            lo = mid + 1;
+        else
+            hi = mid - 1;
+    }
+
+    errset(e, DIE_ERROR_KIND, DIE_DIE_NOT_FOUND);
+    return 1;
+}
+
+/* Create the root DIE of the compilation unit whose root DIE is at
+ * dieoffset in .debug_info. Unlike die_create_cu_root_die, this does not
+ * depend on where dwarf_next_cu_header_d left off, so any Dwarf_Debug
+ * opened on the same file can be used.
+ */
+int die_create_cu_root_die_at_offset(dwarfinfo_t *dwarfinfo,
+        void *compile_unit, uint64_t dieoffset, die_t **_root_die,
+        sym_error_t *e){
+    int is_info = 1;
+    Dwarf_Error d_error = NULL;
+    Dwarf_Die cu_rootdie = NULL;
+
+    int ret = dwarf_offdie_b(dwarfinfo->di_dbg, dieoffset, is_info,
+            &cu_rootdie, &d_error);
+
+    if(ret != DW_DLV_OK){
+        if(ret == DW_DLV_ERROR)
+            dwarf_dealloc(dwarfinfo->di_dbg, d_error, DW_DLA_ERROR);
+
+        errset(e, SYM_ERROR_KIND, SYM_DWARF_OFFDIE_B_FAILED);
+        return 1;
+    }
+
+    *_root_die = create_root_die(dwarfinfo, compile_unit, cu_rootdie);
+
+    if(cu_rootdie)
+        dwarf_dealloc(dwarfinfo->di_dbg, cu_rootdie, DW_DLA_DIE);
+
+    return 0;
+}
+
+/* Decode the line program straight out of the mapped .debug_line,
+ * without libdwarf making an object for every row.
+ */
+static int read_cu_linetab_native(dwarfinfo_t *dwarfinfo,
+        Dwarf_Die cu_rootdie, const char *cuname, void **linetabout){
+    Dwarf_Attribute attr = NULL;
+    get_die_attribute(dwarfinfo->di_dbg, cu_rootdie, DW_AT_stmt_list, &attr);
+
+    if(!attr)
+        return 1;
+
+    Dwarf_Error d_error = NULL;
+    Dwarf_Off stmtlist = 0;
+
+    int ret = dwarf_global_formref(attr, &stmtlist, &d_error);
+
+    /* Before DWARF 4, it's a constant */
+    if(ret == DW_DLV_ERROR){
+        dwarf_dealloc(dwarfinfo->di_dbg, d_error, DW_DLA_ERROR);
+        d_error = NULL;
+
+        Dwarf_Unsigned udata = 0;
+        ret = get_form_data_from_attr(dwarfinfo->di_dbg, attr, &udata,
+                FORMUDATA);
+
+        stmtlist = udata;
+        ret = ret ? DW_DLV_ERROR : DW_DLV_OK;
+    }
+
+    dwarf_dealloc(dwarfinfo->di_dbg, attr, DW_DLA_ATTR);
+
+    if(ret != DW_DLV_OK)
+        return 1;
+
+    char *compdir = NULL;
+    attr = NULL;
+    get_die_attribute(dwarfinfo->di_dbg, cu_rootdie, DW_AT_comp_dir, &attr);
+
+    if(attr){
+        if(dwarf_formstring(attr, &compdir, &d_error) == DW_DLV_ERROR){
+            dwarf_dealloc(dwarfinfo->di_dbg, d_error, DW_DLA_ERROR);
+            compdir = NULL;
+        }
+
+        dwarf_dealloc(dwarfinfo->di_dbg, attr, DW_DLA_ATTR);
+    }
+
+    struct linetab_row *rows = NULL;
+    int rowcnt = 0;
+    char **files = NULL;
+    int filecnt = 0;
+
+    /* compdir points into .debug_str, so it doesn't need to be freed */
+    if(lineprog_decode(dwarfinfo->di_dwarfobj, stmtlist, compdir, &rows,
+                &rowcnt, &files, &filecnt)){
+        return 1;
+    }
+
+    *linetabout = linetab_new_from_rows(rows, rowcnt, files, filecnt,
+            cuname);
+
+    for(int i=0; i<filecnt; i++)
+        free(files[i]);
+
+    free(files);
+    free(rows);
+
+    return 0;
+}
+
+/* Decode the line program of the compilation unit cu_rootdie is
+ * the root DIE of.
+ */
+static int read_cu_linetab(dwarfinfo_t *dwarfinfo, Dwarf_Die cu_rootdie,
+        const char *cuname, void **linetabout, sym_error_t *e){
+    /* libdwarf is only needed when the dSYM couldn't be mapped, or
+     * when its line program is something we can't decode.
+     */
+    if(dwarfinfo->di_dwarfobj &&
+            read_cu_linetab_native(dwarfinfo, cu_rootdie, cuname,
+                linetabout) == 0){
+        return 0;
+    }
+
+    Dwarf_Error d_error = NULL;
+    Dwarf_Line *srclines = NULL;
+    Dwarf_Signed srclinescnt = 0;
+
+    int ret = dwarf_srclines(cu_rootdie, &srclines, &srclinescnt, &d_error);
+    
+    if(ret == DW_DLV_ERROR){
+        dwarf_dealloc(dwarfinfo->di_dbg, d_error, DW_DLA_ERROR);
+        errset(e, SYM_ERROR_KIND, SYM_DWARF_SRCLINES_FAILED);
+        return 1;
+    }
+
+    /* Decode the line program once so line queries never
+     * have to go back to libdwarf.
+     */
+    *linetabout = linetab_new(dwarfinfo->di_dbg, srclines, srclinescnt,
+            cuname);
+
+    if(ret == DW_DLV_OK)
+        dwarf_srclines_dealloc(dwarfinfo->di_dbg, srclines, srclinescnt);
+
+    return 0;
+}
+
+/* Get the line table of a compilation unit without building its
+ * DIE tree. If the tree is already built, its line table is returned
+ * and ownedout is set to zero. Otherwise, the line table is decoded
+ * for the caller, ownedout is set to non-zero, and it must be freed
+ * with linetab_free.
+ */
+int die_get_cu_linetab(dwarfinfo_t *dwarfinfo, die_t *root_die,
+        void **linetabout, int *ownedout, sym_error_t *e){
+    if(!root_die || !root_die->die_store){
+        errset(e, GENERIC_ERROR_KIND, GE_INVALID_DIE);
+        return 1;
+    }
+
+    if(root_die->die_store->ds_linetab){
+        *linetabout = root_die->die_store->ds_linetab;
+        *ownedout = 0;
+        return 0;
+    }
+
+    int is_info = 1;
+    Dwarf_Error d_error = NULL;
+    Dwarf_Die cu_rootdie = NULL;
+
+    int ret = dwarf_offdie_b(dwarfinfo->di_dbg, root_die->die_dieoffset,
+            is_info, &cu_rootdie, &d_error);
+
+    if(ret != DW_DLV_OK){
+        if(ret == DW_DLV_ERROR)
+            dwarf_dealloc(dwarfinfo->di_dbg, d_error, DW_DLA_ERROR);
+
+        errset(e, SYM_ERROR_KIND, SYM_DWARF_OFFDIE_B_FAILED);
+        return 1;
+    }
+
+    ret = read_cu_linetab(dwarfinfo, cu_rootdie, die_name(root_die),
+            linetabout, e);
+
+    dwarf_dealloc(dwarfinfo->di_dbg, cu_rootdie, DW_DLA_DIE);
+
+    if(ret)
+        return 1;
+
+    *ownedout = 1;
+    return 0;
+}
+
+/* Most types come from headers, so every compilation unit has its own
+ * copy of them. Find the copy shared by the whole dSYM for this type,
+ * after doing the same for the types of its members. A struct can't
+ * contain itself, only a pointer to itself, and the members of what a
+ * pointer points to aren't looked at, so this always ends.
+ */
+static void *canonicalize_die_type(void *typereg, struct die_store *ds,
+        unsigned int id, int depth){
+    struct die_type *dt = &ds->ds_typetab[id];
+
+    if(dt->dt_canon || depth > 64)
+        return dt->dt_canon;
+
+    const char **membnames = NULL;
+    uint64_t *memboffs = NULL, *membbitsizes = NULL, *membbitoffs = NULL;
+    void **membtypes = NULL;
+    int nummembers = 0;
+
+    int aggregate = (dt->dt_class & (DTC_STRUCT | DTC_UNION)) &&
+        !(dt->dt_class & DTC_POINTER);
+
+    if(aggregate && !die_cache_type_members(ds, dt) && dt->dt_nummembers > 0){
+        nummembers = dt->dt_nummembers;
+        membnames = malloc(sizeof(char *) * nummembers);
+        memboffs = malloc(sizeof(uint64_t) * nummembers);
+        membtypes = malloc(sizeof(void *) * nummembers);
+        membbitsizes = malloc(sizeof(uint64_t) * nummembers);
+        membbitoffs = malloc(sizeof(uint64_t) * nummembers);
+
+        for(int i=0; i<nummembers; i++){
+            die_t *member = die_node(ds, dt->dt_members[i]);
+            const struct die_typeinfo *ti = die_typeinfo(member);
+
+            membnames[i] = die_name(member);
+            memboffs[i] = ti->ti_memb_off;
+            membbitsizes[i] = ti->ti_bitsize;
+            membbitoffs[i] = ti->ti_bitoff;
+            membtypes[i] = ti->ti_typeid == 0 ? NULL :
+                canonicalize_die_type(typereg, ds, ti->ti_typeid, depth + 1);
+        }
+    }
+
+    unsigned int *arrdims = NULL;
+
+    if(dt->dt_arrdimslen > 0){
+        arrdims = malloc(sizeof(unsigned int) * dt->dt_arrdimslen);
+
+        for(int i=0; i<dt->dt_arrdimslen; i++)
+            arrdims[i] = dt->dt_arrdims[i].sz;
+    }
+
+    dt->dt_canon = typereg_intern(typereg, dt->dt_tag,
+            ds->ds_names[dt->dt_nameid], dt->dt_bytesize, dt->dt_encoding,
+            dt->dt_class, dt->dt_arrmembsz, arrdims, dt->dt_arrdimslen,
+            membnames, memboffs, membtypes, membbitsizes, membbitoffs,
+            nummembers);
+
+    free(arrdims);
+    free(membnames);
+    free(memboffs);
+    free(membtypes);
+    free(membbitsizes);
+    free(membbitoffs);
+
+    return dt->dt_canon;
+}
+
+/* Offset of the DIE a pointer type points to, looking through typedefs
+ * and qualifiers. Returns 0 for anything else, or void pointers.
+ */
+static Dwarf_Unsigned get_pointee_offset(Dwarf_Debug dbg,
+        Dwarf_Unsigned offset){
+    for(int depth=0; depth<16; depth++){
+        Dwarf_Die dwdie = NULL;
+        Dwarf_Error d_error = NULL;
+
+        int ret = dwarf_offdie(dbg, offset, &dwdie, &d_error);
+
+        if(ret == DW_DLV_ERROR)
+            dwarf_dealloc(dbg, d_error, DW_DLA_ERROR);
+
+        if(ret != DW_DLV_OK)
+            return 0;
+
+        Dwarf_Half tag = get_die_tag_raw(dbg, dwdie);
+        Dwarf_Unsigned next = 0;
+        Dwarf_Attribute attr = NULL;
+
+        get_die_attribute(dbg, dwdie, DW_AT_type, &attr);
+
+        if(attr){
+            ret = dwarf_global_formref(attr, &next, &d_error);
+
+            if(ret == DW_DLV_ERROR)
+                dwarf_dealloc(dbg, d_error, DW_DLA_ERROR);
+
+            dwarf_dealloc(dbg, attr, DW_DLA_ATTR);
+        }
+
+        dwarf_dealloc(dbg, dwdie, DW_DLA_DIE);
+
+        if(tag == DW_TAG_pointer_type)
+            return next;
+
+        if(tag != DW_TAG_typedef && tag != DW_TAG_const_type &&
+                tag != DW_TAG_volatile_type && tag != DW_TAG_restrict_type){
+            return 0;
+        }
+
+        offset = next;
+    }
+
+    return 0;
+}
+
+/* Tell the shared copy of every pointer type what it points to, so
+ * values can be followed through pointers. This is done after every
+ * type has its shared copy, since a struct can point to itself.
+ * Types pointed to which no DIE uses directly are resolved here.
+ */
+static void link_pointee_types(dwarfinfo_t *dwarfinfo, void *compile_unit,
+        struct die_store *ds){
+    void *typereg = dwarfinfo->di_typereg;
+
+    /* This grows as pointees are resolved */
+    for(int i=1; i<ds->ds_numtypetab; i++){
+        if(!(ds->ds_typetab[i].dt_class & DTC_POINTER))
+            continue;
+
+        Dwarf_Unsigned pointeeoff = get_pointee_offset(dwarfinfo->di_dbg,
+                ds->ds_typetab[i].dt_dieoffset);
+
+        if(pointeeoff == 0)
+            continue;
+
+        unsigned int id = die_find_type(pointeeoff);
+
+        if(id == 0){
+            struct die_type dt = {0};
+
+            resolve_data_type(dwarfinfo, compile_unit, pointeeoff, &dt);
+
+            id = die_add_type(&dt);
+        }
+
+        void *pointee = canonicalize_die_type(typereg, ds, id, 0);
+
+        typereg_set_pointee(ds->ds_typetab[i].dt_canon, pointee);
+    }
+}
+
+static void dedup_die_types(dwarfinfo_t *dwarfinfo, void *compile_unit,
+        struct die_store *ds){
+    if(!dwarfinfo->di_typereg)
+        return;
+
+    for(int i=1; i<ds->ds_numtypetab; i++)
+        canonicalize_die_type(dwarfinfo->di_typereg, ds, i, 0);
+
+    link_pointee_types(dwarfinfo, compile_unit, ds);
+}
+
+/* Number of records at the front of a side table which belong
+ * to the root DIE.
+ */
+static int count_root_side_records(const void *recs, int cnt,
+        size_t recsz){
+    int n = 0;
+
+    while(n < cnt && *(const int *)((const char *)recs + (recsz * n)) == 0)
+        n++;
+
+    return n;
+}
+
+/* Only what belongs to the root DIE, copied into a store of its own.
+ * The records point to the same things the original's do, which belong
+ * to the root DIE, not to any one store.
+ */
+static struct die_store *die_store_copy_root(struct die_store *ds){
+    struct die_store *copy = calloc(1, sizeof(struct die_store));
+
+    copy->ds_root = ds->ds_root;
+    copy->ds_numnodes = 1;
+    copy->ds_rootfirstchild = DIE_NONE;
+
+    copy->ds_numnames = copy->ds_namescap = ds->ds_numrootnames;
+    copy->ds_numrootnames = ds->ds_numrootnames;
+    copy->ds_names = malloc(sizeof(char *) * copy->ds_namescap);
+    memcpy(copy->ds_names, ds->ds_names, sizeof(char *) * copy->ds_numnames);
+
+    copy->ds_numtypes = copy->ds_typescap = count_root_side_records(
+            ds->ds_types, ds->ds_numtypes, sizeof(struct die_typeinfo));
+    copy->ds_numranges = copy->ds_rangescap = count_root_side_records(
+            ds->ds_ranges, ds->ds_numranges, sizeof(struct die_rangeinfo));
+    copy->ds_numlocs = copy->ds_locscap = count_root_side_records(
+            ds->ds_locs, ds->ds_numlocs, sizeof(struct die_locinfo));
+
+    if(copy->ds_numtypes > 0){
+        copy->ds_types = malloc(sizeof(struct die_typeinfo) *
+                copy->ds_numtypes);
+        memcpy(copy->ds_types, ds->ds_types,
+                sizeof(struct die_typeinfo) * copy->ds_numtypes);
+    }
+
+    if(copy->ds_numranges > 0){
+        copy->ds_ranges = malloc(sizeof(struct die_rangeinfo) *
+                copy->ds_numranges);
+        memcpy(copy->ds_ranges, ds->ds_ranges,
+                sizeof(struct die_rangeinfo) * copy->ds_numranges);
+    }
+
+    if(copy->ds_numlocs > 0){
+        copy->ds_locs = malloc(sizeof(struct die_locinfo) * copy->ds_numlocs);
+        memcpy(copy->ds_locs, ds->ds_locs,
+                sizeof(struct die_locinfo) * copy->ds_numlocs);
+    }
+
+    return copy;
+}
+
+/* Free a store, and the tree in it, but not what its root DIE's
+ * records point to.
+ */
+static void die_store_free(void *arg){
+    struct die_store *ds = arg;
+
+    linetab_free(ds->ds_linetab);
+    rangetab_free(ds->ds_scopetab);
+    free(ds->ds_offidx);
+    arena_free(ds->ds_arena);
+
+    free(ds->ds_nodes);
+    free(ds->ds_names);
+    free(ds->ds_types);
+    free(ds->ds_typetab);
+    free(ds->ds_ranges);
+    free(ds->ds_locs);
+    free(ds);
+}
+
+/* Fill in everything queries would otherwise work out and save the
+ * first time they're asked, so once the tree is published, nothing
+ * ever writes to it and any number of threads can read it.
+ */
+static void freeze_die_store(struct die_store *ds){
+    for(int i=0; i<ds->ds_numlocs; i++){
+        struct die_locinfo *li = &ds->ds_locs[i];
+
+        if(li->li_id != 0)
+            die_compile_locations(die_node(ds, li->li_id), li);
+    }
+
+    for(int i=1; i<ds->ds_numtypetab; i++)
+        die_cache_type_members(ds, &ds->ds_typetab[i]);
+}
+
+/* Swap in a new store for a root DIE. Everything a reader needs to
+ * walk the tree, including the root DIE's first child, is in the store,
+ * so this is one atomic store. Readers who already have the old one
+ * keep using it until they leave their read section.
+ */
+static void die_publish_store(die_t *root_die, struct die_store *ds){
+    struct die_store *old = root_die->die_store;
+
+    ds->ds_root = root_die;
+
+    __atomic_store_n(&root_die->die_store, ds, __ATOMIC_RELEASE);
+
+    rcu_retire(old, die_store_free);
+}
+
+/* Build the rest of the DIE tree and the line table for a root DIE
+ * from die_create_cu_root_die. This does not depend on which
+ * compilation unit libdwarf is currently positioned at.
+ *
+ * The tree is built off to the side, in a copy of the root DIE's store,
+ * and published in one go when it's done, so anyone reading the root
+ * DIE at the same time sees either no tree or all of it. Only one
+ * thread can build with a given Dwarf_Debug at a time.
+ */
+int die_build_cu_tree(dwarfinfo_t *dwarfinfo, void *compile_unit,
+        die_t *root_die, sym_error_t *e){
+    if(!root_die){
+        errset(e, GENERIC_ERROR_KIND, GE_INVALID_DIE);
+        return 1;
+    }
+
+    int is_info = 1;
+    Dwarf_Error d_error = NULL;
+    Dwarf_Die cu_rootdie = NULL;
+
+    /* We don't hold onto libdwarf DIEs, so get the root DIE again */
+    int ret = dwarf_offdie_b(dwarfinfo->di_dbg, root_die->die_dieoffset,
+            is_info, &cu_rootdie, &d_error);
+
+    if(ret != DW_DLV_OK){
+        if(ret == DW_DLV_ERROR)
+            dwarf_dealloc(dwarfinfo->di_dbg, d_error, DW_DLA_ERROR);
+
+        errset(e, SYM_ERROR_KIND, SYM_DWARF_OFFDIE_B_FAILED);
+        return 1;
+    }
+
+    struct die_store *ds = die_store_copy_root(root_die->die_store);
+
+    /* Children get linked to this copy of the root DIE while the tree
+     * is being built, since readers can see the real one.
+     */
+    die_t scratchroot = *root_die;
+
+    scratchroot.die_store = ds;
+    scratchroot.die_firstchild = DIE_NONE;
+    ds->ds_root = &scratchroot;
+
+    reset_cur_parents();
+    CUR_PARENTS[0] = 0;
+
+    /* Names generated for anonymous types and lexical blocks should
+     * not depend on the order compilation units are built in.
+     */
+    lex_block_count = 0;
+    anon_struct_count = 0;
+    anon_union_count = 0;
+    anon_enum_count = 0;
+
+    ds->ds_arena = arena_new();
+
+    CUR_STORE = ds;
+    CUR_ARENA = ds->ds_arena;
+    CUR_CU_LOWPC = die_rangeinfo(root_die)->ri_low_pc;
+
+    die_name_hash_resize();
+    die_type_hash_resize();
+
+    construct_die_tree(dwarfinfo, compile_unit, cu_rootdie, 0, 0);
+
+    link_die_children(ds);
+    build_die_offset_index(ds);
+    build_die_scope_index(ds);
+    dedup_die_types(dwarfinfo, compile_unit, ds);
+    freeze_die_store(ds);
+
+    die_name_hash_free();
+    die_type_hash_free();
+
+    CUR_STORE = NULL;
+    CUR_ARENA = NULL;
+
+    /* A line table from the symbol cache is used as is */
+    const void *cachedlinetab = NULL;
+    size_t cachedlinetablen = 0;
+
+    cu_get_cached_linetab(compile_unit, &cachedlinetab, &cachedlinetablen,
+            NULL);
+
+    if(cachedlinetab){
+        ds->ds_linetab = linetab_new_from_flat(cachedlinetab,
+                cachedlinetablen);
+    }
+
+    if(!ds->ds_linetab){
+        ret = read_cu_linetab(dwarfinfo, cu_rootdie, die_name(root_die),
+                &ds->ds_linetab, e);
+    }
+
+    dwarf_dealloc(dwarfinfo->di_dbg, cu_rootdie, DW_DLA_DIE);
+
+    if(ret){
+        ds->ds_root = root_die;
+        die_store_free(ds);
+        return 1;
+    }
+
+    die_publish_store(root_die, ds);
+
+    return 0;
+}
+
+/* Free everything under a compilation unit's root DIE, but keep the
+ * root DIE itself. The tree can be built again with die_build_cu_tree.
+ * Readers who are still looking at the old tree can keep doing so
+ * until they leave their read section.
+ */
+void die_tree_free_children(Dwarf_Debug dbg, die_t *root_die){
+    if(!root_die || !root_die->die_store)
+        return;
+
+    die_publish_store(root_die, die_store_copy_root(root_die->die_store));
+}
+
+/* Approximate number of bytes a DIE tree and its line table take up. */
+size_t die_tree_size(die_t *root_die){
+    if(!root_die || !root_die->die_store)
+        return 0;
+
+    struct die_store *ds = root_die->die_store;
+    size_t reserved = 0;
+
+    arena_get_stats(ds->ds_arena, NULL, NULL, &reserved, NULL);
+
+    return sizeof(die_t) + sizeof(struct die_store) +
+        (sizeof(die_t) * ds->ds_nodescap) +
+        (sizeof(char *) * ds->ds_namescap) +
+        (sizeof(struct die_typeinfo) * ds->ds_typescap) +
+        (sizeof(struct die_type) * ds->ds_typetabcap) +
+        (sizeof(struct die_rangeinfo) * ds->ds_rangescap) +
+        (sizeof(struct die_locinfo) * ds->ds_locscap) +
+        (sizeof(int) * ds->ds_numnodes) +
+        reserved + linetab_size(ds->ds_linetab);
+}
+
+/* How many DIEs are in a compilation unit's DIE tree,
+ * counting the root DIE.
+ */
+int die_tree_count(die_t *root_die){
+    if(!root_die || !root_die->die_store)
+        return 0;
+
+    return root_die->die_store->ds_numnodes;
+}
+
+/* Allocation counts for a compilation unit's DIE tree. These add
+ * to whatever the out parameters already hold.
+ */
+int die_get_allocation_stats(die_t *root_die, size_t *nallocs,
+        size_t *bytesinuse, size_t *bytesreserved, size_t *nchunks,
+        sym_error_t *e){
+    if(!root_die || !root_die->die_store){
+        errset(e, GENERIC_ERROR_KIND, GE_INVALID_DIE);
+        return 1;
+    }
+
+    arena_get_stats(root_die->die_store->ds_arena, nallocs, bytesinuse,
+            bytesreserved, nchunks);
+
+    return 0;
+}
+
+int initialize_and_build_die_tree_from_root_die(dwarfinfo_t *dwarfinfo,
+        void *compile_unit, die_t **_root_die, sym_error_t *e){
+    die_t *root_die = NULL;
+
+    if(die_create_cu_root_die(dwarfinfo, compile_unit, &root_die, e))
+        return 1;
+
+    if(die_build_cu_tree(dwarfinfo, compile_unit, root_die, e))
         return 1;
-    }
 
     printf("output of display_die_tree:\n\n");
 
@@ -1,15 +1,31 @@
 #ifndef _DIE_H_
 #define _DIE_H_
 
+int die_create_value_desc(void *, uint64_t,
+        int (*)(void *, uint64_t, void *, size_t), void *, int, char **,
+        void *);
 int die_create_variable_or_parameter_desc(void *, void *, char **,
         void *, int);
 void die_display(void *);
 void die_display_die_tree_starting_from(void *);
+int die_evaluate_location(void *, uint64_t, int (*)(void *, int, uint64_t *),
+        int (*)(void *, uint64_t, void *, size_t), void *, int **,
+        uint64_t **, uint64_t **, int *, void *);
 int die_evaluate_location_description(void *, uint64_t, uint64_t *, void *);
+int die_evaluate_locations(void *, int, uint64_t,
+        int (*)(void *, int, uint64_t *),
+        int (*)(void *, uint64_t, void *, size_t), void *, int **,
+        uint64_t **, uint64_t **, int **, void *);
+int die_find_by_offset(void *, uint64_t, void **, void *);
+int die_find_function_by_pc(void *, uint64_t, void **, void *);
+int die_get_allocation_stats(void *, size_t *, size_t *, size_t *, size_t *,
+        void *);
 int die_get_array_elem_size(void *, uint64_t *, void *);
 int die_get_array_size_determined_at_runtime(void *, int *, void *);
+int die_get_cu_linetab(void *, void *, void **, int *, void *);
 int die_get_data_type_str(void *, char **, void *);
 int die_get_encoding(void *, uint64_t *, void *);
+int die_get_function_ranges(void *, void *, int *, void *);
 int die_get_high_pc(void *, uint64_t *, void *);
 int die_get_line_info_from_pc(void *, void *, uint64_t, char **, char **,
         uint64_t *, void *);
@@ -17,11 +33,15 @@ int die_get_low_pc(void *, uint64_t *, void *);
 int die_get_members(void *, void *, void ***, int *, void *);
 int die_get_member_offset(void *, uint64_t *, void *);
 int die_get_name(void *, char **, void *);
+int die_get_offset(void *, uint64_t *, void *);
 int die_get_parameters(void *, void ***, int *, void *);
 int die_get_parent(void *, void **, void *);
 int die_get_pc_of_next_line(void *, void *, uint64_t, uint64_t *, void *);
 int die_get_pc_values_from_lineno(void *, void *, uint64_t, uint64_t **,
         int *, void *);
+int die_get_ranges(void *, void **, int *, void *);
+int die_get_scopes_at_pc(void *, uint64_t, void ***, int *, void *);
+int die_get_type_summaries(void *, void *, int *, void *);
 int die_get_variables(void *, void *, void ***, int *, void *);
 int die_get_variable_size(void *, uint64_t *, void *);
 int die_is_member_of_struct_or_union(void *, int *, void *);
@@ -32,9 +52,16 @@ int die_represents_pointer(void *, int *, void *);
 int die_represents_struct(void *, int *, void *);
 int die_represents_union(void *, int *, void *);
 int die_search(void *, void *, int, void **, void *);
+int die_tree_count(void *);
 void die_tree_free(void *, void *, int);
+void die_tree_free_children(void *, void *);
+size_t die_tree_size(void *);
 
 /* Internal functions */
+int die_build_cu_tree(void *, void *, void *, void *);
+int die_create_cu_root_die(void *, void *, void **, void *);
+int die_create_cu_root_die_at_offset(void *, void *, uint64_t, void **,
+        void *);
 int initialize_and_build_die_tree_from_root_die(void *, void *, void **,
         void *);
 
@@ -0,0 +1,524 @@
+#include <arpa/inet.h>
+#include <mach-o/fat.h>
+#include <mach-o/loader.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <libdwarf.h>
+
+struct dwarfobj_section {
+    /* ELF style name libdwarf understands, like .debug_info */
+    char *ds_name;
+    uint64_t ds_addr;
+    uint64_t ds_size;
+
+    /* Points into the mapping */
+    Dwarf_Small *ds_data;
+};
+
+/* A Mach-O, or an ELF file, mapped once, whose DWARF sections are
+ * handed to libdwarf in place through its object access interface.
+ * libdwarf never copies them, and every Dwarf_Debug made from the same
+ * dwarfobj shares the one mapping.
+ */
+struct dwarfobj {
+    void *do_map;
+    size_t do_mapsize;
+
+    /* do_sections[0] is empty, since libdwarf expects section zero to
+     * be the null section, like it is in ELF.
+     */
+    struct dwarfobj_section *do_sections;
+    int do_numsections;
+
+    Dwarf_Small do_pointersize;
+
+    Dwarf_Obj_Access_Interface do_interface;
+};
+
+/* iOS doesn't have elf.h, so the parts of ELF we look at are here.
+ * ELF is only read so the benchmarks can run on a Linux host against
+ * something built there with -g.
+ */
+#define DWARFOBJ_ELFMAG "\177ELF"
+#define DWARFOBJ_ELFCLASS64 2
+#define DWARFOBJ_ELFDATA2LSB 1
+#define DWARFOBJ_SHN_XINDEX 0xffff
+#define DWARFOBJ_SHT_NOBITS 8
+#define DWARFOBJ_SHF_COMPRESSED (1 << 11)
+
+struct dwarfobj_elf64_ehdr {
+    uint8_t e_ident[16];
+    uint16_t e_type;
+    uint16_t e_machine;
+    uint32_t e_version;
+    uint64_t e_entry;
+    uint64_t e_phoff;
+    uint64_t e_shoff;
+    uint32_t e_flags;
+    uint16_t e_ehsize;
+    uint16_t e_phentsize;
+    uint16_t e_phnum;
+    uint16_t e_shentsize;
+    uint16_t e_shnum;
+    uint16_t e_shstrndx;
+};
+
+struct dwarfobj_elf64_shdr {
+    uint32_t sh_name;
+    uint32_t sh_type;
+    uint64_t sh_flags;
+    uint64_t sh_addr;
+    uint64_t sh_offset;
+    uint64_t sh_size;
+    uint32_t sh_link;
+    uint32_t sh_info;
+    uint64_t sh_addralign;
+    uint64_t sh_entsize;
+};
+
+/* Mach-O section names are at most 16 characters, so a few DWARF
+ * section names are cut short.
+ */
+static const char *const TRUNCATED_SECTION_NAMES[][2] = {
+    { "__debug_str_offs", ".debug_str_offsets" },
+    { "__debug_line_str", ".debug_line_str" },
+    { "__debug_pubtypes", ".debug_pubtypes" },
+    { "__debug_pubnames", ".debug_pubnames" }
+};
+
+/* __debug_info becomes .debug_info, __apple_names becomes .apple_names */
+static char *dwarfobj_section_name(const char *sectname){
+    char name[17] = {0};
+    strncpy(name, sectname, 16);
+
+    size_t cnt = sizeof(TRUNCATED_SECTION_NAMES) /
+        sizeof(TRUNCATED_SECTION_NAMES[0]);
+
+    for(size_t i=0; i<cnt; i++){
+        if(strcmp(name, TRUNCATED_SECTION_NAMES[i][0]) == 0)
+            return strdup(TRUNCATED_SECTION_NAMES[i][1]);
+    }
+
+    if(strncmp(name, "__", 2) != 0)
+        return strdup(name);
+
+    char *converted = malloc(strlen(name));
+    converted[0] = '.';
+    strcpy(converted + 1, name + 2);
+
+    return converted;
+}
+
+static void dwarfobj_append_section(struct dwarfobj *dobj, char *name,
+        uint64_t addr, uint64_t size, uint64_t fileoff){
+    struct dwarfobj_section *sections_rea = realloc(dobj->do_sections,
+            sizeof(struct dwarfobj_section) * (dobj->do_numsections + 1));
+
+    dobj->do_sections = sections_rea;
+
+    struct dwarfobj_section *ds = &dobj->do_sections[dobj->do_numsections++];
+
+    ds->ds_name = name;
+    ds->ds_addr = addr;
+    ds->ds_size = size;
+    ds->ds_data = (Dwarf_Small *)dobj->do_map + fileoff;
+}
+
+static int dwarfobj_add_section(struct dwarfobj *dobj, struct section_64 *sect,
+        uint64_t sliceoff, uint64_t slicesize){
+    /* zerofill sections have nothing in the file */
+    if(sect->offset == 0 || sect->size == 0)
+        return 0;
+
+    if(sect->offset > slicesize || sect->size > slicesize - sect->offset)
+        return 1;
+
+    dwarfobj_append_section(dobj, dwarfobj_section_name(sect->sectname),
+            sect->addr, sect->size, sliceoff + sect->offset);
+
+    return 0;
+}
+
+/* Find the sections of every segment in the Mach-O at sliceoff. Only
+ * 64 bit little endian Mach-Os are supported.
+ */
+static int dwarfobj_read_sections(struct dwarfobj *dobj, uint64_t sliceoff,
+        uint64_t slicesize){
+    if(slicesize < sizeof(struct mach_header_64))
+        return 1;
+
+    uint8_t *slice = (uint8_t *)dobj->do_map + sliceoff;
+    struct mach_header_64 *hdr = (struct mach_header_64 *)slice;
+
+    if(hdr->magic != MH_MAGIC_64)
+        return 1;
+
+    if(hdr->sizeofcmds > slicesize - sizeof(struct mach_header_64))
+        return 1;
+
+    dobj->do_pointersize = 8;
+
+    uint8_t *cmds = slice + sizeof(struct mach_header_64);
+    uint32_t cmdoff = 0;
+
+    for(uint32_t i=0; i<hdr->ncmds; i++){
+        if(cmdoff + sizeof(struct load_command) > hdr->sizeofcmds)
+            return 1;
+
+        struct load_command *lc = (struct load_command *)(cmds + cmdoff);
+
+        if(lc->cmdsize < sizeof(struct load_command) ||
+                cmdoff + lc->cmdsize > hdr->sizeofcmds){
+            return 1;
+        }
+
+        if(lc->cmd == LC_SEGMENT_64){
+            struct segment_command_64 *seg = (struct segment_command_64 *)lc;
+            uint64_t sectsz = sizeof(struct section_64) * (uint64_t)seg->nsects;
+
+            if(lc->cmdsize < sizeof(struct segment_command_64) ||
+                    sectsz > lc->cmdsize - sizeof(struct segment_command_64)){
+                return 1;
+            }
+
+            struct section_64 *sects = (struct section_64 *)(seg + 1);
+
+            for(uint32_t k=0; k<seg->nsects; k++){
+                if(dwarfobj_add_section(dobj, &sects[k], sliceoff, slicesize))
+                    return 1;
+            }
+        }
+
+        cmdoff += lc->cmdsize;
+    }
+
+    return 0;
+}
+
+static int dwarfobj_is_elf(struct dwarfobj *dobj){
+    return dobj->do_mapsize >= sizeof(struct dwarfobj_elf64_ehdr) &&
+        memcmp(dobj->do_map, DWARFOBJ_ELFMAG, 4) == 0;
+}
+
+/* Find the .debug_* sections of a linked ELF file. Only 64 bit little
+ * endian ELF is supported, and nothing is relocated, so relocatable
+ * objects can't be read. Compressed sections are left out.
+ */
+static int dwarfobj_read_elf_sections(struct dwarfobj *dobj){
+    uint8_t *map = dobj->do_map;
+    struct dwarfobj_elf64_ehdr *eh = (struct dwarfobj_elf64_ehdr *)map;
+
+    if(eh->e_ident[4] != DWARFOBJ_ELFCLASS64 ||
+            eh->e_ident[5] != DWARFOBJ_ELFDATA2LSB ||
+            eh->e_shentsize != sizeof(struct dwarfobj_elf64_shdr) ||
+            eh->e_shoff == 0 || eh->e_shoff > dobj->do_mapsize){
+        return 1;
+    }
+
+    dobj->do_pointersize = 8;
+
+    struct dwarfobj_elf64_shdr *shdrs =
+        (struct dwarfobj_elf64_shdr *)(map + eh->e_shoff);
+    uint64_t maxshdrs = (dobj->do_mapsize - eh->e_shoff) /
+        sizeof(struct dwarfobj_elf64_shdr);
+
+    if(maxshdrs == 0)
+        return 1;
+
+    /* With a lot of sections, the real counts are in section zero */
+    uint64_t shnum = eh->e_shnum == 0 ? shdrs[0].sh_size : eh->e_shnum;
+    uint64_t shstrndx = eh->e_shstrndx == DWARFOBJ_SHN_XINDEX ?
+        shdrs[0].sh_link : eh->e_shstrndx;
+
+    if(shnum > maxshdrs || shstrndx >= shnum)
+        return 1;
+
+    struct dwarfobj_elf64_shdr *strsh = &shdrs[shstrndx];
+
+    if(strsh->sh_offset > dobj->do_mapsize ||
+            strsh->sh_size > dobj->do_mapsize - strsh->sh_offset){
+        return 1;
+    }
+
+    const char *strs = (const char *)map + strsh->sh_offset;
+
+    for(uint64_t i=1; i<shnum; i++){
+        struct dwarfobj_elf64_shdr *sh = &shdrs[i];
+
+        if(sh->sh_name >= strsh->sh_size ||
+                !memchr(strs + sh->sh_name, '\0',
+                    strsh->sh_size - sh->sh_name)){
+            return 1;
+        }
+
+        const char *name = strs + sh->sh_name;
+
+        if(strncmp(name, ".debug_", 7) != 0 || sh->sh_size == 0 ||
+                sh->sh_type == DWARFOBJ_SHT_NOBITS ||
+                (sh->sh_flags & DWARFOBJ_SHF_COMPRESSED)){
+            continue;
+        }
+
+        if(sh->sh_offset > dobj->do_mapsize ||
+                sh->sh_size > dobj->do_mapsize - sh->sh_offset){
+            return 1;
+        }
+
+        dwarfobj_append_section(dobj, strdup(name), sh->sh_addr, sh->sh_size,
+                sh->sh_offset);
+    }
+
+    return 0;
+}
+
+static int dwarfobj_get_section_info(void *obj, Dwarf_Half idx,
+        Dwarf_Obj_Access_Section *sectout, int *error){
+    struct dwarfobj *dobj = obj;
+
+    if(idx >= dobj->do_numsections)
+        return DW_DLV_NO_ENTRY;
+
+    struct dwarfobj_section *ds = &dobj->do_sections[idx];
+
+    memset(sectout, 0, sizeof(Dwarf_Obj_Access_Section));
+
+    sectout->addr = ds->ds_addr;
+    sectout->size = ds->ds_size;
+    sectout->name = ds->ds_name;
+
+    return DW_DLV_OK;
+}
+
+static Dwarf_Endianness dwarfobj_get_byte_order(void *obj){
+    return DW_OBJECT_LSB;
+}
+
+static Dwarf_Small dwarfobj_get_length_size(void *obj){
+    /* 32 bit DWARF, the only kind a dSYM has, and what compilers
+     * make for ELF unless asked not to
+     */
+    return 4;
+}
+
+static Dwarf_Small dwarfobj_get_pointer_size(void *obj){
+    struct dwarfobj *dobj = obj;
+
+    return dobj->do_pointersize;
+}
+
+static Dwarf_Unsigned dwarfobj_get_section_count(void *obj){
+    struct dwarfobj *dobj = obj;
+
+    return dobj->do_numsections;
+}
+
+static int dwarfobj_load_section(void *obj, Dwarf_Half idx,
+        Dwarf_Small **dataout, int *error){
+    struct dwarfobj *dobj = obj;
+
+    if(idx == 0 || idx >= dobj->do_numsections)
+        return DW_DLV_NO_ENTRY;
+
+    /* Nothing is read or copied, the section is already mapped */
+    *dataout = dobj->do_sections[idx].ds_data;
+
+    return DW_DLV_OK;
+}
+
+static const Dwarf_Obj_Access_Methods DWARFOBJ_METHODS = {
+    dwarfobj_get_section_info,
+    dwarfobj_get_byte_order,
+    dwarfobj_get_length_size,
+    dwarfobj_get_pointer_size,
+    dwarfobj_get_section_count,
+    dwarfobj_load_section,
+    /* dSYMs, and the ELF files we read, are already linked, so
+     * there's nothing to relocate
+     */
+    NULL
+};
+
+void dwarfobj_free(struct dwarfobj *dobj){
+    if(!dobj)
+        return;
+
+    for(int i=0; i<dobj->do_numsections; i++)
+        free(dobj->do_sections[i].ds_name);
+
+    free(dobj->do_sections);
+
+    if(dobj->do_map)
+        munmap(dobj->do_map, dobj->do_mapsize);
+
+    free(dobj);
+}
+
+/* Fat headers are big endian */
+static uint64_t dwarfobj_fat_u64(uint64_t v){
+    const uint32_t *halves = (const uint32_t *)&v;
+
+    return ((uint64_t)ntohl(halves[0]) << 32) | ntohl(halves[1]);
+}
+
+/* Where the Mach-O we read lives in a file of filesize bytes, whose
+ * first hdrsize bytes are at hdr. For a universal file, that's the arm64
+ * slice if there is one, otherwise the first. Returns non-zero if the
+ * fat header or the slice it points to doesn't fit.
+ */
+int dwarfobj_find_slice(const void *hdr, uint64_t hdrsize, uint64_t filesize,
+        uint64_t *sliceoffout, uint64_t *slicesizeout){
+    *sliceoffout = 0;
+    *slicesizeout = filesize;
+
+    if(hdrsize < sizeof(struct fat_header))
+        return 0;
+
+    const struct fat_header *fh = hdr;
+    uint32_t magic = fh->magic;
+
+    if(magic != FAT_CIGAM && magic != FAT_CIGAM_64)
+        return 0;
+
+    uint32_t narchs = ntohl(fh->nfat_arch);
+    uint64_t archsize = magic == FAT_CIGAM ? sizeof(struct fat_arch) :
+        sizeof(struct fat_arch_64);
+
+    if(narchs == 0 || (hdrsize - sizeof(*fh)) / archsize < narchs)
+        return 1;
+
+    const uint8_t *archs = (const uint8_t *)(fh + 1);
+    uint64_t sliceoff = 0, slicesize = 0;
+
+    /* Backwards, so the first slice is left if none is arm64 */
+    for(uint32_t i=narchs; i>0; i--){
+        const uint8_t *arch = archs + ((i - 1) * archsize);
+        cpu_type_t cputype;
+
+        if(magic == FAT_CIGAM){
+            const struct fat_arch *fa = (const struct fat_arch *)arch;
+
+            cputype = (cpu_type_t)ntohl(fa->cputype);
+            sliceoff = ntohl(fa->offset);
+            slicesize = ntohl(fa->size);
+        }
+        else{
+            const struct fat_arch_64 *fa = (const struct fat_arch_64 *)arch;
+
+            cputype = (cpu_type_t)ntohl(fa->cputype);
+            sliceoff = dwarfobj_fat_u64(fa->offset);
+            slicesize = dwarfobj_fat_u64(fa->size);
+        }
+
+        if(cputype == CPU_TYPE_ARM64)
+            break;
+    }
+
+    if(sliceoff > filesize || slicesize > filesize - sliceoff)
+        return 1;
+
+    *sliceoffout = sliceoff;
+    *slicesizeout = slicesize;
+
+    return 0;
+}
+
+/* Map the Mach-O or ELF file open at fd. For a universal file, the
+ * arm64 slice is used if there is one. Returns NULL if it isn't a file
+ * we can read.
+ */
+struct dwarfobj *dwarfobj_new(int fd){
+    struct stat st;
+
+    if(fstat(fd, &st) || st.st_size < (off_t)sizeof(struct mach_header_64))
+        return NULL;
+
+    /* Private and writable so in the unlikely case libdwarf writes to
+     * a section, it only touches its own copy of that page.
+     */
+    void *map = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+            fd, 0);
+
+    if(map == MAP_FAILED)
+        return NULL;
+
+    struct dwarfobj *dobj = calloc(1, sizeof(struct dwarfobj));
+
+    dobj->do_map = map;
+    dobj->do_mapsize = st.st_size;
+
+    dobj->do_sections = calloc(1, sizeof(struct dwarfobj_section));
+    dobj->do_sections[0].ds_name = strdup("");
+    dobj->do_numsections = 1;
+
+    uint64_t sliceoff, slicesize;
+    int ret;
+
+    if(dwarfobj_is_elf(dobj))
+        ret = dwarfobj_read_elf_sections(dobj);
+    else{
+        ret = dwarfobj_find_slice(map, dobj->do_mapsize, dobj->do_mapsize,
+                &sliceoff, &slicesize) ||
+            dwarfobj_read_sections(dobj, sliceoff, slicesize);
+    }
+
+    if(ret){
+        dwarfobj_free(dobj);
+        return NULL;
+    }
+
+    /* Tell the kernel we're going to jump around in here */
+    madvise(map, st.st_size, MADV_RANDOM);
+
+    dobj->do_interface.object = dobj;
+    dobj->do_interface.methods = &DWARFOBJ_METHODS;
+
+    return dobj;
+}
+
+/* Find a DWARF section by its ELF style name, like .debug_line, for
+ * reading it without going through libdwarf. Whatever is returned
+ * points into the mapping.
+ */
+int dwarfobj_get_section(struct dwarfobj *dobj, const char *name,
+        const uint8_t **dataout, uint64_t *sizeout){
+    if(!dobj || !name)
+        return 1;
+
+    for(int i=1; i<dobj->do_numsections; i++){
+        struct dwarfobj_section *ds = &dobj->do_sections[i];
+
+        if(strcmp(ds->ds_name, name) == 0){
+            *dataout = ds->ds_data;
+            *sizeout = ds->ds_size;
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+/* Make a Dwarf_Debug which reads from dobj's mapping. It must be
+ * finished with dwarf_object_finish before dobj is freed. Any number
+ * of them can be made from one dwarfobj.
+ */
+int dwarfobj_init_dbg(struct dwarfobj *dobj, Dwarf_Debug *dbgout){
+    if(!dobj || !dbgout)
+        return 1;
+
+    Dwarf_Error d_error = NULL;
+
+    int ret = dwarf_object_init_b(&dobj->do_interface, NULL, NULL,
+            DW_GROUPNUMBER_ANY, dbgout, &d_error);
+
+    if(ret == DW_DLV_ERROR){
+        /* There's no Dwarf_Debug yet, so libdwarf frees it alone */
+        dwarf_dealloc(NULL, d_error, DW_DLA_ERROR);
+        return 1;
+    }
+
+    return ret != DW_DLV_OK;
+}
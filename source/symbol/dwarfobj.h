@@ -0,0 +1,12 @@
+#ifndef _DWARFOBJ_H_
+#define _DWARFOBJ_H_
+
+int dwarfobj_find_slice(const void *, uint64_t, uint64_t, uint64_t *,
+        uint64_t *);
+void *dwarfobj_new(int);
+int dwarfobj_get_section(void *, const char *, const uint8_t **,
+        uint64_t *);
+int dwarfobj_init_dbg(void *, void *);
+void dwarfobj_free(void *);
+
+#endif
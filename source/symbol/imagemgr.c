@@ -0,0 +1,538 @@
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "machosym.h"
+#include "rangetab.h"
+#include "rcu.h"
+
+#define IMAGEMGR_DSYM_DIR ".iosdbg/dsyms"
+
+/* One Mach-O image loaded into the debuggee */
+struct image {
+    char *im_path;
+
+    /* Points inside im_path */
+    char *im_name;
+
+    uint8_t im_uuid[16];
+    int im_hasuuid;
+
+    /* Where the image's mach header is, how far it was slid from where
+     * it was linked to be, and how much address space it takes up from
+     * the mach header on.
+     */
+    uint64_t im_loadaddr;
+    uint64_t im_slide;
+    uint64_t im_size;
+
+    /* Set if the user told us where the dSYM is */
+    char *im_dsympath;
+
+    /* The dSYM isn't looked for until an address inside this image
+     * needs to be symbolicated.
+     */
+    int im_dsymtried;
+    void *im_dwarfinfo;
+
+    /* The same goes for the image's own symbol table, read from the
+     * image on disk, for when there's no dSYM. Images in the shared
+     * cache aren't on disk, so theirs is read from the debuggee.
+     */
+    int im_symtabtried;
+    void *im_symtab;
+
+    /* Bumped whenever the user picks a different dSYM, so a dSYM
+     * which was being loaded when that happened isn't used.
+     */
+    unsigned int im_dsymgen;
+
+    /* The last update this image was added again in */
+    unsigned int im_updategen;
+
+    /* The image manager's, for freeing the dSYM once
+     * the image is dropped.
+     */
+    void (*im_unload)(void *);
+};
+
+/* Every image of the debuggee, and an index from address to image.
+ * Symbolication can happen from the exception thread and the
+ * command thread at the same time, so it's locked. Images which are
+ * dropped are freed with RCU, since readers use them outside the lock.
+ */
+struct imagemgr {
+    struct image **ims_images;
+    int ims_count;
+    int ims_capacity;
+
+    void *ims_ranges;
+
+    /* Between imagemgr_begin_update and imagemgr_end_update, images
+     * which are added don't go into ims_ranges until the update ends.
+     */
+    int ims_updating;
+    unsigned int ims_updategen;
+
+    /* Where the images added during the current update start */
+    int ims_updatestart;
+
+    /* How dSYMs are loaded and freed */
+    int (*ims_load)(const char *, void **);
+    void (*ims_unload)(void *);
+
+    /* How the debuggee's memory is read, for images which aren't
+     * on disk. Can be NULL.
+     */
+    int (*ims_readmem)(void *, uint64_t, void *, size_t);
+    void *ims_readmemarg;
+
+    pthread_mutex_t ims_lock;
+};
+
+struct imagemgr *imagemgr_new(int (*load)(const char *, void **),
+        void (*unload)(void *)){
+    struct imagemgr *ims = calloc(1, sizeof(struct imagemgr));
+
+    ims->ims_ranges = rangetab_new();
+    ims->ims_load = load;
+    ims->ims_unload = unload;
+
+    pthread_mutex_init(&ims->ims_lock, NULL);
+
+    return ims;
+}
+
+void imagemgr_set_memory_reader(struct imagemgr *ims,
+        int (*readmem)(void *, uint64_t, void *, size_t), void *arg){
+    if(!ims)
+        return;
+
+    pthread_mutex_lock(&ims->ims_lock);
+
+    ims->ims_readmem = readmem;
+    ims->ims_readmemarg = arg;
+
+    pthread_mutex_unlock(&ims->ims_lock);
+}
+
+static void imagemgr_image_free(void *arg){
+    struct image *im = arg;
+
+    if(im->im_dwarfinfo && im->im_unload)
+        im->im_unload(im->im_dwarfinfo);
+
+    machosym_free(im->im_symtab);
+
+    free(im->im_dsympath);
+    free(im->im_path);
+    free(im);
+}
+
+/* Build the address index again from every image. Nothing but the
+ * lock protects it, so the old one can go right away.
+ */
+static void imagemgr_rebuild_ranges(struct imagemgr *ims){
+    void *ranges = rangetab_new();
+
+    for(int i=0; i<ims->ims_count; i++){
+        struct image *im = ims->ims_images[i];
+
+        rangetab_add(ranges, im->im_loadaddr, im->im_loadaddr + im->im_size,
+                im);
+    }
+
+    rangetab_finalize(ranges);
+
+    rangetab_free(ims->ims_ranges);
+    ims->ims_ranges = ranges;
+}
+
+/* Adds an image which takes up [loadaddr, loadaddr + size). If the same
+ * image is already at loadaddr, that one is returned instead, so the
+ * debuggee's image list can be read again whenever it changes.
+ * uuid can be NULL.
+ *
+ * Outside of an update, the address index is rebuilt right away. When
+ * adding every image of the debuggee, use imagemgr_begin_update and
+ * imagemgr_end_update so it's only built once.
+ */
+struct image *imagemgr_add(struct imagemgr *ims, const char *path,
+        const uint8_t *uuid, uint64_t loadaddr, uint64_t slide,
+        uint64_t size){
+    if(!ims || !path || size == 0)
+        return NULL;
+
+    pthread_mutex_lock(&ims->ims_lock);
+
+    /* Only images from before this update are in the index. Something
+     * else at the same address means the old image was unloaded.
+     */
+    struct image *existing = rangetab_lookup(ims->ims_ranges, loadaddr);
+
+    if(existing && existing->im_loadaddr == loadaddr &&
+            strcmp(existing->im_path, path) == 0){
+        existing->im_updategen = ims->ims_updategen;
+        pthread_mutex_unlock(&ims->ims_lock);
+        return existing;
+    }
+
+    /* Or it was already added during this update */
+    if(ims->ims_updating){
+        for(int i=ims->ims_updatestart; i<ims->ims_count; i++){
+            existing = ims->ims_images[i];
+
+            if(existing->im_loadaddr == loadaddr &&
+                    strcmp(existing->im_path, path) == 0){
+                pthread_mutex_unlock(&ims->ims_lock);
+                return existing;
+            }
+        }
+    }
+
+    struct image *im = calloc(1, sizeof(struct image));
+
+    im->im_path = strdup(path);
+
+    char *slash = strrchr(im->im_path, '/');
+    im->im_name = slash ? slash + 1 : im->im_path;
+
+    if(uuid){
+        memcpy(im->im_uuid, uuid, sizeof(im->im_uuid));
+        im->im_hasuuid = 1;
+    }
+
+    im->im_loadaddr = loadaddr;
+    im->im_slide = slide;
+    im->im_size = size;
+    im->im_updategen = ims->ims_updategen;
+    im->im_unload = ims->ims_unload;
+
+    if(ims->ims_count == ims->ims_capacity){
+        int newcap = ims->ims_capacity == 0 ? 64 : ims->ims_capacity * 2;
+
+        struct image **images_rea = realloc(ims->ims_images,
+                sizeof(struct image *) * newcap);
+
+        ims->ims_images = images_rea;
+        ims->ims_capacity = newcap;
+    }
+
+    ims->ims_images[ims->ims_count++] = im;
+
+    if(!ims->ims_updating)
+        imagemgr_rebuild_ranges(ims);
+
+    pthread_mutex_unlock(&ims->ims_lock);
+
+    return im;
+}
+
+/* Start adding the debuggee's whole image list again. Until the update
+ * ends, lookups only see the images from before it.
+ */
+void imagemgr_begin_update(struct imagemgr *ims){
+    if(!ims)
+        return;
+
+    pthread_mutex_lock(&ims->ims_lock);
+
+    ims->ims_updating = 1;
+    ims->ims_updategen++;
+    ims->ims_updatestart = ims->ims_count;
+
+    pthread_mutex_unlock(&ims->ims_lock);
+}
+
+/* Images which weren't added again since imagemgr_begin_update were
+ * unloaded by the debuggee, and are dropped. If some of the debuggee's
+ * images couldn't be read, pass zero for complete, and nothing is
+ * dropped. They're freed once nothing is reading from them anymore.
+ */
+void imagemgr_end_update(struct imagemgr *ims, int complete){
+    if(!ims)
+        return;
+
+    pthread_mutex_lock(&ims->ims_lock);
+
+    if(complete){
+        int kept = 0;
+
+        for(int i=0; i<ims->ims_count; i++){
+            struct image *im = ims->ims_images[i];
+
+            if(im->im_updategen == ims->ims_updategen)
+                ims->ims_images[kept++] = im;
+            else
+                rcu_retire(im, imagemgr_image_free);
+        }
+
+        ims->ims_count = kept;
+    }
+
+    imagemgr_rebuild_ranges(ims);
+
+    ims->ims_updating = 0;
+
+    pthread_mutex_unlock(&ims->ims_lock);
+}
+
+int imagemgr_count(struct imagemgr *ims){
+    if(!ims)
+        return 0;
+
+    pthread_mutex_lock(&ims->ims_lock);
+    int count = ims->ims_count;
+    pthread_mutex_unlock(&ims->ims_lock);
+
+    return count;
+}
+
+/* Which image addr is inside of, or NULL if none of them */
+struct image *imagemgr_find(struct imagemgr *ims, uint64_t addr){
+    if(!ims)
+        return NULL;
+
+    pthread_mutex_lock(&ims->ims_lock);
+    struct image *im = rangetab_lookup(ims->ims_ranges, addr);
+    pthread_mutex_unlock(&ims->ims_lock);
+
+    return im;
+}
+
+/* Images are in the order they were added. Images can be dropped by
+ * another thread, so this is only good inside an RCU read section.
+ */
+struct image *imagemgr_get(struct imagemgr *ims, int idx){
+    if(!ims)
+        return NULL;
+
+    struct image *im = NULL;
+
+    pthread_mutex_lock(&ims->ims_lock);
+
+    if(idx >= 0 && idx < ims->ims_count)
+        im = ims->ims_images[idx];
+
+    pthread_mutex_unlock(&ims->ims_lock);
+
+    return im;
+}
+
+/* Any of the out parameters can be NULL. Nothing returned should
+ * be freed. uuidout is set to NULL if the image has no UUID.
+ */
+void imagemgr_get_info(struct image *im, const char **pathout,
+        const char **nameout, const uint8_t **uuidout,
+        uint64_t *loadaddrout, uint64_t *slideout, uint64_t *sizeout){
+    if(!im)
+        return;
+
+    if(pathout)
+        *pathout = im->im_path;
+
+    if(nameout)
+        *nameout = im->im_name;
+
+    if(uuidout)
+        *uuidout = im->im_hasuuid ? im->im_uuid : NULL;
+
+    if(loadaddrout)
+        *loadaddrout = im->im_loadaddr;
+
+    if(slideout)
+        *slideout = im->im_slide;
+
+    if(sizeout)
+        *sizeout = im->im_size;
+}
+
+/* Use this dSYM for this image from now on. Whatever dSYM was loaded
+ * for it before is freed once nothing is reading from it anymore.
+ */
+void imagemgr_set_dsym(struct imagemgr *ims, struct image *im,
+        const char *dsympath){
+    if(!ims || !im)
+        return;
+
+    pthread_mutex_lock(&ims->ims_lock);
+
+    if(im->im_dwarfinfo && ims->ims_unload)
+        rcu_retire(im->im_dwarfinfo, ims->ims_unload);
+
+    free(im->im_dsympath);
+    im->im_dsympath = dsympath ? strdup(dsympath) : NULL;
+
+    im->im_dwarfinfo = NULL;
+    im->im_dsymtried = 0;
+    im->im_dsymgen++;
+
+    pthread_mutex_unlock(&ims->ims_lock);
+}
+
+static void *imagemgr_try_load(struct imagemgr *ims, const char *dsympath){
+    void *dwarfinfo = NULL;
+
+    if(access(dsympath, R_OK) != 0)
+        return NULL;
+
+    if(ims->ims_load(dsympath, &dwarfinfo))
+        return NULL;
+
+    return dwarfinfo;
+}
+
+/* If the user didn't say where this image's dSYM is, look next to the
+ * image, then in ~/.iosdbg/dsyms, where dSYMs can be named after the
+ * UUID of the image they're for. Only reads what doesn't change after
+ * the image is added, so it's called without the lock held.
+ */
+static void *imagemgr_load_dsym(struct imagemgr *ims, struct image *im,
+        const char *userdsympath){
+    if(!ims->ims_load)
+        return NULL;
+
+    if(userdsympath)
+        return imagemgr_try_load(ims, userdsympath);
+
+    char dsympath[2048];
+
+    snprintf(dsympath, sizeof(dsympath),
+            "%s.dSYM/Contents/Resources/DWARF/%s", im->im_path, im->im_name);
+
+    void *dwarfinfo = imagemgr_try_load(ims, dsympath);
+
+    if(dwarfinfo)
+        return dwarfinfo;
+
+    char *home = getenv("HOME");
+
+    if(!home || !im->im_hasuuid)
+        return NULL;
+
+    const uint8_t *u = im->im_uuid;
+
+    snprintf(dsympath, sizeof(dsympath), "%s/%s/%02X%02X%02X%02X-%02X%02X-"
+            "%02X%02X-%02X%02X-%02X%02X%02X%02X%02X%02X.dSYM/Contents/"
+            "Resources/DWARF/%s", home, IMAGEMGR_DSYM_DIR,
+            u[0], u[1], u[2], u[3], u[4], u[5], u[6], u[7],
+            u[8], u[9], u[10], u[11], u[12], u[13], u[14], u[15],
+            im->im_name);
+
+    return imagemgr_try_load(ims, dsympath);
+}
+
+/* The dwarfinfo for this image, loading it the first time it's asked
+ * for. NULL if there is no dSYM for this image.
+ *
+ * Loading a dSYM takes a while, so it's done without the lock held and
+ * published after. If another thread got there first, or the user
+ * picked a different dSYM in the meantime, what we loaded was never
+ * seen by anyone and is freed right away.
+ */
+void *imagemgr_get_dwarfinfo(struct imagemgr *ims, struct image *im){
+    if(!ims || !im)
+        return NULL;
+
+    pthread_mutex_lock(&ims->ims_lock);
+
+    if(im->im_dsymtried){
+        void *dwarfinfo = im->im_dwarfinfo;
+        pthread_mutex_unlock(&ims->ims_lock);
+        return dwarfinfo;
+    }
+
+    unsigned int dsymgen = im->im_dsymgen;
+    char *userdsympath = im->im_dsympath ? strdup(im->im_dsympath) : NULL;
+
+    pthread_mutex_unlock(&ims->ims_lock);
+
+    void *loaded = imagemgr_load_dsym(ims, im, userdsympath);
+
+    free(userdsympath);
+
+    pthread_mutex_lock(&ims->ims_lock);
+
+    if(!im->im_dsymtried && im->im_dsymgen == dsymgen){
+        im->im_dwarfinfo = loaded;
+        im->im_dsymtried = 1;
+        loaded = NULL;
+    }
+
+    void *dwarfinfo = im->im_dwarfinfo;
+
+    pthread_mutex_unlock(&ims->ims_lock);
+
+    if(loaded && ims->ims_unload)
+        ims->ims_unload(loaded);
+
+    return dwarfinfo;
+}
+
+/* The symbol table for this image, read the first time it's asked
+ * for. NULL if the image can't be read from disk, or if what's on disk
+ * isn't what was loaded. Like a dSYM, it's read without the lock held.
+ */
+void *imagemgr_get_symtab(struct imagemgr *ims, struct image *im){
+    if(!ims || !im)
+        return NULL;
+
+    pthread_mutex_lock(&ims->ims_lock);
+
+    if(im->im_symtabtried){
+        void *symtab = im->im_symtab;
+        pthread_mutex_unlock(&ims->ims_lock);
+        return symtab;
+    }
+
+    int (*readmem)(void *, uint64_t, void *, size_t) = ims->ims_readmem;
+    void *readmemarg = ims->ims_readmemarg;
+
+    pthread_mutex_unlock(&ims->ims_lock);
+
+    void *loaded = machosym_new_from_file(im->im_path);
+    const uint8_t *uuid = machosym_get_uuid(loaded);
+
+    if(uuid && im->im_hasuuid && memcmp(uuid, im->im_uuid, 16) != 0){
+        machosym_free(loaded);
+        loaded = NULL;
+    }
+
+    /* Not on disk, or not the same image as what's on disk anymore.
+     * What's in memory is always the right one.
+     */
+    if(!loaded && readmem)
+        loaded = machosym_new_from_image(im->im_loadaddr, readmem, readmemarg);
+
+    pthread_mutex_lock(&ims->ims_lock);
+
+    if(!im->im_symtabtried){
+        im->im_symtab = loaded;
+        im->im_symtabtried = 1;
+        loaded = NULL;
+    }
+
+    void *symtab = im->im_symtab;
+
+    pthread_mutex_unlock(&ims->ims_lock);
+
+    machosym_free(loaded);
+
+    return symtab;
+}
+
+void imagemgr_free(struct imagemgr *ims){
+    if(!ims)
+        return;
+
+    for(int i=0; i<ims->ims_count; i++)
+        imagemgr_image_free(ims->ims_images[i]);
+
+    free(ims->ims_images);
+    rangetab_free(ims->ims_ranges);
+    pthread_mutex_destroy(&ims->ims_lock);
+    free(ims);
+}
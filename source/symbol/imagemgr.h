@@ -0,0 +1,21 @@
+#ifndef _IMAGEMGR_H_
+#define _IMAGEMGR_H_
+
+void *imagemgr_new(int (*)(const char *, void **), void (*)(void *));
+void *imagemgr_add(void *, const char *, const uint8_t *, uint64_t, uint64_t,
+        uint64_t);
+void imagemgr_begin_update(void *);
+int imagemgr_count(void *);
+void imagemgr_end_update(void *, int);
+void *imagemgr_find(void *, uint64_t);
+void *imagemgr_get(void *, int);
+void *imagemgr_get_dwarfinfo(void *, void *);
+void *imagemgr_get_symtab(void *, void *);
+void imagemgr_get_info(void *, const char **, const char **, const uint8_t **,
+        uint64_t *, uint64_t *, uint64_t *);
+void imagemgr_set_dsym(void *, void *, const char *);
+void imagemgr_set_memory_reader(void *,
+        int (*)(void *, uint64_t, void *, size_t), void *);
+void imagemgr_free(void *);
+
+#endif
@@ -0,0 +1,627 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <dwarf.h>
+
+#include "common.h"
+#include "dwarfobj.h"
+
+/* Bounds checked reader over one section */
+struct lineprog_reader {
+    const uint8_t *lr_cur;
+    const uint8_t *lr_end;
+
+    /* Set once anything reads past lr_end */
+    int lr_bad;
+};
+
+/* What the line program header says, and the sections strings
+ * in it can point into.
+ */
+struct lineprog_header {
+    int lh_version;
+    int lh_offsetsize;
+    int lh_addrsize;
+
+    uint8_t lh_mininsnlen;
+    uint8_t lh_defaultisstmt;
+    int8_t lh_linebase;
+    uint8_t lh_linerange;
+    uint8_t lh_opcodebase;
+    const uint8_t *lh_stdopcodelens;
+
+    const char **lh_dirs;
+    int lh_dircnt;
+
+    const uint8_t *lh_str;
+    uint64_t lh_strsize;
+    const uint8_t *lh_linestr;
+    uint64_t lh_linestrsize;
+
+    const char *lh_compdir;
+};
+
+/* What lineprog_decode hands back */
+struct lineprog_result {
+    struct linetab_row *lr_rows;
+    int lr_rowcnt;
+    int lr_rowcap;
+
+    /* Full paths, indexed by the file numbers the program uses.
+     * Unused numbers are NULL.
+     */
+    char **lr_files;
+    int lr_filecnt;
+};
+
+static uint64_t lineprog_read_fixed(struct lineprog_reader *r, int size){
+    if(r->lr_bad || r->lr_end - r->lr_cur < size){
+        r->lr_bad = 1;
+        r->lr_cur = r->lr_end;
+        return 0;
+    }
+
+    uint64_t val = 0;
+
+    for(int i=0; i<size; i++)
+        val |= (uint64_t)r->lr_cur[i] << (i * 8);
+
+    r->lr_cur += size;
+
+    return val;
+}
+
+static uint64_t lineprog_read_uleb(struct lineprog_reader *r){
+    uint64_t val = 0;
+    int shift = 0;
+
+    while(r->lr_cur < r->lr_end){
+        uint8_t byte = *r->lr_cur++;
+
+        if(shift < 64)
+            val |= (uint64_t)(byte & 0x7f) << shift;
+
+        shift += 7;
+
+        if(!(byte & 0x80))
+            return val;
+    }
+
+    r->lr_bad = 1;
+
+    return 0;
+}
+
+static int64_t lineprog_read_sleb(struct lineprog_reader *r){
+    int64_t val = 0;
+    int shift = 0;
+
+    while(r->lr_cur < r->lr_end){
+        uint8_t byte = *r->lr_cur++;
+
+        if(shift < 64)
+            val |= (int64_t)(byte & 0x7f) << shift;
+
+        shift += 7;
+
+        if(!(byte & 0x80)){
+            if(shift < 64 && (byte & 0x40))
+                val |= -((int64_t)1 << shift);
+
+            return val;
+        }
+    }
+
+    r->lr_bad = 1;
+
+    return 0;
+}
+
+static const char *lineprog_read_cstr(struct lineprog_reader *r){
+    const uint8_t *nul = memchr(r->lr_cur, '\0', r->lr_end - r->lr_cur);
+
+    if(r->lr_bad || !nul){
+        r->lr_bad = 1;
+        r->lr_cur = r->lr_end;
+        return NULL;
+    }
+
+    const char *str = (const char *)r->lr_cur;
+    r->lr_cur = nul + 1;
+
+    return str;
+}
+
+/* A string at off in a string section */
+static const char *lineprog_strp(const uint8_t *sect, uint64_t sectsize,
+        uint64_t off){
+    if(!sect || off >= sectsize)
+        return NULL;
+
+    if(!memchr(sect + off, '\0', sectsize - off))
+        return NULL;
+
+    return (const char *)sect + off;
+}
+
+/* Join a directory and a file name the way dwarf_linesrc does. A
+ * relative directory is relative to the compilation directory.
+ */
+static char *lineprog_make_path(struct lineprog_header *lh, const char *dir,
+        const char *name){
+    if(!name)
+        name = "";
+
+    if(name[0] == '/')
+        return strdup(name);
+
+    if(!dir || !dir[0])
+        dir = lh->lh_compdir;
+
+    if(!dir || !dir[0])
+        return strdup(name);
+
+    const char *compdir = NULL;
+
+    if(dir[0] != '/' && dir != lh->lh_compdir && lh->lh_compdir &&
+            lh->lh_compdir[0]){
+        compdir = lh->lh_compdir;
+    }
+
+    size_t len = strlen(dir) + strlen(name) + 2;
+
+    if(compdir)
+        len += strlen(compdir) + 1;
+
+    char *path = malloc(len);
+
+    if(compdir)
+        snprintf(path, len, "%s/%s/%s", compdir, dir, name);
+    else
+        snprintf(path, len, "%s/%s", dir, name);
+
+    return path;
+}
+
+static void lineprog_set_file(struct lineprog_result *res, uint64_t fileno,
+        char *path){
+    if(fileno > UINT16_MAX){
+        free(path);
+        return;
+    }
+
+    if(fileno >= (uint64_t)res->lr_filecnt){
+        int newcnt = (int)fileno + 1;
+        char **files_rea = realloc(res->lr_files, sizeof(char *) * newcnt);
+
+        res->lr_files = files_rea;
+
+        for(int i=res->lr_filecnt; i<newcnt; i++)
+            res->lr_files[i] = NULL;
+
+        res->lr_filecnt = newcnt;
+    }
+
+    free(res->lr_files[fileno]);
+    res->lr_files[fileno] = path;
+}
+
+/* Skip or read one attribute of a DWARF 5 directory or file entry.
+ * Strings come back through strout, numbers through valout.
+ */
+static int lineprog_read_form(struct lineprog_reader *r,
+        struct lineprog_header *lh, uint64_t form, const char **strout,
+        uint64_t *valout){
+    *strout = NULL;
+    *valout = 0;
+
+    switch(form){
+        case DW_FORM_string:
+            *strout = lineprog_read_cstr(r);
+            break;
+        case DW_FORM_line_strp:
+            *strout = lineprog_strp(lh->lh_linestr, lh->lh_linestrsize,
+                    lineprog_read_fixed(r, lh->lh_offsetsize));
+            break;
+        case DW_FORM_strp:
+            *strout = lineprog_strp(lh->lh_str, lh->lh_strsize,
+                    lineprog_read_fixed(r, lh->lh_offsetsize));
+            break;
+        case DW_FORM_udata:
+            *valout = lineprog_read_uleb(r);
+            break;
+        case DW_FORM_data1:
+            *valout = lineprog_read_fixed(r, 1);
+            break;
+        case DW_FORM_data2:
+            *valout = lineprog_read_fixed(r, 2);
+            break;
+        case DW_FORM_data4:
+            *valout = lineprog_read_fixed(r, 4);
+            break;
+        case DW_FORM_data8:
+            *valout = lineprog_read_fixed(r, 8);
+            break;
+        case DW_FORM_data16:
+            lineprog_read_fixed(r, 8);
+            lineprog_read_fixed(r, 8);
+            break;
+        case DW_FORM_block:
+        {
+            uint64_t len = lineprog_read_uleb(r);
+
+            if(len > (uint64_t)(r->lr_end - r->lr_cur))
+                r->lr_bad = 1;
+            else
+                r->lr_cur += len;
+
+            break;
+        }
+        /* The strx forms need .debug_str_offsets, which dSYMs
+         * don't use for line tables.
+         */
+        default:
+            r->lr_bad = 1;
+    }
+
+    return r->lr_bad;
+}
+
+/* DWARF 5 directory and file name tables describe their own layout */
+static int lineprog_read_v5_entries(struct lineprog_reader *r,
+        struct lineprog_header *lh, struct lineprog_result *res, int isdirs){
+    uint8_t formatcnt = (uint8_t)lineprog_read_fixed(r, 1);
+    uint64_t format[2 * 255];
+
+    for(int i=0; i<formatcnt; i++){
+        format[2 * i] = lineprog_read_uleb(r);
+        format[(2 * i) + 1] = lineprog_read_uleb(r);
+    }
+
+    uint64_t cnt = lineprog_read_uleb(r);
+
+    if(r->lr_bad || cnt > (uint64_t)(r->lr_end - r->lr_cur))
+        return 1;
+
+    if(isdirs){
+        lh->lh_dirs = calloc(cnt + 1, sizeof(char *));
+        lh->lh_dircnt = (int)cnt;
+    }
+
+    for(uint64_t k=0; k<cnt; k++){
+        const char *path = NULL;
+        uint64_t dir = 0;
+
+        for(int i=0; i<formatcnt; i++){
+            const char *str = NULL;
+            uint64_t val = 0;
+
+            if(lineprog_read_form(r, lh, format[(2 * i) + 1], &str, &val))
+                return 1;
+
+            if(format[2 * i] == DW_LNCT_path)
+                path = str;
+            else if(format[2 * i] == DW_LNCT_directory_index)
+                dir = val;
+        }
+
+        if(isdirs){
+            lh->lh_dirs[k] = path;
+            continue;
+        }
+
+        const char *dirname = dir < (uint64_t)lh->lh_dircnt ?
+            lh->lh_dirs[dir] : NULL;
+
+        lineprog_set_file(res, k, lineprog_make_path(lh, dirname, path));
+    }
+
+    return 0;
+}
+
+/* Before DWARF 5, directory zero is the compilation directory and
+ * file numbers start at one.
+ */
+static int lineprog_read_v4_entries(struct lineprog_reader *r,
+        struct lineprog_header *lh, struct lineprog_result *res){
+    lh->lh_dirs = calloc(1, sizeof(char *));
+    lh->lh_dirs[0] = lh->lh_compdir;
+    lh->lh_dircnt = 1;
+
+    while(!r->lr_bad){
+        const char *dir = lineprog_read_cstr(r);
+
+        if(!dir || !dir[0])
+            break;
+
+        const char **dirs_rea = realloc(lh->lh_dirs,
+                sizeof(char *) * (lh->lh_dircnt + 1));
+
+        lh->lh_dirs = dirs_rea;
+        lh->lh_dirs[lh->lh_dircnt++] = dir;
+    }
+
+    uint64_t fileno = 1;
+
+    while(!r->lr_bad){
+        const char *name = lineprog_read_cstr(r);
+
+        if(!name || !name[0])
+            break;
+
+        uint64_t dir = lineprog_read_uleb(r);
+
+        /* Modification time and length */
+        lineprog_read_uleb(r);
+        lineprog_read_uleb(r);
+
+        const char *dirname = dir < (uint64_t)lh->lh_dircnt ?
+            lh->lh_dirs[dir] : NULL;
+
+        lineprog_set_file(res, fileno++, lineprog_make_path(lh, dirname,
+                    name));
+    }
+
+    return r->lr_bad;
+}
+
+static void lineprog_emit_row(struct lineprog_result *res, uint64_t addr,
+        uint64_t line, uint64_t file, int flags){
+    if(res->lr_rowcnt == res->lr_rowcap){
+        int newcap = res->lr_rowcap == 0 ? 256 : res->lr_rowcap * 2;
+        struct linetab_row *rows_rea = realloc(res->lr_rows,
+                sizeof(struct linetab_row) * newcap);
+
+        res->lr_rows = rows_rea;
+        res->lr_rowcap = newcap;
+    }
+
+    struct linetab_row *row = &res->lr_rows[res->lr_rowcnt++];
+
+    row->lr_addr = addr;
+    row->lr_line = (uint32_t)line;
+    row->lr_fileidx = file > UINT16_MAX ? UINT16_MAX : (uint16_t)file;
+    row->lr_flags = (uint16_t)flags;
+}
+
+/* Run the line program itself. Every row it emits, including
+ * end_sequence rows, is kept, in the order it was emitted.
+ */
+static int lineprog_run(struct lineprog_reader *r,
+        struct lineprog_header *lh, struct lineprog_result *res){
+    uint64_t addr = 0, line = 1, file = 1;
+    int isstmt = lh->lh_defaultisstmt, prologueend = 0;
+
+    while(r->lr_cur < r->lr_end && !r->lr_bad){
+        uint8_t op = (uint8_t)lineprog_read_fixed(r, 1);
+
+        if(op >= lh->lh_opcodebase){
+            uint8_t adjusted = op - lh->lh_opcodebase;
+
+            addr += (adjusted / lh->lh_linerange) * lh->lh_mininsnlen;
+            line += lh->lh_linebase + (adjusted % lh->lh_linerange);
+
+            lineprog_emit_row(res, addr, line, file,
+                    (isstmt ? LINETAB_IS_STMT : 0) |
+                    (prologueend ? LINETAB_PROLOGUE_END : 0));
+
+            prologueend = 0;
+            continue;
+        }
+
+        switch(op){
+            case 0:
+            {
+                uint64_t len = lineprog_read_uleb(r);
+
+                if(r->lr_bad || len == 0 ||
+                        len > (uint64_t)(r->lr_end - r->lr_cur)){
+                    return 1;
+                }
+
+                const uint8_t *next = r->lr_cur + len;
+                uint8_t subop = (uint8_t)lineprog_read_fixed(r, 1);
+
+                if(subop == DW_LNE_end_sequence){
+                    lineprog_emit_row(res, addr, line, file,
+                            (isstmt ? LINETAB_IS_STMT : 0) |
+                            LINETAB_END_SEQUENCE);
+
+                    addr = 0;
+                    line = 1;
+                    file = 1;
+                    isstmt = lh->lh_defaultisstmt;
+                    prologueend = 0;
+                }
+                else if(subop == DW_LNE_set_address){
+                    int size = (int)len - 1;
+
+                    if(size > 8)
+                        return 1;
+
+                    addr = lineprog_read_fixed(r, size);
+                }
+                else if(subop == DW_LNE_define_file){
+                    const char *name = lineprog_read_cstr(r);
+                    uint64_t dir = lineprog_read_uleb(r);
+
+                    const char *dirname = dir < (uint64_t)lh->lh_dircnt ?
+                        lh->lh_dirs[dir] : NULL;
+
+                    lineprog_set_file(res, res->lr_filecnt,
+                            lineprog_make_path(lh, dirname, name));
+                }
+
+                /* Discriminators and vendor extensions are skipped */
+                r->lr_cur = next;
+
+                break;
+            }
+            case DW_LNS_copy:
+                lineprog_emit_row(res, addr, line, file,
+                        (isstmt ? LINETAB_IS_STMT : 0) |
+                        (prologueend ? LINETAB_PROLOGUE_END : 0));
+
+                prologueend = 0;
+                break;
+            case DW_LNS_advance_pc:
+                addr += lineprog_read_uleb(r) * lh->lh_mininsnlen;
+                break;
+            case DW_LNS_advance_line:
+                line += lineprog_read_sleb(r);
+                break;
+            case DW_LNS_set_file:
+                file = lineprog_read_uleb(r);
+                break;
+            case DW_LNS_negate_stmt:
+                isstmt = !isstmt;
+                break;
+            case DW_LNS_const_add_pc:
+                addr += ((255 - lh->lh_opcodebase) / lh->lh_linerange) *
+                    lh->lh_mininsnlen;
+                break;
+            case DW_LNS_fixed_advance_pc:
+                addr += lineprog_read_fixed(r, 2);
+                break;
+            case DW_LNS_set_prologue_end:
+                prologueend = 1;
+                break;
+            /* Columns, basic blocks, epilogues, and ISAs aren't kept.
+             * Any standard opcode this doesn't know about says how
+             * many operands to skip.
+             */
+            default:
+            {
+                uint8_t nargs = lh->lh_stdopcodelens[op - 1];
+
+                for(int i=0; i<nargs; i++)
+                    lineprog_read_uleb(r);
+
+                break;
+            }
+        }
+    }
+
+    return r->lr_bad;
+}
+
+/* Decode the line program at off in .debug_line, straight from the
+ * mapping, into rows and the paths of the files they name. Rows are
+ * in the order the program emitted them, and each row's lr_fileidx
+ * is the file number the program used, an index into filesout.
+ * compdir is the compilation unit's DW_AT_comp_dir, and can be NULL.
+ *
+ * Returns non-zero if the program can't be decoded, in which case
+ * nothing needs to be freed.
+ */
+int lineprog_decode(void *dwarfobj, uint64_t off, const char *compdir,
+        struct linetab_row **rowsout, int *rowcntout, char ***filesout,
+        int *filecntout){
+    const uint8_t *sect = NULL;
+    uint64_t sectsize = 0;
+
+    if(dwarfobj_get_section(dwarfobj, ".debug_line", &sect, &sectsize) ||
+            off >= sectsize){
+        return 1;
+    }
+
+    struct lineprog_header lh = {0};
+
+    lh.lh_compdir = compdir;
+
+    dwarfobj_get_section(dwarfobj, ".debug_str", &lh.lh_str, &lh.lh_strsize);
+    dwarfobj_get_section(dwarfobj, ".debug_line_str", &lh.lh_linestr,
+            &lh.lh_linestrsize);
+
+    struct lineprog_reader r = { sect + off, sect + sectsize, 0 };
+
+    uint64_t unitlen = lineprog_read_fixed(&r, 4);
+    lh.lh_offsetsize = 4;
+
+    if(unitlen == 0xffffffff){
+        unitlen = lineprog_read_fixed(&r, 8);
+        lh.lh_offsetsize = 8;
+    }
+
+    if(r.lr_bad || unitlen > (uint64_t)(r.lr_end - r.lr_cur))
+        return 1;
+
+    r.lr_end = r.lr_cur + unitlen;
+
+    lh.lh_version = (int)lineprog_read_fixed(&r, 2);
+
+    if(lh.lh_version < 2 || lh.lh_version > 5)
+        return 1;
+
+    lh.lh_addrsize = 8;
+
+    if(lh.lh_version >= 5){
+        lh.lh_addrsize = (int)lineprog_read_fixed(&r, 1);
+
+        /* Segment selector size */
+        lineprog_read_fixed(&r, 1);
+    }
+
+    uint64_t headerlen = lineprog_read_fixed(&r, lh.lh_offsetsize);
+
+    if(r.lr_bad || headerlen > (uint64_t)(r.lr_end - r.lr_cur))
+        return 1;
+
+    const uint8_t *progstart = r.lr_cur + headerlen;
+
+    lh.lh_mininsnlen = (uint8_t)lineprog_read_fixed(&r, 1);
+
+    /* Maximum operations per instruction, only for VLIW */
+    if(lh.lh_version >= 4)
+        lineprog_read_fixed(&r, 1);
+
+    lh.lh_defaultisstmt = (uint8_t)lineprog_read_fixed(&r, 1);
+    lh.lh_linebase = (int8_t)lineprog_read_fixed(&r, 1);
+    lh.lh_linerange = (uint8_t)lineprog_read_fixed(&r, 1);
+    lh.lh_opcodebase = (uint8_t)lineprog_read_fixed(&r, 1);
+
+    if(r.lr_bad || lh.lh_linerange == 0 || lh.lh_opcodebase == 0 ||
+            lh.lh_opcodebase - 1 > r.lr_end - r.lr_cur){
+        return 1;
+    }
+
+    lh.lh_stdopcodelens = r.lr_cur;
+    r.lr_cur += lh.lh_opcodebase - 1;
+
+    struct lineprog_result res = {0};
+    int ret;
+
+    if(lh.lh_version >= 5){
+        ret = lineprog_read_v5_entries(&r, &lh, &res, 1) ||
+            lineprog_read_v5_entries(&r, &lh, &res, 0);
+    }
+    else{
+        ret = lineprog_read_v4_entries(&r, &lh, &res);
+    }
+
+    if(!ret){
+        r.lr_cur = progstart;
+        ret = lineprog_run(&r, &lh, &res);
+    }
+
+    free(lh.lh_dirs);
+
+    if(ret){
+        for(int i=0; i<res.lr_filecnt; i++)
+            free(res.lr_files[i]);
+
+        free(res.lr_files);
+        free(res.lr_rows);
+
+        return 1;
+    }
+
+    *rowsout = res.lr_rows;
+    *rowcntout = res.lr_rowcnt;
+    *filesout = res.lr_files;
+    *filecntout = res.lr_filecnt;
+
+    return 0;
+}
@@ -0,0 +1,7 @@
+#ifndef _LINEPROG_H_
+#define _LINEPROG_H_
+
+int lineprog_decode(void *, uint64_t, const char *, void *, int *, char ***,
+        int *);
+
+#endif
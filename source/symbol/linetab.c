@@ -0,0 +1,1121 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libdwarf.h>
+
+#include "common.h"
+
+/* Rows are delta encoded in blocks of this many. Finding a row means
+ * a binary search over the blocks, then decoding at most this many rows.
+ */
+#define LINETAB_BLOCK_ROWS 64
+
+/* Where a block of rows starts in each column. Every other row in the
+ * block is stored as the difference from the row before it.
+ */
+struct linetab_block {
+    uint64_t lb_addr;
+    uint32_t lb_line;
+
+    uint32_t lb_addroff;
+    uint32_t lb_lineoff;
+    uint32_t lb_fileoff;
+};
+
+/* An is_stmt row in the line to PC index. The row's address is
+ * decoded from the line table when it's needed.
+ */
+struct linetab_lineent {
+    uint32_t le_line;
+    uint32_t le_row;
+};
+
+/* A compilation unit's line program, decoded once and sorted by
+ * address. Each column is kept separately: address deltas as ULEB128s,
+ * line deltas as SLEB128s, and file indexes as ULEB128s, with one byte
+ * of flags per row. A row rarely takes more than four bytes. Nothing
+ * here calls into libdwarf after linetab_new returns.
+ */
+struct linetab {
+    int lt_rowcnt;
+
+    struct linetab_block *lt_blocks;
+    int lt_blockcnt;
+
+    uint8_t *lt_addrs;
+    uint32_t lt_addrslen;
+    uint8_t *lt_lines;
+    uint32_t lt_lineslen;
+    uint8_t *lt_fileidxs;
+    uint32_t lt_fileidxslen;
+    uint8_t *lt_flags;
+
+    /* Source file names, indexed by a row's file index */
+    char **lt_files;
+    int lt_filecnt;
+
+    /* The file the compilation unit was built from, or -1 */
+    int lt_primaryfile;
+
+    /* Inverted index: is_stmt rows sorted by file, line, then address.
+     * The rows for file i are
+     * [lt_filestart[i], lt_filestart[i + 1]).
+     */
+    struct linetab_lineent *lt_lineidx;
+    int lt_linecnt;
+    int *lt_filestart;
+
+    /* If non-zero, everything but lt_files itself points into a
+     * flattened line table someone else owns.
+     */
+    int lt_borrowed;
+};
+
+/* A line table flattened by linetab_flatten. This header is followed by
+ * the blocks, the line to PC index, lt_filestart, the offsets of each
+ * file name from the start of the header, the flags, the address,
+ * line, and file index columns, and then the file names.
+ */
+struct linetab_flat {
+    uint32_t lf_rowcnt;
+    uint32_t lf_blockcnt;
+    uint32_t lf_linecnt;
+    uint32_t lf_filecnt;
+    int32_t lf_primaryfile;
+    uint32_t lf_addrslen;
+    uint32_t lf_lineslen;
+    uint32_t lf_fileidxslen;
+};
+
+/* Where a walk over the rows is. */
+struct linetab_cursor {
+    int lc_row;
+
+    uint64_t lc_addr;
+    uint64_t lc_line;
+    uint64_t lc_fileidx;
+
+    const uint8_t *lc_addrp;
+    const uint8_t *lc_linep;
+    const uint8_t *lc_fileidxp;
+};
+
+/* Used to keep rows with the same address in the order
+ * the line program produced them.
+ */
+struct linetab_sortent {
+    struct linetab_row row;
+    int idx;
+};
+
+/* An is_stmt row while the line to PC index is built */
+struct linetab_indexent {
+    uint64_t ie_addr;
+    uint32_t ie_line;
+    uint32_t ie_row;
+    uint16_t ie_fileidx;
+};
+
+/* A column while it's being encoded */
+struct linetab_buf {
+    uint8_t *lb_data;
+    uint32_t lb_len;
+    uint32_t lb_cap;
+};
+
+static void linetab_buf_put(struct linetab_buf *buf, uint8_t byte){
+    if(buf->lb_len == buf->lb_cap){
+        uint32_t newcap = buf->lb_cap == 0 ? 256 : buf->lb_cap * 2;
+        uint8_t *data_rea = realloc(buf->lb_data, newcap);
+
+        buf->lb_data = data_rea;
+        buf->lb_cap = newcap;
+    }
+
+    buf->lb_data[buf->lb_len++] = byte;
+}
+
+static void linetab_buf_put_uleb(struct linetab_buf *buf, uint64_t val){
+    do {
+        uint8_t byte = val & 0x7f;
+        val >>= 7;
+
+        if(val)
+            byte |= 0x80;
+
+        linetab_buf_put(buf, byte);
+    } while(val);
+}
+
+static void linetab_buf_put_sleb(struct linetab_buf *buf, int64_t val){
+    int more = 1;
+
+    while(more){
+        uint8_t byte = val & 0x7f;
+        val >>= 7;
+
+        if((val == 0 && !(byte & 0x40)) || (val == -1 && (byte & 0x40)))
+            more = 0;
+        else
+            byte |= 0x80;
+
+        linetab_buf_put(buf, byte);
+    }
+}
+
+/* Give back what the column didn't use */
+static uint8_t *linetab_buf_finish(struct linetab_buf *buf){
+    if(buf->lb_len == 0){
+        free(buf->lb_data);
+        return NULL;
+    }
+
+    uint8_t *data_rea = realloc(buf->lb_data, buf->lb_len);
+
+    return data_rea ? data_rea : buf->lb_data;
+}
+
+static uint64_t linetab_read_uleb(const uint8_t **p, const uint8_t *end){
+    uint64_t val = 0;
+    int shift = 0;
+
+    while(*p < end){
+        uint8_t byte = *(*p)++;
+
+        if(shift < 64)
+            val |= (uint64_t)(byte & 0x7f) << shift;
+
+        shift += 7;
+
+        if(!(byte & 0x80))
+            break;
+    }
+
+    return val;
+}
+
+static int64_t linetab_read_sleb(const uint8_t **p, const uint8_t *end){
+    int64_t val = 0;
+    int shift = 0;
+
+    while(*p < end){
+        uint8_t byte = *(*p)++;
+
+        if(shift < 64)
+            val |= (int64_t)(byte & 0x7f) << shift;
+
+        shift += 7;
+
+        if(!(byte & 0x80)){
+            if(shift < 64 && (byte & 0x40))
+                val |= -((int64_t)1 << shift);
+
+            break;
+        }
+    }
+
+    return val;
+}
+
+/* Put the cursor on the first row of a block */
+static void linetab_cursor_block(struct linetab *lt, struct linetab_cursor *c,
+        int block){
+    struct linetab_block *lb = &lt->lt_blocks[block];
+
+    c->lc_row = block * LINETAB_BLOCK_ROWS;
+    c->lc_addr = lb->lb_addr;
+    c->lc_line = lb->lb_line;
+
+    c->lc_addrp = lt->lt_addrs + lb->lb_addroff;
+    c->lc_linep = lt->lt_lines + lb->lb_lineoff;
+    c->lc_fileidxp = lt->lt_fileidxs + lb->lb_fileoff;
+
+    c->lc_fileidx = linetab_read_uleb(&c->lc_fileidxp,
+            lt->lt_fileidxs + lt->lt_fileidxslen);
+}
+
+/* Move the cursor to the next row. Once it's past the last row,
+ * lc_row is lt_rowcnt.
+ */
+static void linetab_cursor_next(struct linetab *lt, struct linetab_cursor *c){
+    if(++c->lc_row >= lt->lt_rowcnt){
+        c->lc_row = lt->lt_rowcnt;
+        return;
+    }
+
+    if(c->lc_row % LINETAB_BLOCK_ROWS == 0){
+        linetab_cursor_block(lt, c, c->lc_row / LINETAB_BLOCK_ROWS);
+        return;
+    }
+
+    c->lc_addr += linetab_read_uleb(&c->lc_addrp,
+            lt->lt_addrs + lt->lt_addrslen);
+    c->lc_line += linetab_read_sleb(&c->lc_linep,
+            lt->lt_lines + lt->lt_lineslen);
+    c->lc_fileidx = linetab_read_uleb(&c->lc_fileidxp,
+            lt->lt_fileidxs + lt->lt_fileidxslen);
+}
+
+static void linetab_cursor_seek(struct linetab *lt, struct linetab_cursor *c,
+        int row){
+    linetab_cursor_block(lt, c, row / LINETAB_BLOCK_ROWS);
+
+    while(c->lc_row < row)
+        linetab_cursor_next(lt, c);
+}
+
+static int linetab_sortent_cmp(const void *a, const void *b){
+    const struct linetab_sortent *sa = a;
+    const struct linetab_sortent *sb = b;
+
+    if(sa->row.lr_addr < sb->row.lr_addr)
+        return -1;
+    else if(sa->row.lr_addr > sb->row.lr_addr)
+        return 1;
+
+    return sa->idx - sb->idx;
+}
+
+/* Different file numbers can name the same file, so each name
+ * is only kept once.
+ */
+static int linetab_intern_file(struct linetab *lt, const char *name){
+    for(int i=0; i<lt->lt_filecnt; i++){
+        if(strcmp(lt->lt_files[i], name) == 0)
+            return i;
+    }
+
+    char **files_rea = realloc(lt->lt_files,
+            sizeof(char *) * (lt->lt_filecnt + 1));
+    lt->lt_files = files_rea;
+    lt->lt_files[lt->lt_filecnt] = strdup(name);
+
+    return lt->lt_filecnt++;
+}
+
+static int linetab_add_file(struct linetab *lt, Dwarf_Debug dbg,
+        Dwarf_Line line){
+    Dwarf_Error d_error = NULL;
+    char *filename = NULL;
+
+    int ret = dwarf_linesrc(line, &filename, &d_error);
+
+    if(ret == DW_DLV_ERROR){
+        dwarf_dealloc(dbg, d_error, DW_DLA_ERROR);
+        filename = NULL;
+    }
+
+    int idx = linetab_intern_file(lt, filename ? filename : "");
+
+    if(filename)
+        dwarf_dealloc(dbg, filename, DW_DLA_STRING);
+
+    return idx;
+}
+
+static int linetab_indexent_cmp(const void *a, const void *b){
+    const struct linetab_indexent *ia = a;
+    const struct linetab_indexent *ib = b;
+
+    if(ia->ie_fileidx != ib->ie_fileidx)
+        return ia->ie_fileidx < ib->ie_fileidx ? -1 : 1;
+
+    if(ia->ie_line != ib->ie_line)
+        return ia->ie_line < ib->ie_line ? -1 : 1;
+
+    if(ia->ie_addr != ib->ie_addr)
+        return ia->ie_addr < ib->ie_addr ? -1 : 1;
+
+    return 0;
+}
+
+static void linetab_build_line_index(struct linetab *lt,
+        struct linetab_sortent *ents){
+    struct linetab_indexent *ies = malloc(sizeof(struct linetab_indexent) *
+            (lt->lt_rowcnt + 1));
+    int iecnt = 0;
+
+    for(int i=0; i<lt->lt_rowcnt; i++){
+        struct linetab_row *row = &ents[i].row;
+
+        if(!(row->lr_flags & LINETAB_IS_STMT) ||
+                (row->lr_flags & LINETAB_END_SEQUENCE) ||
+                row->lr_line == 0){
+            continue;
+        }
+
+        struct linetab_indexent *ie = &ies[iecnt++];
+
+        ie->ie_addr = row->lr_addr;
+        ie->ie_line = row->lr_line;
+        ie->ie_row = i;
+        ie->ie_fileidx = row->lr_fileidx;
+    }
+
+    qsort(ies, iecnt, sizeof(struct linetab_indexent), linetab_indexent_cmp);
+
+    lt->lt_lineidx = malloc(sizeof(struct linetab_lineent) * (iecnt + 1));
+    lt->lt_linecnt = 0;
+
+    lt->lt_filestart = malloc(sizeof(int) * (lt->lt_filecnt + 1));
+
+    int curfile = 0;
+
+    for(int i=0; i<iecnt; i++){
+        /* The same line can be emitted more than once for an address. */
+        if(i > 0 && linetab_indexent_cmp(&ies[i - 1], &ies[i]) == 0)
+            continue;
+
+        while(curfile <= ies[i].ie_fileidx)
+            lt->lt_filestart[curfile++] = lt->lt_linecnt;
+
+        struct linetab_lineent *le = &lt->lt_lineidx[lt->lt_linecnt++];
+
+        le->le_line = ies[i].ie_line;
+        le->le_row = ies[i].ie_row;
+    }
+
+    while(curfile <= lt->lt_filecnt)
+        lt->lt_filestart[curfile++] = lt->lt_linecnt;
+
+    free(ies);
+}
+
+/* Does path name the same file as name? Either can be a partial path. */
+static int linetab_path_matches(const char *path, const char *name){
+    size_t pathlen = strlen(path), namelen = strlen(name);
+
+    if(pathlen == namelen)
+        return strcmp(path, name) == 0;
+
+    const char *longer = pathlen > namelen ? path : name;
+    const char *shorter = pathlen > namelen ? name : path;
+    size_t longerlen = pathlen > namelen ? pathlen : namelen;
+    size_t shorterlen = pathlen > namelen ? namelen : pathlen;
+
+    if(shorterlen == 0)
+        return 0;
+
+    const char *tail = longer + (longerlen - shorterlen);
+
+    return *(tail - 1) == '/' && strcmp(tail, shorter) == 0;
+}
+
+int linetab_find_file(struct linetab *lt, const char *name){
+    if(!lt || !name)
+        return -1;
+
+    for(int i=0; i<lt->lt_filecnt; i++){
+        if(linetab_path_matches(lt->lt_files[i], name))
+            return i;
+    }
+
+    return -1;
+}
+
+/* Sort the rows by address and delta encode them into lt. ents
+ * is freed.
+ */
+static void linetab_encode(struct linetab *lt, struct linetab_sortent *ents,
+        int cnt, const char *cuname){
+    /* Sequences aren't guarenteed to be in address order. */
+    qsort(ents, cnt, sizeof(struct linetab_sortent), linetab_sortent_cmp);
+
+    lt->lt_rowcnt = cnt;
+    lt->lt_blockcnt = (cnt + LINETAB_BLOCK_ROWS - 1) / LINETAB_BLOCK_ROWS;
+    lt->lt_blocks = malloc(sizeof(struct linetab_block) * lt->lt_blockcnt);
+    lt->lt_flags = malloc(cnt);
+
+    struct linetab_buf addrs = {0}, lines = {0}, fileidxs = {0};
+
+    for(int i=0; i<cnt; i++){
+        struct linetab_row *row = &ents[i].row;
+
+        if(i % LINETAB_BLOCK_ROWS == 0){
+            struct linetab_block *lb =
+                &lt->lt_blocks[i / LINETAB_BLOCK_ROWS];
+
+            lb->lb_addr = row->lr_addr;
+            lb->lb_line = row->lr_line;
+            lb->lb_addroff = addrs.lb_len;
+            lb->lb_lineoff = lines.lb_len;
+            lb->lb_fileoff = fileidxs.lb_len;
+        }
+        else{
+            struct linetab_row *prev = &ents[i - 1].row;
+
+            linetab_buf_put_uleb(&addrs, row->lr_addr - prev->lr_addr);
+            linetab_buf_put_sleb(&lines,
+                    (int64_t)row->lr_line - (int64_t)prev->lr_line);
+        }
+
+        linetab_buf_put_uleb(&fileidxs, row->lr_fileidx);
+
+        lt->lt_flags[i] = (uint8_t)row->lr_flags;
+    }
+
+    lt->lt_addrslen = addrs.lb_len;
+    lt->lt_addrs = linetab_buf_finish(&addrs);
+    lt->lt_lineslen = lines.lb_len;
+    lt->lt_lines = linetab_buf_finish(&lines);
+    lt->lt_fileidxslen = fileidxs.lb_len;
+    lt->lt_fileidxs = linetab_buf_finish(&fileidxs);
+
+    linetab_build_line_index(lt, ents);
+
+    free(ents);
+
+    lt->lt_primaryfile = linetab_find_file(lt, cuname);
+}
+
+struct linetab *linetab_new(Dwarf_Debug dbg, Dwarf_Line *lines,
+        Dwarf_Signed linecnt, const char *cuname){
+    struct linetab *lt = calloc(1, sizeof(struct linetab));
+
+    lt->lt_primaryfile = -1;
+
+    if(!lines || linecnt <= 0)
+        return lt;
+
+    struct linetab_sortent *ents = malloc(sizeof(struct linetab_sortent) *
+            linecnt);
+
+    /* DWARF file numbers to indexes into lt_files, so dwarf_linesrc
+     * is only called once per file.
+     */
+    int *filemap = NULL;
+    Dwarf_Unsigned filemaplen = 0;
+
+    for(Dwarf_Signed i=0; i<linecnt; i++){
+        Dwarf_Line line = lines[i];
+        Dwarf_Error d_error = NULL;
+        Dwarf_Addr addr = 0;
+        Dwarf_Unsigned lineno = 0, fileno = 0;
+        Dwarf_Bool isstmt = 0, endseq = 0, prologue_end = 0, epilogue_begin = 0;
+        Dwarf_Unsigned isa = 0, discriminator = 0;
+
+        if(dwarf_lineaddr(line, &addr, &d_error) == DW_DLV_ERROR){
+            dwarf_dealloc(dbg, d_error, DW_DLA_ERROR);
+            d_error = NULL;
+        }
+
+        if(dwarf_lineno(line, &lineno, &d_error) == DW_DLV_ERROR){
+            dwarf_dealloc(dbg, d_error, DW_DLA_ERROR);
+            d_error = NULL;
+        }
+
+        if(dwarf_linebeginstatement(line, &isstmt, &d_error) == DW_DLV_ERROR){
+            dwarf_dealloc(dbg, d_error, DW_DLA_ERROR);
+            d_error = NULL;
+        }
+
+        if(dwarf_lineendsequence(line, &endseq, &d_error) == DW_DLV_ERROR){
+            dwarf_dealloc(dbg, d_error, DW_DLA_ERROR);
+            d_error = NULL;
+        }
+
+        if(dwarf_prologue_end_etc(line, &prologue_end, &epilogue_begin,
+                    &isa, &discriminator, &d_error) == DW_DLV_ERROR){
+            dwarf_dealloc(dbg, d_error, DW_DLA_ERROR);
+            d_error = NULL;
+        }
+
+        int fileidx;
+
+        if(dwarf_line_srcfileno(line, &fileno, &d_error) == DW_DLV_OK){
+            if(fileno >= filemaplen){
+                Dwarf_Unsigned newlen = fileno + 1;
+                int *filemap_rea = realloc(filemap, sizeof(int) * newlen);
+                filemap = filemap_rea;
+
+                for(Dwarf_Unsigned k=filemaplen; k<newlen; k++)
+                    filemap[k] = -1;
+
+                filemaplen = newlen;
+            }
+
+            if(filemap[fileno] == -1)
+                filemap[fileno] = linetab_add_file(lt, dbg, line);
+
+            fileidx = filemap[fileno];
+        }
+        else{
+            if(d_error)
+                dwarf_dealloc(dbg, d_error, DW_DLA_ERROR);
+
+            fileidx = linetab_add_file(lt, dbg, line);
+        }
+
+        struct linetab_row *row = &ents[i].row;
+
+        row->lr_addr = addr;
+        row->lr_line = (uint32_t)lineno;
+        row->lr_fileidx = (uint16_t)fileidx;
+        row->lr_flags = 0;
+
+        if(isstmt)
+            row->lr_flags |= LINETAB_IS_STMT;
+        if(endseq)
+            row->lr_flags |= LINETAB_END_SEQUENCE;
+        if(prologue_end)
+            row->lr_flags |= LINETAB_PROLOGUE_END;
+
+        ents[i].idx = (int)i;
+    }
+
+    free(filemap);
+
+    linetab_encode(lt, ents, (int)linecnt, cuname);
+
+    return lt;
+}
+
+/* Make a line table out of rows decoded by lineprog_decode, whose file
+ * indexes are the file numbers the line program used, indexes into
+ * files. Nothing passed in is kept.
+ */
+struct linetab *linetab_new_from_rows(struct linetab_row *rows, int rowcnt,
+        char **files, int filecnt, const char *cuname){
+    struct linetab *lt = calloc(1, sizeof(struct linetab));
+
+    lt->lt_primaryfile = -1;
+
+    if(!rows || rowcnt <= 0)
+        return lt;
+
+    struct linetab_sortent *ents = malloc(sizeof(struct linetab_sortent) *
+            rowcnt);
+
+    /* File numbers to indexes into lt_files */
+    int *filemap = malloc(sizeof(int) * (filecnt + 1));
+
+    for(int i=0; i<=filecnt; i++)
+        filemap[i] = -1;
+
+    for(int i=0; i<rowcnt; i++){
+        int fileno = rows[i].lr_fileidx;
+
+        /* A row naming a file that doesn't exist gets the empty name */
+        if(fileno >= filecnt || !files[fileno])
+            fileno = filecnt;
+
+        if(filemap[fileno] == -1){
+            filemap[fileno] = linetab_intern_file(lt,
+                    fileno < filecnt ? files[fileno] : "");
+        }
+
+        ents[i].row = rows[i];
+        ents[i].row.lr_fileidx = (uint16_t)filemap[fileno];
+        ents[i].idx = i;
+    }
+
+    free(filemap);
+
+    linetab_encode(lt, ents, rowcnt, cuname);
+
+    return lt;
+}
+
+/* The first row whose address is at or after addr, or if upper is
+ * non-zero, the first row whose address is after addr. Returns the
+ * number of rows if there isn't one.
+ */
+static int linetab_bound(struct linetab *lt, uint64_t addr, int upper){
+    /* The last block that starts before addr, or at it, for upper.
+     * The row we want is in that block or at the start of the next.
+     */
+    int lo = 0, hi = lt->lt_blockcnt - 1, block = 0;
+
+    while(lo <= hi){
+        int mid = lo + ((hi - lo) / 2);
+        uint64_t blockaddr = lt->lt_blocks[mid].lb_addr;
+
+        if(blockaddr < addr || (upper && blockaddr == addr)){
+            block = mid;
+            lo = mid + 1;
+        }
+        else{
+            hi = mid - 1;
+        }
+    }
+
+    struct linetab_cursor c;
+    linetab_cursor_block(lt, &c, block);
+
+    while(c.lc_row < lt->lt_rowcnt){
+        if(c.lc_addr > addr || (!upper && c.lc_addr == addr))
+            break;
+
+        linetab_cursor_next(lt, &c);
+    }
+
+    return c.lc_row;
+}
+
+/* Returns the index of the row which describes pc, or -1. If exact
+ * is non-zero, the row must start at pc. Otherwise, the closest row
+ * at or before pc is returned, as long as pc is still inside that
+ * row's sequence.
+ */
+int linetab_find_row(struct linetab *lt, uint64_t pc, int exact){
+    if(!lt || lt->lt_rowcnt == 0)
+        return -1;
+
+    int found = linetab_bound(lt, pc, 1) - 1;
+
+    if(found == -1)
+        return -1;
+
+    struct linetab_cursor c;
+    linetab_cursor_seek(lt, &c, found);
+
+    uint64_t rowaddr = c.lc_addr;
+
+    if(exact && rowaddr != pc)
+        return -1;
+
+    /* Back up to the first row for this address */
+    int first = linetab_bound(lt, rowaddr, 0);
+
+    /* The end of one sequence can share an address with the start
+     * of another, so skip any end_sequence rows here.
+     */
+    linetab_cursor_seek(lt, &c, first);
+
+    while(c.lc_row < lt->lt_rowcnt && c.lc_addr == rowaddr){
+        if(!(lt->lt_flags[c.lc_row] & LINETAB_END_SEQUENCE))
+            return c.lc_row;
+
+        linetab_cursor_next(lt, &c);
+    }
+
+    return -1;
+}
+
+int linetab_get_row(struct linetab *lt, int idx, uint64_t *addrout,
+        uint64_t *lineout, char **fileout, int *flagsout){
+    if(!lt || idx < 0 || idx >= lt->lt_rowcnt)
+        return 1;
+
+    struct linetab_cursor c;
+    linetab_cursor_seek(lt, &c, idx);
+
+    if(c.lc_fileidx >= (uint64_t)lt->lt_filecnt)
+        return 1;
+
+    if(addrout)
+        *addrout = c.lc_addr;
+
+    if(lineout)
+        *lineout = (uint32_t)c.lc_line;
+
+    if(fileout)
+        *fileout = lt->lt_files[c.lc_fileidx];
+
+    if(flagsout)
+        *flagsout = lt->lt_flags[idx];
+
+    return 0;
+}
+
+/* First entry in [start, end) whose line is >= line. */
+static int linetab_line_lower_bound(struct linetab *lt, int start, int end,
+        uint64_t line){
+    int lo = start, hi = end;
+
+    while(lo < hi){
+        int mid = lo + ((hi - lo) / 2);
+
+        if(lt->lt_lineidx[mid].le_line < line)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return lo;
+}
+
+/* Finds the line closest to the one asked for inside one file's
+ * slice of the index. When two lines are equally close, the later
+ * one wins, since the line asked for is most likely a blank line
+ * or a comment before a statement.
+ */
+static int linetab_nearest_line(struct linetab *lt, int start, int end,
+        uint64_t line, uint64_t *nearestout){
+    if(start == end)
+        return 1;
+
+    int lb = linetab_line_lower_bound(lt, start, end, line);
+
+    if(lb < end && lt->lt_lineidx[lb].le_line == line){
+        *nearestout = line;
+        return 0;
+    }
+
+    int have = 0;
+    uint64_t best = 0, bestdiff = 0;
+
+    if(lb < end){
+        best = lt->lt_lineidx[lb].le_line;
+        bestdiff = best - line;
+        have = 1;
+    }
+
+    if(lb > start){
+        uint64_t prev = lt->lt_lineidx[lb - 1].le_line;
+        uint64_t prevdiff = line - prev;
+
+        if(!have || prevdiff < bestdiff){
+            best = prev;
+            bestdiff = prevdiff;
+            have = 1;
+        }
+    }
+
+    *nearestout = best;
+    return !have;
+}
+
+static void linetab_collect_pcs(struct linetab *lt, int start, int end,
+        uint64_t line, uint64_t **pcs, int *len){
+    int lb = linetab_line_lower_bound(lt, start, end, line);
+    int cnt = 0;
+
+    while(lb + cnt < end && lt->lt_lineidx[lb + cnt].le_line == line)
+        cnt++;
+
+    if(cnt == 0)
+        return;
+
+    uint64_t *pcs_rea = realloc(*pcs, sizeof(uint64_t) * (*len + cnt));
+    *pcs = pcs_rea;
+
+    for(int i=0; i<cnt; i++){
+        struct linetab_cursor c;
+        linetab_cursor_seek(lt, &c, lt->lt_lineidx[lb + i].le_row);
+
+        (*pcs)[(*len)++] = c.lc_addr;
+    }
+}
+
+static int linetab_u64_cmp(const void *a, const void *b){
+    uint64_t ua = *(const uint64_t *)a, ub = *(const uint64_t *)b;
+
+    if(ua < ub)
+        return -1;
+    else if(ua > ub)
+        return 1;
+
+    return 0;
+}
+
+/* Get every is_stmt address for line in the file at fileidx. If fileidx
+ * is -1, every file in the line table is searched. If nearest is
+ * non-zero and line has no code, the closest line which does is used,
+ * and it is returned through lineout.
+ *
+ * Addresses are returned in ascending order and the array must be freed.
+ */
+int linetab_line_to_pcs(struct linetab *lt, int fileidx, uint64_t line,
+        int nearest, uint64_t *lineout, uint64_t **pcsout, int *lenout){
+    if(!lt || !pcsout || !lenout || fileidx >= lt->lt_filecnt)
+        return 1;
+
+    *pcsout = NULL;
+    *lenout = 0;
+
+    if(lt->lt_linecnt == 0)
+        return 1;
+
+    int firstfile = fileidx == -1 ? 0 : fileidx;
+    int lastfile = fileidx == -1 ? lt->lt_filecnt - 1 : fileidx;
+
+    uint64_t use = line;
+
+    if(nearest){
+        int have = 0;
+        uint64_t best = 0, bestdiff = 0;
+
+        for(int i=firstfile; i<=lastfile; i++){
+            uint64_t cur = 0;
+
+            if(linetab_nearest_line(lt, lt->lt_filestart[i],
+                        lt->lt_filestart[i + 1], line, &cur)){
+                continue;
+            }
+
+            uint64_t diff = cur > line ? cur - line : line - cur;
+
+            if(!have || diff < bestdiff ||
+                    (diff == bestdiff && cur > best)){
+                best = cur;
+                bestdiff = diff;
+                have = 1;
+            }
+        }
+
+        if(!have)
+            return 1;
+
+        use = best;
+    }
+
+    for(int i=firstfile; i<=lastfile; i++){
+        linetab_collect_pcs(lt, lt->lt_filestart[i], lt->lt_filestart[i + 1],
+                use, pcsout, lenout);
+    }
+
+    if(*lenout == 0)
+        return 1;
+
+    if(firstfile != lastfile)
+        qsort(*pcsout, *lenout, sizeof(uint64_t), linetab_u64_cmp);
+
+    if(lineout)
+        *lineout = use;
+
+    return 0;
+}
+
+int linetab_primary_file(struct linetab *lt){
+    if(!lt)
+        return -1;
+
+    return lt->lt_primaryfile;
+}
+
+size_t linetab_size(struct linetab *lt){
+    if(!lt)
+        return 0;
+
+    size_t sz = sizeof(struct linetab);
+
+    sz += sizeof(struct linetab_block) * lt->lt_blockcnt;
+    sz += lt->lt_addrslen + lt->lt_lineslen + lt->lt_fileidxslen;
+    sz += lt->lt_rowcnt;
+    sz += sizeof(struct linetab_lineent) * lt->lt_linecnt;
+    sz += sizeof(int) * (lt->lt_filecnt + 1);
+
+    for(int i=0; i<lt->lt_filecnt; i++)
+        sz += sizeof(char *) + strlen(lt->lt_files[i]) + 1;
+
+    return sz;
+}
+
+int linetab_count(struct linetab *lt){
+    if(!lt)
+        return 0;
+
+    return lt->lt_rowcnt;
+}
+
+/* Layout of a flattened line table, up to the file names. */
+static size_t linetab_flat_fixed_size(const struct linetab_flat *lf){
+    return sizeof(struct linetab_flat) +
+        (sizeof(struct linetab_block) * (size_t)lf->lf_blockcnt) +
+        (sizeof(struct linetab_lineent) * (size_t)lf->lf_linecnt) +
+        (sizeof(int32_t) * ((size_t)lf->lf_filecnt + 1)) +
+        (sizeof(uint32_t) * (size_t)lf->lf_filecnt) +
+        lf->lf_rowcnt + lf->lf_addrslen + lf->lf_lineslen +
+        lf->lf_fileidxslen;
+}
+
+/* Write lt to buf without any pointers, so it can be saved to disk and
+ * used again with linetab_new_from_flat. Returns how many bytes were,
+ * or would be if buf is NULL, written.
+ */
+size_t linetab_flatten(struct linetab *lt, void *buf){
+    if(!lt)
+        return 0;
+
+    struct linetab_flat hdr = {
+        .lf_rowcnt = lt->lt_rowcnt,
+        .lf_blockcnt = lt->lt_blockcnt,
+        .lf_linecnt = lt->lt_linecnt,
+        .lf_filecnt = lt->lt_filecnt,
+        .lf_primaryfile = lt->lt_primaryfile,
+        .lf_addrslen = lt->lt_addrslen,
+        .lf_lineslen = lt->lt_lineslen,
+        .lf_fileidxslen = lt->lt_fileidxslen
+    };
+
+    size_t sz = linetab_flat_fixed_size(&hdr);
+    size_t fixedsz = sz;
+
+    for(int i=0; i<lt->lt_filecnt; i++)
+        sz += strlen(lt->lt_files[i]) + 1;
+
+    if(!buf)
+        return sz;
+
+    uint8_t *cursor = buf;
+
+    memcpy(cursor, &hdr, sizeof(hdr));
+    cursor += sizeof(struct linetab_flat);
+
+    memcpy(cursor, lt->lt_blocks,
+            sizeof(struct linetab_block) * lt->lt_blockcnt);
+    cursor += sizeof(struct linetab_block) * lt->lt_blockcnt;
+
+    memcpy(cursor, lt->lt_lineidx,
+            sizeof(struct linetab_lineent) * lt->lt_linecnt);
+    cursor += sizeof(struct linetab_lineent) * lt->lt_linecnt;
+
+    int32_t *filestart = (int32_t *)cursor;
+
+    for(int i=0; i<=lt->lt_filecnt; i++)
+        filestart[i] = lt->lt_filestart ? lt->lt_filestart[i] : 0;
+
+    cursor += sizeof(int32_t) * (lt->lt_filecnt + 1);
+
+    uint32_t *fileoffs = (uint32_t *)cursor;
+    cursor += sizeof(uint32_t) * lt->lt_filecnt;
+
+    memcpy(cursor, lt->lt_flags, lt->lt_rowcnt);
+    cursor += lt->lt_rowcnt;
+
+    memcpy(cursor, lt->lt_addrs, lt->lt_addrslen);
+    cursor += lt->lt_addrslen;
+
+    memcpy(cursor, lt->lt_lines, lt->lt_lineslen);
+    cursor += lt->lt_lineslen;
+
+    memcpy(cursor, lt->lt_fileidxs, lt->lt_fileidxslen);
+
+    size_t stroff = fixedsz;
+
+    for(int i=0; i<lt->lt_filecnt; i++){
+        size_t len = strlen(lt->lt_files[i]) + 1;
+
+        fileoffs[i] = (uint32_t)stroff;
+        memcpy((uint8_t *)buf + stroff, lt->lt_files[i], len);
+
+        stroff += len;
+    }
+
+    return sz;
+}
+
+/* Make a line table out of one flattened by linetab_flatten. Nothing
+ * is copied, so blob must stay around, and must be eight byte aligned,
+ * for as long as the line table does. Returns NULL if blob doesn't
+ * look like a flattened line table.
+ */
+struct linetab *linetab_new_from_flat(const void *blob, size_t len){
+    if(!blob || len < sizeof(struct linetab_flat))
+        return NULL;
+
+    const struct linetab_flat *lf = blob;
+
+    if(lf->lf_rowcnt > INT32_MAX || lf->lf_linecnt > lf->lf_rowcnt ||
+            lf->lf_filecnt > UINT16_MAX + 1 ||
+            lf->lf_blockcnt != (lf->lf_rowcnt + LINETAB_BLOCK_ROWS - 1) /
+            LINETAB_BLOCK_ROWS){
+        return NULL;
+    }
+
+    size_t fixedsz = linetab_flat_fixed_size(lf);
+
+    if(fixedsz > len)
+        return NULL;
+
+    const uint8_t *cursor = (const uint8_t *)blob + sizeof(struct linetab_flat);
+    struct linetab *lt = calloc(1, sizeof(struct linetab));
+
+    lt->lt_rowcnt = lf->lf_rowcnt;
+
+    lt->lt_blockcnt = lf->lf_blockcnt;
+    lt->lt_blocks = (struct linetab_block *)cursor;
+    cursor += sizeof(struct linetab_block) * lf->lf_blockcnt;
+
+    lt->lt_linecnt = lf->lf_linecnt;
+    lt->lt_lineidx = (struct linetab_lineent *)cursor;
+    cursor += sizeof(struct linetab_lineent) * lf->lf_linecnt;
+
+    lt->lt_filestart = (int *)cursor;
+    cursor += sizeof(int32_t) * (lf->lf_filecnt + 1);
+
+    const uint32_t *fileoffs = (const uint32_t *)cursor;
+    cursor += sizeof(uint32_t) * lf->lf_filecnt;
+
+    lt->lt_flags = (uint8_t *)cursor;
+    cursor += lf->lf_rowcnt;
+
+    lt->lt_addrslen = lf->lf_addrslen;
+    lt->lt_addrs = (uint8_t *)cursor;
+    cursor += lf->lf_addrslen;
+
+    lt->lt_lineslen = lf->lf_lineslen;
+    lt->lt_lines = (uint8_t *)cursor;
+    cursor += lf->lf_lineslen;
+
+    lt->lt_fileidxslen = lf->lf_fileidxslen;
+    lt->lt_fileidxs = (uint8_t *)cursor;
+
+    lt->lt_filecnt = lf->lf_filecnt;
+    lt->lt_files = malloc(sizeof(char *) * (lf->lf_filecnt + 1));
+
+    int bad = 0;
+
+    /* Decoding never reads past the end of a column, but a block
+     * or index entry pointing somewhere else could.
+     */
+    for(uint32_t i=0; i<lf->lf_blockcnt && !bad; i++){
+        const struct linetab_block *lb = &lt->lt_blocks[i];
+
+        bad = lb->lb_addroff > lf->lf_addrslen ||
+            lb->lb_lineoff > lf->lf_lineslen ||
+            lb->lb_fileoff > lf->lf_fileidxslen;
+    }
+
+    for(uint32_t i=0; i<lf->lf_linecnt && !bad; i++)
+        bad = lt->lt_lineidx[i].le_row >= lf->lf_rowcnt;
+
+    for(uint32_t i=0; i<lf->lf_filecnt && !bad; i++){
+        if(fileoffs[i] < fixedsz || fileoffs[i] >= len ||
+                !memchr((const char *)blob + fileoffs[i], '\0',
+                    len - fileoffs[i])){
+            bad = 1;
+            break;
+        }
+
+        lt->lt_files[i] = (char *)blob + fileoffs[i];
+    }
+
+    if(bad){
+        free(lt->lt_files);
+        free(lt);
+        return NULL;
+    }
+
+    lt->lt_primaryfile = lf->lf_primaryfile;
+    lt->lt_borrowed = 1;
+
+    return lt;
+}
+
+void linetab_free(struct linetab *lt){
+    if(!lt)
+        return;
+
+    if(lt->lt_borrowed){
+        free(lt->lt_files);
+        free(lt);
+        return;
+    }
+
+    for(int i=0; i<lt->lt_filecnt; i++)
+        free(lt->lt_files[i]);
+
+    free(lt->lt_files);
+    free(lt->lt_blocks);
+    free(lt->lt_addrs);
+    free(lt->lt_lines);
+    free(lt->lt_fileidxs);
+    free(lt->lt_flags);
+    free(lt->lt_lineidx);
+    free(lt->lt_filestart);
+    free(lt);
+}
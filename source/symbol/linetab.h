@@ -0,0 +1,18 @@
+#ifndef _LINETAB_H_
+#define _LINETAB_H_
+
+void *linetab_new(void *, void *, int64_t, const char *);
+void *linetab_new_from_flat(const void *, size_t);
+void *linetab_new_from_rows(void *, int, char **, int, const char *);
+int linetab_find_file(void *, const char *);
+int linetab_find_row(void *, uint64_t, int);
+size_t linetab_flatten(void *, void *);
+int linetab_get_row(void *, int, uint64_t *, uint64_t *, char **, int *);
+int linetab_line_to_pcs(void *, int, uint64_t, int, uint64_t *, uint64_t **,
+        int *);
+int linetab_primary_file(void *);
+int linetab_count(void *);
+size_t linetab_size(void *);
+void linetab_free(void *);
+
+#endif
@@ -0,0 +1,585 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <dwarf.h>
+
+#include "arena.h"
+#include "common.h"
+
+/* Deep enough for anything a compiler emits */
+#define LOCPROG_STACK_DEPTH 64
+
+/* A location description which doesn't say how big a piece is
+ * describes the whole object.
+ */
+#define LOCPROG_WHOLE_OBJECT 0
+
+/* One DWARF operation. Branch operands, which are byte offsets in the
+ * expression, are resolved to instruction indexes when compiling.
+ */
+struct locprog_insn {
+    uint8_t li_op;
+    int32_t li_target;
+    uint64_t li_opd1;
+    uint64_t li_opd2;
+};
+
+/* A DWARF location expression compiled to a flat array of instructions,
+ * so evaluating it doesn't chase a linked list or parse anything. It
+ * doesn't depend on libdwarf, and registers and memory are only read
+ * through the callbacks given to locprog_eval.
+ */
+struct locprog {
+    /* Only for location list entries: [lp_lopc, lp_hipc) */
+    int lp_bounded;
+    uint64_t lp_lopc;
+    uint64_t lp_hipc;
+
+    int lp_ninsns;
+    struct locprog_insn lp_insns[];
+};
+
+/* Everything locprog_eval needs besides the program itself */
+struct locprog_ctx {
+    int (*lc_readreg)(void *, int, uint64_t *);
+    int (*lc_readmem)(void *, uint64_t, void *, size_t);
+    void *lc_arg;
+
+    struct locprog *lc_frameprog;
+
+    /* If not NULL, the frame base is computed once and kept here, for
+     * when many programs of the same function are evaluated at one PC.
+     */
+    int *lc_fbknown;
+    uint64_t *lc_fb;
+
+    /* Guards against a frame base which uses DW_OP_fbreg */
+    int lc_depth;
+};
+
+/* Compile one location expression. ops, opd1s, opd2s, and offs each have
+ * ninsns elements, where offs holds the byte offset of every operation
+ * in the expression. Returns NULL if a branch goes somewhere which
+ * isn't the start of an operation.
+ */
+struct locprog *locprog_compile(void *arena, int bounded, uint64_t lopc,
+        uint64_t hipc, const uint8_t *ops, const uint64_t *opd1s,
+        const uint64_t *opd2s, const uint64_t *offs, int ninsns){
+    struct locprog *lp = arena_alloc(arena, sizeof(struct locprog) +
+            (sizeof(struct locprog_insn) * ninsns));
+
+    if(!lp)
+        return NULL;
+
+    lp->lp_bounded = bounded;
+    lp->lp_lopc = lopc;
+    lp->lp_hipc = hipc;
+    lp->lp_ninsns = ninsns;
+
+    for(int i=0; i<ninsns; i++){
+        struct locprog_insn *insn = &lp->lp_insns[i];
+
+        insn->li_op = ops[i];
+        insn->li_opd1 = opd1s[i];
+        insn->li_opd2 = opd2s[i];
+        insn->li_target = -1;
+
+        if(insn->li_op != DW_OP_bra && insn->li_op != DW_OP_skip)
+            continue;
+
+        /* The branch offset is from the end of the branch, which is
+         * where the next operation starts. A branch past the last
+         * operation ends the program.
+         */
+        if(i + 1 == ninsns){
+            insn->li_target = ninsns;
+            continue;
+        }
+
+        uint64_t target = offs[i + 1] + (int64_t)(int16_t)insn->li_opd1;
+
+        if(target > offs[ninsns - 1]){
+            insn->li_target = ninsns;
+            continue;
+        }
+
+        for(int k=0; k<ninsns; k++){
+            if(offs[k] == target){
+                insn->li_target = k;
+                break;
+            }
+        }
+
+        if(insn->li_target == -1){
+            if(!arena)
+                free(lp);
+
+            return NULL;
+        }
+    }
+
+    return lp;
+}
+
+int locprog_in_bounds(struct locprog *lp, uint64_t pc){
+    if(!lp)
+        return 0;
+
+    if(!lp->lp_bounded)
+        return 1;
+
+    return pc >= lp->lp_lopc && pc < lp->lp_hipc;
+}
+
+/* Returns non-zero if this program only applies to [lo, hi) */
+int locprog_get_bounds(struct locprog *lp, uint64_t *lopcout,
+        uint64_t *hipcout){
+    if(!lp || !lp->lp_bounded)
+        return 0;
+
+    *lopcout = lp->lp_lopc;
+    *hipcout = lp->lp_hipc;
+
+    return 1;
+}
+
+static int locprog_deref(struct locprog_ctx *ctx, uint64_t addr,
+        uint64_t size, uint64_t *valout){
+    if(!ctx->lc_readmem || size == 0 || size > sizeof(uint64_t))
+        return 1;
+
+    uint64_t val = 0;
+
+    /* Little endian, so the low bytes come first */
+    if(ctx->lc_readmem(ctx->lc_arg, addr, &val, size))
+        return 1;
+
+    *valout = val;
+    return 0;
+}
+
+static int locprog_readreg(struct locprog_ctx *ctx, uint64_t reg,
+        uint64_t *valout){
+    if(!ctx->lc_readreg)
+        return 1;
+
+    return ctx->lc_readreg(ctx->lc_arg, (int)reg, valout);
+}
+
+static int locprog_run(struct locprog *lp, struct locprog_ctx *ctx,
+        int *kindsout, uint64_t *valuesout, uint64_t *sizesout,
+        int *npiecesout, int maxpieces);
+
+/* DW_OP_fbreg is relative to whatever the frame base evaluates to.
+ * A frame base of DW_OP_regN means the value of that register.
+ */
+static int locprog_frame_base(struct locprog_ctx *ctx, uint64_t *fbout){
+    if(ctx->lc_fbknown && *ctx->lc_fbknown){
+        *fbout = *ctx->lc_fb;
+        return 0;
+    }
+
+    if(!ctx->lc_frameprog || ctx->lc_depth > 0)
+        return 1;
+
+    int kind = LOCPROG_UNDEFINED, npieces = 0;
+    uint64_t value = 0, size = 0;
+
+    ctx->lc_depth++;
+
+    int ret = locprog_run(ctx->lc_frameprog, ctx, &kind, &value, &size,
+            &npieces, 1);
+
+    ctx->lc_depth--;
+
+    if(ret || npieces != 1)
+        return 1;
+
+    if(kind == LOCPROG_REGISTER){
+        if(locprog_readreg(ctx, value, fbout))
+            return 1;
+    }
+    else if(kind == LOCPROG_MEMORY || kind == LOCPROG_VALUE)
+        *fbout = value;
+    else
+        return 1;
+
+    if(ctx->lc_fbknown){
+        *ctx->lc_fb = *fbout;
+        *ctx->lc_fbknown = 1;
+    }
+
+    return 0;
+}
+
+#define NEED(n) do { if(sp < (n)) return 1; } while(0)
+#define PUSH(v) do { \
+    if(sp == LOCPROG_STACK_DEPTH) \
+        return 1; \
+    uint64_t pushed = (v); \
+    stack[sp] = pushed; \
+    sp++; \
+    } while(0)
+
+static int locprog_run(struct locprog *lp, struct locprog_ctx *ctx,
+        int *kindsout, uint64_t *valuesout, uint64_t *sizesout,
+        int *npiecesout, int maxpieces){
+    uint64_t stack[LOCPROG_STACK_DEPTH];
+    int sp = 0;
+
+    /* What the current piece is, if it isn't the top of the stack */
+    int inreg = 0, isvalue = 0;
+    uint64_t reg = 0;
+
+    int npieces = 0;
+
+    /* So a bad branch can't loop forever */
+    long budget = 100000;
+
+    int pc = 0;
+
+    while(pc < lp->lp_ninsns){
+        if(--budget == 0)
+            return 1;
+
+        struct locprog_insn *insn = &lp->lp_insns[pc];
+        uint8_t op = insn->li_op;
+        uint64_t opd1 = insn->li_opd1, opd2 = insn->li_opd2;
+
+        pc++;
+
+        switch(op){
+            case DW_OP_addr:
+            case DW_OP_const1u:
+            case DW_OP_const2u:
+            case DW_OP_const4u:
+            case DW_OP_const8u:
+            case DW_OP_constu:
+                PUSH(opd1);
+                break;
+            case DW_OP_const1s:
+                PUSH((int64_t)(int8_t)opd1);
+                break;
+            case DW_OP_const2s:
+                PUSH((int64_t)(int16_t)opd1);
+                break;
+            case DW_OP_const4s:
+                PUSH((int64_t)(int32_t)opd1);
+                break;
+            case DW_OP_const8s:
+            case DW_OP_consts:
+                PUSH(opd1);
+                break;
+            case DW_OP_lit0...DW_OP_lit31:
+                PUSH(op - DW_OP_lit0);
+                break;
+            case DW_OP_dup:
+                NEED(1);
+                PUSH(stack[sp - 1]);
+                break;
+            case DW_OP_drop:
+                NEED(1);
+                sp--;
+                break;
+            case DW_OP_over:
+                NEED(2);
+                PUSH(stack[sp - 2]);
+                break;
+            case DW_OP_pick:
+                NEED((int)(uint8_t)opd1 + 1);
+                PUSH(stack[sp - 1 - (uint8_t)opd1]);
+                break;
+            case DW_OP_swap:
+                {
+                    NEED(2);
+                    uint64_t t = stack[sp - 1];
+                    stack[sp - 1] = stack[sp - 2];
+                    stack[sp - 2] = t;
+                    break;
+                }
+            case DW_OP_rot:
+                {
+                    NEED(3);
+                    uint64_t t = stack[sp - 1];
+                    stack[sp - 1] = stack[sp - 2];
+                    stack[sp - 2] = stack[sp - 3];
+                    stack[sp - 3] = t;
+                    break;
+                }
+            case DW_OP_deref:
+                NEED(1);
+                if(locprog_deref(ctx, stack[sp - 1], sizeof(uint64_t),
+                            &stack[sp - 1])){
+                    return 1;
+                }
+                break;
+            case DW_OP_deref_size:
+                NEED(1);
+                if(locprog_deref(ctx, stack[sp - 1], (uint8_t)opd1,
+                            &stack[sp - 1])){
+                    return 1;
+                }
+                break;
+            case DW_OP_abs:
+                NEED(1);
+                if((int64_t)stack[sp - 1] < 0)
+                    stack[sp - 1] = -stack[sp - 1];
+                break;
+            case DW_OP_neg:
+                NEED(1);
+                stack[sp - 1] = -stack[sp - 1];
+                break;
+            case DW_OP_not:
+                NEED(1);
+                stack[sp - 1] = ~stack[sp - 1];
+                break;
+            case DW_OP_plus_uconst:
+                NEED(1);
+                stack[sp - 1] += opd1;
+                break;
+            case DW_OP_and:
+                NEED(2);
+                stack[sp - 2] &= stack[sp - 1];
+                sp--;
+                break;
+            case DW_OP_or:
+                NEED(2);
+                stack[sp - 2] |= stack[sp - 1];
+                sp--;
+                break;
+            case DW_OP_xor:
+                NEED(2);
+                stack[sp - 2] ^= stack[sp - 1];
+                sp--;
+                break;
+            case DW_OP_plus:
+                NEED(2);
+                stack[sp - 2] += stack[sp - 1];
+                sp--;
+                break;
+            case DW_OP_minus:
+                NEED(2);
+                stack[sp - 2] -= stack[sp - 1];
+                sp--;
+                break;
+            case DW_OP_mul:
+                NEED(2);
+                stack[sp - 2] *= stack[sp - 1];
+                sp--;
+                break;
+            case DW_OP_div:
+                NEED(2);
+                if(stack[sp - 1] == 0)
+                    return 1;
+                stack[sp - 2] = (int64_t)stack[sp - 2] / (int64_t)stack[sp - 1];
+                sp--;
+                break;
+            case DW_OP_mod:
+                NEED(2);
+                if(stack[sp - 1] == 0)
+                    return 1;
+                stack[sp - 2] %= stack[sp - 1];
+                sp--;
+                break;
+            case DW_OP_shl:
+                NEED(2);
+                stack[sp - 2] = stack[sp - 1] >= 64 ? 0 :
+                    stack[sp - 2] << stack[sp - 1];
+                sp--;
+                break;
+            case DW_OP_shr:
+                NEED(2);
+                stack[sp - 2] = stack[sp - 1] >= 64 ? 0 :
+                    stack[sp - 2] >> stack[sp - 1];
+                sp--;
+                break;
+            case DW_OP_shra:
+                NEED(2);
+                stack[sp - 2] = (int64_t)stack[sp - 2] >>
+                    (stack[sp - 1] >= 64 ? 63 : stack[sp - 1]);
+                sp--;
+                break;
+            case DW_OP_eq:
+                NEED(2);
+                stack[sp - 2] = (int64_t)stack[sp - 2] == (int64_t)stack[sp - 1];
+                sp--;
+                break;
+            case DW_OP_ne:
+                NEED(2);
+                stack[sp - 2] = (int64_t)stack[sp - 2] != (int64_t)stack[sp - 1];
+                sp--;
+                break;
+            case DW_OP_lt:
+                NEED(2);
+                stack[sp - 2] = (int64_t)stack[sp - 2] < (int64_t)stack[sp - 1];
+                sp--;
+                break;
+            case DW_OP_le:
+                NEED(2);
+                stack[sp - 2] = (int64_t)stack[sp - 2] <= (int64_t)stack[sp - 1];
+                sp--;
+                break;
+            case DW_OP_gt:
+                NEED(2);
+                stack[sp - 2] = (int64_t)stack[sp - 2] > (int64_t)stack[sp - 1];
+                sp--;
+                break;
+            case DW_OP_ge:
+                NEED(2);
+                stack[sp - 2] = (int64_t)stack[sp - 2] >= (int64_t)stack[sp - 1];
+                sp--;
+                break;
+            case DW_OP_skip:
+                pc = insn->li_target;
+                break;
+            case DW_OP_bra:
+                NEED(1);
+                if(stack[--sp] != 0)
+                    pc = insn->li_target;
+                break;
+            case DW_OP_reg0...DW_OP_reg31:
+                inreg = 1;
+                reg = op - DW_OP_reg0;
+                break;
+            case DW_OP_regx:
+                inreg = 1;
+                reg = opd1;
+                break;
+            case DW_OP_breg0...DW_OP_breg31:
+                {
+                    uint64_t regval = 0;
+
+                    if(locprog_readreg(ctx, op - DW_OP_breg0, &regval))
+                        return 1;
+
+                    PUSH(regval + opd1);
+                    break;
+                }
+            case DW_OP_bregx:
+                {
+                    uint64_t regval = 0;
+
+                    if(locprog_readreg(ctx, opd1, &regval))
+                        return 1;
+
+                    PUSH(regval + opd2);
+                    break;
+                }
+            case DW_OP_fbreg:
+                {
+                    uint64_t fb = 0;
+
+                    if(locprog_frame_base(ctx, &fb))
+                        return 1;
+
+                    PUSH(fb + opd1);
+                    break;
+                }
+            case DW_OP_stack_value:
+                NEED(1);
+                isvalue = 1;
+                break;
+            case DW_OP_nop:
+                break;
+            case DW_OP_piece:
+                {
+                    if(npieces == maxpieces)
+                        return 1;
+
+                    if(inreg){
+                        kindsout[npieces] = LOCPROG_REGISTER;
+                        valuesout[npieces] = reg;
+                    }
+                    else if(sp > 0){
+                        kindsout[npieces] = isvalue ? LOCPROG_VALUE :
+                            LOCPROG_MEMORY;
+                        valuesout[npieces] = stack[--sp];
+                    }
+                    else{
+                        /* Optimized out */
+                        kindsout[npieces] = LOCPROG_UNDEFINED;
+                        valuesout[npieces] = 0;
+                    }
+
+                    sizesout[npieces] = opd1;
+                    npieces++;
+
+                    inreg = isvalue = 0;
+                    break;
+                }
+            default:
+                /* Not something we can evaluate */
+                return 1;
+        };
+    }
+
+    /* An expression without DW_OP_piece describes the whole object.
+     * Otherwise, anything after the last piece doesn't matter.
+     */
+    if(npieces == 0){
+        if(inreg){
+            kindsout[0] = LOCPROG_REGISTER;
+            valuesout[0] = reg;
+        }
+        else if(sp > 0){
+            kindsout[0] = isvalue ? LOCPROG_VALUE : LOCPROG_MEMORY;
+            valuesout[0] = stack[sp - 1];
+        }
+        else{
+            kindsout[0] = LOCPROG_UNDEFINED;
+            valuesout[0] = 0;
+        }
+
+        sizesout[0] = LOCPROG_WHOLE_OBJECT;
+        npieces = 1;
+    }
+
+    *npiecesout = npieces;
+
+    return 0;
+}
+
+#undef NEED
+#undef PUSH
+
+/* Evaluate lp. frameprog is what DW_OP_fbreg is relative to, and can be
+ * NULL. Registers are DWARF register numbers, and both callbacks return
+ * non-zero on failure. Either callback can be NULL, in which case
+ * anything which needs it fails.
+ *
+ * Each piece of the location is returned through kindsout, valuesout,
+ * and sizesout, which have room for maxpieces elements. A kind of
+ * LOCPROG_MEMORY means the value is an address, LOCPROG_REGISTER means
+ * the value is a DWARF register number, and LOCPROG_VALUE means the
+ * value is the value of the object. A size of zero means the whole
+ * object. Returns non-zero if lp can't be evaluated.
+ */
+/* fbknown and fb can be NULL. Otherwise, the frame base is taken from
+ * fb if *fbknown is non-zero, and saved there if it has to be computed.
+ * Callers evaluating every variable of one function at the same PC
+ * pass the same pair for all of them.
+ */
+int locprog_eval(struct locprog *lp, struct locprog *frameprog,
+        int *fbknown, uint64_t *fb, int (*readreg)(void *, int, uint64_t *),
+        int (*readmem)(void *, uint64_t, void *, size_t), void *arg,
+        int *kindsout, uint64_t *valuesout, uint64_t *sizesout,
+        int maxpieces, int *npiecesout){
+    if(!lp || !kindsout || !valuesout || !sizesout || !npiecesout ||
+            maxpieces <= 0){
+        return 1;
+    }
+
+    struct locprog_ctx ctx = {
+        .lc_readreg = readreg,
+        .lc_readmem = readmem,
+        .lc_arg = arg,
+        .lc_frameprog = frameprog,
+        .lc_fbknown = fb ? fbknown : NULL,
+        .lc_fb = fb
+    };
+
+    return locprog_run(lp, &ctx, kindsout, valuesout, sizesout, npiecesout,
+            maxpieces);
+}
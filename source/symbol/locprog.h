@@ -0,0 +1,13 @@
+#ifndef _LOCPROG_H_
+#define _LOCPROG_H_
+
+void *locprog_compile(void *, int, uint64_t, uint64_t, const uint8_t *,
+        const uint64_t *, const uint64_t *, const uint64_t *, int);
+int locprog_eval(void *, void *, int *, uint64_t *,
+        int (*)(void *, int, uint64_t *),
+        int (*)(void *, uint64_t, void *, size_t), void *, int *, uint64_t *,
+        uint64_t *, int, int *);
+int locprog_get_bounds(void *, uint64_t *, uint64_t *);
+int locprog_in_bounds(void *, uint64_t);
+
+#endif
@@ -0,0 +1,908 @@
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <mach-o/fat.h>
+#include <mach-o/loader.h>
+#include <mach-o/nlist.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* No name, only an address from LC_FUNCTION_STARTS */
+#define MACHOSYM_NO_NAME UINT32_MAX
+
+struct machosym_entry {
+    uint64_t me_addr;
+
+    /* Where this symbol's name is in the string pool */
+    uint32_t me_nameoff;
+
+    /* Which segment this symbol is inside of */
+    uint16_t me_seg;
+
+    uint16_t me_external;
+};
+
+struct machosym_segment {
+    uint64_t ms_vmaddr;
+    uint64_t ms_vmsize;
+};
+
+/* The symbols of one Mach-O, sorted by address. Every name is stored
+ * once in a single string pool, no matter how many symbols have it.
+ * Addresses are unslid.
+ */
+struct machosym {
+    struct machosym_entry *mo_syms;
+    int mo_numsyms;
+
+    /* Indexes into mo_syms of symbols with names, sorted by name */
+    int *mo_byname;
+    int mo_numbyname;
+
+    char *mo_strings;
+    size_t mo_stringslen;
+    size_t mo_stringscap;
+
+    struct machosym_segment *mo_segs;
+    int mo_numsegs;
+
+    uint8_t mo_uuid[16];
+    int mo_hasuuid;
+};
+
+/* Only used while the table is being built */
+struct machosym_interner {
+    uint32_t *mi_slots;
+    uint32_t mi_numslots;
+    uint32_t mi_count;
+};
+
+static uint32_t machosym_hash(const char *s){
+    /* FNV-1a */
+    uint32_t h = 2166136261u;
+
+    while(*s){
+        h ^= (uint8_t)*s++;
+        h *= 16777619u;
+    }
+
+    return h;
+}
+
+static uint32_t machosym_pool_add(struct machosym *mo, const char *s,
+        size_t len){
+    if(mo->mo_stringslen + len + 1 > mo->mo_stringscap){
+        size_t newcap = mo->mo_stringscap == 0 ? 4096 : mo->mo_stringscap * 2;
+
+        while(mo->mo_stringslen + len + 1 > newcap)
+            newcap *= 2;
+
+        char *strings_rea = realloc(mo->mo_strings, newcap);
+
+        mo->mo_strings = strings_rea;
+        mo->mo_stringscap = newcap;
+    }
+
+    uint32_t off = mo->mo_stringslen;
+
+    memcpy(mo->mo_strings + off, s, len);
+    mo->mo_strings[off + len] = '\0';
+    mo->mo_stringslen += len + 1;
+
+    return off;
+}
+
+static void machosym_interner_grow(struct machosym *mo,
+        struct machosym_interner *mi){
+    uint32_t newnum = mi->mi_numslots == 0 ? 1024 : mi->mi_numslots * 2;
+    uint32_t *newslots = malloc(sizeof(uint32_t) * newnum);
+
+    memset(newslots, 0xff, sizeof(uint32_t) * newnum);
+
+    for(uint32_t i=0; i<mi->mi_numslots; i++){
+        uint32_t off = mi->mi_slots[i];
+
+        if(off == MACHOSYM_NO_NAME)
+            continue;
+
+        uint32_t slot = machosym_hash(mo->mo_strings + off) & (newnum - 1);
+
+        while(newslots[slot] != MACHOSYM_NO_NAME)
+            slot = (slot + 1) & (newnum - 1);
+
+        newslots[slot] = off;
+    }
+
+    free(mi->mi_slots);
+    mi->mi_slots = newslots;
+    mi->mi_numslots = newnum;
+}
+
+/* Returns where name is in the string pool, adding it the first time
+ * it's seen.
+ */
+static uint32_t machosym_intern(struct machosym *mo,
+        struct machosym_interner *mi, const char *name){
+    if((mi->mi_count + 1) * 2 > mi->mi_numslots)
+        machosym_interner_grow(mo, mi);
+
+    uint32_t slot = machosym_hash(name) & (mi->mi_numslots - 1);
+
+    while(mi->mi_slots[slot] != MACHOSYM_NO_NAME){
+        uint32_t off = mi->mi_slots[slot];
+
+        if(strcmp(mo->mo_strings + off, name) == 0)
+            return off;
+
+        slot = (slot + 1) & (mi->mi_numslots - 1);
+    }
+
+    uint32_t off = machosym_pool_add(mo, name, strlen(name));
+
+    mi->mi_slots[slot] = off;
+    mi->mi_count++;
+
+    return off;
+}
+
+static void machosym_add(struct machosym *mo, int *cap, uint64_t addr,
+        uint32_t nameoff, int external){
+    if(mo->mo_numsyms == *cap){
+        *cap = *cap == 0 ? 1024 : *cap * 2;
+
+        struct machosym_entry *syms_rea = realloc(mo->mo_syms,
+                sizeof(struct machosym_entry) * (*cap));
+
+        mo->mo_syms = syms_rea;
+    }
+
+    struct machosym_entry *me = &mo->mo_syms[mo->mo_numsyms++];
+
+    me->me_addr = addr;
+    me->me_nameoff = nameoff;
+    me->me_seg = 0;
+    me->me_external = external;
+}
+
+/* Same address, named symbols first, then external ones, so the
+ * best name for an address is the first one.
+ */
+static int machosym_entry_cmp(const void *a, const void *b){
+    const struct machosym_entry *ma = a;
+    const struct machosym_entry *mb = b;
+
+    if(ma->me_addr != mb->me_addr)
+        return ma->me_addr < mb->me_addr ? -1 : 1;
+
+    int anamed = ma->me_nameoff != MACHOSYM_NO_NAME;
+    int bnamed = mb->me_nameoff != MACHOSYM_NO_NAME;
+
+    if(anamed != bnamed)
+        return bnamed - anamed;
+
+    return (int)mb->me_external - (int)ma->me_external;
+}
+
+/* qsort has no context parameter everywhere we build */
+static __thread const struct machosym *CUR_MACHOSYM;
+
+static int machosym_byname_cmp(const void *a, const void *b){
+    const struct machosym *mo = CUR_MACHOSYM;
+    const struct machosym_entry *ma = &mo->mo_syms[*(const int *)a];
+    const struct machosym_entry *mb = &mo->mo_syms[*(const int *)b];
+
+    int ret = strcmp(mo->mo_strings + ma->me_nameoff,
+            mo->mo_strings + mb->me_nameoff);
+
+    if(ret)
+        return ret;
+
+    return ma->me_addr < mb->me_addr ? -1 : ma->me_addr > mb->me_addr;
+}
+
+static int machosym_read_nlist(struct machosym *mo,
+        struct machosym_interner *mi, int *cap, const uint8_t *slice,
+        uint64_t slicesize, struct symtab_command *symtab,
+        uint32_t first, uint32_t count){
+    if(symtab->symoff > slicesize || symtab->stroff > slicesize ||
+            symtab->strsize > slicesize - symtab->stroff){
+        return 1;
+    }
+
+    if((uint64_t)symtab->nsyms * sizeof(struct nlist_64) >
+            slicesize - symtab->symoff){
+        return 1;
+    }
+
+    if(first > symtab->nsyms || count > symtab->nsyms - first)
+        return 1;
+
+    const struct nlist_64 *nl = (const struct nlist_64 *)(slice +
+            symtab->symoff);
+    const char *strtab = (const char *)(slice + symtab->stroff);
+
+    for(uint32_t i=first; i<first+count; i++){
+        /* Debugging symbols and anything not defined in a section */
+        if((nl[i].n_type & N_STAB) || (nl[i].n_type & N_TYPE) != N_SECT)
+            continue;
+
+        if(nl[i].n_un.n_strx == 0 || nl[i].n_un.n_strx >= symtab->strsize)
+            continue;
+
+        const char *name = strtab + nl[i].n_un.n_strx;
+
+        if(!memchr(name, '\0', symtab->strsize - nl[i].n_un.n_strx))
+            continue;
+
+        /* _main is main to the user */
+        if(*name == '_')
+            name++;
+
+        if(*name == '\0')
+            continue;
+
+        machosym_add(mo, cap, nl[i].n_value, machosym_intern(mo, mi, name),
+                (nl[i].n_type & N_EXT) != 0);
+    }
+
+    return 0;
+}
+
+/* LC_FUNCTION_STARTS is a list of ULEB128 deltas, starting from
+ * __TEXT. Stripped binaries still have it, so we at least know where
+ * functions start.
+ */
+static int machosym_read_function_starts(struct machosym *mo, int *cap,
+        const uint8_t *slice, uint64_t slicesize,
+        struct linkedit_data_command *fstarts, uint64_t textvmaddr){
+    if(fstarts->dataoff > slicesize ||
+            fstarts->datasize > slicesize - fstarts->dataoff){
+        return 1;
+    }
+
+    const uint8_t *cur = slice + fstarts->dataoff;
+    const uint8_t *end = cur + fstarts->datasize;
+
+    uint64_t addr = textvmaddr;
+
+    while(cur < end){
+        uint64_t delta = 0;
+        int shift = 0;
+
+        while(cur < end){
+            uint8_t byte = *cur++;
+
+            if(shift < 64)
+                delta |= (uint64_t)(byte & 0x7f) << shift;
+
+            shift += 7;
+
+            if(!(byte & 0x80))
+                break;
+        }
+
+        if(delta == 0)
+            break;
+
+        addr += delta;
+
+        machosym_add(mo, cap, addr, MACHOSYM_NO_NAME, 0);
+    }
+
+    return 0;
+}
+
+/* Only 64 bit little endian Mach-Os are supported. */
+static int machosym_read_slice(struct machosym *mo, const uint8_t *slice,
+        uint64_t slicesize){
+    if(slicesize < sizeof(struct mach_header_64))
+        return 1;
+
+    const struct mach_header_64 *hdr = (const struct mach_header_64 *)slice;
+
+    if(hdr->magic != MH_MAGIC_64)
+        return 1;
+
+    if(hdr->sizeofcmds > slicesize - sizeof(struct mach_header_64))
+        return 1;
+
+    struct symtab_command *symtab = NULL;
+    struct dysymtab_command *dysymtab = NULL;
+    struct linkedit_data_command *fstarts = NULL;
+    uint64_t textvmaddr = 0;
+
+    const uint8_t *cmds = slice + sizeof(struct mach_header_64);
+    uint32_t cmdoff = 0;
+
+    for(uint32_t i=0; i<hdr->ncmds; i++){
+        if(cmdoff + sizeof(struct load_command) > hdr->sizeofcmds)
+            return 1;
+
+        struct load_command *lc = (struct load_command *)(cmds + cmdoff);
+
+        if(lc->cmdsize < sizeof(struct load_command) ||
+                cmdoff + lc->cmdsize > hdr->sizeofcmds){
+            return 1;
+        }
+
+        if(lc->cmd == LC_SEGMENT_64 &&
+                lc->cmdsize >= sizeof(struct segment_command_64)){
+            struct segment_command_64 *seg = (struct segment_command_64 *)lc;
+
+            if(strncmp(seg->segname, "__TEXT", 16) == 0)
+                textvmaddr = seg->vmaddr;
+
+            struct machosym_segment *segs_rea = realloc(mo->mo_segs,
+                    sizeof(struct machosym_segment) * (mo->mo_numsegs + 1));
+
+            mo->mo_segs = segs_rea;
+            mo->mo_segs[mo->mo_numsegs].ms_vmaddr = seg->vmaddr;
+            mo->mo_segs[mo->mo_numsegs].ms_vmsize = seg->vmsize;
+            mo->mo_numsegs++;
+        }
+        else if(lc->cmd == LC_SYMTAB &&
+                lc->cmdsize >= sizeof(struct symtab_command)){
+            symtab = (struct symtab_command *)lc;
+        }
+        else if(lc->cmd == LC_DYSYMTAB &&
+                lc->cmdsize >= sizeof(struct dysymtab_command)){
+            dysymtab = (struct dysymtab_command *)lc;
+        }
+        else if(lc->cmd == LC_FUNCTION_STARTS &&
+                lc->cmdsize >= sizeof(struct linkedit_data_command)){
+            fstarts = (struct linkedit_data_command *)lc;
+        }
+        else if(lc->cmd == LC_UUID &&
+                lc->cmdsize >= sizeof(struct uuid_command)){
+            memcpy(mo->mo_uuid, ((struct uuid_command *)lc)->uuid, 16);
+            mo->mo_hasuuid = 1;
+        }
+
+        cmdoff += lc->cmdsize;
+    }
+
+    struct machosym_interner mi = {0};
+    int cap = 0;
+
+    if(symtab){
+        /* With LC_DYSYMTAB, undefined symbols can be skipped
+         * without looking at them.
+         */
+        if(dysymtab){
+            if(machosym_read_nlist(mo, &mi, &cap, slice, slicesize, symtab,
+                        dysymtab->ilocalsym, dysymtab->nlocalsym) ||
+                    machosym_read_nlist(mo, &mi, &cap, slice, slicesize,
+                        symtab, dysymtab->iextdefsym,
+                        dysymtab->nextdefsym)){
+                free(mi.mi_slots);
+                return 1;
+            }
+        }
+        else if(machosym_read_nlist(mo, &mi, &cap, slice, slicesize, symtab,
+                    0, symtab->nsyms)){
+            free(mi.mi_slots);
+            return 1;
+        }
+    }
+
+    free(mi.mi_slots);
+
+    if(fstarts && machosym_read_function_starts(mo, &cap, slice, slicesize,
+                fstarts, textvmaddr)){
+        return 1;
+    }
+
+    return 0;
+}
+
+/* Sort by address, keep the best symbol for each address, and figure
+ * out which segment each one is in.
+ */
+static void machosym_finalize(struct machosym *mo){
+    if(mo->mo_numsyms == 0)
+        return;
+
+    qsort(mo->mo_syms, mo->mo_numsyms, sizeof(struct machosym_entry),
+            machosym_entry_cmp);
+
+    int out = 0;
+
+    for(int i=0; i<mo->mo_numsyms; i++){
+        if(out > 0 && mo->mo_syms[out - 1].me_addr == mo->mo_syms[i].me_addr)
+            continue;
+
+        mo->mo_syms[out++] = mo->mo_syms[i];
+    }
+
+    mo->mo_numsyms = out;
+
+    /* Symbols and segments are both in ascending order */
+    int seg = 0;
+
+    for(int i=0; i<mo->mo_numsyms; i++){
+        struct machosym_entry *me = &mo->mo_syms[i];
+
+        while(seg < mo->mo_numsegs - 1 &&
+                me->me_addr >= mo->mo_segs[seg].ms_vmaddr +
+                mo->mo_segs[seg].ms_vmsize){
+            seg++;
+        }
+
+        me->me_seg = seg;
+    }
+
+    mo->mo_byname = malloc(sizeof(int) * mo->mo_numsyms);
+
+    for(int i=0; i<mo->mo_numsyms; i++){
+        if(mo->mo_syms[i].me_nameoff != MACHOSYM_NO_NAME)
+            mo->mo_byname[mo->mo_numbyname++] = i;
+    }
+
+    CUR_MACHOSYM = mo;
+    qsort(mo->mo_byname, mo->mo_numbyname, sizeof(int), machosym_byname_cmp);
+    CUR_MACHOSYM = NULL;
+}
+
+static int machosym_segment_cmp(const void *a, const void *b){
+    const struct machosym_segment *sa = a;
+    const struct machosym_segment *sb = b;
+
+    if(sa->ms_vmaddr < sb->ms_vmaddr)
+        return -1;
+
+    return sa->ms_vmaddr > sb->ms_vmaddr;
+}
+
+void machosym_free(struct machosym *mo){
+    if(!mo)
+        return;
+
+    free(mo->mo_syms);
+    free(mo->mo_byname);
+    free(mo->mo_strings);
+    free(mo->mo_segs);
+    free(mo);
+}
+
+/* Build the symbol table of a Mach-O which is already in memory. For
+ * a universal file, the arm64 slice is used if there is one, otherwise
+ * the first. Nothing in buf is needed after this returns. Returns NULL
+ * if it isn't a Mach-O we can read.
+ */
+struct machosym *machosym_new_from_memory(const void *buf, size_t size){
+    if(!buf || size < sizeof(struct mach_header_64))
+        return NULL;
+
+    const uint8_t *base = buf;
+    uint64_t sliceoff = 0, slicesize = size;
+
+    if(*(const uint32_t *)base == FAT_CIGAM){
+        const struct fat_header *fh = (const struct fat_header *)base;
+        uint32_t narchs = ntohl(fh->nfat_arch);
+
+        if(narchs == 0 ||
+                (size - sizeof(*fh)) / sizeof(struct fat_arch) < narchs){
+            return NULL;
+        }
+
+        const struct fat_arch *fa = (const struct fat_arch *)(fh + 1);
+        const struct fat_arch *use = &fa[0];
+
+        for(uint32_t i=0; i<narchs; i++){
+            if((cpu_type_t)ntohl(fa[i].cputype) == CPU_TYPE_ARM64){
+                use = &fa[i];
+                break;
+            }
+        }
+
+        sliceoff = ntohl(use->offset);
+        slicesize = ntohl(use->size);
+
+        if(sliceoff > size || slicesize > size - sliceoff)
+            return NULL;
+    }
+
+    struct machosym *mo = calloc(1, sizeof(struct machosym));
+
+    if(machosym_read_slice(mo, base + sliceoff, slicesize)){
+        machosym_free(mo);
+        return NULL;
+    }
+
+    qsort(mo->mo_segs, mo->mo_numsegs, sizeof(struct machosym_segment),
+            machosym_segment_cmp);
+
+    machosym_finalize(mo);
+
+    return mo;
+}
+
+struct machosym *machosym_new_from_file(const char *path){
+    int fd = open(path, O_RDONLY);
+
+    if(fd < 0)
+        return NULL;
+
+    struct stat st;
+
+    if(fstat(fd, &st) || st.st_size < (off_t)sizeof(struct mach_header_64)){
+        close(fd);
+        return NULL;
+    }
+
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    close(fd);
+
+    if(map == MAP_FAILED)
+        return NULL;
+
+    struct machosym *mo = machosym_new_from_memory(map, st.st_size);
+
+    munmap(map, st.st_size);
+
+    return mo;
+}
+
+/* Images in the shared cache share one string table which is tens
+ * of megabytes, so only the part this image's symbols use is read.
+ */
+#define MACHOSYM_MAX_STRINGS (64 * 1024 * 1024)
+
+/* How far past the last name to read to get all of it */
+#define MACHOSYM_MAX_NAME 4096
+
+/* Anything bigger isn't a real mach header */
+#define MACHOSYM_MAX_CMDS (1024 * 1024)
+
+struct machosym_image_reader {
+    int (*mr_read)(void *, uint64_t, void *, size_t);
+    void *mr_arg;
+
+    /* Where __LINKEDIT is in the debuggee, and where
+     * it was in the file.
+     */
+    uint64_t mr_linkeditaddr;
+    uint64_t mr_linkeditoff;
+    uint64_t mr_linkeditsize;
+};
+
+/* Read part of __LINKEDIT from the debuggee. off is a file offset,
+ * like the ones in load commands.
+ */
+static int machosym_read_linkedit(struct machosym_image_reader *mr,
+        uint64_t off, void *buf, size_t size){
+    if(off < mr->mr_linkeditoff ||
+            off - mr->mr_linkeditoff > mr->mr_linkeditsize ||
+            size > mr->mr_linkeditsize - (off - mr->mr_linkeditoff)){
+        return 1;
+    }
+
+    return mr->mr_read(mr->mr_arg,
+            mr->mr_linkeditaddr + (off - mr->mr_linkeditoff), buf, size);
+}
+
+static void machosym_image_append(uint8_t **buf, size_t *len, size_t *cap,
+        size_t add){
+    while(*len + add > *cap){
+        *cap *= 2;
+
+        uint8_t *buf_rea = realloc(*buf, *cap);
+
+        *buf = buf_rea;
+    }
+
+    memset(*buf + *len, 0, add);
+    *len += add;
+}
+
+/* Copy the symbol table out of __LINKEDIT to the end of buf, along
+ * with only the names it needs, and point symtab at the copies.
+ */
+static int machosym_image_copy_symtab(struct machosym_image_reader *mr,
+        uint8_t **buf, size_t *len, size_t *cap, size_t symtaboff){
+    struct symtab_command symtab;
+
+    memcpy(&symtab, *buf + symtaboff, sizeof(symtab));
+
+    size_t nlsize = (size_t)symtab.nsyms * sizeof(struct nlist_64);
+    size_t nloff = *len;
+
+    machosym_image_append(buf, len, cap, nlsize);
+
+    if(machosym_read_linkedit(mr, symtab.symoff, *buf + nloff, nlsize))
+        return 1;
+
+    struct nlist_64 *nl = (struct nlist_64 *)(*buf + nloff);
+    uint32_t minstrx = UINT32_MAX, maxstrx = 0;
+
+    for(uint32_t i=0; i<symtab.nsyms; i++){
+        uint32_t strx = nl[i].n_un.n_strx;
+
+        if((nl[i].n_type & N_STAB) || (nl[i].n_type & N_TYPE) != N_SECT ||
+                strx == 0 || strx >= symtab.strsize){
+            nl[i].n_un.n_strx = 0;
+            continue;
+        }
+
+        if(strx < minstrx)
+            minstrx = strx;
+        if(strx > maxstrx)
+            maxstrx = strx;
+    }
+
+    uint32_t strsize = 1;
+
+    if(minstrx <= maxstrx){
+        uint64_t end = (uint64_t)maxstrx + MACHOSYM_MAX_NAME;
+
+        if(end > symtab.strsize)
+            end = symtab.strsize;
+
+        if(end - minstrx > MACHOSYM_MAX_STRINGS)
+            return 1;
+
+        strsize += end - minstrx;
+    }
+
+    /* The names start one byte in, since a string table
+     * index of zero means no name.
+     */
+    size_t stroff = *len;
+
+    machosym_image_append(buf, len, cap, strsize);
+
+    if(strsize > 1 && machosym_read_linkedit(mr,
+                (uint64_t)symtab.stroff + minstrx, *buf + stroff + 1,
+                strsize - 1)){
+        return 1;
+    }
+
+    nl = (struct nlist_64 *)(*buf + nloff);
+
+    for(uint32_t i=0; i<symtab.nsyms; i++){
+        if(nl[i].n_un.n_strx != 0)
+            nl[i].n_un.n_strx = nl[i].n_un.n_strx - minstrx + 1;
+    }
+
+    symtab.symoff = nloff;
+    symtab.stroff = stroff;
+    symtab.strsize = strsize;
+
+    memcpy(*buf + symtaboff, &symtab, sizeof(symtab));
+
+    return 0;
+}
+
+static int machosym_image_copy_function_starts(
+        struct machosym_image_reader *mr, uint8_t **buf, size_t *len,
+        size_t *cap, size_t fstartsoff){
+    struct linkedit_data_command fstarts;
+
+    memcpy(&fstarts, *buf + fstartsoff, sizeof(fstarts));
+
+    size_t dataoff = *len;
+
+    machosym_image_append(buf, len, cap, fstarts.datasize);
+
+    if(machosym_read_linkedit(mr, fstarts.dataoff, *buf + dataoff,
+                fstarts.datasize)){
+        return 1;
+    }
+
+    fstarts.dataoff = dataoff;
+
+    memcpy(*buf + fstartsoff, &fstarts, sizeof(fstarts));
+
+    return 0;
+}
+
+/* Build the symbol table of an image from the debuggee's memory,
+ * for images with nothing on disk, like the ones in the shared cache.
+ * The mach header is at loadaddr. read gets size bytes at an address
+ * in the debuggee, and returns non-zero if it couldn't. What's needed
+ * from __LINKEDIT is copied after the load commands, so the copy can
+ * be read like any other Mach-O. Returns NULL if the image can't be
+ * read.
+ */
+struct machosym *machosym_new_from_image(uint64_t loadaddr,
+        int (*read)(void *, uint64_t, void *, size_t), void *arg){
+    struct mach_header_64 hdr;
+
+    if(!read || read(arg, loadaddr, &hdr, sizeof(hdr)) ||
+            hdr.magic != MH_MAGIC_64 || hdr.sizeofcmds == 0 ||
+            hdr.sizeofcmds > MACHOSYM_MAX_CMDS){
+        return NULL;
+    }
+
+    size_t cap = sizeof(hdr) + hdr.sizeofcmds, len = 0;
+    uint8_t *buf = malloc(cap);
+
+    machosym_image_append(&buf, &len, &cap, cap);
+    memcpy(buf, &hdr, sizeof(hdr));
+
+    if(read(arg, loadaddr + sizeof(hdr), buf + sizeof(hdr),
+                hdr.sizeofcmds)){
+        free(buf);
+        return NULL;
+    }
+
+    struct machosym_image_reader mr = {0};
+    size_t symtaboff = 0, fstartsoff = 0;
+    uint64_t textvmaddr = 0;
+    int hastext = 0, haslinkedit = 0;
+    uint64_t linkeditvmaddr = 0;
+    uint32_t cmdoff = 0;
+
+    mr.mr_read = read;
+    mr.mr_arg = arg;
+
+    /* machosym_read_slice checks these again */
+    for(uint32_t i=0; i<hdr.ncmds; i++){
+        if(cmdoff + sizeof(struct load_command) > hdr.sizeofcmds)
+            break;
+
+        struct load_command *lc = (struct load_command *)(buf +
+                sizeof(hdr) + cmdoff);
+
+        if(lc->cmdsize < sizeof(struct load_command) ||
+                cmdoff + lc->cmdsize > hdr.sizeofcmds){
+            break;
+        }
+
+        if(lc->cmd == LC_SEGMENT_64 &&
+                lc->cmdsize >= sizeof(struct segment_command_64)){
+            struct segment_command_64 *seg = (struct segment_command_64 *)lc;
+
+            if(strncmp(seg->segname, "__TEXT", 16) == 0){
+                textvmaddr = seg->vmaddr;
+                hastext = 1;
+            }
+            else if(strncmp(seg->segname, "__LINKEDIT", 16) == 0){
+                linkeditvmaddr = seg->vmaddr;
+                mr.mr_linkeditoff = seg->fileoff;
+                mr.mr_linkeditsize = seg->filesize;
+                haslinkedit = 1;
+            }
+        }
+        else if(lc->cmd == LC_SYMTAB &&
+                lc->cmdsize >= sizeof(struct symtab_command)){
+            symtaboff = (uint8_t *)lc - buf;
+        }
+        else if(lc->cmd == LC_FUNCTION_STARTS &&
+                lc->cmdsize >= sizeof(struct linkedit_data_command)){
+            fstartsoff = (uint8_t *)lc - buf;
+        }
+
+        cmdoff += lc->cmdsize;
+    }
+
+    if(!hastext || !haslinkedit){
+        free(buf);
+        return NULL;
+    }
+
+    mr.mr_linkeditaddr = linkeditvmaddr + (loadaddr - textvmaddr);
+
+    if((symtaboff && machosym_image_copy_symtab(&mr, &buf, &len, &cap,
+                    symtaboff)) ||
+            (fstartsoff && machosym_image_copy_function_starts(&mr, &buf,
+                    &len, &cap, fstartsoff))){
+        free(buf);
+        return NULL;
+    }
+
+    struct machosym *mo = machosym_new_from_memory(buf, len);
+
+    free(buf);
+
+    return mo;
+}
+
+int machosym_count(struct machosym *mo){
+    return mo ? mo->mo_numsyms : 0;
+}
+
+/* Returns the UUID of the Mach-O, or NULL if it has none */
+const uint8_t *machosym_get_uuid(struct machosym *mo){
+    if(!mo || !mo->mo_hasuuid)
+        return NULL;
+
+    return mo->mo_uuid;
+}
+
+/* Finds the symbol at or closest below addr, in the same segment as
+ * addr. The name is NULL if all we know is that a function starts there.
+ * The size is how far it is to the next symbol, or to the end of the
+ * segment. Any of the out parameters can be NULL. Nothing returned
+ * should be freed.
+ */
+int machosym_lookup(struct machosym *mo, uint64_t addr,
+        const char **nameout, uint64_t *startout, uint64_t *sizeout){
+    if(!mo || mo->mo_numsyms == 0)
+        return 1;
+
+    int lo = 0, hi = mo->mo_numsyms - 1, found = -1;
+
+    while(lo <= hi){
+        int mid = lo + ((hi - lo) / 2);
+
+        if(mo->mo_syms[mid].me_addr <= addr){
+            found = mid;
+            lo = mid + 1;
+        }
+        else{
+            hi = mid - 1;
+        }
+    }
+
+    if(found == -1)
+        return 1;
+
+    struct machosym_entry *me = &mo->mo_syms[found];
+    uint64_t end = me->me_addr + 1;
+
+    if(mo->mo_numsegs > 0){
+        struct machosym_segment *seg = &mo->mo_segs[me->me_seg];
+
+        end = seg->ms_vmaddr + seg->ms_vmsize;
+    }
+
+    if(found + 1 < mo->mo_numsyms && mo->mo_syms[found + 1].me_addr < end)
+        end = mo->mo_syms[found + 1].me_addr;
+
+    if(addr >= end)
+        return 1;
+
+    if(nameout){
+        *nameout = me->me_nameoff == MACHOSYM_NO_NAME ? NULL :
+            mo->mo_strings + me->me_nameoff;
+    }
+
+    if(startout)
+        *startout = me->me_addr;
+
+    if(sizeout)
+        *sizeout = end - me->me_addr;
+
+    return 0;
+}
+
+/* Finds the address of a symbol by name. If more than one symbol has
+ * that name, the lowest address is returned.
+ */
+int machosym_find_by_name(struct machosym *mo, const char *name,
+        uint64_t *addrout){
+    if(!mo || !name)
+        return 1;
+
+    int lo = 0, hi = mo->mo_numbyname - 1, found = -1;
+
+    while(lo <= hi){
+        int mid = lo + ((hi - lo) / 2);
+        struct machosym_entry *me = &mo->mo_syms[mo->mo_byname[mid]];
+
+        int ret = strcmp(mo->mo_strings + me->me_nameoff, name);
+
+        if(ret >= 0){
+            if(ret == 0)
+                found = mid;
+
+            hi = mid - 1;
+        }
+        else{
+            lo = mid + 1;
+        }
+    }
+
+    if(found == -1)
+        return 1;
+
+    if(addrout)
+        *addrout = mo->mo_syms[mo->mo_byname[found]].me_addr;
+
+    return 0;
+}
@@ -0,0 +1,14 @@
+#ifndef _MACHOSYM_H_
+#define _MACHOSYM_H_
+
+void *machosym_new_from_file(const char *);
+void *machosym_new_from_image(uint64_t,
+        int (*)(void *, uint64_t, void *, size_t), void *);
+void *machosym_new_from_memory(const void *, size_t);
+int machosym_count(void *);
+int machosym_find_by_name(void *, const char *, uint64_t *);
+const uint8_t *machosym_get_uuid(void *);
+int machosym_lookup(void *, uint64_t, const char **, uint64_t *, uint64_t *);
+void machosym_free(void *);
+
+#endif
@@ -0,0 +1,678 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <dwarf.h>
+#include <libdwarf.h>
+
+#include "common.h"
+
+/* Names are offsets into nx_strs and compilation units are indexes
+ * into di_cus, so the index has no pointers in it and can be
+ * flattened as is.
+ */
+struct nameidx_entry {
+    uint32_t ne_nameoff;
+    int32_t ne_cuidx;
+    uint64_t ne_dieoffset;
+};
+
+/* Every entry with the same name */
+struct nameidx_run {
+    uint64_t nr_hash;
+    uint32_t nr_nameoff;
+    int32_t nr_start;
+    int32_t nr_count;
+};
+
+/* Maps names to the compilation units and DIE offsets of every DIE
+ * with that name. Entries and runs are sorted by name, so prefix
+ * lookups are a binary search over nx_runs. Exact lookups go through
+ * the open addressed hash table nx_slots, which holds indexes
+ * into nx_runs.
+ */
+struct nameidx {
+    dwarfinfo_t *nx_dwarfinfo;
+
+    struct nameidx_entry *nx_entries;
+    int nx_entrycnt;
+    int nx_entrycap;
+
+    struct nameidx_run *nx_runs;
+    int nx_runcnt;
+
+    int32_t *nx_slots;
+    uint64_t nx_slotmask;
+
+    char *nx_strs;
+    size_t nx_strslen;
+    size_t nx_strscap;
+
+    /* If non-zero, everything above points into a flattened name
+     * index someone else owns.
+     */
+    int nx_borrowed;
+};
+
+/* A name index flattened by nameidx_flatten. This header is followed
+ * by the entries, the runs, the hash table slots, and the names.
+ */
+struct nameidx_flat {
+    uint32_t nf_entrycnt;
+    uint32_t nf_runcnt;
+    uint64_t nf_slotcnt;
+    uint64_t nf_strslen;
+};
+
+/* qsort has no way to pass nx_strs to the comparator */
+static __thread const char *SORT_STRS;
+
+static inline const char *nameidx_str(struct nameidx *nx, uint32_t off){
+    return nx->nx_strs + off;
+}
+
+static uint64_t nameidx_hash(const char *name){
+    /* FNV-1a */
+    uint64_t hash = 0xcbf29ce484222325ULL;
+
+    while(*name){
+        hash ^= (unsigned char)*name++;
+        hash *= 0x100000001b3ULL;
+    }
+
+    return hash;
+}
+
+/* Index into di_cus of the compilation unit whose root DIE is at
+ * cudieoff, or -1.
+ */
+static int nameidx_cu_index(dwarfinfo_t *dwarfinfo, uint64_t cudieoff){
+    int lo = 0, hi = dwarfinfo->di_numcompunits - 1;
+
+    while(lo <= hi){
+        int mid = lo + ((hi - lo) / 2);
+        uint64_t off = dwarfinfo->di_curootoffs[mid];
+
+        if(off == cudieoff)
+            return mid;
+        else if(off < cudieoff)
+            lo = mid + 1;
+        else
+            hi = mid - 1;
+    }
+
+    return -1;
+}
+
+static void nameidx_add(struct nameidx *nx, const char *name, int cuidx,
+        uint64_t dieoffset){
+    if(!name || !(*name) || cuidx == -1)
+        return;
+
+    if(nx->nx_entrycnt == nx->nx_entrycap){
+        int newcap = nx->nx_entrycap == 0 ? 256 : nx->nx_entrycap * 2;
+
+        struct nameidx_entry *entries_rea = realloc(nx->nx_entries,
+                sizeof(struct nameidx_entry) * newcap);
+
+        nx->nx_entries = entries_rea;
+        nx->nx_entrycap = newcap;
+    }
+
+    size_t len = strlen(name) + 1;
+
+    if(nx->nx_strslen + len > nx->nx_strscap){
+        size_t newcap = nx->nx_strscap == 0 ? 4096 : nx->nx_strscap * 2;
+
+        while(nx->nx_strslen + len > newcap)
+            newcap *= 2;
+
+        char *strs_rea = realloc(nx->nx_strs, newcap);
+
+        nx->nx_strs = strs_rea;
+        nx->nx_strscap = newcap;
+    }
+
+    struct nameidx_entry *ne = &nx->nx_entries[nx->nx_entrycnt++];
+
+    ne->ne_nameoff = (uint32_t)nx->nx_strslen;
+    ne->ne_cuidx = cuidx;
+    ne->ne_dieoffset = dieoffset;
+
+    memcpy(nx->nx_strs + nx->nx_strslen, name, len);
+    nx->nx_strslen += len;
+}
+
+static int nameidx_entry_cmp(const void *a, const void *b){
+    const struct nameidx_entry *na = a;
+    const struct nameidx_entry *nb = b;
+
+    int res = strcmp(SORT_STRS + na->ne_nameoff, SORT_STRS + nb->ne_nameoff);
+
+    if(res)
+        return res;
+
+    if(na->ne_dieoffset < nb->ne_dieoffset)
+        return -1;
+    else if(na->ne_dieoffset > nb->ne_dieoffset)
+        return 1;
+
+    return 0;
+}
+
+/* Read .debug_pubnames and .debug_pubtypes. Compilation units they
+ * describe are marked in covered.
+ */
+static void nameidx_add_from_accelerator_tables(struct nameidx *nx,
+        dwarfinfo_t *dwarfinfo, int *covered){
+    Dwarf_Debug dbg = dwarfinfo->di_dbg;
+    Dwarf_Error d_error = NULL;
+
+    Dwarf_Global *globals = NULL;
+    Dwarf_Signed globalcnt = 0;
+
+    int ret = dwarf_get_globals(dbg, &globals, &globalcnt, &d_error);
+
+    if(ret == DW_DLV_ERROR){
+        dwarf_dealloc(dbg, d_error, DW_DLA_ERROR);
+        d_error = NULL;
+    }
+
+    if(ret == DW_DLV_OK){
+        for(Dwarf_Signed i=0; i<globalcnt; i++){
+            char *name = NULL;
+            Dwarf_Off dieoff = 0, cudieoff = 0;
+
+            ret = dwarf_global_name_offsets(globals[i], &name, &dieoff,
+                    &cudieoff, &d_error);
+
+            if(ret == DW_DLV_ERROR){
+                dwarf_dealloc(dbg, d_error, DW_DLA_ERROR);
+                d_error = NULL;
+                continue;
+            }
+
+            int which = nameidx_cu_index(dwarfinfo, cudieoff);
+
+            if(which != -1){
+                nameidx_add(nx, name, which, dieoff);
+                covered[which] = 1;
+            }
+
+            dwarf_dealloc(dbg, name, DW_DLA_STRING);
+        }
+
+        dwarf_globals_dealloc(dbg, globals, globalcnt);
+    }
+
+    Dwarf_Type *types = NULL;
+    Dwarf_Signed typecnt = 0;
+
+    ret = dwarf_get_pubtypes(dbg, &types, &typecnt, &d_error);
+
+    if(ret == DW_DLV_ERROR){
+        dwarf_dealloc(dbg, d_error, DW_DLA_ERROR);
+        d_error = NULL;
+    }
+
+    if(ret == DW_DLV_OK){
+        for(Dwarf_Signed i=0; i<typecnt; i++){
+            char *name = NULL;
+            Dwarf_Off dieoff = 0, cudieoff = 0;
+
+            ret = dwarf_pubtype_name_offsets(types[i], &name, &dieoff,
+                    &cudieoff, &d_error);
+
+            if(ret == DW_DLV_ERROR){
+                dwarf_dealloc(dbg, d_error, DW_DLA_ERROR);
+                d_error = NULL;
+                continue;
+            }
+
+            int which = nameidx_cu_index(dwarfinfo, cudieoff);
+
+            if(which != -1){
+                nameidx_add(nx, name, which, dieoff);
+                covered[which] = 1;
+            }
+
+            dwarf_dealloc(dbg, name, DW_DLA_STRING);
+        }
+
+        dwarf_pubtypes_dealloc(dbg, types, typecnt);
+    }
+}
+
+static int nameidx_should_index_tag(Dwarf_Half tag){
+    switch(tag){
+        case DW_TAG_subprogram:
+        case DW_TAG_variable:
+        case DW_TAG_formal_parameter:
+        case DW_TAG_structure_type:
+        case DW_TAG_union_type:
+        case DW_TAG_enumeration_type:
+        case DW_TAG_enumerator:
+        case DW_TAG_member:
+        case DW_TAG_typedef:
+        case DW_TAG_base_type:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+static void nameidx_walk_dies(struct nameidx *nx, Dwarf_Debug dbg,
+        Dwarf_Die die, int cuidx){
+    int is_info = 1;
+    Dwarf_Error d_error = NULL;
+    Dwarf_Die cur = die;
+
+    while(cur){
+        Dwarf_Half tag = 0;
+
+        if(dwarf_tag(cur, &tag, &d_error) == DW_DLV_OK &&
+                nameidx_should_index_tag(tag)){
+            char *name = NULL;
+
+            if(dwarf_diename(cur, &name, &d_error) == DW_DLV_OK){
+                Dwarf_Off off = 0;
+                dwarf_dieoffset(cur, &off, &d_error);
+
+                nameidx_add(nx, name, cuidx, off);
+
+                dwarf_dealloc(dbg, name, DW_DLA_STRING);
+            }
+        }
+
+        Dwarf_Die child = NULL;
+
+        if(dwarf_child(cur, &child, &d_error) == DW_DLV_OK)
+            nameidx_walk_dies(nx, dbg, child, cuidx);
+
+        Dwarf_Die sibling = NULL;
+        int ret = dwarf_siblingof_b(dbg, cur, is_info, &sibling, &d_error);
+
+        dwarf_dealloc(dbg, cur, DW_DLA_DIE);
+
+        if(ret != DW_DLV_OK)
+            return;
+
+        cur = sibling;
+    }
+}
+
+/* For compilation units without accelerator tables, walk their DIEs
+ * straight from libdwarf. This doesn't need the DIE trees, so it works
+ * for lazily loaded compilation units too.
+ */
+static void nameidx_add_from_dies(struct nameidx *nx,
+        dwarfinfo_t *dwarfinfo, int *covered){
+    Dwarf_Debug dbg = dwarfinfo->di_dbg;
+    int is_info = 1;
+
+    for(int i=0; i<dwarfinfo->di_numcompunits; i++){
+        if(covered[i])
+            continue;
+
+        Dwarf_Die rootdie = NULL;
+        Dwarf_Error d_error = NULL;
+
+        int ret = dwarf_offdie_b(dbg, dwarfinfo->di_curootoffs[i], is_info,
+                &rootdie, &d_error);
+
+        if(ret == DW_DLV_ERROR)
+            dwarf_dealloc(dbg, d_error, DW_DLA_ERROR);
+
+        if(ret != DW_DLV_OK)
+            continue;
+
+        Dwarf_Die child = NULL;
+
+        if(dwarf_child(rootdie, &child, &d_error) == DW_DLV_OK)
+            nameidx_walk_dies(nx, dbg, child, i);
+
+        dwarf_dealloc(dbg, rootdie, DW_DLA_DIE);
+    }
+}
+
+static void nameidx_finalize(struct nameidx *nx){
+    SORT_STRS = nx->nx_strs;
+
+    qsort(nx->nx_entries, nx->nx_entrycnt, sizeof(struct nameidx_entry),
+            nameidx_entry_cmp);
+
+    SORT_STRS = NULL;
+
+    nx->nx_runs = malloc(sizeof(struct nameidx_run) * (nx->nx_entrycnt + 1));
+    nx->nx_runcnt = 0;
+
+    /* Every entry got its own copy of its name. Only keep one copy
+     * per run.
+     */
+    char *strs = malloc(nx->nx_strslen + 1);
+    size_t strslen = 0;
+
+    for(int i=0; i<nx->nx_entrycnt; i++){
+        struct nameidx_entry *ne = &nx->nx_entries[i];
+        const char *name = nameidx_str(nx, ne->ne_nameoff);
+
+        struct nameidx_run *last = nx->nx_runcnt > 0 ?
+            &nx->nx_runs[nx->nx_runcnt - 1] : NULL;
+
+        if(last && strcmp(strs + last->nr_nameoff, name) == 0){
+            ne->ne_nameoff = last->nr_nameoff;
+            last->nr_count++;
+            continue;
+        }
+
+        size_t len = strlen(name) + 1;
+
+        memcpy(strs + strslen, name, len);
+
+        struct nameidx_run *run = &nx->nx_runs[nx->nx_runcnt++];
+
+        run->nr_nameoff = (uint32_t)strslen;
+        run->nr_hash = nameidx_hash(name);
+        run->nr_start = i;
+        run->nr_count = 1;
+
+        ne->ne_nameoff = run->nr_nameoff;
+
+        strslen += len;
+    }
+
+    free(nx->nx_strs);
+    nx->nx_strs = strs;
+    nx->nx_strslen = strslen;
+    nx->nx_strscap = nx->nx_strslen + 1;
+
+    /* Keep the load factor at or under one half */
+    uint64_t nslots = 16;
+
+    while(nslots < (uint64_t)nx->nx_runcnt * 2)
+        nslots <<= 1;
+
+    nx->nx_slots = malloc(sizeof(int32_t) * nslots);
+    nx->nx_slotmask = nslots - 1;
+
+    for(uint64_t i=0; i<nslots; i++)
+        nx->nx_slots[i] = -1;
+
+    for(int i=0; i<nx->nx_runcnt; i++){
+        uint64_t slot = nx->nx_runs[i].nr_hash & nx->nx_slotmask;
+
+        while(nx->nx_slots[slot] != -1)
+            slot = (slot + 1) & nx->nx_slotmask;
+
+        nx->nx_slots[slot] = i;
+    }
+}
+
+struct nameidx *nameidx_new(dwarfinfo_t *dwarfinfo){
+    struct nameidx *nx = calloc(1, sizeof(struct nameidx));
+
+    nx->nx_dwarfinfo = dwarfinfo;
+
+    int *covered = calloc(dwarfinfo->di_numcompunits + 1, sizeof(int));
+
+    nameidx_add_from_accelerator_tables(nx, dwarfinfo, covered);
+    nameidx_add_from_dies(nx, dwarfinfo, covered);
+
+    free(covered);
+
+    nameidx_finalize(nx);
+
+    return nx;
+}
+
+static struct nameidx_run *nameidx_find_run(struct nameidx *nx,
+        const char *name){
+    if(nx->nx_runcnt == 0)
+        return NULL;
+
+    uint64_t hash = nameidx_hash(name);
+    uint64_t slot = hash & nx->nx_slotmask;
+
+    while(nx->nx_slots[slot] != -1){
+        struct nameidx_run *run = &nx->nx_runs[nx->nx_slots[slot]];
+
+        if(run->nr_hash == hash &&
+                strcmp(nameidx_str(nx, run->nr_nameoff), name) == 0){
+            return run;
+        }
+
+        slot = (slot + 1) & nx->nx_slotmask;
+    }
+
+    return NULL;
+}
+
+/* Returns how many DIEs are named name. Their compilation units and
+ * DIE offsets are returned through cusout and offsout, in ascending
+ * DIE offset order. Both arrays must be freed.
+ */
+int nameidx_lookup(struct nameidx *nx, const char *name, void ***cusout,
+        uint64_t **offsout){
+    if(!nx || !name)
+        return 0;
+
+    struct nameidx_run *run = nameidx_find_run(nx, name);
+
+    if(!run)
+        return 0;
+
+    if(cusout)
+        *cusout = malloc(sizeof(void *) * run->nr_count);
+
+    if(offsout)
+        *offsout = malloc(sizeof(uint64_t) * run->nr_count);
+
+    for(int i=0; i<run->nr_count; i++){
+        struct nameidx_entry *ne = &nx->nx_entries[run->nr_start + i];
+
+        if(cusout)
+            (*cusout)[i] = nx->nx_dwarfinfo->di_cus[ne->ne_cuidx];
+
+        if(offsout)
+            (*offsout)[i] = ne->ne_dieoffset;
+    }
+
+    return run->nr_count;
+}
+
+/* Returns how many distinct names start with prefix. They are returned
+ * through namesout in sorted order. The array must be freed, but
+ * the names inside it must not.
+ */
+int nameidx_lookup_prefix(struct nameidx *nx, const char *prefix,
+        char ***namesout){
+    if(!nx || !prefix || !namesout)
+        return 0;
+
+    size_t prefixlen = strlen(prefix);
+
+    /* First run not less than prefix */
+    int lo = 0, hi = nx->nx_runcnt;
+
+    while(lo < hi){
+        int mid = lo + ((hi - lo) / 2);
+
+        if(strcmp(nameidx_str(nx, nx->nx_runs[mid].nr_nameoff), prefix) < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    int cnt = 0;
+
+    while(lo + cnt < nx->nx_runcnt &&
+            strncmp(nameidx_str(nx, nx->nx_runs[lo + cnt].nr_nameoff), prefix,
+                prefixlen) == 0){
+        cnt++;
+    }
+
+    if(cnt == 0)
+        return 0;
+
+    *namesout = malloc(sizeof(char *) * cnt);
+
+    for(int i=0; i<cnt; i++)
+        (*namesout)[i] = (char *)nameidx_str(nx, nx->nx_runs[lo + i].nr_nameoff);
+
+    return cnt;
+}
+
+/* Write nx to buf without any pointers, so it can be saved to disk and
+ * used again with nameidx_new_from_flat. Returns how many bytes were,
+ * or would be if buf is NULL, written.
+ */
+size_t nameidx_flatten(struct nameidx *nx, void *buf){
+    if(!nx)
+        return 0;
+
+    size_t entriessz = sizeof(struct nameidx_entry) * nx->nx_entrycnt;
+    size_t runssz = sizeof(struct nameidx_run) * nx->nx_runcnt;
+    size_t slotssz = sizeof(int32_t) * (nx->nx_slotmask + 1);
+
+    size_t sz = sizeof(struct nameidx_flat) + entriessz + runssz +
+        slotssz + nx->nx_strslen;
+
+    if(!buf)
+        return sz;
+
+    uint8_t *cursor = buf;
+    struct nameidx_flat *nf = buf;
+
+    nf->nf_entrycnt = nx->nx_entrycnt;
+    nf->nf_runcnt = nx->nx_runcnt;
+    nf->nf_slotcnt = nx->nx_slotmask + 1;
+    nf->nf_strslen = nx->nx_strslen;
+
+    cursor += sizeof(struct nameidx_flat);
+
+    memcpy(cursor, nx->nx_entries, entriessz);
+    cursor += entriessz;
+
+    memcpy(cursor, nx->nx_runs, runssz);
+    cursor += runssz;
+
+    memcpy(cursor, nx->nx_slots, slotssz);
+    cursor += slotssz;
+
+    memcpy(cursor, nx->nx_strs, nx->nx_strslen);
+
+    return sz;
+}
+
+/* Make a name index out of one flattened by nameidx_flatten. Nothing is
+ * copied, so blob must stay around, and must be eight byte aligned, for
+ * as long as the name index does. Returns NULL if blob doesn't look like
+ * a flattened name index for dwarfinfo.
+ */
+struct nameidx *nameidx_new_from_flat(dwarfinfo_t *dwarfinfo,
+        const void *blob, size_t len){
+    if(!dwarfinfo || !blob || len < sizeof(struct nameidx_flat))
+        return NULL;
+
+    const struct nameidx_flat *nf = blob;
+
+    /* The slot count must be a power of two, more than the run count */
+    if(nf->nf_runcnt > nf->nf_entrycnt || nf->nf_entrycnt > INT32_MAX ||
+            nf->nf_slotcnt <= nf->nf_runcnt ||
+            (nf->nf_slotcnt & (nf->nf_slotcnt - 1)) != 0 ||
+            nf->nf_slotcnt > len || nf->nf_strslen > len){
+        return NULL;
+    }
+
+    size_t entriessz = sizeof(struct nameidx_entry) * nf->nf_entrycnt;
+    size_t runssz = sizeof(struct nameidx_run) * nf->nf_runcnt;
+    size_t slotssz = sizeof(int32_t) * nf->nf_slotcnt;
+
+    if(sizeof(struct nameidx_flat) + entriessz + runssz + slotssz +
+            nf->nf_strslen != len){
+        return NULL;
+    }
+
+    const uint8_t *cursor = (const uint8_t *)blob + sizeof(struct nameidx_flat);
+    struct nameidx *nx = calloc(1, sizeof(struct nameidx));
+
+    nx->nx_dwarfinfo = dwarfinfo;
+
+    nx->nx_entries = (struct nameidx_entry *)cursor;
+    nx->nx_entrycnt = nf->nf_entrycnt;
+    cursor += entriessz;
+
+    nx->nx_runs = (struct nameidx_run *)cursor;
+    nx->nx_runcnt = nf->nf_runcnt;
+    cursor += runssz;
+
+    nx->nx_slots = (int32_t *)cursor;
+    nx->nx_slotmask = nf->nf_slotcnt - 1;
+    cursor += slotssz;
+
+    nx->nx_strs = (char *)cursor;
+    nx->nx_strslen = nf->nf_strslen;
+
+    nx->nx_borrowed = 1;
+
+    /* Everything we hand out must be in bounds */
+    for(int i=0; i<nx->nx_entrycnt; i++){
+        struct nameidx_entry *ne = &nx->nx_entries[i];
+
+        if(ne->ne_cuidx < 0 || ne->ne_cuidx >= dwarfinfo->di_numcompunits ||
+                ne->ne_nameoff >= nx->nx_strslen){
+            free(nx);
+            return NULL;
+        }
+    }
+
+    if(nx->nx_strslen > 0 && nx->nx_strs[nx->nx_strslen - 1] != '\0'){
+        free(nx);
+        return NULL;
+    }
+
+    for(int i=0; i<nx->nx_runcnt; i++){
+        struct nameidx_run *run = &nx->nx_runs[i];
+
+        if(run->nr_start < 0 || run->nr_count <= 0 ||
+                run->nr_start + run->nr_count > nx->nx_entrycnt ||
+                run->nr_nameoff >= nx->nx_strslen){
+            free(nx);
+            return NULL;
+        }
+    }
+
+    /* A probe has to reach an empty slot eventually */
+    int haveempty = 0;
+
+    for(uint64_t i=0; i<=nx->nx_slotmask; i++){
+        if(nx->nx_slots[i] == -1)
+            haveempty = 1;
+        else if(nx->nx_slots[i] < -1 || nx->nx_slots[i] >= nx->nx_runcnt){
+            free(nx);
+            return NULL;
+        }
+    }
+
+    if(!haveempty){
+        free(nx);
+        return NULL;
+    }
+
+    return nx;
+}
+
+void nameidx_free(struct nameidx *nx){
+    if(!nx)
+        return;
+
+    if(!nx->nx_borrowed){
+        free(nx->nx_entries);
+        free(nx->nx_runs);
+        free(nx->nx_slots);
+        free(nx->nx_strs);
+    }
+
+    free(nx);
+}
@@ -0,0 +1,11 @@
+#ifndef _NAMEIDX_H_
+#define _NAMEIDX_H_
+
+void *nameidx_new(void *);
+void *nameidx_new_from_flat(void *, const void *, size_t);
+size_t nameidx_flatten(void *, void *);
+int nameidx_lookup(void *, const char *, void ***, uint64_t **);
+int nameidx_lookup_prefix(void *, const char *, char ***);
+void nameidx_free(void *);
+
+#endif
@@ -0,0 +1,181 @@
+#include <stdint.h>
+#include <stdlib.h>
+
+struct rangetab_entry {
+    uint64_t re_lowpc;
+    uint64_t re_highpc;
+    void *re_data;
+};
+
+/* A table of [low, high) address ranges, each mapped to some piece
+ * of data. Ranges are collected with rangetab_add, and once
+ * rangetab_finalize is called, the table is sorted and every range
+ * is made to not overlap with any other, so a lookup is a binary search.
+ */
+struct rangetab {
+    struct rangetab_entry *rt_entries;
+    int rt_count;
+    int rt_capacity;
+    int rt_finalized;
+};
+
+struct rangetab *rangetab_new(void){
+    struct rangetab *rt = calloc(1, sizeof(struct rangetab));
+
+    return rt;
+}
+
+void rangetab_add(struct rangetab *rt, uint64_t lowpc, uint64_t highpc,
+        void *data){
+    if(!rt || lowpc >= highpc)
+        return;
+
+    if(rt->rt_count == rt->rt_capacity){
+        int newcap = rt->rt_capacity == 0 ? 64 : rt->rt_capacity * 2;
+
+        struct rangetab_entry *entries_rea = realloc(rt->rt_entries,
+                sizeof(struct rangetab_entry) * newcap);
+
+        rt->rt_entries = entries_rea;
+        rt->rt_capacity = newcap;
+    }
+
+    struct rangetab_entry *re = &rt->rt_entries[rt->rt_count++];
+
+    re->re_lowpc = lowpc;
+    re->re_highpc = highpc;
+    re->re_data = data;
+
+    rt->rt_finalized = 0;
+}
+
+static int rangetab_entry_cmp(const void *a, const void *b){
+    const struct rangetab_entry *ra = a;
+    const struct rangetab_entry *rb = b;
+
+    if(ra->re_lowpc < rb->re_lowpc)
+        return -1;
+    else if(ra->re_lowpc > rb->re_lowpc)
+        return 1;
+
+    /* Longer range first for the same starting address. */
+    if(ra->re_highpc > rb->re_highpc)
+        return -1;
+    else if(ra->re_highpc < rb->re_highpc)
+        return 1;
+
+    return 0;
+}
+
+void rangetab_finalize(struct rangetab *rt){
+    if(!rt || rt->rt_finalized)
+        return;
+
+    if(rt->rt_count == 0){
+        rt->rt_finalized = 1;
+        return;
+    }
+
+    qsort(rt->rt_entries, rt->rt_count, sizeof(struct rangetab_entry),
+            rangetab_entry_cmp);
+
+    /* Clip overlapping ranges so every address maps to exactly one
+     * entry. Whoever claimed an address first keeps it. Adjacent ranges
+     * which map to the same data are merged.
+     */
+    int out = 0;
+
+    for(int i=0; i<rt->rt_count; i++){
+        struct rangetab_entry cur = rt->rt_entries[i];
+
+        if(out > 0){
+            struct rangetab_entry *last = &rt->rt_entries[out - 1];
+
+            if(cur.re_lowpc < last->re_highpc){
+                if(cur.re_highpc <= last->re_highpc)
+                    continue;
+
+                cur.re_lowpc = last->re_highpc;
+            }
+
+            if(cur.re_lowpc == last->re_highpc &&
+                    cur.re_data == last->re_data){
+                last->re_highpc = cur.re_highpc;
+                continue;
+            }
+        }
+
+        rt->rt_entries[out++] = cur;
+    }
+
+    rt->rt_count = out;
+
+    struct rangetab_entry *entries_rea = realloc(rt->rt_entries,
+            sizeof(struct rangetab_entry) * rt->rt_count);
+
+    rt->rt_entries = entries_rea;
+    rt->rt_capacity = rt->rt_count;
+    rt->rt_finalized = 1;
+}
+
+void *rangetab_lookup(struct rangetab *rt, uint64_t pc){
+    if(!rt || !rt->rt_finalized || rt->rt_count == 0)
+        return NULL;
+
+    /* Find the last range which starts at or before pc. */
+    int lo = 0, hi = rt->rt_count - 1, found = -1;
+
+    while(lo <= hi){
+        int mid = lo + ((hi - lo) / 2);
+
+        if(rt->rt_entries[mid].re_lowpc <= pc){
+            found = mid;
+            lo = mid + 1;
+        }
+        else{
+            hi = mid - 1;
+        }
+    }
+
+    if(found == -1 || pc >= rt->rt_entries[found].re_highpc)
+        return NULL;
+
+    return rt->rt_entries[found].re_data;
+}
+
+/* Get the range at idx. Once the table is finalized, ranges are
+ * in ascending order.
+ */
+int rangetab_get(struct rangetab *rt, int idx, uint64_t *lowpcout,
+        uint64_t *highpcout, void **dataout){
+    if(!rt || idx < 0 || idx >= rt->rt_count)
+        return 1;
+
+    struct rangetab_entry *re = &rt->rt_entries[idx];
+
+    if(lowpcout)
+        *lowpcout = re->re_lowpc;
+
+    if(highpcout)
+        *highpcout = re->re_highpc;
+
+    if(dataout)
+        *dataout = re->re_data;
+
+    return 0;
+}
+
+int rangetab_count(struct rangetab *rt){
+    if(!rt)
+        return 0;
+
+    return rt->rt_count;
+}
+
+void rangetab_free(struct rangetab *rt){
+    if(!rt)
+        return;
+
+    free(rt->rt_entries);
+    free(rt);
+}
@@ -0,0 +1,12 @@
+#ifndef _RANGETAB_H_
+#define _RANGETAB_H_
+
+void *rangetab_new(void);
+void rangetab_add(void *, uint64_t, uint64_t, void *);
+void rangetab_finalize(void *);
+int rangetab_get(void *, int, uint64_t *, uint64_t *, void **);
+void *rangetab_lookup(void *, uint64_t);
+int rangetab_count(void *);
+void rangetab_free(void *);
+
+#endif
@@ -0,0 +1,188 @@
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+/* Something which was unpublished, and can be freed once no reader
+ * could still be looking at it.
+ */
+struct rcu_retired {
+    void *rt_ptr;
+    void (*rt_free)(void *);
+
+    /* The epoch it was retired in */
+    uint64_t rt_epoch;
+
+    struct rcu_retired *rt_next;
+};
+
+/* One per thread which has ever entered a read section */
+struct rcu_reader {
+    /* The epoch this thread's outermost read section started in, or
+     * zero if it isn't in one.
+     */
+    uint64_t rr_epoch;
+    int rr_depth;
+
+    /* Set when the thread exits */
+    int rr_dead;
+
+    struct rcu_reader *rr_next;
+};
+
+/* Readers never take a lock. They publish which epoch they started
+ * in, and anything retired in that epoch or after it stays around
+ * until they're done.
+ */
+static uint64_t RCU_EPOCH = 1;
+
+static struct rcu_reader *RCU_READERS = NULL;
+static struct rcu_retired *RCU_RETIRED = NULL;
+
+static pthread_mutex_t RCU_LOCK = PTHREAD_MUTEX_INITIALIZER;
+
+static pthread_key_t RCU_KEY;
+static pthread_once_t RCU_ONCE = PTHREAD_ONCE_INIT;
+
+static __thread struct rcu_reader *CUR_READER = NULL;
+
+static void rcu_reader_exit(void *arg){
+    struct rcu_reader *rr = arg;
+
+    __atomic_store_n(&rr->rr_epoch, 0, __ATOMIC_RELEASE);
+    __atomic_store_n(&rr->rr_dead, 1, __ATOMIC_RELEASE);
+}
+
+static void rcu_init_key(void){
+    pthread_key_create(&RCU_KEY, rcu_reader_exit);
+}
+
+static struct rcu_reader *rcu_get_reader(void){
+    if(CUR_READER)
+        return CUR_READER;
+
+    pthread_once(&RCU_ONCE, rcu_init_key);
+
+    struct rcu_reader *rr = calloc(1, sizeof(struct rcu_reader));
+
+    pthread_mutex_lock(&RCU_LOCK);
+    rr->rr_next = RCU_READERS;
+    RCU_READERS = rr;
+    pthread_mutex_unlock(&RCU_LOCK);
+
+    pthread_setspecific(RCU_KEY, rr);
+
+    CUR_READER = rr;
+
+    return rr;
+}
+
+/* Free whatever no reader can still be looking at. */
+void rcu_reclaim(void){
+    pthread_mutex_lock(&RCU_LOCK);
+
+    uint64_t oldest = UINT64_MAX;
+    struct rcu_reader **rrp = &RCU_READERS;
+
+    while(*rrp){
+        struct rcu_reader *rr = *rrp;
+
+        if(__atomic_load_n(&rr->rr_dead, __ATOMIC_ACQUIRE)){
+            *rrp = rr->rr_next;
+            free(rr);
+            continue;
+        }
+
+        uint64_t epoch = __atomic_load_n(&rr->rr_epoch, __ATOMIC_SEQ_CST);
+
+        if(epoch != 0 && epoch < oldest)
+            oldest = epoch;
+
+        rrp = &rr->rr_next;
+    }
+
+    /* A reader which started in an epoch after something was retired
+     * started after it was unpublished, so it can't see it.
+     */
+    struct rcu_retired *freeable = NULL;
+    struct rcu_retired **rtp = &RCU_RETIRED;
+
+    while(*rtp){
+        struct rcu_retired *rt = *rtp;
+
+        if(rt->rt_epoch < oldest){
+            /* Readers check RCU_RETIRED without the lock */
+            __atomic_store_n(rtp, rt->rt_next, __ATOMIC_RELAXED);
+            rt->rt_next = freeable;
+            freeable = rt;
+            continue;
+        }
+
+        rtp = &rt->rt_next;
+    }
+
+    pthread_mutex_unlock(&RCU_LOCK);
+
+    while(freeable){
+        struct rcu_retired *next = freeable->rt_next;
+
+        freeable->rt_free(freeable->rt_ptr);
+        free(freeable);
+
+        freeable = next;
+    }
+}
+
+/* Read sections can be nested. Anything a reader finds through a
+ * published pointer stays valid until its outermost read section ends.
+ */
+void rcu_read_lock(void){
+    struct rcu_reader *rr = rcu_get_reader();
+
+    if(rr->rr_depth++ > 0)
+        return;
+
+    uint64_t epoch = __atomic_load_n(&RCU_EPOCH, __ATOMIC_SEQ_CST);
+
+    __atomic_store_n(&rr->rr_epoch, epoch, __ATOMIC_SEQ_CST);
+
+    /* Nothing this reader loads from here on can come from before
+     * it said which epoch it's in.
+     */
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+void rcu_read_unlock(void){
+    struct rcu_reader *rr = rcu_get_reader();
+
+    if(rr->rr_depth == 0 || --rr->rr_depth > 0)
+        return;
+
+    __atomic_store_n(&rr->rr_epoch, 0, __ATOMIC_RELEASE);
+
+    /* This reader may have been the last one holding something up */
+    if(__atomic_load_n(&RCU_RETIRED, __ATOMIC_RELAXED))
+        rcu_reclaim();
+}
+
+/* Free ptr with freefn once every reader which could have seen it is
+ * done. It must already be unpublished.
+ */
+void rcu_retire(void *ptr, void (*freefn)(void *)){
+    if(!ptr)
+        return;
+
+    struct rcu_retired *rt = malloc(sizeof(struct rcu_retired));
+
+    rt->rt_ptr = ptr;
+    rt->rt_free = freefn;
+
+    pthread_mutex_lock(&RCU_LOCK);
+
+    rt->rt_epoch = __atomic_fetch_add(&RCU_EPOCH, 1, __ATOMIC_SEQ_CST);
+    rt->rt_next = RCU_RETIRED;
+    __atomic_store_n(&RCU_RETIRED, rt, __ATOMIC_RELAXED);
+
+    pthread_mutex_unlock(&RCU_LOCK);
+
+    rcu_reclaim();
+}
@@ -0,0 +1,9 @@
+#ifndef _RCU_H_
+#define _RCU_H_
+
+void rcu_read_lock(void);
+void rcu_read_unlock(void);
+void rcu_reclaim(void);
+void rcu_retire(void *, void (*)(void *));
+
+#endif
@@ -12,10 +12,20 @@
 #include "common.h"
 #include "compunit.h"
 #include "die.h"
+#include "dwarfobj.h"
+#include "imagemgr.h"
+#include "machosym.h"
+#include "nameidx.h"
+#include "rangetab.h"
+#include "rcu.h"
+#include "symcache.h"
 #include "symerr.h"
+#include "typereg.h"
 
-int sym_init_with_dwarf_file(const char *file, dwarfinfo_t **_dwarfinfo,
-        sym_error_t *e){
+void sym_end(dwarfinfo_t **);
+
+static int sym_init_internal(const char *file, int lazy, int nworkers,
+        dwarfinfo_t **_dwarfinfo, sym_error_t *e){
     int fd = open(file, O_RDONLY);
 
     if(fd < 0){
@@ -24,27 +34,145 @@ int sym_init_with_dwarf_file(const char *file, dwarfinfo_t **_dwarfinfo,
     }
 
     dwarfinfo_t *dwarfinfo = calloc(1, sizeof(dwarfinfo_t));
-    Dwarf_Error d_error = NULL;
-    int ret = dwarf_init(fd, DW_DLC_READ, NULL, NULL,
-            &dwarfinfo->di_dbg, &d_error);
 
-    if(ret != DW_DLV_OK){
+    /* Prefer handing libdwarf sections straight from a mapping of
+     * the file so it doesn't read them into memory of its own.
+     */
+    dwarfinfo->di_dwarfobj = dwarfobj_new(fd);
+
+    int ret;
+
+    if(dwarfinfo->di_dwarfobj)
+        ret = dwarfobj_init_dbg(dwarfinfo->di_dwarfobj, &dwarfinfo->di_dbg);
+    else{
+        Dwarf_Error d_error = NULL;
+
+        ret = dwarf_init(fd, DW_DLC_READ, NULL, NULL, &dwarfinfo->di_dbg,
+                &d_error) != DW_DLV_OK;
+    }
+
+    if(ret){
         errset(e, SYM_ERROR_KIND, SYM_DWARF_INIT_FAILED);
+        dwarfobj_free(dwarfinfo->di_dwarfobj);
+        close(fd);
         free(dwarfinfo);
         return 1;
     }
 
+    pthread_mutex_init(&dwarfinfo->di_buildlock, NULL);
+
+    dwarfinfo->di_fd = fd;
     dwarfinfo->di_compunits = linkedlist_new();
+    dwarfinfo->di_typereg = typereg_new();
     dwarfinfo->di_numcompunits = 0;
 
-    if(cu_load_compilation_units(dwarfinfo, e))
+    /* With an up to date symbol cache, nothing has to be read out of
+     * the dSYM up front, so compilation units are loaded lazily
+     * no matter how we were asked to load them.
+     */
+    void *symcache = symcache_open(fd);
+
+    if(symcache){
+        dwarfinfo->di_symcache = symcache;
+        dwarfinfo->di_lazy = 1;
+
+        if(cu_load_compilation_units_from_cache(dwarfinfo, symcache, e)){
+            sym_end(&dwarfinfo);
+            return 1;
+        }
+
+        const void *flatnameidx = NULL;
+        size_t flatnameidxlen = 0;
+
+        if(!symcache_get_nameidx(symcache, &flatnameidx, &flatnameidxlen)){
+            dwarfinfo->di_nameidx = nameidx_new_from_flat(dwarfinfo,
+                    flatnameidx, flatnameidxlen);
+        }
+
+        if(!dwarfinfo->di_nameidx)
+            dwarfinfo->di_nameidx = nameidx_new(dwarfinfo);
+
+        *_dwarfinfo = dwarfinfo;
+
+        return 0;
+    }
+
+    /* For a parallel load, only root DIEs are created here and the
+     * loader threads build everything else.
+     */
+    dwarfinfo->di_lazy = lazy || nworkers > 0;
+
+    if(cu_load_compilation_units(dwarfinfo, e)){
+        sym_end(&dwarfinfo);
         return 1;
+    }
+
+    if(nworkers > 0){
+        int ret = cu_build_compilation_units_parallel(dwarfinfo, file,
+                nworkers, e);
+
+        dwarfinfo->di_lazy = 0;
+
+        if(ret){
+            sym_end(&dwarfinfo);
+            return 1;
+        }
+    }
+
+    dwarfinfo->di_nameidx = nameidx_new(dwarfinfo);
+
+    /* The cache is made from every DIE tree, so it's only written
+     * after a full load, when they've all been built anyway. Building
+     * them here for a lazy load would throw away the point of one.
+     * Not being able to write the cache only means the next load
+     * won't be any faster.
+     */
+    if(!lazy)
+        symcache_write(dwarfinfo, fd);
 
     *_dwarfinfo = dwarfinfo;
 
     return 0;
 }
 
+int sym_init_with_dwarf_file(const char *file, dwarfinfo_t **_dwarfinfo,
+        sym_error_t *e){
+    return sym_init_internal(file, 0, 0, _dwarfinfo, e);
+}
+
+int sym_init_with_dwarf_file_lazy(const char *file,
+        dwarfinfo_t **_dwarfinfo, sym_error_t *e){
+    return sym_init_internal(file, 1, 0, _dwarfinfo, e);
+}
+
+int sym_init_with_dwarf_file_parallel(const char *file, int nworkers,
+        dwarfinfo_t **_dwarfinfo, sym_error_t *e){
+    if(nworkers <= 0){
+        long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+        nworkers = ncpu > 0 ? (int)ncpu : 1;
+    }
+
+    return sym_init_internal(file, 0, nworkers, _dwarfinfo, e);
+}
+
+int sym_set_memory_budget(dwarfinfo_t *dwarfinfo, size_t budget,
+        sym_error_t *e){
+    if(!dwarfinfo){
+        errset(e, GENERIC_ERROR_KIND, GE_INVALID_DWARFINFO);
+        return 1;
+    }
+
+    pthread_mutex_lock(&dwarfinfo->di_buildlock);
+
+    dwarfinfo->di_membudget = budget;
+
+    cu_evict_cold_compilation_units(dwarfinfo, NULL);
+
+    pthread_mutex_unlock(&dwarfinfo->di_buildlock);
+
+    return 0;
+}
+
 void sym_end(dwarfinfo_t **_dwarfinfo){
     if(!_dwarfinfo || !(*_dwarfinfo))
         return;
@@ -55,31 +183,99 @@ void sym_end(dwarfinfo_t **_dwarfinfo){
 
     while(current){
         void *cu = current->data;
-        void *root_die = NULL;
-
-        cu_get_root_die(cu, &root_die, NULL);
 
         current = current->next;
 
-        die_tree_free(dwarfinfo->di_dbg, root_die, 0);
         linkedlist_delete(dwarfinfo->di_compunits, cu);
         cu_free(cu, NULL);
     }
 
+    rangetab_free(dwarfinfo->di_curanges);
+    nameidx_free(dwarfinfo->di_nameidx);
+
+    /* No DIE tree points to a shared type anymore */
+    typereg_free(dwarfinfo->di_typereg);
+
+    /* Nothing can point into the cache anymore */
+    symcache_close(dwarfinfo->di_symcache);
+
+    free(dwarfinfo->di_cus);
+    free(dwarfinfo->di_curootoffs);
+
     close(dwarfinfo->di_fd);
 
     Dwarf_Error d_error = NULL;
-    int ret = dwarf_finish(dwarfinfo->di_dbg, &d_error);
+
+    if(dwarfinfo->di_dwarfobj){
+        dwarf_object_finish(dwarfinfo->di_dbg, &d_error);
+
+        for(int i=0; i<dwarfinfo->di_numworkers; i++)
+            dwarf_object_finish(dwarfinfo->di_workerdbgs[i], &d_error);
+    }
+    else{
+        dwarf_finish(dwarfinfo->di_dbg, &d_error);
+
+        for(int i=0; i<dwarfinfo->di_numworkers; i++){
+            dwarf_finish(dwarfinfo->di_workerdbgs[i], &d_error);
+            close(dwarfinfo->di_workerfds[i]);
+        }
+    }
+
+    /* Every handle reading from the mapping is gone now */
+    dwarfobj_free(dwarfinfo->di_dwarfobj);
+
+    free(dwarfinfo->di_workerdbgs);
+    free(dwarfinfo->di_workerfds);
 
     linkedlist_free(dwarfinfo->di_compunits);
+    pthread_mutex_destroy(&dwarfinfo->di_buildlock);
     free(dwarfinfo);
 }
 
+void sym_read_lock(void){
+    rcu_read_lock();
+}
+
+void sym_read_unlock(void){
+    rcu_read_unlock();
+}
+
+int sym_display_allocation_stats(dwarfinfo_t *dwarfinfo, sym_error_t *e){
+    return cu_display_allocation_stats(dwarfinfo, e);
+}
+
 int sym_display_compilation_units(dwarfinfo_t *dwarfinfo,
         sym_error_t *e){
     return cu_display_compilation_units(dwarfinfo, e);
 }
 
+int sym_get_allocation_stats(dwarfinfo_t *dwarfinfo, size_t *nallocs,
+        size_t *bytesinuse, size_t *bytesreserved, size_t *nchunks,
+        sym_error_t *e){
+    return cu_get_allocation_stats(dwarfinfo, nallocs, bytesinuse,
+            bytesreserved, nchunks, e);
+}
+
+int sym_get_type_dedup_stats(dwarfinfo_t *dwarfinfo, int *ntypesout,
+        int *nmergedout, sym_error_t *e){
+    if(!dwarfinfo){
+        errset(e, GENERIC_ERROR_KIND, GE_INVALID_DWARFINFO);
+        return 1;
+    }
+
+    if(!ntypesout || !nmergedout){
+        errset(e, GENERIC_ERROR_KIND, GE_INVALID_PARAMETER);
+        return 1;
+    }
+
+    *ntypesout = 0;
+    *nmergedout = 0;
+
+    typereg_get_stats(dwarfinfo->di_typereg, ntypesout, nmergedout);
+
+    return 0;
+}
+
 int sym_find_compilation_unit_by_name(dwarfinfo_t *dwarfinfo, void **cuout,
         char *name, sym_error_t *e){
     return cu_find_compilation_unit_by_name(dwarfinfo, cuout, name, e);
@@ -90,8 +286,8 @@ int sym_get_compilation_unit_root_die(void *cu, void **dieout,
     return cu_get_root_die(cu, dieout, e);
 }
 
-int sym_create_variable_or_parameter_die_desc(void *die, void *cu,
-        char **desc, sym_error_t *e){
+static int sym_create_variable_or_parameter_die_desc_internal(void *die,
+        void *cu, char **desc, sym_error_t *e){
     void *root_die = NULL;
     if(cu_get_root_die(cu, &root_die, e))
         return 1;
@@ -99,6 +295,22 @@ int sym_create_variable_or_parameter_die_desc(void *die, void *cu,
     return die_create_variable_or_parameter_desc(die, root_die, desc, e, 0);
 }
 
+int sym_create_variable_or_parameter_die_desc(void *die, void *cu,
+        char **desc, sym_error_t *e){
+    rcu_read_lock();
+    int ret = sym_create_variable_or_parameter_die_desc_internal(die, cu, desc,
+            e);
+    rcu_read_unlock();
+
+    return ret;
+}
+
+int sym_create_variable_or_parameter_die_value_desc(void *die,
+        uint64_t addr, int (*readmem)(void *, uint64_t, void *, size_t),
+        void *arg, int maxdepth, char **desc, sym_error_t *e){
+    return die_create_value_desc(die, addr, readmem, arg, maxdepth, desc, e);
+}
+
 void sym_display_die(void *die){
     die_display(die);
 }
@@ -107,18 +319,60 @@ void sym_display_die_tree_starting_from(void *die){
     die_display_die_tree_starting_from(die);
 }
 
+int sym_evaluate_die_location(void *die, uint64_t pc,
+        int (*readreg)(void *, int, uint64_t *),
+        int (*readmem)(void *, uint64_t, void *, size_t), void *arg,
+        int **kindsout, uint64_t **valuesout, uint64_t **sizesout,
+        int *lenout, sym_error_t *e){
+    return die_evaluate_location(die, pc, readreg, readmem, arg, kindsout,
+            valuesout, sizesout, lenout, e);
+}
+
+int sym_evaluate_die_locations(void **dies, int numdies, uint64_t pc,
+        int (*readreg)(void *, int, uint64_t *),
+        int (*readmem)(void *, uint64_t, void *, size_t), void *arg,
+        int **kindsout, uint64_t **valuesout, uint64_t **sizesout,
+        int **piececntsout, sym_error_t *e){
+    return die_evaluate_locations(dies, numdies, pc, readreg, readmem, arg,
+            kindsout, valuesout, sizesout, piececntsout, e);
+}
+
 int sym_evaluate_die_location_description(void *die, uint64_t pc,
         uint64_t *resultout, sym_error_t *e){
     return die_evaluate_location_description(die, pc, resultout, e);
 }
 
-int sym_find_die_by_name(void *cu, const char *name, void **dieout,
-        sym_error_t *e){
+static int sym_find_die_by_name_internal(void *cu, const char *name,
+        void **dieout, sym_error_t *e){
     void *root_die = NULL;
     if(cu_get_root_die(cu, &root_die, e))
         return 1;
 
+    dwarfinfo_t *dwarfinfo = NULL;
+    cu_get_dwarfinfo(cu, (void **)&dwarfinfo, NULL);
+
+    void **cus = NULL;
+    uint64_t *offs = NULL;
+    int cnt = nameidx_lookup(dwarfinfo->di_nameidx, name, &cus, &offs);
+
     void *result = NULL;
+
+    for(int i=0; i<cnt && !result; i++){
+        if(cus[i] == cu)
+            die_find_by_offset(root_die, offs[i], &result, NULL);
+    }
+
+    free(cus);
+    free(offs);
+
+    if(result){
+        *dieout = result;
+        return 0;
+    }
+
+    /* Not everything we name gets indexed, like anonymous types
+     * and lexical blocks.
+     */
     int ret = die_search(root_die, (void *)name, DIE_SEARCH_IF_NAME_MATCHES,
             &result, e);
 
@@ -126,20 +380,159 @@ int sym_find_die_by_name(void *cu, const char *name, void **dieout,
     return ret;
 }
 
-int sym_find_function_die_by_pc(void *cu, uint64_t pc, void **dieout,
+int sym_find_die_by_name(void *cu, const char *name, void **dieout,
         sym_error_t *e){
+    rcu_read_lock();
+    int ret = sym_find_die_by_name_internal(cu, name, dieout, e);
+    rcu_read_unlock();
+
+    return ret;
+}
+
+static int sym_find_dies_by_name_internal(dwarfinfo_t *dwarfinfo,
+        const char *name,
+        void ***diesout, void ***cusout, int *lenout, sym_error_t *e){
+    if(!dwarfinfo){
+        errset(e, GENERIC_ERROR_KIND, GE_INVALID_DWARFINFO);
+        return 1;
+    }
+
+    if(!name || !diesout || !lenout){
+        errset(e, GENERIC_ERROR_KIND, GE_INVALID_PARAMETER);
+        return 1;
+    }
+
+    void **cus = NULL;
+    uint64_t *offs = NULL;
+    int cnt = nameidx_lookup(dwarfinfo->di_nameidx, name, &cus, &offs);
+
+    if(cnt == 0){
+        errset(e, DIE_ERROR_KIND, DIE_DIE_NOT_FOUND);
+        return 1;
+    }
+
+    *diesout = malloc(sizeof(void *) * cnt);
+
+    if(cusout)
+        *cusout = malloc(sizeof(void *) * cnt);
+
+    *lenout = 0;
+
+    for(int i=0; i<cnt; i++){
+        void *root_die = NULL, *die = NULL;
+
+        if(cu_get_root_die(cus[i], &root_die, NULL))
+            continue;
+
+        /* Some DIEs we index aren't kept in the DIE tree */
+        if(die_find_by_offset(root_die, offs[i], &die, NULL))
+            continue;
+
+        (*diesout)[*lenout] = die;
+
+        if(cusout)
+            (*cusout)[*lenout] = cus[i];
+
+        (*lenout)++;
+    }
+
+    free(cus);
+    free(offs);
+
+    if(*lenout == 0){
+        free(*diesout);
+        *diesout = NULL;
+
+        if(cusout){
+            free(*cusout);
+            *cusout = NULL;
+        }
+
+        errset(e, DIE_ERROR_KIND, DIE_DIE_NOT_FOUND);
+        return 1;
+    }
+
+    return 0;
+}
+
+int sym_find_dies_by_name(dwarfinfo_t *dwarfinfo, const char *name,
+        void ***diesout, void ***cusout, int *lenout, sym_error_t *e){
+    rcu_read_lock();
+    int ret = sym_find_dies_by_name_internal(dwarfinfo, name, diesout, cusout,
+            lenout, e);
+    rcu_read_unlock();
+
+    return ret;
+}
+
+int sym_find_names_with_prefix(dwarfinfo_t *dwarfinfo, const char *prefix,
+        char ***namesout, int *lenout, sym_error_t *e){
+    if(!dwarfinfo){
+        errset(e, GENERIC_ERROR_KIND, GE_INVALID_DWARFINFO);
+        return 1;
+    }
+
+    if(!prefix || !namesout || !lenout){
+        errset(e, GENERIC_ERROR_KIND, GE_INVALID_PARAMETER);
+        return 1;
+    }
+
+    *lenout = nameidx_lookup_prefix(dwarfinfo->di_nameidx, prefix, namesout);
+
+    if(*lenout == 0){
+        *namesout = NULL;
+        errset(e, DIE_ERROR_KIND, DIE_DIE_NOT_FOUND);
+        return 1;
+    }
+
+    return 0;
+}
+
+static int sym_find_function_die_by_pc_internal(void *cu, uint64_t pc,
+        void **dieout, sym_error_t *e){
     void *root_die = NULL;
     if(cu_get_root_die(cu, &root_die, e))
         return 1;
 
     void *result = NULL;
-    int ret = die_search(root_die, (void *)pc, DIE_SEARCH_FUNCTION_BY_PC,
-            &result, e);
+    int ret = die_find_function_by_pc(root_die, pc, &result, e);
 
     *dieout = result;
     return ret;
 }
 
+int sym_find_function_die_by_pc(void *cu, uint64_t pc, void **dieout,
+        sym_error_t *e){
+    rcu_read_lock();
+    int ret = sym_find_function_die_by_pc_internal(cu, pc, dieout, e);
+    rcu_read_unlock();
+
+    return ret;
+}
+
+static int sym_get_scopes_at_pc_internal(dwarfinfo_t *dwarfinfo, uint64_t pc,
+        void ***scopesout, int *lenout, sym_error_t *e){
+    void *cu = NULL;
+    if(cu_find_compilation_unit_by_pc(dwarfinfo, &cu, pc, e))
+        return 1;
+
+    void *root_die = NULL;
+    if(cu_get_root_die(cu, &root_die, e))
+        return 1;
+
+    return die_get_scopes_at_pc(root_die, pc, scopesout, lenout, e);
+}
+
+int sym_get_scopes_at_pc(dwarfinfo_t *dwarfinfo, uint64_t pc,
+        void ***scopesout, int *lenout, sym_error_t *e){
+    rcu_read_lock();
+    int ret = sym_get_scopes_at_pc_internal(dwarfinfo, pc, scopesout, lenout,
+            e);
+    rcu_read_unlock();
+
+    return ret;
+}
+
 int sym_get_die_array_elem_size(void *die, uint64_t *elemszout, sym_error_t *e){
     return die_get_array_elem_size(die, elemszout, e);
 }
@@ -165,7 +558,7 @@ int sym_get_die_low_pc(void *die, uint64_t *lowpcout, sym_error_t *e){
     return die_get_low_pc(die, lowpcout, e);
 }
 
-int sym_get_die_members(void *die, void *cu, void ***membersout,
+static int sym_get_die_members_internal(void *die, void *cu, void ***membersout,
         int *membersarrlen, sym_error_t *e){
     void *root_die = NULL;
     if(cu_get_root_die(cu, &root_die, e))
@@ -174,6 +567,16 @@ int sym_get_die_members(void *die, void *cu, void ***membersout,
     return die_get_members(die, root_die, membersout, membersarrlen, e);
 }
 
+int sym_get_die_members(void *die, void *cu, void ***membersout,
+        int *membersarrlen, sym_error_t *e){
+    rcu_read_lock();
+    int ret = sym_get_die_members_internal(die, cu, membersout, membersarrlen,
+            e);
+    rcu_read_unlock();
+
+    return ret;
+}
+
 int sym_get_die_name(void *die, char **dienameout, sym_error_t *e){
     return die_get_name(die, dienameout, e);
 }
@@ -209,7 +612,7 @@ int sym_get_parent_of_die(void *die, void **parentout, sym_error_t *e){
     return die_get_parent(die, parentout, e);
 }
 
-int sym_get_variable_dies(dwarfinfo_t *dwarfinfo, uint64_t pc,
+static int sym_get_variable_dies_internal(dwarfinfo_t *dwarfinfo, uint64_t pc,
         void ***vardies, int *len, sym_error_t *e){
     void *cu = NULL;
     if(cu_find_compilation_unit_by_pc(dwarfinfo, &cu, pc, e))
@@ -219,7 +622,19 @@ int sym_get_variable_dies(dwarfinfo_t *dwarfinfo, uint64_t pc,
     if(sym_find_function_die_by_pc(cu, pc, &fxndie, e))
         return 1;
 
-    return die_get_variables(dwarfinfo->di_dbg, fxndie, vardies, len, e);
+    void *dbg = NULL;
+    cu_get_dbg(cu, &dbg, NULL);
+
+    return die_get_variables(dbg, fxndie, vardies, len, e);
+}
+
+int sym_get_variable_dies(dwarfinfo_t *dwarfinfo, uint64_t pc,
+        void ***vardies, int *len, sym_error_t *e){
+    rcu_read_lock();
+    int ret = sym_get_variable_dies_internal(dwarfinfo, pc, vardies, len, e);
+    rcu_read_unlock();
+
+    return ret;
 }
 
 int sym_is_die_a_member_of_struct_or_union(void *die, int *retval,
@@ -227,13 +642,21 @@ int sym_is_die_a_member_of_struct_or_union(void *die, int *retval,
     return die_is_member_of_struct_or_union(die, retval, e);
 }
 
-int sym_get_line_info_from_pc(dwarfinfo_t *dwarfinfo, uint64_t pc,
-        char **outsrcfilename, char **outsrcfunction,
+static int sym_get_line_info_from_pc_internal(dwarfinfo_t *dwarfinfo,
+        uint64_t pc, char **outsrcfilename, char **outsrcfunction,
         uint64_t *outsrcfilelineno, void **cudieout, sym_error_t *e){
     void *cu = NULL;
     if(cu_find_compilation_unit_by_pc(dwarfinfo, &cu, pc, e))
         return 1;
 
+    /* Without anyone wanting the CU DIE, the symbol cache can say
+     * where pc is without building the DIE tree.
+     */
+    if(!cudieout && cu_get_line_info_from_cache(cu, pc, outsrcfilename,
+                outsrcfunction, outsrcfilelineno, NULL) == 0){
+        return 0;
+    }
+
     void *root_die = NULL;
     if(cu_get_root_die(cu, &root_die, e))
         return 1;
@@ -241,11 +664,24 @@ int sym_get_line_info_from_pc(dwarfinfo_t *dwarfinfo, uint64_t pc,
     int ret = die_get_line_info_from_pc(dwarfinfo->di_dbg, root_die, pc,
             outsrcfilename, outsrcfunction, outsrcfilelineno, e);
 
-    *cudieout = root_die;
+    if(cudieout)
+        *cudieout = root_die;
+
     return 0;
 }
 
-int sym_get_pc_of_next_line(dwarfinfo_t *dwarfinfo, uint64_t pc,
+int sym_get_line_info_from_pc(dwarfinfo_t *dwarfinfo, uint64_t pc,
+        char **outsrcfilename, char **outsrcfunction,
+        uint64_t *outsrcfilelineno, void **cudieout, sym_error_t *e){
+    rcu_read_lock();
+    int ret = sym_get_line_info_from_pc_internal(dwarfinfo, pc, outsrcfilename,
+            outsrcfunction, outsrcfilelineno, cudieout, e);
+    rcu_read_unlock();
+
+    return ret;
+}
+
+static int sym_get_pc_of_next_line_internal(dwarfinfo_t *dwarfinfo, uint64_t pc,
         uint64_t *next_line_pc, void **cudieout, sym_error_t *e){
     void *cu = NULL;
     if(cu_find_compilation_unit_by_pc(dwarfinfo, &cu, pc, e))
@@ -262,8 +698,18 @@ int sym_get_pc_of_next_line(dwarfinfo_t *dwarfinfo, uint64_t pc,
     return ret;
 }
 
-int sym_get_pc_values_from_lineno(dwarfinfo_t *dwarfinfo, void *cu,
-        uint64_t lineno, uint64_t **pcs, int *len, sym_error_t *e){
+int sym_get_pc_of_next_line(dwarfinfo_t *dwarfinfo, uint64_t pc,
+        uint64_t *next_line_pc, void **cudieout, sym_error_t *e){
+    rcu_read_lock();
+    int ret = sym_get_pc_of_next_line_internal(dwarfinfo, pc, next_line_pc,
+            cudieout, e);
+    rcu_read_unlock();
+
+    return ret;
+}
+
+static int sym_get_pc_values_from_lineno_internal(dwarfinfo_t *dwarfinfo,
+        void *cu, uint64_t lineno, uint64_t **pcs, int *len, sym_error_t *e){
     if(!dwarfinfo){
         errset(e, GENERIC_ERROR_KIND, GE_INVALID_DWARFINFO);
         return 1;
@@ -277,7 +723,17 @@ int sym_get_pc_values_from_lineno(dwarfinfo_t *dwarfinfo, void *cu,
             pcs, len, e);
 }
 
-int sym_lineno_to_pc_a(dwarfinfo_t *dwarfinfo,
+int sym_get_pc_values_from_lineno(dwarfinfo_t *dwarfinfo, void *cu,
+        uint64_t lineno, uint64_t **pcs, int *len, sym_error_t *e){
+    rcu_read_lock();
+    int ret = sym_get_pc_values_from_lineno_internal(dwarfinfo, cu, lineno,
+            pcs, len, e);
+    rcu_read_unlock();
+
+    return ret;
+}
+
+static int sym_lineno_to_pc_a_internal(dwarfinfo_t *dwarfinfo,
         char *srcfilename, uint64_t *srcfilelineno, uint64_t *pcout,
         sym_error_t *e){
     void *cu = NULL;
@@ -292,7 +748,18 @@ int sym_lineno_to_pc_a(dwarfinfo_t *dwarfinfo,
             pcout, e);
 }
 
-int sym_lineno_to_pc_b(dwarfinfo_t *dwarfinfo, void *cu,
+int sym_lineno_to_pc_a(dwarfinfo_t *dwarfinfo,
+        char *srcfilename, uint64_t *srcfilelineno, uint64_t *pcout,
+        sym_error_t *e){
+    rcu_read_lock();
+    int ret = sym_lineno_to_pc_a_internal(dwarfinfo, srcfilename,
+            srcfilelineno, pcout, e);
+    rcu_read_unlock();
+
+    return ret;
+}
+
+static int sym_lineno_to_pc_b_internal(dwarfinfo_t *dwarfinfo, void *cu,
         uint64_t *srcfilelineno, uint64_t *pcout, sym_error_t *e){
     void *root_die = NULL;
     if(cu_get_root_die(cu, &root_die, e))
@@ -302,7 +769,17 @@ int sym_lineno_to_pc_b(dwarfinfo_t *dwarfinfo, void *cu,
             pcout, e);
 }
 
-int sym_pc_to_lineno_a(dwarfinfo_t *dwarfinfo, uint64_t pc,
+int sym_lineno_to_pc_b(dwarfinfo_t *dwarfinfo, void *cu,
+        uint64_t *srcfilelineno, uint64_t *pcout, sym_error_t *e){
+    rcu_read_lock();
+    int ret = sym_lineno_to_pc_b_internal(dwarfinfo, cu, srcfilelineno, pcout,
+            e);
+    rcu_read_unlock();
+
+    return ret;
+}
+
+static int sym_pc_to_lineno_a_internal(dwarfinfo_t *dwarfinfo, uint64_t pc,
         uint64_t *srcfilelineno, sym_error_t *e){
     void *cu = NULL;
     if(cu_find_compilation_unit_by_pc(dwarfinfo, &cu, pc, e))
@@ -315,8 +792,17 @@ int sym_pc_to_lineno_a(dwarfinfo_t *dwarfinfo, uint64_t pc,
     return die_pc_to_lineno(dwarfinfo->di_dbg, root_die, pc, srcfilelineno, e);
 }
 
-int sym_pc_to_lineno_b(dwarfinfo_t *dwarfinfo, void *cu, uint64_t pc,
+int sym_pc_to_lineno_a(dwarfinfo_t *dwarfinfo, uint64_t pc,
         uint64_t *srcfilelineno, sym_error_t *e){
+    rcu_read_lock();
+    int ret = sym_pc_to_lineno_a_internal(dwarfinfo, pc, srcfilelineno, e);
+    rcu_read_unlock();
+
+    return ret;
+}
+
+static int sym_pc_to_lineno_b_internal(dwarfinfo_t *dwarfinfo, void *cu,
+        uint64_t pc, uint64_t *srcfilelineno, sym_error_t *e){
     void *root_die = NULL;
     if(cu_get_root_die(cu, &root_die, e))
         return 1;
@@ -324,6 +810,253 @@ int sym_pc_to_lineno_b(dwarfinfo_t *dwarfinfo, void *cu, uint64_t pc,
     return die_pc_to_lineno(dwarfinfo->di_dbg, root_die, pc, srcfilelineno, e);
 }
 
+int sym_pc_to_lineno_b(dwarfinfo_t *dwarfinfo, void *cu, uint64_t pc,
+        uint64_t *srcfilelineno, sym_error_t *e){
+    rcu_read_lock();
+    int ret = sym_pc_to_lineno_b_internal(dwarfinfo, cu, pc, srcfilelineno, e);
+    rcu_read_unlock();
+
+    return ret;
+}
+
+static int sym_images_load_dsym(const char *file, void **dwarfinfoout){
+    return sym_init_with_dwarf_file_lazy(file, (dwarfinfo_t **)dwarfinfoout,
+            NULL);
+}
+
+static void sym_images_unload_dsym(void *dwarfinfo){
+    sym_end((dwarfinfo_t **)&dwarfinfo);
+}
+
+int sym_images_new(void **imagesout, sym_error_t *e){
+    if(!imagesout){
+        errset(e, GENERIC_ERROR_KIND, GE_INVALID_PARAMETER);
+        return 1;
+    }
+
+    *imagesout = imagemgr_new(sym_images_load_dsym, sym_images_unload_dsym);
+
+    return 0;
+}
+
+int sym_images_set_memory_reader(void *images,
+        int (*readmem)(void *, uint64_t, void *, size_t), void *arg,
+        sym_error_t *e){
+    if(!images || !readmem){
+        errset(e, GENERIC_ERROR_KIND, GE_INVALID_PARAMETER);
+        return 1;
+    }
+
+    imagemgr_set_memory_reader(images, readmem, arg);
+
+    return 0;
+}
+
+int sym_images_add(void *images, const char *path, const uint8_t *uuid,
+        uint64_t loadaddr, uint64_t slide, uint64_t size, sym_error_t *e){
+    if(!images || !path || size == 0){
+        errset(e, GENERIC_ERROR_KIND, GE_INVALID_PARAMETER);
+        return 1;
+    }
+
+    imagemgr_add(images, path, uuid, loadaddr, slide, size);
+
+    return 0;
+}
+
+int sym_images_begin_update(void *images, sym_error_t *e){
+    if(!images){
+        errset(e, GENERIC_ERROR_KIND, GE_INVALID_PARAMETER);
+        return 1;
+    }
+
+    imagemgr_begin_update(images);
+
+    return 0;
+}
+
+int sym_images_end_update(void *images, int complete, sym_error_t *e){
+    if(!images){
+        errset(e, GENERIC_ERROR_KIND, GE_INVALID_PARAMETER);
+        return 1;
+    }
+
+    imagemgr_end_update(images, complete);
+
+    return 0;
+}
+
+int sym_images_find_by_address(void *images, uint64_t addr,
+        const char **pathout, uint64_t *loadaddrout, uint64_t *slideout,
+        sym_error_t *e){
+    void *image = imagemgr_find(images, addr);
+
+    if(!image){
+        errset(e, SYM_ERROR_KIND, SYM_ADDRESS_NOT_IN_IMAGE);
+        return 1;
+    }
+
+    imagemgr_get_info(image, pathout, NULL, NULL, loadaddrout, slideout,
+            NULL);
+
+    return 0;
+}
+
+static int sym_images_set_dsym_internal(void *images, const char *imagename,
+        const char *dsympath, sym_error_t *e){
+    int count = imagemgr_count(images);
+
+    for(int i=0; i<count; i++){
+        void *image = imagemgr_get(images, i);
+        const char *path = NULL, *name = NULL;
+
+        if(!image)
+            break;
+
+        imagemgr_get_info(image, &path, &name, NULL, NULL, NULL, NULL);
+
+        if(strcmp(imagename, path) == 0 || strcmp(imagename, name) == 0){
+            imagemgr_set_dsym(images, image, dsympath);
+            return 0;
+        }
+    }
+
+    errset(e, SYM_ERROR_KIND, SYM_IMAGE_NOT_FOUND);
+    return 1;
+}
+
+/* Images can be dropped by another thread while we look through them */
+int sym_images_set_dsym(void *images, const char *imagename,
+        const char *dsympath, sym_error_t *e){
+    if(!images || !imagename || !dsympath){
+        errset(e, GENERIC_ERROR_KIND, GE_INVALID_PARAMETER);
+        return 1;
+    }
+
+    rcu_read_lock();
+    int ret = sym_images_set_dsym_internal(images, imagename, dsympath, e);
+    rcu_read_unlock();
+
+    return ret;
+}
+
+static int sym_symbolicate_address_internal(void *images, uint64_t addr,
+        const char **imagenameout, uint64_t *offsetout,
+        char **functionout, char **fileout, uint64_t *linenoout,
+        sym_error_t *e){
+    if(!imagenameout || !offsetout || !functionout || !fileout ||
+            !linenoout){
+        errset(e, GENERIC_ERROR_KIND, GE_INVALID_PARAMETER);
+        return 1;
+    }
+
+    *functionout = NULL;
+    *fileout = NULL;
+    *linenoout = 0;
+
+    void *image = imagemgr_find(images, addr);
+
+    if(!image){
+        errset(e, SYM_ERROR_KIND, SYM_ADDRESS_NOT_IN_IMAGE);
+        return 1;
+    }
+
+    uint64_t loadaddr = 0, slide = 0;
+
+    imagemgr_get_info(image, NULL, imagenameout, NULL, &loadaddr, &slide,
+            NULL);
+
+    *offsetout = addr - loadaddr;
+
+    /* Symbols only know about unslid addresses. Not finding any for
+     * this address isn't an error, we still know the image.
+     */
+    dwarfinfo_t *dwarfinfo = imagemgr_get_dwarfinfo(images, image);
+
+    if(dwarfinfo){
+        sym_get_line_info_from_pc(dwarfinfo, addr - slide, fileout,
+                functionout, linenoout, NULL, NULL);
+
+        if(*functionout)
+            return 0;
+    }
+
+    /* A function start with no name tells us nothing the image
+     * offset doesn't.
+     */
+    const char *name = NULL;
+
+    if(machosym_lookup(imagemgr_get_symtab(images, image), addr - slide,
+                &name, NULL, NULL) == 0 && name){
+        *functionout = strdup(name);
+    }
+
+    return 0;
+}
+
+/* The image's dSYM can be swapped out from under us by another thread,
+ * and the image itself dropped, so both are only looked at inside a
+ * read section.
+ */
+int sym_symbolicate_address(void *images, uint64_t addr,
+        const char **imagenameout, uint64_t *offsetout,
+        char **functionout, char **fileout, uint64_t *linenoout,
+        sym_error_t *e){
+    rcu_read_lock();
+    int ret = sym_symbolicate_address_internal(images, addr, imagenameout,
+            offsetout, functionout, fileout, linenoout, e);
+    rcu_read_unlock();
+
+    return ret;
+}
+
+static int sym_images_find_address_by_name_internal(void *images,
+        const char *name, uint64_t *addrout, sym_error_t *e){
+    int count = imagemgr_count(images);
+
+    for(int i=0; i<count; i++){
+        void *image = imagemgr_get(images, i);
+        uint64_t addr = 0, slide = 0;
+
+        if(!image)
+            break;
+
+        if(machosym_find_by_name(imagemgr_get_symtab(images, image), name,
+                    &addr) == 0){
+            imagemgr_get_info(image, NULL, NULL, NULL, NULL, &slide, NULL);
+
+            *addrout = addr + slide;
+            return 0;
+        }
+    }
+
+    errset(e, SYM_ERROR_KIND, SYM_SYMBOL_NOT_FOUND);
+    return 1;
+}
+
+int sym_images_find_address_by_name(void *images, const char *name,
+        uint64_t *addrout, sym_error_t *e){
+    if(!images || !name || !addrout){
+        errset(e, GENERIC_ERROR_KIND, GE_INVALID_PARAMETER);
+        return 1;
+    }
+
+    rcu_read_lock();
+    int ret = sym_images_find_address_by_name_internal(images, name,
+            addrout, e);
+    rcu_read_unlock();
+
+    return ret;
+}
+
+void sym_images_free(void **images){
+    if(!images || !(*images))
+        return;
+
+    imagemgr_free(*images);
+    *images = NULL;
+}
+
 const char *sym_strerror(sym_error_t e){
     return errmsg(e);
 }
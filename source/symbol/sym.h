@@ -10,19 +10,101 @@
  * what went wrong.
  * If an error is to be ignored, passing NULL in place of the error pointer
  * is always acceptable.
+ *
+ * Once a dwarfinfo is loaded, any number of threads can query it at
+ * the same time. A compilation unit which is built lazily is built on
+ * the side and swapped in, and one which is evicted is freed only after
+ * every thread which could have been looking at it is done.
  */
 
 /* General purpose functions */
+
+/* The first time a dSYM is loaded, what was indexed is saved to
+ * ~/.iosdbg/symcache, keyed by the dSYM's UUID, modification time, and
+ * size. Later loads of the same dSYM map that cache file instead of
+ * reading .debug_info, and every compilation unit is loaded lazily,
+ * regardless of which of these functions was called. An out of date
+ * cache file is ignored and replaced.
+ */
 int sym_init_with_dwarf_file(
         const char *    /* dSYM file path */, 
         void **         /* return dwarfinfo ptr */,
         void *          /* return error ptr */);
 
+/* Only the compilation unit headers, root DIEs, and address ranges
+ * are loaded here. A compilation unit's DIE tree is built the first
+ * time something needs it.
+ */
+int sym_init_with_dwarf_file_lazy(
+        const char *    /* dSYM file path */, 
+        void **         /* return dwarfinfo ptr */,
+        void *          /* return error ptr */);
+
+/* The same as sym_init_with_dwarf_file, but compilation units are built
+ * by a pool of threads, each with its own handle on the dSYM file.
+ * If the number of threads is zero or less, one per CPU is used.
+ */
+int sym_init_with_dwarf_file_parallel(
+        const char *    /* dSYM file path */, 
+        int             /* number of threads */,
+        void **         /* return dwarfinfo ptr */,
+        void *          /* return error ptr */);
+
+/* Only matters for lazily loaded dwarfinfo. Once the DIE trees which have
+ * been built take up more than this many bytes, the trees of the least
+ * recently used compilation units are freed, and any DIE from them is
+ * no longer valid. They are built again if needed. Zero means no limit,
+ * which is the default.
+ */
+int sym_set_memory_budget(
+        void *      /* dwarfinfo ptr */,
+        size_t      /* budget in bytes */,
+        void *      /* return error ptr */);
+
 void sym_end(
         void **     /* dwarfinfo ptr */);
 
+/* DIEs and names handed back by these functions point into a
+ * compilation unit's DIE tree, which could be evicted or rebuilt by
+ * another thread once the function returns. Anything which holds onto
+ * them across calls has to do so between these two. Read sections can
+ * be nested, and never block.
+ */
+void sym_read_lock(void);
+void sym_read_unlock(void);
+
 
 /* Compilation unit related functions */
+
+/* Everything under a compilation unit's root DIE is allocated from an
+ * arena owned by that compilation unit. These report how many
+ * allocations were made from the arenas of the compilation units which
+ * are currently built, how many bytes those allocations asked for, and
+ * how many bytes were actually reserved in how many chunks.
+ */
+int sym_display_allocation_stats(
+        void *      /* dwarfinfo ptr */,
+        void *      /* return error ptr */);
+
+int sym_get_allocation_stats(
+        void *      /* dwarfinfo ptr */,
+        size_t *    /* return allocation count */,
+        size_t *    /* return bytes in use */,
+        size_t *    /* return bytes reserved */,
+        size_t *    /* return chunk count */,
+        void *      /* return error ptr */);
+
+/* Types which are identical in more than one compilation unit, like
+ * those from a common header, are stored once for the whole dSYM.
+ * These report how many distinct types there are, and how many copies
+ * were merged into them, as compilation units were built.
+ */
+int sym_get_type_dedup_stats(
+        void *      /* dwarfinfo ptr */,
+        int *       /* return distinct type count */,
+        int *       /* return merged type count */,
+        void *      /* return error ptr */);
+
 int sym_display_compilation_units(
         void *      /* dwarfinfo ptr */,
         void *      /* return error ptr */);
@@ -46,12 +128,80 @@ int sym_create_variable_or_parameter_die_desc(
         char **     /* return description */,
         void *      /* return error ptr */);
 
+/* Describe a variable or parameter DIE along with its value, which lives
+ * at the given address in the target. Memory is read through the
+ * callback, which takes an address, a buffer, and a size, and returns
+ * non-zero on failure. The whole variable is read at once, and pointers
+ * to structs are followed up to the given depth, with everything at one
+ * depth read together, so even a large struct takes a few reads.
+ */
+int sym_create_variable_or_parameter_die_value_desc(
+        void *      /* die */,
+        uint64_t    /* address of value */,
+        int (*)(void *, uint64_t, void *, size_t)   /* memory callback */,
+        void *      /* callback argument */,
+        int         /* pointer depth */,
+        char **     /* return description */,
+        void *      /* return error ptr */);
+
 void sym_display_die(
         void *      /* die */);
 
 void sym_display_die_tree_starting_from(
         void *      /* die */);
 
+/* Kinds of location pieces from sym_evaluate_die_location */
+enum {
+    /* The value is the address of the piece in the target's memory */
+    SYM_LOCATION_MEMORY = 0,
+    /* The value is the DWARF number of the register holding the piece */
+    SYM_LOCATION_REGISTER,
+    /* The value is the piece itself */
+    SYM_LOCATION_VALUE,
+    /* The piece was optimized out */
+    SYM_LOCATION_UNDEFINED
+};
+
+/* Evaluate the location of a variable or parameter DIE at pc. The
+ * register callback is given a DWARF register number and the memory
+ * callback an address, a buffer, and a size. Both return non-zero on
+ * failure and can be NULL if the location doesn't need them. There's
+ * one piece for each DW_OP_piece in the location, or one piece with a
+ * size of zero, meaning the whole object, if there are none. All three
+ * arrays must be freed.
+ */
+int sym_evaluate_die_location(
+        void *      /* die */,
+        uint64_t    /* pc */,
+        int (*)(void *, int, uint64_t *)        /* register callback */,
+        int (*)(void *, uint64_t, void *, size_t)   /* memory callback */,
+        void *      /* callback argument */,
+        int **      /* return piece kinds */,
+        uint64_t ** /* return piece values */,
+        uint64_t ** /* return piece sizes in bytes */,
+        int *       /* return piece count */,
+        void *      /* return error ptr */);
+
+/* The same as sym_evaluate_die_location, but for every DIE in an array,
+ * like the one from sym_get_variable_dies. Everything the DIEs share,
+ * like their function's frame base, is only evaluated once. Pieces are
+ * put one after the other, with a piece count for each DIE, which is
+ * zero if that DIE has no location at pc. All four arrays must be freed.
+ */
+int sym_evaluate_die_locations(
+        void **     /* DIE array */,
+        int         /* DIE array len */,
+        uint64_t    /* pc */,
+        int (*)(void *, int, uint64_t *)        /* register callback */,
+        int (*)(void *, uint64_t, void *, size_t)   /* memory callback */,
+        void *      /* callback argument */,
+        int **      /* return piece kinds */,
+        uint64_t ** /* return piece values */,
+        uint64_t ** /* return piece sizes in bytes */,
+        int **      /* return piece counts, one per DIE */,
+        void *      /* return error ptr */);
+
+/* Only for locations that don't use the target's registers or memory */
 int sym_evaluate_die_location_description(
         void *      /* die */,
         uint64_t    /* pc */,
@@ -64,12 +214,48 @@ int sym_find_die_by_name(
         void **         /* return die */,
         void *          /* return error ptr */);
 
+/* Search every compilation unit for DIEs with this name. Compilation
+ * units which need to be are loaded. Both arrays must be freed,
+ * but not their contents. The compilation unit array can be NULL.
+ */
+int sym_find_dies_by_name(
+        void *          /* dwarfinfo ptr */,
+        const char *    /* name */,
+        void ***        /* return DIE array */,
+        void ***        /* return compilation unit array */,
+        int *           /* return array len */,
+        void *          /* return error ptr */);
+
+/* If pc is inside inlined code, the function it was inlined into is
+ * returned. Use sym_get_scopes_at_pc to get the inlined subroutines.
+ */
 int sym_find_function_die_by_pc(
         void *      /* compilation unit */,
         uint64_t    /* pc */,
         void **     /* return die */,
         void *      /* return error ptr */);
 
+/* Returns every distinct name that starts with the given prefix, in
+ * sorted order. The array must be freed, but not the names inside it.
+ */
+int sym_find_names_with_prefix(
+        void *          /* dwarfinfo ptr */,
+        const char *    /* prefix */,
+        char ***        /* return name array */,
+        int *           /* return name array len */,
+        void *          /* return error ptr */);
+
+/* Returns every subprogram, inlined subroutine, and lexical block DIE
+ * pc is inside of, innermost first. The array must be freed,
+ * but not its contents.
+ */
+int sym_get_scopes_at_pc(
+        void *      /* dwarfinfo ptr */,
+        uint64_t    /* pc */,
+        void ***    /* return scope DIE array */,
+        int *       /* return scope DIE array len */,
+        void *      /* return error ptr */);
+
 int sym_get_die_array_elem_size(
         void *      /* die */,
         uint64_t *  /* return array elem size */,
@@ -178,7 +364,9 @@ int sym_is_die_a_member_of_struct_or_union(
 
 /* Line related functions */
 
-/* Returns CU DIE which this line resides in */
+/* Returns CU DIE which this line resides in. If that's NULL, the
+ * answer can come from the symbol cache without building any DIEs.
+ */
 int sym_get_line_info_from_pc(
         void *      /* dwarfinfo ptr */,
         uint64_t    /* pc */,
@@ -198,7 +386,9 @@ int sym_get_pc_of_next_line(
         void **     /* return CU DIE */,
         void *      /* return error ptr */);
 
-/* Returns an array of the PC values a source line is comprised of. */
+/* Returns an array of the PC values a source line is comprised of,
+ * in ascending order. The array must be freed.
+ */
 int sym_get_pc_values_from_lineno(
         void *          /* dwarfinfo ptr */,
         void *          /* compilation unit */,
@@ -240,6 +430,109 @@ int sym_pc_to_lineno_b(
         void *      /* return error ptr */);
 
 
+/* Image related functions */
+
+/* Keeps track of every image loaded into the debuggee, each with its
+ * own load address and slide. An image's dSYM isn't loaded until
+ * an address inside of it is symbolicated.
+ */
+int sym_images_new(
+        void **     /* return images ptr */,
+        void *      /* return error ptr */);
+
+/* How to read the debuggee's memory, so images with nothing on disk,
+ * like the ones in the shared cache, still have a symbol table. The
+ * function reads size bytes at an address into a buffer and returns
+ * non-zero if it couldn't. The last parameter is passed to it as is.
+ */
+int sym_images_set_memory_reader(
+        void *      /* images ptr */,
+        int (*)(void *, uint64_t, void *, size_t) /* read function */,
+        void *      /* read function argument */,
+        void *      /* return error ptr */);
+
+/* The image takes up [load address, load address + size). Adding
+ * an image which was already added does nothing. The UUID can be NULL.
+ */
+int sym_images_add(
+        void *              /* images ptr */,
+        const char *        /* image path */,
+        const uint8_t *     /* image UUID */,
+        uint64_t            /* load address */,
+        uint64_t            /* slide */,
+        uint64_t            /* size */,
+        void *              /* return error ptr */);
+
+/* Start adding every image of the debuggee again, like after dyld's
+ * image list changes. Images added until sym_images_end_update are
+ * only looked up by address once it's called, so a whole image list
+ * costs one sort of the address index instead of one per image.
+ */
+int sym_images_begin_update(
+        void *      /* images ptr */,
+        void *      /* return error ptr */);
+
+/* Images which weren't added since sym_images_begin_update were unloaded
+ * by the debuggee and are dropped. If some of the debuggee's images
+ * couldn't be read, pass zero, and no image is dropped.
+ */
+int sym_images_end_update(
+        void *      /* images ptr */,
+        int         /* non-zero if every image was added */,
+        void *      /* return error ptr */);
+
+/* Returns the image an address is inside of. Nothing returned should
+ * be freed. Since the image can be dropped once the debuggee unloads
+ * it, the path is only good inside a read section.
+ */
+int sym_images_find_by_address(
+        void *          /* images ptr */,
+        uint64_t        /* address */,
+        const char **   /* return image path */,
+        uint64_t *      /* return load address */,
+        uint64_t *      /* return slide */,
+        void *          /* return error ptr */);
+
+/* Use this dSYM for the image with this name or path, instead of
+ * looking for one.
+ */
+int sym_images_set_dsym(
+        void *          /* images ptr */,
+        const char *    /* image name or path */,
+        const char *    /* dSYM file path */,
+        void *          /* return error ptr */);
+
+/* Figures out the image, function, and source line of an address in the
+ * debuggee. If the image has no dSYM, the function name comes from the
+ * image's symbol table, and there's no source file or line. If there
+ * are no symbols at all, only the image name and the offset of the
+ * address from the image's load address are returned, and the rest are
+ * NULL or zero. The function and source file names must be freed. The
+ * image name isn't, and is only good inside a read section.
+ */
+int sym_symbolicate_address(
+        void *          /* images ptr */,
+        uint64_t        /* address */,
+        const char **   /* return image name */,
+        uint64_t *      /* return offset from load address */,
+        char **         /* return function name */,
+        char **         /* return source file name */,
+        uint64_t *      /* return source line number */,
+        void *          /* return error ptr */);
+
+/* Searches the symbol table of every image for a symbol with this
+ * name, without its leading underscore. The address returned is slid.
+ */
+int sym_images_find_address_by_name(
+        void *          /* images ptr */,
+        const char *    /* symbol name */,
+        uint64_t *      /* return address */,
+        void *          /* return error ptr */);
+
+void sym_images_free(
+        void **     /* images ptr */);
+
+
 /* Error handling functions */
 const char *sym_strerror(
         sym_error_t     /* error */);
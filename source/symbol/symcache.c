@@ -0,0 +1,870 @@
+#include <fcntl.h>
+#include <mach-o/loader.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "common.h"
+#include "compunit.h"
+#include "die.h"
+#include "dwarfobj.h"
+#include "linetab.h"
+#include "nameidx.h"
+#include "rangetab.h"
+
+#define SYMCACHE_MAGIC 0x45484341434d5953ULL /* "SYMCACHE" */
+
+/* Bump this whenever the layout of anything in the cache changes */
+#define SYMCACHE_VERSION 3
+
+/* Where cache files go, relative to $HOME */
+#define SYMCACHE_DIR ".iosdbg/symcache"
+
+/* Everything in a cache file is eight byte aligned and referred to
+ * by its offset from the start of the file, so the file is used right
+ * from where it's mapped.
+ */
+struct symcache_header {
+    uint64_t sh_magic;
+    uint32_t sh_version;
+    uint32_t sh_cucnt;
+
+    /* What the cache was built from */
+    uint8_t sh_uuid[16];
+    int64_t sh_mtime;
+    uint64_t sh_dsymsize;
+
+    /* Size of the whole cache file, to catch one that got cut short */
+    uint64_t sh_cachesize;
+
+    uint64_t sh_cuoff;
+    uint64_t sh_rangeoff;
+    uint64_t sh_rangecnt;
+    uint64_t sh_nameidxoff;
+    uint64_t sh_nameidxlen;
+    uint64_t sh_fxnoff;
+    uint64_t sh_fxncnt;
+    uint64_t sh_typeoff;
+    uint64_t sh_typecnt;
+
+    /* NUL terminated names which functions and types refer to by
+     * their offset in here. Offset zero is no name.
+     */
+    uint64_t sh_stroff;
+    uint64_t sh_strlen;
+};
+
+struct symcache_cu {
+    uint64_t sc_rootoff;
+    uint64_t sc_headerlen;
+    uint64_t sc_abbrevoff;
+    uint64_t sc_nextheaderoff;
+
+    /* Flattened line table. Zero length if there isn't one. */
+    uint64_t sc_linetaboff;
+    uint64_t sc_linetablen;
+
+    uint16_t sc_addrsize;
+    uint16_t sc_pad[3];
+};
+
+struct symcache_range {
+    uint64_t sr_lowpc;
+    uint64_t sr_highpc;
+    int64_t sr_cuidx;
+};
+
+/* Sorted by low PC */
+struct symcache_fxn {
+    uint64_t sf_lowpc;
+    uint64_t sf_highpc;
+    uint64_t sf_dieoff;
+    uint64_t sf_nameoff;
+};
+
+/* Sorted by DIE offset */
+struct symcache_type {
+    uint64_t st_dieoff;
+    uint64_t st_basedieoff;
+    uint64_t st_bytesize;
+    uint64_t st_arrmembsz;
+    uint64_t st_nameoff;
+    uint32_t st_class;
+    uint16_t st_tag;
+    uint16_t st_encoding;
+};
+
+struct symcache {
+    void *sc_map;
+    size_t sc_mapsize;
+
+    struct symcache_header *sc_header;
+    struct symcache_cu *sc_cus;
+    struct symcache_range *sc_ranges;
+    struct symcache_fxn *sc_fxns;
+    struct symcache_type *sc_types;
+    const char *sc_strs;
+};
+
+/* What a cache file is keyed by */
+struct symcache_key {
+    uint8_t sk_uuid[16];
+    int64_t sk_mtime;
+    uint64_t sk_dsymsize;
+};
+
+/* Read the LC_UUID of the Mach-O at offset off in fd. */
+static int symcache_read_macho_uuid(int fd, off_t off, uint8_t *uuid){
+    struct mach_header_64 hdr = {0};
+
+    if(pread(fd, &hdr, sizeof(hdr), off) != sizeof(hdr))
+        return 1;
+
+    size_t hdrsz;
+
+    if(hdr.magic == MH_MAGIC_64)
+        hdrsz = sizeof(struct mach_header_64);
+    else if(hdr.magic == MH_MAGIC)
+        hdrsz = sizeof(struct mach_header);
+    else
+        return 1;
+
+    if(hdr.sizeofcmds == 0 || hdr.sizeofcmds > (64 * 1024 * 1024))
+        return 1;
+
+    uint8_t *cmds = malloc(hdr.sizeofcmds);
+
+    if(pread(fd, cmds, hdr.sizeofcmds, off + hdrsz) != hdr.sizeofcmds){
+        free(cmds);
+        return 1;
+    }
+
+    uint32_t cmdoff = 0;
+
+    for(uint32_t i=0; i<hdr.ncmds; i++){
+        if(cmdoff + sizeof(struct load_command) > hdr.sizeofcmds)
+            break;
+
+        struct load_command *lc = (struct load_command *)(cmds + cmdoff);
+
+        if(lc->cmdsize < sizeof(struct load_command) ||
+                cmdoff + lc->cmdsize > hdr.sizeofcmds){
+            break;
+        }
+
+        if(lc->cmd == LC_UUID && lc->cmdsize >= sizeof(struct uuid_command)){
+            memcpy(uuid, ((struct uuid_command *)lc)->uuid, 16);
+            free(cmds);
+            return 0;
+        }
+
+        cmdoff += lc->cmdsize;
+    }
+
+    free(cmds);
+
+    return 1;
+}
+
+static int symcache_get_key(int fd, struct symcache_key *key){
+    struct stat st;
+
+    if(fstat(fd, &st))
+        return 1;
+
+    memset(key, 0, sizeof(struct symcache_key));
+
+    key->sk_mtime = (int64_t)st.st_mtime;
+    key->sk_dsymsize = (uint64_t)st.st_size;
+
+    /* For a universal dSYM, the slice dwarfobj reads is what's used.
+     * The fat header and its slices are at the start of the file.
+     */
+    uint8_t hdr[4096];
+    ssize_t hdrsize = pread(fd, hdr, sizeof(hdr), 0);
+    uint64_t sliceoff, slicesize;
+
+    if(hdrsize < 0 || dwarfobj_find_slice(hdr, hdrsize, key->sk_dsymsize,
+                &sliceoff, &slicesize)){
+        return 1;
+    }
+
+    return symcache_read_macho_uuid(fd, sliceoff, key->sk_uuid);
+}
+
+/* The cache file for key goes in $HOME/.iosdbg/symcache, named after
+ * the dSYM's UUID. The returned path must be freed.
+ */
+static char *symcache_path(struct symcache_key *key, int create){
+    char *home = getenv("HOME");
+
+    if(!home)
+        return NULL;
+
+    char dir[1024];
+
+    snprintf(dir, sizeof(dir), "%s/.iosdbg", home);
+
+    if(create)
+        mkdir(dir, 0755);
+
+    snprintf(dir, sizeof(dir), "%s/%s", home, SYMCACHE_DIR);
+
+    if(create)
+        mkdir(dir, 0755);
+
+    const uint8_t *u = key->sk_uuid;
+    char *path = malloc(strlen(dir) + 64);
+
+    sprintf(path, "%s/%02X%02X%02X%02X-%02X%02X-%02X%02X-%02X%02X-"
+            "%02X%02X%02X%02X%02X%02X", dir,
+            u[0], u[1], u[2], u[3], u[4], u[5], u[6], u[7],
+            u[8], u[9], u[10], u[11], u[12], u[13], u[14], u[15]);
+
+    return path;
+}
+
+/* Is [off, off + len) inside the cache file and eight byte aligned? */
+static int symcache_in_bounds(struct symcache *sc, uint64_t off,
+        uint64_t len){
+    if(off % 8 != 0)
+        return 0;
+
+    return off <= sc->sc_mapsize && len <= sc->sc_mapsize - off;
+}
+
+static int symcache_validate(struct symcache *sc, struct symcache_key *key){
+    if(sc->sc_mapsize < sizeof(struct symcache_header))
+        return 1;
+
+    struct symcache_header *sh = sc->sc_header;
+
+    if(sh->sh_magic != SYMCACHE_MAGIC || sh->sh_version != SYMCACHE_VERSION)
+        return 1;
+
+    /* Rebuilding a dSYM always changes its UUID, but copying one over
+     * another with the same UUID could still change its contents.
+     */
+    if(memcmp(sh->sh_uuid, key->sk_uuid, 16) != 0 ||
+            sh->sh_mtime != key->sk_mtime ||
+            sh->sh_dsymsize != key->sk_dsymsize ||
+            sh->sh_cachesize != sc->sc_mapsize){
+        return 1;
+    }
+
+    if(!symcache_in_bounds(sc, sh->sh_cuoff,
+                sizeof(struct symcache_cu) * (uint64_t)sh->sh_cucnt) ||
+            sh->sh_rangecnt > sc->sc_mapsize ||
+            !symcache_in_bounds(sc, sh->sh_rangeoff,
+                sizeof(struct symcache_range) * sh->sh_rangecnt) ||
+            !symcache_in_bounds(sc, sh->sh_nameidxoff, sh->sh_nameidxlen) ||
+            sh->sh_fxncnt > sc->sc_mapsize ||
+            !symcache_in_bounds(sc, sh->sh_fxnoff,
+                sizeof(struct symcache_fxn) * sh->sh_fxncnt) ||
+            sh->sh_typecnt > sc->sc_mapsize ||
+            !symcache_in_bounds(sc, sh->sh_typeoff,
+                sizeof(struct symcache_type) * sh->sh_typecnt) ||
+            !symcache_in_bounds(sc, sh->sh_stroff, sh->sh_strlen)){
+        return 1;
+    }
+
+    sc->sc_strs = (const char *)sc->sc_map + sh->sh_stroff;
+
+    /* So no name can run off the end */
+    if(sh->sh_strlen == 0 || sc->sc_strs[sh->sh_strlen - 1] != '\0')
+        return 1;
+
+    sc->sc_cus = (struct symcache_cu *)((uint8_t *)sc->sc_map + sh->sh_cuoff);
+    sc->sc_ranges = (struct symcache_range *)((uint8_t *)sc->sc_map +
+            sh->sh_rangeoff);
+    sc->sc_fxns = (struct symcache_fxn *)((uint8_t *)sc->sc_map +
+            sh->sh_fxnoff);
+    sc->sc_types = (struct symcache_type *)((uint8_t *)sc->sc_map +
+            sh->sh_typeoff);
+
+    for(uint32_t i=0; i<sh->sh_cucnt; i++){
+        struct symcache_cu *scu = &sc->sc_cus[i];
+
+        if(!symcache_in_bounds(sc, scu->sc_linetaboff, scu->sc_linetablen))
+            return 1;
+    }
+
+    return 0;
+}
+
+/* Map the cache file for the dSYM open at fd. Returns NULL if there
+ * isn't one, or if it's out of date.
+ */
+struct symcache *symcache_open(int fd){
+    struct symcache_key key;
+
+    if(symcache_get_key(fd, &key))
+        return NULL;
+
+    char *path = symcache_path(&key, 0);
+
+    if(!path)
+        return NULL;
+
+    int cfd = open(path, O_RDONLY);
+
+    free(path);
+
+    if(cfd < 0)
+        return NULL;
+
+    struct stat st;
+
+    if(fstat(cfd, &st) || st.st_size <= 0){
+        close(cfd);
+        return NULL;
+    }
+
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, cfd, 0);
+
+    /* The mapping stays valid after the descriptor is closed */
+    close(cfd);
+
+    if(map == MAP_FAILED)
+        return NULL;
+
+    struct symcache *sc = calloc(1, sizeof(struct symcache));
+
+    sc->sc_map = map;
+    sc->sc_mapsize = st.st_size;
+    sc->sc_header = map;
+
+    if(symcache_validate(sc, &key)){
+        munmap(map, st.st_size);
+        free(sc);
+        return NULL;
+    }
+
+    return sc;
+}
+
+int symcache_cu_count(struct symcache *sc){
+    if(!sc)
+        return 0;
+
+    return sc->sc_header->sh_cucnt;
+}
+
+int symcache_get_cu(struct symcache *sc, int idx, uint64_t *rootoffout,
+        uint64_t *headerlenout, uint64_t *abbrevoffout,
+        unsigned short *addrsizeout, uint64_t *nextheaderoffout,
+        const void **linetabout, size_t *linetablenout){
+    if(!sc || idx < 0 || idx >= (int)sc->sc_header->sh_cucnt)
+        return 1;
+
+    struct symcache_cu *scu = &sc->sc_cus[idx];
+
+    *rootoffout = scu->sc_rootoff;
+    *headerlenout = scu->sc_headerlen;
+    *abbrevoffout = scu->sc_abbrevoff;
+    *addrsizeout = scu->sc_addrsize;
+    *nextheaderoffout = scu->sc_nextheaderoff;
+
+    if(scu->sc_linetablen == 0){
+        *linetabout = NULL;
+        *linetablenout = 0;
+    }
+    else{
+        *linetabout = (uint8_t *)sc->sc_map + scu->sc_linetaboff;
+        *linetablenout = scu->sc_linetablen;
+    }
+
+    return 0;
+}
+
+int symcache_range_count(struct symcache *sc){
+    if(!sc)
+        return 0;
+
+    return (int)sc->sc_header->sh_rangecnt;
+}
+
+int symcache_get_range(struct symcache *sc, int idx, uint64_t *lowpcout,
+        uint64_t *highpcout, int *cuidxout){
+    if(!sc || idx < 0 || (uint64_t)idx >= sc->sc_header->sh_rangecnt)
+        return 1;
+
+    struct symcache_range *sr = &sc->sc_ranges[idx];
+
+    *lowpcout = sr->sr_lowpc;
+    *highpcout = sr->sr_highpc;
+    *cuidxout = (int)sr->sr_cuidx;
+
+    return 0;
+}
+
+int symcache_get_nameidx(struct symcache *sc, const void **nameidxout,
+        size_t *lenout){
+    if(!sc || sc->sc_header->sh_nameidxlen == 0)
+        return 1;
+
+    *nameidxout = (uint8_t *)sc->sc_map + sc->sc_header->sh_nameidxoff;
+    *lenout = sc->sc_header->sh_nameidxlen;
+
+    return 0;
+}
+
+static const char *symcache_str(struct symcache *sc, uint64_t off){
+    if(off == 0 || off >= sc->sc_header->sh_strlen)
+        return NULL;
+
+    return sc->sc_strs + off;
+}
+
+/* Find the function pc is inside of without building the DIE tree
+ * it's in. The name points into the cache.
+ */
+int symcache_find_function(struct symcache *sc, uint64_t pc,
+        struct fxnrange *fxnout){
+    if(!sc || !fxnout)
+        return 1;
+
+    /* Last function which starts at or before pc */
+    uint64_t lo = 0, hi = sc->sc_header->sh_fxncnt;
+
+    while(lo < hi){
+        uint64_t mid = lo + ((hi - lo) / 2);
+
+        if(sc->sc_fxns[mid].sf_lowpc <= pc)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    if(lo == 0)
+        return 1;
+
+    struct symcache_fxn *sf = &sc->sc_fxns[lo - 1];
+
+    if(pc >= sf->sf_highpc)
+        return 1;
+
+    const char *name = symcache_str(sc, sf->sf_nameoff);
+
+    if(!name)
+        return 1;
+
+    fxnout->fr_lowpc = sf->sf_lowpc;
+    fxnout->fr_highpc = sf->sf_highpc;
+    fxnout->fr_dieoffset = sf->sf_dieoff;
+    fxnout->fr_name = name;
+
+    return 0;
+}
+
+/* Get what resolving the type whose DIE is at dieoff came up with
+ * last time, so it doesn't have to be resolved with libdwarf again.
+ * The name points into the cache.
+ */
+int symcache_find_type(struct symcache *sc, uint64_t dieoff,
+        struct typesummary *typeout){
+    if(!sc || !typeout)
+        return 1;
+
+    uint64_t lo = 0, hi = sc->sc_header->sh_typecnt;
+
+    while(lo < hi){
+        uint64_t mid = lo + ((hi - lo) / 2);
+
+        if(sc->sc_types[mid].st_dieoff < dieoff)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    if(lo == sc->sc_header->sh_typecnt ||
+            sc->sc_types[lo].st_dieoff != dieoff){
+        return 1;
+    }
+
+    struct symcache_type *st = &sc->sc_types[lo];
+
+    typeout->ts_dieoffset = st->st_dieoff;
+    typeout->ts_basedieoffset = st->st_basedieoff;
+    typeout->ts_bytesize = st->st_bytesize;
+    typeout->ts_arrmembsz = st->st_arrmembsz;
+    typeout->ts_name = symcache_str(sc, st->st_nameoff);
+    typeout->ts_tag = st->st_tag;
+    typeout->ts_encoding = st->st_encoding;
+    typeout->ts_class = st->st_class;
+
+    return 0;
+}
+
+void symcache_close(struct symcache *sc){
+    if(!sc)
+        return;
+
+    munmap(sc->sc_map, sc->sc_mapsize);
+    free(sc);
+}
+
+struct symcache_buf {
+    uint8_t *sb_data;
+    size_t sb_len;
+    size_t sb_cap;
+};
+
+/* Make room for sz more bytes, eight byte aligned, and return the
+ * offset of that room. sb_data can move.
+ */
+static size_t symcache_buf_reserve(struct symcache_buf *sb, size_t sz){
+    size_t off = (sb->sb_len + 7) & ~(size_t)7;
+
+    if(off + sz > sb->sb_cap){
+        size_t newcap = sb->sb_cap == 0 ? (64 * 1024) : sb->sb_cap;
+
+        while(off + sz > newcap)
+            newcap *= 2;
+
+        uint8_t *data_rea = realloc(sb->sb_data, newcap);
+
+        sb->sb_data = data_rea;
+        sb->sb_cap = newcap;
+    }
+
+    memset(sb->sb_data + sb->sb_len, 0, (off + sz) - sb->sb_len);
+    sb->sb_len = off + sz;
+
+    return off;
+}
+
+struct symcache_cuent {
+    void *ce_cu;
+    int ce_idx;
+};
+
+static int symcache_cuent_cmp(const void *a, const void *b){
+    const struct symcache_cuent *ca = a;
+    const struct symcache_cuent *cb = b;
+
+    if(ca->ce_cu < cb->ce_cu)
+        return -1;
+    else if(ca->ce_cu > cb->ce_cu)
+        return 1;
+
+    return 0;
+}
+
+/* Add a name to the string table and return its offset in it. Names
+ * aren't aligned, so they're packed together.
+ */
+static uint64_t symcache_add_str(struct symcache_buf *sb, const char *str){
+    if(!str)
+        return 0;
+
+    size_t len = strlen(str) + 1;
+
+    if(sb->sb_len + len > sb->sb_cap){
+        size_t newcap = sb->sb_cap == 0 ? (64 * 1024) : sb->sb_cap;
+
+        while(sb->sb_len + len > newcap)
+            newcap *= 2;
+
+        uint8_t *data_rea = realloc(sb->sb_data, newcap);
+
+        sb->sb_data = data_rea;
+        sb->sb_cap = newcap;
+    }
+
+    uint64_t off = sb->sb_len;
+
+    memcpy(sb->sb_data + off, str, len);
+    sb->sb_len += len;
+
+    return off;
+}
+
+static int symcache_fxn_cmp(const void *a, const void *b){
+    const struct symcache_fxn *fa = a;
+    const struct symcache_fxn *fb = b;
+
+    if(fa->sf_lowpc < fb->sf_lowpc)
+        return -1;
+    else if(fa->sf_lowpc > fb->sf_lowpc)
+        return 1;
+
+    return 0;
+}
+
+static int symcache_type_cmp(const void *a, const void *b){
+    const struct symcache_type *ta = a;
+    const struct symcache_type *tb = b;
+
+    if(ta->st_dieoff < tb->st_dieoff)
+        return -1;
+    else if(ta->st_dieoff > tb->st_dieoff)
+        return 1;
+
+    return 0;
+}
+
+/* Save what dwarfinfo has indexed to the cache file for the dSYM open
+ * at fd. Functions and types come from the DIE trees, so this is only
+ * for after a full load, once every tree is built. The file is written
+ * somewhere else first and renamed, so a half written cache file is
+ * never seen.
+ */
+int symcache_write(dwarfinfo_t *dwarfinfo, int fd){
+    if(!dwarfinfo)
+        return 1;
+
+    struct symcache_key key;
+
+    if(symcache_get_key(fd, &key))
+        return 1;
+
+    char *path = symcache_path(&key, 1);
+
+    if(!path)
+        return 1;
+
+    int cucnt = dwarfinfo->di_numcompunits;
+
+    struct symcache_buf sb = {0};
+
+    size_t hdroff = symcache_buf_reserve(&sb, sizeof(struct symcache_header));
+    size_t cuoff = symcache_buf_reserve(&sb,
+            sizeof(struct symcache_cu) * cucnt);
+
+    for(int i=0; i<cucnt; i++){
+        void *cu = dwarfinfo->di_cus[i];
+        struct symcache_cu scu = {0};
+
+        scu.sc_rootoff = dwarfinfo->di_curootoffs[i];
+
+        cu_get_header_info(cu, &scu.sc_headerlen, &scu.sc_abbrevoff,
+                &scu.sc_addrsize, &scu.sc_nextheaderoff, NULL);
+
+        void *linetab = NULL;
+        int owned = 0;
+
+        if(!cu_get_linetab(cu, &linetab, &owned, NULL)){
+            size_t len = linetab_flatten(linetab, NULL);
+
+            scu.sc_linetaboff = symcache_buf_reserve(&sb, len);
+            scu.sc_linetablen = len;
+
+            linetab_flatten(linetab, sb.sb_data + scu.sc_linetaboff);
+
+            if(owned)
+                linetab_free(linetab);
+        }
+
+        memcpy(sb.sb_data + cuoff + (sizeof(struct symcache_cu) * i), &scu,
+                sizeof(scu));
+    }
+
+    /* Ranges map to compilation unit pointers, and those have to
+     * be turned into indexes into di_cus.
+     */
+    struct symcache_cuent *cuents = malloc(sizeof(struct symcache_cuent) *
+            (cucnt + 1));
+
+    for(int i=0; i<cucnt; i++){
+        cuents[i].ce_cu = dwarfinfo->di_cus[i];
+        cuents[i].ce_idx = i;
+    }
+
+    qsort(cuents, cucnt, sizeof(struct symcache_cuent), symcache_cuent_cmp);
+
+    int rangecnt = rangetab_count(dwarfinfo->di_curanges);
+    size_t rangeoff = symcache_buf_reserve(&sb,
+            sizeof(struct symcache_range) * rangecnt);
+
+    for(int i=0; i<rangecnt; i++){
+        struct symcache_range sr = {0};
+        struct symcache_cuent want = {0};
+
+        rangetab_get(dwarfinfo->di_curanges, i, &sr.sr_lowpc, &sr.sr_highpc,
+                &want.ce_cu);
+
+        struct symcache_cuent *found = bsearch(&want, cuents, cucnt,
+                sizeof(struct symcache_cuent), symcache_cuent_cmp);
+
+        sr.sr_cuidx = found ? found->ce_idx : -1;
+
+        memcpy(sb.sb_data + rangeoff + (sizeof(struct symcache_range) * i),
+                &sr, sizeof(sr));
+    }
+
+    free(cuents);
+
+    size_t nameidxlen = nameidx_flatten(dwarfinfo->di_nameidx, NULL);
+    size_t nameidxoff = symcache_buf_reserve(&sb, nameidxlen);
+
+    nameidx_flatten(dwarfinfo->di_nameidx, sb.sb_data + nameidxoff);
+
+    struct symcache_buf strs = {0};
+
+    /* Offset zero is no name */
+    symcache_add_str(&strs, "");
+
+    int fxncnt = 0, fxncap = 0;
+    struct symcache_fxn *fxns = NULL;
+    int typecnt = 0, typecap = 0;
+    struct symcache_type *types = NULL;
+
+    for(int i=0; i<cucnt; i++){
+        void *root_die = NULL;
+
+        if(cu_get_root_die(dwarfinfo->di_cus[i], &root_die, NULL))
+            continue;
+
+        struct fxnrange *frs = NULL;
+        int nfrs = 0;
+
+        if(!die_get_function_ranges(root_die, &frs, &nfrs, NULL)){
+            if(fxncnt + nfrs > fxncap){
+                fxncap = (fxncnt + nfrs) * 2;
+
+                struct symcache_fxn *fxns_rea = realloc(fxns,
+                        sizeof(struct symcache_fxn) * fxncap);
+                fxns = fxns_rea;
+            }
+
+            for(int k=0; k<nfrs; k++){
+                struct symcache_fxn *sf = &fxns[fxncnt++];
+
+                sf->sf_lowpc = frs[k].fr_lowpc;
+                sf->sf_highpc = frs[k].fr_highpc;
+                sf->sf_dieoff = frs[k].fr_dieoffset;
+                sf->sf_nameoff = symcache_add_str(&strs, frs[k].fr_name);
+            }
+
+            free(frs);
+        }
+
+        struct typesummary *tss = NULL;
+        int ntss = 0;
+
+        if(!die_get_type_summaries(root_die, &tss, &ntss, NULL)){
+            if(typecnt + ntss > typecap){
+                typecap = (typecnt + ntss) * 2;
+
+                struct symcache_type *types_rea = realloc(types,
+                        sizeof(struct symcache_type) * typecap);
+                types = types_rea;
+            }
+
+            for(int k=0; k<ntss; k++){
+                struct symcache_type *st = &types[typecnt++];
+
+                st->st_dieoff = tss[k].ts_dieoffset;
+                st->st_basedieoff = tss[k].ts_basedieoffset;
+                st->st_bytesize = tss[k].ts_bytesize;
+                st->st_arrmembsz = tss[k].ts_arrmembsz;
+                st->st_nameoff = symcache_add_str(&strs, tss[k].ts_name);
+                st->st_class = tss[k].ts_class;
+                st->st_tag = tss[k].ts_tag;
+                st->st_encoding = tss[k].ts_encoding;
+            }
+
+            free(tss);
+        }
+    }
+
+    qsort(fxns, fxncnt, sizeof(struct symcache_fxn), symcache_fxn_cmp);
+    qsort(types, typecnt, sizeof(struct symcache_type), symcache_type_cmp);
+
+    /* A type used by more than one compilation unit was resolved
+     * by each of them.
+     */
+    int ntypes = 0;
+
+    for(int i=0; i<typecnt; i++){
+        if(ntypes > 0 && types[ntypes - 1].st_dieoff == types[i].st_dieoff)
+            continue;
+
+        types[ntypes++] = types[i];
+    }
+
+    size_t fxnoff = symcache_buf_reserve(&sb,
+            sizeof(struct symcache_fxn) * fxncnt);
+
+    if(fxncnt > 0){
+        memcpy(sb.sb_data + fxnoff, fxns,
+                sizeof(struct symcache_fxn) * fxncnt);
+    }
+
+    size_t typeoff = symcache_buf_reserve(&sb,
+            sizeof(struct symcache_type) * ntypes);
+
+    if(ntypes > 0){
+        memcpy(sb.sb_data + typeoff, types,
+                sizeof(struct symcache_type) * ntypes);
+    }
+
+    size_t stroff = symcache_buf_reserve(&sb, strs.sb_len);
+
+    memcpy(sb.sb_data + stroff, strs.sb_data, strs.sb_len);
+
+    free(fxns);
+    free(types);
+
+    struct symcache_header *sh = (struct symcache_header *)(sb.sb_data +
+            hdroff);
+
+    sh->sh_magic = SYMCACHE_MAGIC;
+    sh->sh_version = SYMCACHE_VERSION;
+    sh->sh_cucnt = cucnt;
+
+    memcpy(sh->sh_uuid, key.sk_uuid, 16);
+    sh->sh_mtime = key.sk_mtime;
+    sh->sh_dsymsize = key.sk_dsymsize;
+
+    sh->sh_cachesize = sb.sb_len;
+
+    sh->sh_cuoff = cuoff;
+    sh->sh_rangeoff = rangeoff;
+    sh->sh_rangecnt = rangecnt;
+    sh->sh_nameidxoff = nameidxoff;
+    sh->sh_nameidxlen = nameidxlen;
+    sh->sh_fxnoff = fxnoff;
+    sh->sh_fxncnt = fxncnt;
+    sh->sh_typeoff = typeoff;
+    sh->sh_typecnt = ntypes;
+    sh->sh_stroff = stroff;
+    sh->sh_strlen = strs.sb_len;
+
+    char *tmppath = malloc(strlen(path) + 32);
+    sprintf(tmppath, "%s.%d", path, getpid());
+
+    int ret = 1;
+    int cfd = open(tmppath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+    if(cfd >= 0){
+        size_t written = 0;
+
+        while(written < sb.sb_len){
+            ssize_t cur = write(cfd, sb.sb_data + written, sb.sb_len - written);
+
+            if(cur <= 0)
+                break;
+
+            written += cur;
+        }
+
+        close(cfd);
+
+        if(written == sb.sb_len && rename(tmppath, path) == 0)
+            ret = 0;
+        else
+            unlink(tmppath);
+    }
+
+    free(tmppath);
+    free(path);
+    free(sb.sb_data);
+    free(strs.sb_data);
+
+    return ret;
+}
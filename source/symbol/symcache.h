@@ -0,0 +1,16 @@
+#ifndef _SYMCACHE_H_
+#define _SYMCACHE_H_
+
+void *symcache_open(int);
+int symcache_cu_count(void *);
+int symcache_find_function(void *, uint64_t, void *);
+int symcache_find_type(void *, uint64_t, void *);
+int symcache_get_cu(void *, int, uint64_t *, uint64_t *, uint64_t *,
+        unsigned short *, uint64_t *, const void **, size_t *);
+int symcache_get_nameidx(void *, const void **, size_t *);
+int symcache_get_range(void *, int, uint64_t *, uint64_t *, int *);
+int symcache_range_count(void *);
+int symcache_write(void *, int);
+void symcache_close(void *);
+
+#endif
@@ -19,13 +19,18 @@ static const char *const SYM_ERROR_TABLE[] = {
     "No error (0)",
     "dwarf_init failed (1 - sym error)",
     "dwarf_siblingof_b failed (2 - sym error)",
-    "dwarf_srclines failed (3 - sym error)"
+    "dwarf_srclines failed (3 - sym error)",
+    "dwarf_offdie_b failed (4 - sym error)",
+    "Address is not inside any image (5 - sym error)",
+    "Image not found (6 - sym error)",
+    "Symbol not found (7 - sym error)"
 };
 
 static const char *const CU_ERROR_TABLE[] = {
     "No error (0)",
     "Compilation unit not found (1 - compilation unit error)",
-    "dwarf_next_cu_header_d failed (2 - compilation unit error)"
+    "dwarf_next_cu_header_d failed (2 - compilation unit error)",
+    "Could not start a loader thread (3 - compilation unit error)"
 };
 
 static const char *const DIE_ERROR_TABLE[] = {
@@ -39,7 +44,10 @@ static const char *const DIE_ERROR_TABLE[] = {
     "No data type name (7 - die error)",
     "Not a struct or union DIE (8 - die error)",
     "No parent (9 - die error)",
-    "Not a variable (10 - die error)"
+    "Not a variable (10 - die error)",
+    "No location for this PC (11 - die error)",
+    "Could not evaluate location (12 - die error)",
+    "No data type (13 - die error)"
 };
 
 static const size_t NO_ERROR_TABLE_LEN = sizeof(NO_ERROR_TABLE) / sizeof(const char *);
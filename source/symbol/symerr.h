@@ -27,13 +27,18 @@ enum {
     SYM_NO_ERROR = 0,
     SYM_DWARF_INIT_FAILED,
     SYM_DWARF_SIBLING_OF_B_FAILED,
-    SYM_DWARF_SRCLINES_FAILED
+    SYM_DWARF_SRCLINES_FAILED,
+    SYM_DWARF_OFFDIE_B_FAILED,
+    SYM_ADDRESS_NOT_IN_IMAGE,
+    SYM_IMAGE_NOT_FOUND,
+    SYM_SYMBOL_NOT_FOUND
 };
 
 enum {
     CU_NO_ERROR = 0,
     CU_CU_NOT_FOUND,
     CU_DWARF_NEXT_CU_HEADER_D_FAILED,
+    CU_LOADER_THREAD_FAILED
 };
 
 enum {
@@ -47,7 +52,10 @@ enum {
     DIE_NO_DATA_TYPE_NAME,
     DIE_NOT_STRUCT_OR_UNION,
     DIE_NO_PARENT,
-    DIE_NOT_VARIABLE_DIE
+    DIE_NOT_VARIABLE_DIE,
+    DIE_NO_LOCATION,
+    DIE_LOCATION_EVAL_FAILED,
+    DIE_NO_DATA_TYPE
 };
 
 void errclear(sym_error_t *);
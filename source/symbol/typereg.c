@@ -0,0 +1,385 @@
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* One member of a canonical struct or union */
+struct typereg_member {
+    char *tm_name;
+    uint64_t tm_offset;
+    struct typereg_type *tm_type;
+
+    /* For bitfields, how many bits there are, and where the first one
+     * is, counting from the start of the struct.
+     */
+    uint64_t tm_bitsize;
+    uint64_t tm_bitoffset;
+};
+
+/* A data type, shared by every compilation unit which has an identical
+ * copy of it. Two types are identical if their tag, name, size,
+ * encoding, classification, and array dimensions are the same, and if
+ * they're structs or unions, their members have the same names and
+ * offsets and identical types.
+ */
+struct typereg_type {
+    uint64_t tt_hash;
+
+    int tt_tag;
+    char *tt_name;
+    uint64_t tt_bytesize;
+    int tt_encoding;
+    unsigned int tt_class;
+    uint64_t tt_arrmembsz;
+    unsigned int *tt_arrdims;
+    int tt_arrdimslen;
+
+    struct typereg_member *tt_members;
+    int tt_nummembers;
+
+    /* For pointers, what they point to, if it's known. Not part of what
+     * makes two types identical, since a struct can point to itself.
+     */
+    struct typereg_type *tt_pointee;
+
+    struct typereg_type *tt_next;
+};
+
+/* Every canonical type of a dSYM. Compilation units can be built by
+ * many threads at once, so it's locked.
+ */
+struct typereg {
+    struct typereg_type **tr_buckets;
+    int tr_numbuckets;
+
+    /* Canonical types, and how many types compilation units asked for
+     * which turned out to be identical to one already here.
+     */
+    int tr_numtypes;
+    int tr_nummerged;
+
+    pthread_mutex_t tr_lock;
+};
+
+struct typereg *typereg_new(void){
+    struct typereg *tr = calloc(1, sizeof(struct typereg));
+
+    tr->tr_numbuckets = 1024;
+    tr->tr_buckets = calloc(tr->tr_numbuckets, sizeof(struct typereg_type *));
+
+    pthread_mutex_init(&tr->tr_lock, NULL);
+
+    return tr;
+}
+
+static uint64_t typereg_mix(uint64_t h, uint64_t v){
+    /* FNV-1a, a byte at a time */
+    for(int i=0; i<8; i++){
+        h ^= (v >> (i * 8)) & 0xff;
+        h *= 1099511628211ull;
+    }
+
+    return h;
+}
+
+static uint64_t typereg_mix_str(uint64_t h, const char *s){
+    if(!s)
+        return typereg_mix(h, 0);
+
+    while(*s){
+        h ^= (uint8_t)*s++;
+        h *= 1099511628211ull;
+    }
+
+    return typereg_mix(h, 1);
+}
+
+static int typereg_streq(const char *a, const char *b){
+    if(!a || !b)
+        return a == b;
+
+    return strcmp(a, b) == 0;
+}
+
+static int typereg_equal(struct typereg_type *tt, int tag, const char *name,
+        uint64_t bytesize, int encoding, unsigned int class,
+        uint64_t arrmembsz, const unsigned int *arrdims, int arrdimslen,
+        const char **membnames, const uint64_t *memboffs, void **membtypes,
+        const uint64_t *membbitsizes, const uint64_t *membbitoffs,
+        int nummembers){
+    if(tt->tt_tag != tag || tt->tt_bytesize != bytesize ||
+            tt->tt_encoding != encoding || tt->tt_class != class ||
+            tt->tt_arrmembsz != arrmembsz ||
+            tt->tt_arrdimslen != arrdimslen ||
+            tt->tt_nummembers != nummembers ||
+            !typereg_streq(tt->tt_name, name)){
+        return 0;
+    }
+
+    if(arrdimslen > 0 &&
+            memcmp(tt->tt_arrdims, arrdims, sizeof(unsigned int) * arrdimslen)){
+        return 0;
+    }
+
+    /* Member types are canonical already, so comparing them is
+     * comparing pointers.
+     */
+    for(int i=0; i<nummembers; i++){
+        struct typereg_member *tm = &tt->tt_members[i];
+
+        if(tm->tm_offset != memboffs[i] || tm->tm_type != membtypes[i] ||
+                tm->tm_bitsize != membbitsizes[i] ||
+                tm->tm_bitoffset != membbitoffs[i] ||
+                !typereg_streq(tm->tm_name, membnames[i])){
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+static char *typereg_strdup(const char *s){
+    return s ? strdup(s) : NULL;
+}
+
+/* Returns the canonical type identical to the one described, adding it
+ * if this is the first time it's been seen. Member types must be
+ * canonical types from this registry.
+ */
+struct typereg_type *typereg_intern(struct typereg *tr, int tag,
+        const char *name, uint64_t bytesize, int encoding,
+        unsigned int class, uint64_t arrmembsz, const unsigned int *arrdims,
+        int arrdimslen, const char **membnames, const uint64_t *memboffs,
+        void **membtypes, const uint64_t *membbitsizes,
+        const uint64_t *membbitoffs, int nummembers){
+    if(!tr)
+        return NULL;
+
+    uint64_t h = 14695981039346656037ull;
+
+    h = typereg_mix(h, tag);
+    h = typereg_mix_str(h, name);
+    h = typereg_mix(h, bytesize);
+    h = typereg_mix(h, encoding);
+    h = typereg_mix(h, class);
+    h = typereg_mix(h, arrmembsz);
+
+    for(int i=0; i<arrdimslen; i++)
+        h = typereg_mix(h, arrdims[i]);
+
+    for(int i=0; i<nummembers; i++){
+        h = typereg_mix_str(h, membnames[i]);
+        h = typereg_mix(h, memboffs[i]);
+        h = typereg_mix(h, membbitsizes[i]);
+        h = typereg_mix(h, membbitoffs[i]);
+        h = typereg_mix(h, membtypes[i] ?
+                ((struct typereg_type *)membtypes[i])->tt_hash : 0);
+    }
+
+    pthread_mutex_lock(&tr->tr_lock);
+
+    int bucket = h & (tr->tr_numbuckets - 1);
+
+    for(struct typereg_type *tt = tr->tr_buckets[bucket]; tt; tt = tt->tt_next){
+        if(tt->tt_hash == h && typereg_equal(tt, tag, name, bytesize,
+                    encoding, class, arrmembsz, arrdims, arrdimslen,
+                    membnames, memboffs, membtypes, membbitsizes,
+                    membbitoffs, nummembers)){
+            tr->tr_nummerged++;
+            pthread_mutex_unlock(&tr->tr_lock);
+
+            return tt;
+        }
+    }
+
+    struct typereg_type *tt = calloc(1, sizeof(struct typereg_type));
+
+    tt->tt_hash = h;
+    tt->tt_tag = tag;
+    tt->tt_name = typereg_strdup(name);
+    tt->tt_bytesize = bytesize;
+    tt->tt_encoding = encoding;
+    tt->tt_class = class;
+    tt->tt_arrmembsz = arrmembsz;
+
+    if(arrdimslen > 0){
+        tt->tt_arrdims = malloc(sizeof(unsigned int) * arrdimslen);
+        memcpy(tt->tt_arrdims, arrdims, sizeof(unsigned int) * arrdimslen);
+        tt->tt_arrdimslen = arrdimslen;
+    }
+
+    if(nummembers > 0){
+        tt->tt_members = malloc(sizeof(struct typereg_member) * nummembers);
+
+        for(int i=0; i<nummembers; i++){
+            tt->tt_members[i].tm_name = typereg_strdup(membnames[i]);
+            tt->tt_members[i].tm_offset = memboffs[i];
+            tt->tt_members[i].tm_type = membtypes[i];
+            tt->tt_members[i].tm_bitsize = membbitsizes[i];
+            tt->tt_members[i].tm_bitoffset = membbitoffs[i];
+        }
+
+        tt->tt_nummembers = nummembers;
+    }
+
+    tt->tt_next = tr->tr_buckets[bucket];
+    tr->tr_buckets[bucket] = tt;
+    tr->tr_numtypes++;
+
+    /* Keep chains short */
+    if(tr->tr_numtypes > tr->tr_numbuckets * 2){
+        int newnum = tr->tr_numbuckets * 2;
+        struct typereg_type **newbuckets =
+            calloc(newnum, sizeof(struct typereg_type *));
+
+        for(int i=0; i<tr->tr_numbuckets; i++){
+            struct typereg_type *cur = tr->tr_buckets[i];
+
+            while(cur){
+                struct typereg_type *next = cur->tt_next;
+                int b = cur->tt_hash & (newnum - 1);
+
+                cur->tt_next = newbuckets[b];
+                newbuckets[b] = cur;
+                cur = next;
+            }
+        }
+
+        free(tr->tr_buckets);
+        tr->tr_buckets = newbuckets;
+        tr->tr_numbuckets = newnum;
+    }
+
+    pthread_mutex_unlock(&tr->tr_lock);
+
+    return tt;
+}
+
+/* Any of the out parameters can be NULL. Nothing returned should
+ * be freed.
+ */
+void typereg_get_info(struct typereg_type *tt, int *tagout,
+        const char **nameout, uint64_t *bytesizeout, int *encodingout,
+        unsigned int *classout, uint64_t *arrmembszout,
+        const unsigned int **arrdimsout, int *arrdimslenout,
+        void **pointeeout){
+    if(!tt)
+        return;
+
+    if(tagout)
+        *tagout = tt->tt_tag;
+
+    if(nameout)
+        *nameout = tt->tt_name;
+
+    if(bytesizeout)
+        *bytesizeout = tt->tt_bytesize;
+
+    if(encodingout)
+        *encodingout = tt->tt_encoding;
+
+    if(classout)
+        *classout = tt->tt_class;
+
+    if(arrmembszout)
+        *arrmembszout = tt->tt_arrmembsz;
+
+    if(arrdimsout)
+        *arrdimsout = tt->tt_arrdims;
+
+    if(arrdimslenout)
+        *arrdimslenout = tt->tt_arrdimslen;
+
+    /* Set once by whichever thread gets there first */
+    if(pointeeout)
+        *pointeeout = __atomic_load_n(&tt->tt_pointee, __ATOMIC_ACQUIRE);
+}
+
+/* The members of a canonical struct or union. Nothing returned
+ * should be freed.
+ */
+int typereg_get_members(struct typereg_type *tt, int idx,
+        const char **nameout, uint64_t *offout, void **typeout,
+        uint64_t *bitsizeout, uint64_t *bitoffout){
+    if(!tt || idx < 0 || idx >= tt->tt_nummembers)
+        return 1;
+
+    struct typereg_member *tm = &tt->tt_members[idx];
+
+    if(nameout)
+        *nameout = tm->tm_name;
+
+    if(offout)
+        *offout = tm->tm_offset;
+
+    if(typeout)
+        *typeout = tm->tm_type;
+
+    if(bitsizeout)
+        *bitsizeout = tm->tm_bitsize;
+
+    if(bitoffout)
+        *bitoffout = tm->tm_bitoffset;
+
+    return 0;
+}
+
+int typereg_get_member_count(struct typereg_type *tt){
+    return tt ? tt->tt_nummembers : 0;
+}
+
+/* The first compilation unit to figure out what a pointer points
+ * to decides it for everyone.
+ */
+void typereg_set_pointee(struct typereg_type *tt,
+        struct typereg_type *pointee){
+    if(!tt || !pointee)
+        return;
+
+    struct typereg_type *expected = NULL;
+
+    __atomic_compare_exchange_n(&tt->tt_pointee, &expected, pointee, 0,
+            __ATOMIC_RELEASE, __ATOMIC_RELAXED);
+}
+
+void typereg_get_stats(struct typereg *tr, int *ntypesout, int *nmergedout){
+    if(!tr)
+        return;
+
+    pthread_mutex_lock(&tr->tr_lock);
+
+    if(ntypesout)
+        *ntypesout = tr->tr_numtypes;
+
+    if(nmergedout)
+        *nmergedout = tr->tr_nummerged;
+
+    pthread_mutex_unlock(&tr->tr_lock);
+}
+
+void typereg_free(struct typereg *tr){
+    if(!tr)
+        return;
+
+    for(int i=0; i<tr->tr_numbuckets; i++){
+        struct typereg_type *tt = tr->tr_buckets[i];
+
+        while(tt){
+            struct typereg_type *next = tt->tt_next;
+
+            for(int k=0; k<tt->tt_nummembers; k++)
+                free(tt->tt_members[k].tm_name);
+
+            free(tt->tt_members);
+            free(tt->tt_arrdims);
+            free(tt->tt_name);
+            free(tt);
+
+            tt = next;
+        }
+    }
+
+    free(tr->tr_buckets);
+    pthread_mutex_destroy(&tr->tr_lock);
+    free(tr);
+}
@@ -0,0 +1,17 @@
+#ifndef _TYPEREG_H_
+#define _TYPEREG_H_
+
+void *typereg_new(void);
+void typereg_get_info(void *, int *, const char **, uint64_t *, int *,
+        unsigned int *, uint64_t *, const unsigned int **, int *, void **);
+int typereg_get_members(void *, int, const char **, uint64_t *, void **,
+        uint64_t *, uint64_t *);
+int typereg_get_member_count(void *);
+void typereg_get_stats(void *, int *, int *);
+void *typereg_intern(void *, int, const char *, uint64_t, int, unsigned int,
+        uint64_t, const unsigned int *, int, const char **, const uint64_t *,
+        void **, const uint64_t *, const uint64_t *, int);
+void typereg_set_pointee(void *, void *);
+void typereg_free(void *);
+
+#endif
@@ -0,0 +1,560 @@
+#include <ctype.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <dwarf.h>
+
+#include "../strext.h"
+
+#include "common.h"
+#include "typereg.h"
+
+/* Objects closer together than this are read together */
+#define VALREAD_COALESCE_GAP 256
+
+/* No single read is bigger than this */
+#define VALREAD_MAX_READ (1024 * 1024)
+
+#define VALREAD_INDENT_INCRE (2)
+
+/* Bytes read out of the target */
+struct valread_chunk {
+    uint64_t vc_addr;
+    uint64_t vc_len;
+    uint8_t *vc_buf;
+};
+
+/* An object which has to be read, a type at an address */
+struct valread_obj {
+    void *vo_type;
+    uint64_t vo_addr;
+    uint64_t vo_size;
+};
+
+/* Reads a value and whatever its pointers point to, up to some depth,
+ * with as few reads of the target as possible. Every object at one
+ * depth is known before any of them are read, so objects near each
+ * other are read at once. Once everything is read, the value is
+ * described from what was read without going back to the target.
+ */
+struct valread {
+    int (*vr_readmem)(void *, uint64_t, void *, size_t);
+    void *vr_arg;
+
+    struct valread_chunk *vr_chunks;
+    int vr_numchunks;
+
+    int vr_maxdepth;
+};
+
+struct valread_typeinfo {
+    int vt_tag;
+    const char *vt_name;
+    uint64_t vt_bytesize;
+    int vt_encoding;
+    unsigned int vt_class;
+    uint64_t vt_arrmembsz;
+    void *vt_pointee;
+    int vt_nummembers;
+};
+
+static void valread_get_typeinfo(void *type, struct valread_typeinfo *vt){
+    memset(vt, 0, sizeof(struct valread_typeinfo));
+
+    typereg_get_info(type, &vt->vt_tag, &vt->vt_name, &vt->vt_bytesize,
+            &vt->vt_encoding, &vt->vt_class, &vt->vt_arrmembsz, NULL, NULL,
+            &vt->vt_pointee);
+
+    vt->vt_nummembers = typereg_get_member_count(type);
+}
+
+static int is_aggregate(struct valread_typeinfo *vt){
+    return (vt->vt_class & (DTC_STRUCT | DTC_UNION)) &&
+        !(vt->vt_class & (DTC_POINTER | DTC_ARRAY));
+}
+
+static int is_plain_pointer(struct valread_typeinfo *vt){
+    return (vt->vt_class & DTC_POINTER) && !(vt->vt_class & DTC_ARRAY);
+}
+
+/* Where [addr, addr+len) was read to, or NULL if it wasn't */
+static const uint8_t *valread_lookup(struct valread *vr, uint64_t addr,
+        uint64_t len){
+    for(int i=0; i<vr->vr_numchunks; i++){
+        struct valread_chunk *vc = &vr->vr_chunks[i];
+
+        if(addr >= vc->vc_addr && len <= vc->vc_len &&
+                addr - vc->vc_addr <= vc->vc_len - len){
+            return vc->vc_buf + (addr - vc->vc_addr);
+        }
+    }
+
+    return NULL;
+}
+
+static int valread_read_chunk(struct valread *vr, uint64_t addr,
+        uint64_t len){
+    uint8_t *buf = malloc(len);
+
+    if(vr->vr_readmem(vr->vr_arg, addr, buf, len)){
+        free(buf);
+        return 1;
+    }
+
+    struct valread_chunk *chunks_rea = realloc(vr->vr_chunks,
+            sizeof(struct valread_chunk) * (vr->vr_numchunks + 1));
+
+    vr->vr_chunks = chunks_rea;
+
+    struct valread_chunk *vc = &vr->vr_chunks[vr->vr_numchunks++];
+
+    vc->vc_addr = addr;
+    vc->vc_len = len;
+    vc->vc_buf = buf;
+
+    return 0;
+}
+
+static int valread_obj_cmp(const void *a, const void *b){
+    const struct valread_obj *oa = a;
+    const struct valread_obj *ob = b;
+
+    if(oa->vo_addr < ob->vo_addr)
+        return -1;
+    else if(oa->vo_addr > ob->vo_addr)
+        return 1;
+
+    return 0;
+}
+
+/* Read every object, merging those which are close to each other
+ * into one read. If a merged read fails, maybe because it spans
+ * something unmapped, its objects are read one by one.
+ */
+static void valread_read_objs(struct valread *vr, struct valread_obj *objs,
+        int numobjs){
+    qsort(objs, numobjs, sizeof(struct valread_obj), valread_obj_cmp);
+
+    int start = 0;
+
+    while(start < numobjs){
+        uint64_t lo = objs[start].vo_addr;
+        uint64_t hi = lo + objs[start].vo_size;
+        int end = start + 1;
+
+        while(end < numobjs && objs[end].vo_addr <= hi + VALREAD_COALESCE_GAP){
+            uint64_t objhi = objs[end].vo_addr + objs[end].vo_size;
+
+            if(objhi > hi){
+                if(objhi - lo > VALREAD_MAX_READ)
+                    break;
+
+                hi = objhi;
+            }
+
+            end++;
+        }
+
+        if(valread_read_chunk(vr, lo, hi - lo) && end - start > 1){
+            for(int i=start; i<end; i++){
+                valread_read_chunk(vr, objs[i].vo_addr, objs[i].vo_size);
+            }
+        }
+
+        start = end;
+    }
+}
+
+static uint64_t valread_get_uint(const uint8_t *buf, uint64_t size){
+    uint64_t val = 0;
+
+    if(size > sizeof(uint64_t))
+        size = sizeof(uint64_t);
+
+    /* Little endian */
+    memcpy(&val, buf, size);
+
+    return val;
+}
+
+static void valread_add_obj(struct valread_obj **objs, int *numobjs,
+        void *type, uint64_t addr, uint64_t size){
+    struct valread_obj *objs_rea = realloc(*objs,
+            sizeof(struct valread_obj) * (*numobjs + 1));
+
+    *objs = objs_rea;
+
+    struct valread_obj *vo = &(*objs)[(*numobjs)++];
+
+    vo->vo_type = type;
+    vo->vo_addr = addr;
+    vo->vo_size = size;
+}
+
+/* Find the pointers inside an object which has been read, and queue
+ * what they point to if it hasn't been read yet.
+ */
+static void valread_find_pointers(struct valread *vr, void *type,
+        uint64_t addr, struct valread_obj **next, int *numnext){
+    struct valread_typeinfo vt;
+    valread_get_typeinfo(type, &vt);
+
+    if(is_plain_pointer(&vt)){
+        const uint8_t *buf = valread_lookup(vr, addr, sizeof(uint64_t));
+
+        if(!buf || !vt.vt_pointee)
+            return;
+
+        uint64_t target = valread_get_uint(buf, sizeof(uint64_t));
+
+        struct valread_typeinfo pvt;
+        valread_get_typeinfo(vt.vt_pointee, &pvt);
+
+        if(target == 0 || pvt.vt_bytesize == 0 ||
+                pvt.vt_bytesize > VALREAD_MAX_READ){
+            return;
+        }
+
+        if(!valread_lookup(vr, target, pvt.vt_bytesize)){
+            valread_add_obj(next, numnext, vt.vt_pointee, target,
+                    pvt.vt_bytesize);
+        }
+
+        return;
+    }
+
+    if(vt.vt_nummembers == 0)
+        return;
+
+    /* A struct, or an array of them */
+    uint64_t elemsz = vt.vt_bytesize, nelems = 1;
+
+    if(vt.vt_class & DTC_ARRAY){
+        if(vt.vt_arrmembsz == 0)
+            return;
+
+        elemsz = vt.vt_arrmembsz;
+        nelems = vt.vt_bytesize / elemsz;
+    }
+
+    for(uint64_t e=0; e<nelems; e++){
+        for(int i=0; i<vt.vt_nummembers; i++){
+            void *membtype = NULL;
+            uint64_t off = 0, bitsize = 0;
+
+            typereg_get_members(type, i, NULL, &off, &membtype, &bitsize,
+                    NULL);
+
+            if(!membtype || bitsize)
+                continue;
+
+            valread_find_pointers(vr, membtype, addr + (e * elemsz) + off,
+                    next, numnext);
+        }
+    }
+}
+
+static void valread_fetch(struct valread *vr, void *type, uint64_t addr){
+    struct valread_typeinfo vt;
+    valread_get_typeinfo(type, &vt);
+
+    uint64_t size = vt.vt_bytesize;
+
+    if(size > VALREAD_MAX_READ)
+        size = VALREAD_MAX_READ;
+
+    if(size == 0)
+        return;
+
+    struct valread_obj *cur = NULL;
+    int numcur = 0;
+
+    valread_add_obj(&cur, &numcur, type, addr, size);
+
+    for(int depth=0; numcur > 0; depth++){
+        valread_read_objs(vr, cur, numcur);
+
+        if(depth == vr->vr_maxdepth)
+            break;
+
+        struct valread_obj *next = NULL;
+        int numnext = 0;
+
+        for(int i=0; i<numcur; i++){
+            valread_find_pointers(vr, cur[i].vo_type, cur[i].vo_addr,
+                    &next, &numnext);
+        }
+
+        free(cur);
+
+        cur = next;
+        numcur = numnext;
+    }
+
+    free(cur);
+}
+
+static void valread_describe_scalar(struct valread_typeinfo *vt,
+        const uint8_t *buf, uint64_t size, uint64_t bitsize,
+        uint64_t bitoff, char **desc){
+    if(!buf){
+        concat(desc, "<unreadable>");
+        return;
+    }
+
+    uint64_t val = 0;
+
+    if(bitsize){
+        /* Read enough bytes to cover the bitfield */
+        uint64_t firstbyte = bitoff / 8;
+        uint64_t nbytes = ((bitoff % 8) + bitsize + 7) / 8;
+
+        val = valread_get_uint(buf + firstbyte, nbytes);
+        val >>= bitoff % 8;
+
+        if(bitsize < 64)
+            val &= (1ull << bitsize) - 1;
+
+        size = 0;
+    }
+    else{
+        val = valread_get_uint(buf, size);
+    }
+
+    uint64_t nbits = bitsize ? bitsize : size * 8;
+
+    if(vt->vt_class & DTC_POINTER){
+        concat(desc, "%#llx", val);
+        return;
+    }
+
+    switch(vt->vt_encoding){
+        case DW_ATE_float:
+            {
+                if(size == sizeof(float)){
+                    float f;
+                    memcpy(&f, buf, sizeof(f));
+                    concat(desc, "%g", f);
+                }
+                else if(size == sizeof(double)){
+                    double d;
+                    memcpy(&d, buf, sizeof(d));
+                    concat(desc, "%g", d);
+                }
+                else{
+                    concat(desc, "%#llx", val);
+                }
+
+                return;
+            }
+        case DW_ATE_boolean:
+            {
+                concat(desc, "%s", val ? "true" : "false");
+                return;
+            }
+        case DW_ATE_unsigned:
+        case DW_ATE_unsigned_char:
+            {
+                concat(desc, "%llu", val);
+
+                if(vt->vt_encoding == DW_ATE_unsigned_char && isprint(val))
+                    concat(desc, " '%c'", (int)val);
+
+                return;
+            }
+        default:
+            {
+                /* Signed, and enums */
+                if(nbits > 0 && nbits < 64 && (val & (1ull << (nbits - 1))))
+                    val |= ~((1ull << nbits) - 1);
+
+                concat(desc, "%lld", (long long)val);
+
+                if(vt->vt_encoding == DW_ATE_signed_char &&
+                        (long long)val >= 0 && isprint(val)){
+                    concat(desc, " '%c'", (int)val);
+                }
+
+                return;
+            }
+    }
+}
+
+static void valread_describe(struct valread *vr, void *type,
+        const char *name, uint64_t addr, int indent, int depth,
+        char **desc);
+
+static void valread_describe_members(struct valread *vr, void *type,
+        uint64_t addr, int indent, int depth, char **desc){
+    int nummembers = typereg_get_member_count(type);
+
+    for(int i=0; i<nummembers; i++){
+        const char *membname = NULL;
+        void *membtype = NULL;
+        uint64_t off = 0, bitsize = 0, bitoff = 0;
+
+        typereg_get_members(type, i, &membname, &off, &membtype, &bitsize,
+                &bitoff);
+
+        if(!bitsize){
+            valread_describe(vr, membtype, membname, addr + off, indent,
+                    depth, desc);
+            concat(desc, "\n");
+            continue;
+        }
+
+        struct valread_typeinfo mvt;
+        valread_get_typeinfo(membtype, &mvt);
+
+        concat(desc, "%*s(%s) %s : %llu = ", indent, "",
+                mvt.vt_name ? mvt.vt_name : "?", membname ? membname : "",
+                bitsize);
+
+        uint64_t nbytes = ((bitoff % 8) + bitsize + 7) / 8;
+
+        valread_describe_scalar(&mvt,
+                valread_lookup(vr, addr + (bitoff / 8), nbytes), 0,
+                bitsize, bitoff % 8, desc);
+
+        concat(desc, "\n");
+    }
+}
+
+static void valread_describe(struct valread *vr, void *type,
+        const char *name, uint64_t addr, int indent, int depth,
+        char **desc){
+    struct valread_typeinfo vt;
+    valread_get_typeinfo(type, &vt);
+
+    const char *typename = vt.vt_name;
+
+    if(!typename){
+        if(vt.vt_class & DTC_STRUCT)
+            typename = "(anonymous struct)";
+        else if(vt.vt_class & DTC_UNION)
+            typename = "(anonymous union)";
+        else
+            typename = "?";
+    }
+
+    if(!name)
+        name = "";
+
+    if(!type){
+        concat(desc, "%*s(?) %s = <unknown type>", indent, "", name);
+        return;
+    }
+
+    if(is_aggregate(&vt)){
+        concat(desc, "%*s(%s) %s = {\n", indent, "", typename, name);
+        valread_describe_members(vr, type, addr, indent + VALREAD_INDENT_INCRE,
+                depth, desc);
+        concat(desc, "%*s}", indent, "");
+
+        return;
+    }
+
+    if(vt.vt_class & DTC_ARRAY){
+        concat(desc, "%*s(%s) %s = {\n", indent, "", typename, name);
+
+        uint64_t elemsz = vt.vt_arrmembsz;
+        uint64_t nelems = elemsz ? vt.vt_bytesize / elemsz : 0;
+        int subindent = indent + VALREAD_INDENT_INCRE;
+
+        for(uint64_t e=0; e<nelems; e++){
+            uint64_t elemaddr = addr + (e * elemsz);
+
+            if(vt.vt_nummembers > 0 && !(vt.vt_class & DTC_POINTER)){
+                concat(desc, "%*s[%llu] = {\n", subindent, "", e);
+                valread_describe_members(vr, type, elemaddr,
+                        subindent + VALREAD_INDENT_INCRE, depth, desc);
+                concat(desc, "%*s}\n", subindent, "");
+
+                continue;
+            }
+
+            concat(desc, "%*s[%llu] = ", subindent, "", e);
+            valread_describe_scalar(&vt, valread_lookup(vr, elemaddr, elemsz),
+                    elemsz, 0, 0, desc);
+            concat(desc, "\n");
+        }
+
+        concat(desc, "%*s}", indent, "");
+
+        return;
+    }
+
+    concat(desc, "%*s(%s) %s = ", indent, "", typename, name);
+
+    uint64_t size = vt.vt_bytesize;
+
+    if(size == 0 || size > sizeof(uint64_t)){
+        concat(desc, "<unsupported size %#llx>", size);
+        return;
+    }
+
+    const uint8_t *buf = valread_lookup(vr, addr, size);
+
+    valread_describe_scalar(&vt, buf, size, 0, 0, desc);
+
+    if(!buf || !is_plain_pointer(&vt) || !vt.vt_pointee ||
+            depth >= vr->vr_maxdepth){
+        return;
+    }
+
+    /* Follow the pointer if what it points to was read */
+    uint64_t target = valread_get_uint(buf, size);
+
+    struct valread_typeinfo pvt;
+    valread_get_typeinfo(vt.vt_pointee, &pvt);
+
+    if(target == 0 || pvt.vt_bytesize == 0 ||
+            !valread_lookup(vr, target, pvt.vt_bytesize)){
+        return;
+    }
+
+    concat(desc, " -> {\n");
+
+    if(is_aggregate(&pvt)){
+        valread_describe_members(vr, vt.vt_pointee, target,
+                indent + VALREAD_INDENT_INCRE, depth + 1, desc);
+    }
+    else{
+        valread_describe(vr, vt.vt_pointee, "*", target,
+                indent + VALREAD_INDENT_INCRE, depth + 1, desc);
+        concat(desc, "\n");
+    }
+
+    concat(desc, "%*s}", indent, "");
+}
+
+/* Describe the value of a variable of the given shared type which lives
+ * at addr in the target. The whole variable is read at once, and
+ * pointers are followed maxdepth levels deep, reading everything at
+ * the same level together.
+ */
+int valread_describe_value(void *type, const char *name, uint64_t addr,
+        int (*readmem)(void *, uint64_t, void *, size_t), void *arg,
+        int maxdepth, char **descout){
+    if(!type || !readmem || !descout)
+        return 1;
+
+    struct valread vr = {
+        .vr_readmem = readmem,
+        .vr_arg = arg,
+        .vr_maxdepth = maxdepth < 0 ? 0 : maxdepth
+    };
+
+    valread_fetch(&vr, type, addr);
+
+    valread_describe(&vr, type, name, addr, 0, 0, descout);
+
+    for(int i=0; i<vr.vr_numchunks; i++)
+        free(vr.vr_chunks[i].vc_buf);
+
+    free(vr.vr_chunks);
+
+    return 0;
+}
@@ -0,0 +1,7 @@
+#ifndef _VALREAD_H_
+#define _VALREAD_H_
+
+int valread_describe_value(void *, const char *, uint64_t,
+        int (*)(void *, uint64_t, void *, size_t), void *, int, char **);
+
+#endif
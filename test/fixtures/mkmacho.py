@@ -0,0 +1,183 @@
+#!/usr/bin/env python3
+"""Writes the Mach-O files machosym_test reads: thin.macho, a 64 bit
+arm64 image, and fat.macho, a universal file with an x86_64 slice
+first and that same arm64 image second.
+
+    python3 mkmacho.py [output directory]
+"""
+
+import os
+import struct
+import sys
+
+MH_MAGIC_64 = 0xfeedfacf
+FAT_MAGIC = 0xcafebabe
+CPU_TYPE_ARM64 = 0x0100000c
+CPU_TYPE_X86_64 = 0x01000007
+MH_EXECUTE = 2
+
+LC_SEGMENT_64 = 0x19
+LC_SYMTAB = 0x2
+LC_DYSYMTAB = 0xb
+LC_UUID = 0x1b
+LC_FUNCTION_STARTS = 0x26
+
+N_EXT = 0x01
+N_SECT = 0x0e
+N_UNDF = 0x00
+N_FUN = 0x24
+
+TEXT = 0x100000000
+DATA = 0x100004000
+LINKEDIT = 0x100008000
+
+UUID = bytes(range(0x10, 0x20))
+
+
+def uleb(v):
+    out = bytearray()
+    while True:
+        byte = v & 0x7f
+        v >>= 7
+        if v:
+            out.append(byte | 0x80)
+        else:
+            out.append(byte)
+            return bytes(out)
+
+
+def segment(name, vmaddr, vmsize, fileoff=0, filesize=0):
+    return struct.pack("<II16sQQQQiiII", LC_SEGMENT_64, 72,
+                       name.encode(), vmaddr, vmsize, fileoff, filesize,
+                       7, 5, 0, 0)
+
+
+def image(cputype, locals_, extdefs, undefs, fstarts):
+    """Each symbol is (name, type, sect, value). Symbols go in the
+    symbol table as locals, then defined externals, then undefined
+    ones, like ld puts them.
+    """
+    syms = locals_ + extdefs + undefs
+
+    strtab = bytearray(b"\0")
+    stroffs = []
+    for name, _, _, _ in syms:
+        stroffs.append(len(strtab))
+        strtab += name.encode() + b"\0"
+    while len(strtab) % 8:
+        strtab.append(0)
+
+    fsdata = bytearray()
+    last = TEXT
+    for addr in fstarts:
+        fsdata += uleb(addr - last)
+        last = addr
+    fsdata += b"\0"
+    while len(fsdata) % 8:
+        fsdata.append(0)
+
+    ncmds = 8
+    sizeofcmds = (72 * 4) + 24 + 24 + 80 + 16
+    linkedit = 32 + sizeofcmds
+    linkedit = (linkedit + 7) & ~7
+
+    fsoff = linkedit
+    symoff = fsoff + len(fsdata)
+    stroff = symoff + (16 * len(syms))
+    end = stroff + len(strtab)
+
+    # __TEXT only maps the headers, and __LINKEDIT maps the rest, so
+    # machosym_test can load the file like dyld would
+    cmds = bytearray()
+    cmds += segment("__PAGEZERO", 0, TEXT)
+    cmds += segment("__TEXT", TEXT, DATA - TEXT, 0, linkedit)
+    cmds += segment("__DATA", DATA, LINKEDIT - DATA)
+    cmds += segment("__LINKEDIT", LINKEDIT, 0x4000, linkedit,
+                    end - linkedit)
+    cmds += struct.pack("<II16s", LC_UUID, 24, UUID)
+    cmds += struct.pack("<IIIIII", LC_SYMTAB, 24, symoff, len(syms),
+                        stroff, len(strtab))
+    cmds += struct.pack("<II18I", LC_DYSYMTAB, 80,
+                        0, len(locals_),
+                        len(locals_), len(extdefs),
+                        len(locals_) + len(extdefs), len(undefs),
+                        *([0] * 12))
+    cmds += struct.pack("<IIII", LC_FUNCTION_STARTS, 16, fsoff,
+                        len(fsdata))
+    assert len(cmds) == sizeofcmds
+
+    out = bytearray(struct.pack("<IiiIIIII", MH_MAGIC_64, cputype, 0,
+                                MH_EXECUTE, ncmds, sizeofcmds, 0, 0))
+    out += cmds
+    while len(out) < linkedit:
+        out.append(0)
+
+    out += fsdata
+    for (name, ntype, sect, value), strx in zip(syms, stroffs):
+        out += struct.pack("<IBBHQ", strx, ntype, sect, 0, value)
+    out += strtab
+    assert len(out) == end
+
+    return bytes(out)
+
+
+def arm64_image():
+    locals_ = [
+        ("_helper", N_SECT, 1, TEXT + 0x100),
+        ("_static_fn", N_SECT, 1, TEXT + 0x200),
+        # A debugging symbol, which isn't a function to us
+        ("_helper", N_FUN, 1, TEXT + 0x300),
+    ]
+    extdefs = [
+        ("_main", N_SECT | N_EXT, 1, TEXT + 0x80),
+        # Same name, same address, like an alias
+        ("_main", N_SECT | N_EXT, 1, TEXT + 0x80),
+        ("_data_var", N_SECT | N_EXT, 2, DATA + 0x10),
+    ]
+    undefs = [
+        ("_printf", N_UNDF | N_EXT, 0, 0),
+    ]
+    # main, then two functions which were stripped
+    fstarts = [TEXT + 0x80, TEXT + 0x180, TEXT + 0x1c0]
+
+    return image(CPU_TYPE_ARM64, locals_, extdefs, undefs, fstarts)
+
+
+def x86_64_image():
+    extdefs = [("_x86_only", N_SECT | N_EXT, 1, TEXT + 0x80)]
+
+    return image(CPU_TYPE_X86_64, [], extdefs, [], [TEXT + 0x80])
+
+
+def fat(slices):
+    align = 0x1000
+    out = bytearray(struct.pack(">II", FAT_MAGIC, len(slices)))
+    off = align
+    body = bytearray()
+    for cputype, data in slices:
+        out += struct.pack(">iiIII", cputype, 0, off, len(data), 12)
+        body += data
+        while len(body) % align:
+            body.append(0)
+        off = align + len(body)
+    while len(out) < align:
+        out.append(0)
+    return bytes(out + body)
+
+
+def main():
+    outdir = sys.argv[1] if len(sys.argv) > 1 else os.path.dirname(
+        os.path.abspath(__file__))
+
+    thin = arm64_image()
+
+    with open(os.path.join(outdir, "thin.macho"), "wb") as f:
+        f.write(thin)
+
+    with open(os.path.join(outdir, "fat.macho"), "wb") as f:
+        f.write(fat([(CPU_TYPE_X86_64, x86_64_image()),
+                     (CPU_TYPE_ARM64, thin)]))
+
+
+if __name__ == "__main__":
+    main()
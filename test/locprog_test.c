@@ -0,0 +1,229 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <dwarf.h>
+
+#include "common.h"
+#include "locprog.h"
+
+/* Runs compiled location programs against fake registers and memory.
+ * Register N holds REG_BASE + N, and reading memory at an address
+ * gives back twice the address.
+ */
+
+#define REG_BASE 0x1000
+
+static int failures = 0;
+
+#define CHECK(cond) do { \
+    if(!(cond)){ \
+        printf("%s:%d: %s failed\n", __FILE__, __LINE__, #cond); \
+        failures++; \
+    } \
+    } while(0)
+
+static int nregreads = 0;
+
+static int fake_readreg(void *arg, int reg, uint64_t *valout){
+    nregreads++;
+    *valout = REG_BASE + reg;
+    return 0;
+}
+
+static int fake_readmem(void *arg, uint64_t addr, void *buf, size_t size){
+    uint64_t val = addr * 2;
+
+    memcpy(buf, &val, size);
+
+    return 0;
+}
+
+/* Operands and byte offsets default to zero */
+struct test_prog {
+    int tp_ninsns;
+    uint8_t tp_ops[16];
+    uint64_t tp_opd1s[16];
+    uint64_t tp_opd2s[16];
+    uint64_t tp_offs[16];
+};
+
+static void *compile(struct test_prog *tp){
+    return locprog_compile(NULL, 0, 0, 0, tp->tp_ops, tp->tp_opd1s,
+            tp->tp_opd2s, tp->tp_offs, tp->tp_ninsns);
+}
+
+struct result {
+    int r_ret;
+    int r_npieces;
+    int r_kinds[4];
+    uint64_t r_values[4];
+    uint64_t r_sizes[4];
+};
+
+static void eval(void *lp, void *frameprog, int *fbknown, uint64_t *fb,
+        struct result *r){
+    memset(r, 0, sizeof(*r));
+
+    r->r_ret = locprog_eval(lp, frameprog, fbknown, fb, fake_readreg,
+            fake_readmem, NULL, r->r_kinds, r->r_values, r->r_sizes, 4,
+            &r->r_npieces);
+}
+
+static void test_breg(void){
+    struct test_prog tp = {
+        .tp_ninsns = 1,
+        .tp_ops = { DW_OP_breg31 },
+        .tp_opd1s = { 0x20 }
+    };
+    void *lp = compile(&tp);
+    struct result r;
+
+    eval(lp, NULL, NULL, NULL, &r);
+
+    CHECK(r.r_ret == 0);
+    CHECK(r.r_npieces == 1);
+    CHECK(r.r_kinds[0] == LOCPROG_MEMORY);
+    CHECK(r.r_values[0] == REG_BASE + 31 + 0x20);
+    CHECK(r.r_sizes[0] == 0);
+
+    free(lp);
+}
+
+static void test_fbreg_deref(void){
+    /* Frame base is x29 + 16 */
+    struct test_prog fbtp = {
+        .tp_ninsns = 1,
+        .tp_ops = { DW_OP_breg29 },
+        .tp_opd1s = { 16 }
+    };
+    struct test_prog tp = {
+        .tp_ninsns = 2,
+        .tp_ops = { DW_OP_fbreg, DW_OP_deref },
+        .tp_opd1s = { (uint64_t)-8 },
+        .tp_offs = { 0, 2 }
+    };
+    void *frameprog = compile(&fbtp);
+    void *lp = compile(&tp);
+    uint64_t fb = REG_BASE + 29 + 16;
+    struct result r;
+
+    eval(lp, frameprog, NULL, NULL, &r);
+
+    CHECK(r.r_ret == 0);
+    CHECK(r.r_npieces == 1);
+    CHECK(r.r_kinds[0] == LOCPROG_MEMORY);
+    CHECK(r.r_values[0] == (fb - 8) * 2);
+
+    /* Without a frame base program, DW_OP_fbreg can't be evaluated */
+    eval(lp, NULL, NULL, NULL, &r);
+
+    CHECK(r.r_ret != 0);
+
+    /* A frame base kept between calls is only computed once */
+    int fbknown = 0;
+    uint64_t fbsaved = 0;
+
+    nregreads = 0;
+    eval(lp, frameprog, &fbknown, &fbsaved, &r);
+    eval(lp, frameprog, &fbknown, &fbsaved, &r);
+
+    CHECK(fbknown == 1);
+    CHECK(fbsaved == fb);
+    CHECK(nregreads == 1);
+    CHECK(r.r_values[0] == (fb - 8) * 2);
+
+    free(frameprog);
+    free(lp);
+}
+
+static void test_pieces(void){
+    /* Low four bytes in x0, high four bytes are the constant 5 */
+    struct test_prog tp = {
+        .tp_ninsns = 5,
+        .tp_ops = { DW_OP_reg0, DW_OP_piece, DW_OP_lit5, DW_OP_stack_value,
+            DW_OP_piece },
+        .tp_opd1s = { 0, 4, 0, 0, 4 },
+        .tp_offs = { 0, 1, 3, 4, 5 }
+    };
+    void *lp = compile(&tp);
+    struct result r;
+
+    eval(lp, NULL, NULL, NULL, &r);
+
+    CHECK(r.r_ret == 0);
+    CHECK(r.r_npieces == 2);
+    CHECK(r.r_kinds[0] == LOCPROG_REGISTER);
+    CHECK(r.r_values[0] == 0);
+    CHECK(r.r_sizes[0] == 4);
+    CHECK(r.r_kinds[1] == LOCPROG_VALUE);
+    CHECK(r.r_values[1] == 5);
+    CHECK(r.r_sizes[1] == 4);
+
+    free(lp);
+}
+
+static void test_bra(void){
+    /* if(cond) 3 else 7:
+     *
+     *   0: cond
+     *   1: bra +4      (to 8)
+     *   4: lit7
+     *   5: skip +1     (to 9)
+     *   8: lit3
+     *   9: stack_value
+     */
+    struct test_prog tp = {
+        .tp_ninsns = 6,
+        .tp_ops = { DW_OP_lit1, DW_OP_bra, DW_OP_lit7, DW_OP_skip,
+            DW_OP_lit3, DW_OP_stack_value },
+        .tp_opd1s = { 0, 4, 0, 1, 0, 0 },
+        .tp_offs = { 0, 1, 4, 5, 8, 9 }
+    };
+    void *lp = compile(&tp);
+    struct result r;
+
+    CHECK(lp != NULL);
+
+    eval(lp, NULL, NULL, NULL, &r);
+
+    CHECK(r.r_ret == 0);
+    CHECK(r.r_npieces == 1);
+    CHECK(r.r_kinds[0] == LOCPROG_VALUE);
+    CHECK(r.r_values[0] == 3);
+
+    free(lp);
+
+    tp.tp_ops[0] = DW_OP_lit0;
+    lp = compile(&tp);
+
+    eval(lp, NULL, NULL, NULL, &r);
+
+    CHECK(r.r_ret == 0);
+    CHECK(r.r_kinds[0] == LOCPROG_VALUE);
+    CHECK(r.r_values[0] == 7);
+
+    free(lp);
+
+    /* Into the middle of the skip at 5 */
+    tp.tp_opd1s[1] = 2;
+
+    CHECK(compile(&tp) == NULL);
+}
+
+int main(void){
+    test_breg();
+    test_fbreg_deref();
+    test_pieces();
+    test_bra();
+
+    if(failures){
+        printf("locprog_test: %d check(s) failed\n", failures);
+        return 1;
+    }
+
+    printf("locprog_test: ok\n");
+
+    return 0;
+}
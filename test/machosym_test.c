@@ -0,0 +1,252 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <mach-o/loader.h>
+
+#include "machosym.h"
+
+/* Reads the Mach-Os in fixtures/, which fixtures/mkmacho.py writes,
+ * and looks symbols up in them by address and by name. The thin one
+ * is also read out of a pretend debuggee it's been loaded into.
+ *
+ *   machosym_test [fixtures directory]
+ */
+
+#define TEXT 0x100000000ULL
+#define DATA 0x100004000ULL
+
+static int failures = 0;
+
+#define CHECK(cond) do { \
+    if(!(cond)){ \
+        printf("%s:%d: %s failed\n", __FILE__, __LINE__, #cond); \
+        failures++; \
+    } \
+    } while(0)
+
+/* Name is NULL for a function start with no name. If expectfound
+ * is zero, addr shouldn't be inside any symbol.
+ */
+static void check_lookup(void *mo, uint64_t addr, int expectfound,
+        const char *expectname, uint64_t expectstart, uint64_t expectsize){
+    const char *name = NULL;
+    uint64_t start = 0, size = 0;
+
+    int ret = machosym_lookup(mo, addr, &name, &start, &size);
+
+    if(!expectfound){
+        if(ret == 0){
+            printf("%#llx: expected no symbol, got '%s' at %#llx\n",
+                    (unsigned long long)addr, name ? name : "(no name)",
+                    (unsigned long long)start);
+            failures++;
+        }
+
+        return;
+    }
+
+    int namematches = expectname ? (name && strcmp(name, expectname) == 0) :
+        name == NULL;
+
+    if(ret || !namematches || start != expectstart || size != expectsize){
+        printf("%#llx: expected '%s' at %#llx, size %#llx, got %d '%s' at"
+                " %#llx, size %#llx\n", (unsigned long long)addr,
+                expectname ? expectname : "(no name)",
+                (unsigned long long)expectstart,
+                (unsigned long long)expectsize, ret,
+                name ? name : "(no name)", (unsigned long long)start,
+                (unsigned long long)size);
+        failures++;
+    }
+}
+
+static void check_arm64_image(void *mo){
+    static const uint8_t uuid[16] = {
+        0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17,
+        0x18, 0x19, 0x1a, 0x1b, 0x1c, 0x1d, 0x1e, 0x1f
+    };
+
+    CHECK(mo != NULL);
+
+    if(!mo)
+        return;
+
+    CHECK(machosym_get_uuid(mo) != NULL &&
+            memcmp(machosym_get_uuid(mo), uuid, 16) == 0);
+
+    /* main, helper, two stripped functions, static_fn, and data_var.
+     * The second main and main's function start are the same symbol,
+     * and the debugging symbol and printf aren't symbols at all.
+     */
+    CHECK(machosym_count(mo) == 6);
+
+    /* Nearest symbol at or below */
+    check_lookup(mo, TEXT, 0, NULL, 0, 0);
+    check_lookup(mo, TEXT + 0x80, 1, "main", TEXT + 0x80, 0x80);
+    check_lookup(mo, TEXT + 0x90, 1, "main", TEXT + 0x80, 0x80);
+    check_lookup(mo, TEXT + 0xff, 1, "main", TEXT + 0x80, 0x80);
+    check_lookup(mo, TEXT + 0x100, 1, "helper", TEXT + 0x100, 0x80);
+    check_lookup(mo, TEXT + 0x180, 1, NULL, TEXT + 0x180, 0x40);
+    check_lookup(mo, TEXT + 0x1c0, 1, NULL, TEXT + 0x1c0, 0x40);
+
+    /* The last symbol in __TEXT runs to the end of __TEXT, and
+     * the debugging symbol at 0x300 doesn't cut it short.
+     */
+    check_lookup(mo, TEXT + 0x250, 1, "static_fn", TEXT + 0x200,
+            DATA - (TEXT + 0x200));
+    check_lookup(mo, TEXT + 0x300, 1, "static_fn", TEXT + 0x200,
+            DATA - (TEXT + 0x200));
+    check_lookup(mo, DATA - 1, 1, "static_fn", TEXT + 0x200,
+            DATA - (TEXT + 0x200));
+
+    /* Past the end of __TEXT, but before anything in __DATA */
+    check_lookup(mo, DATA, 0, NULL, 0, 0);
+    check_lookup(mo, DATA + 0x10, 1, "data_var", DATA + 0x10,
+            0x4000 - 0x10);
+    check_lookup(mo, DATA + 0x4000, 0, NULL, 0, 0);
+
+    /* Exact names, without the leading underscore */
+    uint64_t addr = 0;
+
+    CHECK(machosym_find_by_name(mo, "main", &addr) == 0 &&
+            addr == TEXT + 0x80);
+    CHECK(machosym_find_by_name(mo, "helper", &addr) == 0 &&
+            addr == TEXT + 0x100);
+    CHECK(machosym_find_by_name(mo, "static_fn", &addr) == 0 &&
+            addr == TEXT + 0x200);
+    CHECK(machosym_find_by_name(mo, "data_var", &addr) == 0 &&
+            addr == DATA + 0x10);
+
+    CHECK(machosym_find_by_name(mo, "_main", &addr) != 0);
+    CHECK(machosym_find_by_name(mo, "mai", &addr) != 0);
+    CHECK(machosym_find_by_name(mo, "mainx", &addr) != 0);
+    CHECK(machosym_find_by_name(mo, "printf", &addr) != 0);
+    CHECK(machosym_find_by_name(mo, "x86_only", &addr) != 0);
+}
+
+static void *load(const char *dir, const char *file){
+    char path[1024];
+
+    snprintf(path, sizeof(path), "%s/%s", dir, file);
+
+    void *mo = machosym_new_from_file(path);
+
+    if(!mo)
+        printf("couldn't read %s\n", path);
+
+    return mo;
+}
+
+/* The file, mapped segment by segment, like dyld would, at slide */
+struct fake_debuggee {
+    const uint8_t *fd_file;
+    uint64_t fd_slide;
+    int fd_numreads;
+};
+
+static int fake_read(void *arg, uint64_t addr, void *buf, size_t size){
+    struct fake_debuggee *fd = arg;
+    const struct mach_header_64 *hdr =
+        (const struct mach_header_64 *)fd->fd_file;
+    const uint8_t *cmds = fd->fd_file + sizeof(*hdr);
+    uint32_t cmdoff = 0;
+
+    fd->fd_numreads++;
+
+    for(uint32_t i=0; i<hdr->ncmds; i++){
+        const struct load_command *lc =
+            (const struct load_command *)(cmds + cmdoff);
+
+        if(lc->cmd == LC_SEGMENT_64){
+            const struct segment_command_64 *seg =
+                (const struct segment_command_64 *)lc;
+            uint64_t start = seg->vmaddr + fd->fd_slide;
+
+            if(addr >= start && addr - start <= seg->filesize &&
+                    size <= seg->filesize - (addr - start)){
+                memcpy(buf, fd->fd_file + seg->fileoff + (addr - start),
+                        size);
+                return 0;
+            }
+        }
+
+        cmdoff += lc->cmdsize;
+    }
+
+    return 1;
+}
+
+static int failing_read(void *arg, uint64_t addr, void *buf, size_t size){
+    return 1;
+}
+
+static void check_from_image(const char *dir){
+    char path[1024];
+
+    snprintf(path, sizeof(path), "%s/thin.macho", dir);
+
+    FILE *fp = fopen(path, "rb");
+
+    if(!fp){
+        printf("couldn't read %s\n", path);
+        failures++;
+        return;
+    }
+
+    static uint8_t file[4096];
+    struct fake_debuggee fd = {0};
+
+    fd.fd_file = file;
+    fread(file, 1, sizeof(file), fp);
+    fd.fd_slide = 0x4c000;
+
+    fclose(fp);
+
+    void *mo = machosym_new_from_image(TEXT + fd.fd_slide, fake_read, &fd);
+
+    /* Addresses are unslid no matter where it was read from */
+    check_arm64_image(mo);
+    machosym_free(mo);
+
+    /* The header, the load commands, the symbol table, the names,
+     * and the function starts, and nothing more
+     */
+    CHECK(fd.fd_numreads == 5);
+
+    /* Not where the image is */
+    CHECK(machosym_new_from_image(TEXT, fake_read, &fd) == NULL);
+    CHECK(machosym_new_from_image(TEXT, failing_read, NULL) == NULL);
+}
+
+int main(int argc, char **argv){
+    const char *dir = argc > 1 ? argv[1] : "fixtures";
+
+    void *thin = load(dir, "thin.macho");
+    check_arm64_image(thin);
+    machosym_free(thin);
+
+    /* The arm64 slice is second, and is the one used */
+    void *fat = load(dir, "fat.macho");
+    check_arm64_image(fat);
+    machosym_free(fat);
+
+    check_from_image(dir);
+
+    /* Something which isn't a Mach-O */
+    char path[1024];
+
+    snprintf(path, sizeof(path), "%s/mkmacho.py", dir);
+
+    CHECK(machosym_new_from_file(path) == NULL);
+
+    if(failures){
+        printf("machosym_test: %d check(s) failed\n", failures);
+        return 1;
+    }
+
+    printf("machosym_test: ok\n");
+
+    return 0;
+}